@@ -35,6 +35,10 @@
 #include <algorithm>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+// the S-box, Rcon and the large round tables are constant, generated by AESTablesGenerator.cpp
+// they are placed in read only data and shared by all processes, nothing is computed at run time
+#include "AESTables.h"
 
 // todo - make faster 128 blocksize version with 128 blocksize hardcoded as necessary
 
@@ -50,46 +54,12 @@ using namespace std;
 
 namespace { // anonymous namespace for local linkage
 
-// tables for inverses, byte sub
-unsigned char gf2_8_inv[256];
-unsigned char byte_sub[256];
-unsigned char inv_byte_sub[256];
-
-// this table needs Nb*(Nr+1)/Nk entries - up to 8*(15)/4 = 60
-// todo - remove table, note cycles every 17(?) elements
-unsigned long Rcon[60];
-
-// long tables for encryption stuff
-unsigned long T0[256];
-unsigned long T1[256];
-unsigned long T2[256];
-unsigned long T3[256];
-
-// long tables for decryption stuff
-unsigned long I0[256];
-unsigned long I1[256];
-unsigned long I2[256];
-unsigned long I3[256];
-
-// huge tables - todo - ifdef out
-unsigned long T4[256];
-unsigned long T5[256];
-unsigned long T6[256];
-unsigned long T7[256];
-unsigned long I4[256];
-unsigned long I5[256];
-unsigned long I6[256];
-unsigned long I7[256];
-
-// have the tables been initialized?
-bool tablesInitialized = false;
-
 // define to mult a byte by x mod the proper poly
 // todo - move magic numbers out?
 #define xmult(a) ((a)<<1) ^ (((a)&128) ? 0x01B : 0)
 
 // make 4 bytes (LSB first) into a 4 byte vector
-#define VEC4(a,b,c,d) (((unsigned long)(a)) | (((unsigned long)(b))<<8) | (((unsigned long)(c))<<16) | (((unsigned long)(d))<<24))
+#define VEC4(a,b,c,d) (((uint32_t)(a)) | (((uint32_t)(b))<<8) | (((uint32_t)(c))<<16) | (((uint32_t)(d))<<24))
 
 // get byte 0 to 3 from word a
 #define GetByte(a,n) ((unsigned char)((a) >> (n<<3)))
@@ -132,175 +102,6 @@ inline unsigned char GF2_8_mult(unsigned char a, unsigned char b)
 	return result;
 	} // GF2_8_mult
 
-bool CheckLargeTables(bool create)
-	{
-	unsigned int i;
-	unsigned char a1,a2,a3,b1,b2,b3,b4,b5;
-	for (i = 0; i < 256; i++)
-		{
-		a1 = byte_sub[i];
-		a2 = xmult(a1);
-		a3 = a2^a1;
-
-		b5 = inv_byte_sub[i];
-		b1 = GF2_8_mult(0x0E,b5);
-		b2 = GF2_8_mult(0x09,b5);
-		b3 = GF2_8_mult(0x0D,b5);
-		b4 = GF2_8_mult(0x0B,b5);
-
-		if (create == true)
-			{
-			T0[i] = VEC4(a2,a1,a1,a3);
-			T1[i] = RotByteL(T0[i]);
-			T2[i] = RotByteL(T1[i]);
-			T3[i] = RotByteL(T2[i]);
-
-			T4[i] = VEC4(a1,0,0,0); // identity
-			T5[i] = RotByteL(T4[i]);
-			T6[i] = RotByteL(T5[i]);
-			T7[i] = RotByteL(T6[i]);
-
-			I0[i] = VEC4(b1,b2,b3,b4);
-			I1[i] = RotByteL(I0[i]);
-			I2[i] = RotByteL(I1[i]);
-			I3[i] = RotByteL(I2[i]);
-
-			I4[i] = VEC4(b5,0,0,0); // identity
-			I5[i] = RotByteL(I4[i]);
-			I6[i] = RotByteL(I5[i]);
-			I7[i] = RotByteL(I6[i]);
-			}
-		else
-			{
-			if (T0[i] != VEC4(a2,a1,a1,a3))
-				return false;
-			if (T1[i] != RotByteL(T0[i]))
-				return false;
-			if (T2[i] != RotByteL(T1[i]))
-				return false;
-			if (T3[i] != RotByteL(T2[i]))
-				return false;
-			if (T4[i] != VEC4(a1,0,0,0))
-				return false;
-			if (T5[i] != RotByteL(T4[i]))
-				return false;
-			if (T6[i] != RotByteL(T5[i]))
-				return false;
-			if (T7[i] != RotByteL(T6[i]))
-				return false;
-			if (I0[i] != VEC4(b1,b2,b3,b4))
-				return false;
-			if (I1[i] != RotByte(I0[i]))
-				return false;
-			if (I2[i] != RotByte(I1[i]))
-				return false;
-			if (I3[i] != RotByte(I2[i]))
-				return false;
-			if (I4[i] != VEC4(b5,0,0,0))
-				return false;
-			if (I5[i] != RotByteL(I4[i]))
-				return false;
-			if (I6[i] != RotByteL(I5[i]))
-				return false;
-			if (I7[i] != RotByteL(I6[i]))
-				return false;
-			}
-		}
-	return true;
-	} // CheckLargeTables
-
-// some functions to create/verify table integrity
-bool CheckInverses(bool create)
-	{
-	unsigned int a,b; // need int here to prevent wraps in loop
-	if (create == true)
-		gf2_8_inv[0] = 0;
-	else if (gf2_8_inv[0] != 0)
-		return false;
-	for (a = 1; a <= 255; a++)
-		{
-		b = 1;
-		while (GF2_8_mult(a,b) != 1)
-			b++;
-
-		if (create == true)
-			gf2_8_inv[a] = b;
-		else if (gf2_8_inv[a] != b)
-			return false;
-		}
-	return true;
-	} // CheckInverses
-
-unsigned char BitSum(unsigned char byte)
-	{ // return the sum of bits mod 2
-	byte = (byte>>4)^(byte&15);
-	byte = (byte>>2)^(byte&3);
-	return (byte>>1)^(byte&1);
-	} // BitSum
-
-bool CheckByteSub(bool create)
-	{
-	if (CheckInverses(create) == false)
-		return false; // we cannot do this without inverses
-
-	unsigned int x,y; // need ints here to prevent wrap in loop
-	for (x = 0; x <= 255; x++)
-		{
-		y = gf2_8_inv[x]; // inverse to start with
-
-		// affine transform
-		y = BitSum(y&0xF1) | (BitSum(y&0xE3)<<1) | (BitSum(y&0xC7)<<2) | (BitSum(y&0x8F)<<3) |
-			(BitSum(y&0x1F)<<4) | (BitSum(y&0x3E)<<5) | (BitSum(y&0x7C)<<6) | (BitSum(y&0xF8)<<7);
-		y = y ^ 0x63;
-		if (create == true)
-			byte_sub[x] = y;
-		else if (byte_sub[x] != y)
-			return false;
-		}
-	return true;
-	} // CheckByteSub
-
-bool CheckInvByteSub(bool create)
-	{
-	if (CheckInverses(create) == false)
-		return false; // we cannot do this without inverses
-	if (CheckByteSub(create) == false)
-		return false; // we cannot do this without byte_sub
-
-	unsigned int x,y; // need ints here to prevent wrap in loop
-	for (x = 0; x <= 255; x++)
-		{
-		// we brute force it...
-		y = 0;
-		while (byte_sub[y] != x)
-			y++;
-		if (create == true)
-			inv_byte_sub[x] = y;
-		else if (inv_byte_sub[x] != y)
-			return false;
-		}
-	return true;
-	} // CheckInvByteSub
-
-bool CheckRcon(bool create)
-	{
-	unsigned char Ri = 1; // start here
-
-	if (create == true)
-		Rcon[0] = 0;
-	else if (Rcon[0] != 0)
-		return false; // todo - this is unused still check?
-	for (unsigned int i = 1; i < sizeof(Rcon)/sizeof(Rcon[0])-1; i++)
-		{
-		if (create == true)
-			Rcon[i] = Ri;
-		else if (Rcon[i] != Ri)
-			return false;
-		Ri = GF2_8_mult(Ri,0x02); // multiply by x - todo replace with xmult
-		}
-	return true;
-	} // CheckRCon
-
 // key adding for 4,6,8 column cases
 #define AddRoundKey4(dest,src)	\
 	*dest++ = *r_ptr++ ^ *src++;\
@@ -457,7 +258,7 @@ bool CheckRcon(bool create)
 						compute_one_final_inv(d,s,6,1,3,4,8); \
 						compute_one_final_inv(d,s,7,1,3,4,8);
 
-unsigned long SubByte(unsigned long data)
+uint32_t SubByte(uint32_t data)
 	{ // does the SBox on this 4 byte data
 	unsigned result = 0;
 	result = byte_sub[data>>24];
@@ -470,30 +271,13 @@ unsigned long SubByte(unsigned long data)
 	return result;
 	} // SubByte
 
-// return true iff tables are valid. create = true fills them in if not
-bool CreateAESTables(bool create)
-	{
-	bool retval = true;
-	if (CheckInverses(create) == false)
-		retval = false;
-	if (CheckByteSub(create) == false)
-		retval = false;
-	if (CheckInvByteSub(create) == false)
-		retval = false;
-	if (CheckRcon(create) == false)
-		return false;
-	if (CheckLargeTables(create) == false)
-		return false;
-	return retval;
-	} // CreateAESTables
-
 }// end of anonymous namespace
 
 // Key expansion code - makes local copy
 void AES::KeyExpansion(const unsigned char * key)
 	{
 	int i;
-	unsigned long temp, * Wb = reinterpret_cast<unsigned long*>(W); // todo not portable - Endian problems
+	uint32_t temp, * Wb = reinterpret_cast<uint32_t*>(W); // todo not portable - Endian problems
 	if (Nk <= 6)
 		{
 		// todo - memcpy
@@ -562,12 +346,12 @@ void AES::EncryptBlock(const unsigned char * datain1, unsigned char * dataout1)
 	  // todo - clean up - lots of repeated macros
 	  // we only encrypt one block from now on
 
-	unsigned long state[8*2]; // 2 buffers
-	unsigned long * r_ptr = reinterpret_cast<unsigned long*>(W);
-	unsigned long * dest  = state;
-	unsigned long * src   = state;
-	const unsigned long * datain = reinterpret_cast<const unsigned long*>(datain1);
-	unsigned long * dataout = reinterpret_cast<unsigned long*>(dataout1);
+	uint32_t state[8*2]; // 2 buffers
+	uint32_t * r_ptr = reinterpret_cast<uint32_t*>(W);
+	uint32_t * dest  = state;
+	uint32_t * src   = state;
+	const uint32_t * datain = reinterpret_cast<const uint32_t*>(datain1);
+	uint32_t * dataout = reinterpret_cast<uint32_t*>(dataout1);
 
 	if (Nb == 4)
 		{
@@ -712,7 +496,7 @@ void AES::StartDecryption(const unsigned char * key)
 		}
 
 	// we reverse the rounds to make decryption faster
-	unsigned long * WL = reinterpret_cast<unsigned long*>(W);
+	uint32_t * WL = reinterpret_cast<uint32_t*>(W);
 	for (int pos = 0; pos < Nr/2; pos++)
 		for (int col = 0; col < Nb; col++)
 			swap(WL[col+pos*Nb],WL[col+(Nr-pos)*Nb]);
@@ -720,13 +504,13 @@ void AES::StartDecryption(const unsigned char * key)
 
 void AES::DecryptBlock(const unsigned char * datain1, unsigned char * dataout1)
 	{
-	unsigned long state[8*2]; // 2 buffers
-	unsigned long * r_ptr = reinterpret_cast<unsigned long*>(W);
-	unsigned long * dest  = state;
-	unsigned long * src   = state;
+	uint32_t state[8*2]; // 2 buffers
+	uint32_t * r_ptr = reinterpret_cast<uint32_t*>(W);
+	uint32_t * dest  = state;
+	uint32_t * src   = state;
 
-	const unsigned long * datain = reinterpret_cast<const unsigned long*>(datain1);
-	unsigned long * dataout = reinterpret_cast<unsigned long*>(dataout1);
+	const uint32_t * datain = reinterpret_cast<const uint32_t*>(datain1);
+	uint32_t * dataout = reinterpret_cast<uint32_t*>(dataout1);
 
 	if (Nb == 4)
 		{
@@ -848,11 +632,9 @@ void AES::Decrypt(const unsigned char * datain, unsigned char * dataout, unsigne
 		}
 	} // Decrypt
 
-// the constructor - makes sure local things are initialized
+// the constructor - the tables are constant, see AESTables.h
 AES::AES(void)
 	{
-	if (false == tablesInitialized)
-		tablesInitialized = CreateAESTables(true);
 	}
 
 // end - AES.cpp
@@ -62,8 +62,7 @@
 class AES
 	{
 public:
-	// the constructor - makes sure local things are initialized
-	// it if fails, throws the string "Tables failed to initialize"
+	// the constructor - the tables are constant (AESTables.h), nothing is initialized at run time
 	AES(void);
 
 	// multiple block encryption/decryption modes
@@ -0,0 +1,199 @@
+/* AES - Advanced Encryption Standard
+
+  Generator of AESTables.h, the constant tables of AES.cpp.
+
+  The tables are computed with the code which AES.cpp used to run at the start of every process, verified and
+  written as constant arrays, so they are placed in read only data and shared by every process which uses them.
+  Run `make aes-tables` to regenerate the header.
+
+  Copyright (C) 2000-2005 Chris Lomont, see AES.cpp
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+namespace {
+
+// tables for inverses, byte sub
+unsigned char gf2_8_inv[256];
+unsigned char byte_sub[256];
+unsigned char inv_byte_sub[256];
+
+// this table needs Nb*(Nr+1)/Nk entries - up to 8*(15)/4 = 60
+uint32_t Rcon[60];
+
+// long tables for encryption and decryption, T4-T7 and I4-I7 are used by the final round
+uint32_t T[8][256];
+uint32_t I[8][256];
+
+// define to mult a byte by x mod the proper poly
+#define xmult(a) ((a)<<1) ^ (((a)&128) ? 0x01B : 0)
+
+// make 4 bytes (LSB first) into a 4 byte vector
+#define VEC4(a,b,c,d) (((uint32_t)(a)) | (((uint32_t)(b))<<8) | (((uint32_t)(c))<<16) | (((uint32_t)(d))<<24))
+
+/* Rotates 32-bit word left by 1 byte  */
+#define RotByteL(x) (((x)<<8)|((x)>>24))
+
+// mult 2 elements using gf2_8_poly as a reduction
+unsigned char GF2_8_mult(unsigned char a, unsigned char b)
+	{
+	unsigned char result = 0;
+
+	// should give 0x57 . 0x13 = 0xFE with poly 0x11B
+	int count = 8;
+	while (count--)
+		{
+		if (b&1)
+			result ^= a;
+		if (a&128)
+			{
+			a <<= 1;
+			a ^= (0x1B);
+			}
+		else
+			a <<= 1;
+		b >>= 1;
+		}
+	return result;
+	} // GF2_8_mult
+
+void CreateInverses()
+	{
+	unsigned int a,b; // need int here to prevent wraps in loop
+	gf2_8_inv[0] = 0;
+	for (a = 1; a <= 255; a++)
+		{
+		b = 1;
+		while (GF2_8_mult(a,b) != 1)
+			b++;
+		gf2_8_inv[a] = b;
+		}
+	} // CreateInverses
+
+unsigned char BitSum(unsigned char byte)
+	{ // return the sum of bits mod 2
+	byte = (byte>>4)^(byte&15);
+	byte = (byte>>2)^(byte&3);
+	return (byte>>1)^(byte&1);
+	} // BitSum
+
+void CreateByteSub()
+	{
+	unsigned int x,y; // need ints here to prevent wrap in loop
+	for (x = 0; x <= 255; x++)
+		{
+		y = gf2_8_inv[x]; // inverse to start with
+
+		// affine transform
+		y = BitSum(y&0xF1) | (BitSum(y&0xE3)<<1) | (BitSum(y&0xC7)<<2) | (BitSum(y&0x8F)<<3) |
+			(BitSum(y&0x1F)<<4) | (BitSum(y&0x3E)<<5) | (BitSum(y&0x7C)<<6) | (BitSum(y&0xF8)<<7);
+		byte_sub[x] = y ^ 0x63;
+		}
+	for (x = 0; x <= 255; x++)
+		inv_byte_sub[byte_sub[x]] = x;
+	} // CreateByteSub
+
+void CreateRcon()
+	{
+	unsigned char Ri = 1; // start here
+	Rcon[0] = 0;
+	for (unsigned int i = 1; i < sizeof(Rcon)/sizeof(Rcon[0])-1; i++)
+		{
+		Rcon[i] = Ri;
+		Ri = GF2_8_mult(Ri,0x02); // multiply by x
+		}
+	} // CreateRcon
+
+void CreateLargeTables()
+	{
+	for (unsigned int i = 0; i < 256; i++)
+		{
+		unsigned char a1 = byte_sub[i];
+		unsigned char a2 = xmult(a1);
+		unsigned char a3 = a2^a1;
+
+		unsigned char b5 = inv_byte_sub[i];
+		unsigned char b1 = GF2_8_mult(0x0E,b5);
+		unsigned char b2 = GF2_8_mult(0x09,b5);
+		unsigned char b3 = GF2_8_mult(0x0D,b5);
+		unsigned char b4 = GF2_8_mult(0x0B,b5);
+
+		T[0][i] = VEC4(a2,a1,a1,a3);
+		T[4][i] = VEC4(a1,0,0,0); // identity
+		I[0][i] = VEC4(b1,b2,b3,b4);
+		I[4][i] = VEC4(b5,0,0,0); // identity
+		for (int n = 1; n < 4; n++)
+			{
+			T[n][i] = RotByteL(T[n-1][i]);
+			T[n+4][i] = RotByteL(T[n+3][i]);
+			I[n][i] = RotByteL(I[n-1][i]);
+			I[n+4][i] = RotByteL(I[n+3][i]);
+			}
+		}
+	} // CreateLargeTables
+
+bool CheckTables()
+	{
+	// every byte has an inverse, the S-box is a permutation and known values of FIPS-197 match
+	for (unsigned int x = 1; x <= 255; x++)
+		if (GF2_8_mult(x,gf2_8_inv[x]) != 1 || inv_byte_sub[byte_sub[x]] != x)
+			return false;
+	return GF2_8_mult(0x57,0x13) == 0xFE && byte_sub[0x00] == 0x63 && byte_sub[0x53] == 0xED && inv_byte_sub[0x63] == 0x00
+			&& Rcon[10] == 0x36 && T[0][0] == 0xA56363C6;
+	} // CheckTables
+
+void PrintTable(const char * name, const uint32_t * table, unsigned int count)
+	{
+	printf("static const uint32_t %s[%u] = {\n", name, count);
+	for (unsigned int i = 0; i < count; i++)
+		printf("%s0x%08X%s", (i % 8) == 0 ? "\t" : "", table[i], (i + 1 == count) ? "\n" : ((i % 8) == 7 ? ",\n" : ", "));
+	printf("};\n");
+	} // PrintTable
+
+void PrintBytes(const char * name, const unsigned char * table)
+	{
+	printf("static const unsigned char %s[256] = {\n", name);
+	for (unsigned int i = 0; i < 256; i++)
+		printf("%s0x%02X%s", (i % 16) == 0 ? "\t" : "", table[i], (i == 255) ? "\n" : ((i % 16) == 15 ? ",\n" : ", "));
+	printf("};\n");
+	} // PrintBytes
+
+}// end of anonymous namespace
+
+int main(void)
+	{
+	CreateInverses();
+	CreateByteSub();
+	CreateRcon();
+	CreateLargeTables();
+	if (!CheckTables())
+		{
+		fprintf(stderr, "AES tables failed to verify\n");
+		return EXIT_FAILURE;
+		}
+
+	printf("/* AES - Advanced Encryption Standard\n\n");
+	printf("  Constant tables of AES.cpp, generated by AESTablesGenerator.cpp (make aes-tables), do not edit.\n\n");
+	printf("  Copyright (C) 2000-2005 Chris Lomont, see AES.cpp\n*/\n\n");
+	printf("#ifndef _AES_TABLES_H\n#define _AES_TABLES_H\n\n#include <stdint.h>\n\n");
+	printf("// S-box of the key expansion\n");
+	PrintBytes("byte_sub", byte_sub);
+	printf("\n// this table needs Nb*(Nr+1)/Nk entries - up to 8*(15)/4 = 60\n");
+	PrintTable("Rcon", Rcon, 60);
+	for (int n = 0; n < 8; n++)
+		{
+		char name[3] = {'T', (char)('0' + n), 0};
+		printf("\n%s", n == 0 ? "// long tables for encryption stuff\n" : (n == 4 ? "// tables of the final encryption round\n" : ""));
+		PrintTable(name, T[n], 256);
+		}
+	for (int n = 0; n < 8; n++)
+		{
+		char name[3] = {'I', (char)('0' + n), 0};
+		printf("\n%s", n == 0 ? "// long tables for decryption stuff\n" : (n == 4 ? "// tables of the final decryption round\n" : ""));
+		PrintTable(name, I[n], 256);
+		}
+	printf("\n#endif // _AES_TABLES_H\n");
+	return EXIT_SUCCESS;
+	} // main
@@ -0,0 +1,363 @@
+/*
+ * RscpBatteryDetail.cpp
+ *
+ * DCB module and cell values of every battery.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "RscpBatteryDetail.h"
+#include "RscpProtocol.h"
+#include "RscpCodec.h"
+#include "RscpTags.h"
+
+namespace {
+struct SField {
+	SRscpTag tag;
+	const char *name;
+};
+
+// the count and the cell temperatures are values of TAG_BAT_DATA, the others are answered inside TAG_BAT_INFO
+const SField batteryFields[] = {
+	{ TAG_BAT_DCB_COUNT, "dcb_count" },
+	{ TAG_BAT_MAX_DCB_CELL_TEMPERATURE, "max_cell_temp" },
+	{ TAG_BAT_MIN_DCB_CELL_TEMPERATURE, "min_cell_temp" },
+	{ TAG_BAT_RSOC, "rsoc" },
+	{ TAG_BAT_MODULE_VOLTAGE, "voltage" },
+	{ TAG_BAT_CURRENT, "current" },
+	{ TAG_BAT_TERMINAL_VOLTAGE, "terminal_volt" },
+	{ TAG_BAT_MAX_BAT_VOLTAGE, "max_voltage" },
+	{ TAG_BAT_EOD_VOLTAGE, "eod_voltage" },
+	{ TAG_BAT_MAX_CHARGE_CURRENT, "max_charge" },
+	{ TAG_BAT_MAX_DISCHARGE_CURRENT, "max_discharge" },
+	{ TAG_BAT_CHARGE_CYCLES, "cycles" },
+	{ TAG_BAT_STATUS_CODE, "status_code" },
+	{ TAG_BAT_ERROR_CODE, "error_code" },
+};
+static_assert(sizeof(batteryFields) / sizeof(batteryFields[0]) == RSCP_BATTERY_FIELDS, "RSCP_BATTERY_FIELDS does not match");
+
+const SField moduleFields[] = {
+	{ TAG_BAT_DCB_SOC, "soc" },
+	{ TAG_BAT_DCB_SOH, "soh" },
+	{ TAG_BAT_DCB_CYCLE_COUNT, "cycles" },
+	{ TAG_BAT_DCB_VOLTAGE, "voltage" },
+	{ TAG_BAT_DCB_CURRENT, "current" },
+	{ TAG_BAT_DCB_VOLTAGE_AVG_30S, "voltage_avg" },
+	{ TAG_BAT_DCB_CURRENT_AVG_30S, "current_avg" },
+	{ TAG_BAT_DCB_FULL_CHARGE_CAPACITY, "full_capacity" },
+	{ TAG_BAT_DCB_REMAINING_CAPACITY, "remaining_cap" },
+	{ TAG_BAT_DCB_DESIGN_CAPACITY, "design_cap" },
+	{ TAG_BAT_DCB_NR_SERIES_CELL, "series_cells" },
+	{ TAG_BAT_DCB_NR_PARALLEL_CELL, "parallel_cells" },
+};
+static_assert(sizeof(moduleFields) / sizeof(moduleFields[0]) == RSCP_BATTERY_MODULE_FIELDS, "RSCP_BATTERY_MODULE_FIELDS does not match");
+
+// the requests of every battery, its modules follow
+const SRscpTag batteryRequests[] = {
+	TAG_BAT_REQ_DCB_COUNT, TAG_BAT_REQ_MAX_DCB_CELL_TEMPERATURE, TAG_BAT_REQ_MIN_DCB_CELL_TEMPERATURE, TAG_BAT_REQ_INFO
+};
+// the requests of every module, their data is the index of the module
+const SRscpTag moduleRequests[] = {
+	TAG_BAT_REQ_DCB_INFO, TAG_BAT_REQ_DCB_ALL_CELL_TEMPERATURES, TAG_BAT_REQ_DCB_ALL_CELL_VOLTAGES
+};
+
+int32_t findField(const SField *fields, uint32_t count, SRscpTag tag) {
+	for(uint32_t i = 0; i < count; ++i) {
+		if(fields[i].tag == tag) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// numeric data of a value, false for other types and data which is too short
+bool getValueAsDouble(const SRscpValue & value, double & result) {
+	switch(value.dataType) {
+	case RSCP::eTypeBool:
+	case RSCP::eTypeUChar8:
+		result = (value.length >= 1) ? RscpCodec::load<uint8_t>(value.data) : NAN;
+		break;
+	case RSCP::eTypeChar8:
+		result = (value.length >= 1) ? RscpCodec::load<int8_t>(value.data) : NAN;
+		break;
+	case RSCP::eTypeInt16:
+		result = (value.length >= 2) ? RscpCodec::load<int16_t>(value.data) : NAN;
+		break;
+	case RSCP::eTypeUInt16:
+		result = (value.length >= 2) ? RscpCodec::load<uint16_t>(value.data) : NAN;
+		break;
+	case RSCP::eTypeInt32:
+		result = (value.length >= 4) ? RscpCodec::load<int32_t>(value.data) : NAN;
+		break;
+	case RSCP::eTypeUInt32:
+		result = (value.length >= 4) ? RscpCodec::load<uint32_t>(value.data) : NAN;
+		break;
+	case RSCP::eTypeInt64:
+		result = (value.length >= 8) ? RscpCodec::load<int64_t>(value.data) : NAN;
+		break;
+	case RSCP::eTypeUInt64:
+		result = (value.length >= 8) ? RscpCodec::load<uint64_t>(value.data) : NAN;
+		break;
+	case RSCP::eTypeFloat32:
+		result = (value.length >= 4) ? RscpCodec::load<float>(value.data) : NAN;
+		break;
+	case RSCP::eTypeDouble64:
+		result = (value.length >= 8) ? RscpCodec::load<double>(value.data) : NAN;
+		break;
+	default:
+		return false;
+	}
+	return !isnan(result);
+}
+
+int32_t appendFrame(RscpProtocol & protocol, SRscpValue & root, std::vector<std::vector<uint8_t> > & frames) {
+	frames.push_back(std::vector<uint8_t>(root.data, root.data + root.length));
+	protocol.destroyValueData(root);
+	return protocol.createContainerValue(&root, 0);
+}
+}
+
+RscpBatteryDetail::RscpBatteryDetail() :
+		decodedFrames(0), errorValues(0), droppedCells(0), walkReceived(0), walkBattery(NULL), walkContainer(0),
+		walkDcb(-1), walkCells(0) {
+}
+
+int32_t RscpBatteryDetail::createRequests(const std::vector<std::pair<uint8_t, uint8_t> > & batteries, uint32_t batch,
+		std::vector<std::vector<uint8_t> > & frames) {
+	frames.clear();
+	if(batch == 0) {
+		batch = 1;
+	}
+	RscpProtocol protocol;
+	SRscpValue root;
+	protocol.createContainerValue(&root, 0);
+	int32_t iResult = RSCP::OK;
+	uint32_t uiModules = 0;
+	uint32_t uiBatched = 0;
+	for(size_t b = 0; b < batteries.size() && iResult >= 0; ++b) {
+		SRscpValue container;
+		protocol.createContainerValue(&container, TAG_BAT_REQ_DATA);
+		protocol.appendValue(&container, TAG_BAT_INDEX, batteries[b].first);
+		for(size_t i = 0; i < sizeof(batteryRequests) / sizeof(batteryRequests[0]); ++i) {
+			protocol.appendValue(&container, batteryRequests[i]);
+		}
+		for(uint8_t dcb = 0; dcb < batteries[b].second && uiModules < RSCP_BATTERY_MAX_MODULES && iResult >= 0; ++dcb, ++uiModules) {
+			if(uiBatched == batch) {
+				// the frame is full, the further modules of the battery follow in a container of the next frame
+				iResult = protocol.appendValue(&root, container);
+				protocol.destroyValueData(container);
+				if(iResult >= 0) {
+					iResult = appendFrame(protocol, root, frames);
+				}
+				protocol.createContainerValue(&container, TAG_BAT_REQ_DATA);
+				protocol.appendValue(&container, TAG_BAT_INDEX, batteries[b].first);
+				uiBatched = 0;
+			}
+			for(size_t i = 0; i < sizeof(moduleRequests) / sizeof(moduleRequests[0]); ++i) {
+				protocol.appendValue(&container, moduleRequests[i], dcb);
+			}
+			++uiBatched;
+		}
+		if(iResult >= 0) {
+			iResult = protocol.appendValue(&root, container);
+		}
+		protocol.destroyValueData(container);
+	}
+	if(iResult >= 0 && root.length > 0) {
+		iResult = appendFrame(protocol, root, frames);
+	}
+	protocol.destroyValueData(root);
+	return (iResult < 0) ? iResult : RSCP::OK;
+}
+
+bool RscpBatteryDetail::isResponse(const uint8_t *data, uint32_t length) {
+	if(length < sizeof(SRscpFrameHeader) + RSCP_VALUE_HEADER_SIZE) {
+		return false;
+	}
+	return RscpCodec::load32(data + sizeof(SRscpFrameHeader)) == TAG_BAT_DATA;
+}
+
+const char * RscpBatteryDetail::batteryField(uint32_t field, SRscpTag *tag) {
+	if(tag != NULL) {
+		*tag = batteryFields[field].tag;
+	}
+	return batteryFields[field].name;
+}
+
+const char * RscpBatteryDetail::moduleField(uint32_t field, SRscpTag *tag) {
+	if(tag != NULL) {
+		*tag = moduleFields[field].tag;
+	}
+	return moduleFields[field].name;
+}
+
+void RscpBatteryDetail::setLayout(const std::vector<std::pair<uint8_t, uint8_t> > & layout) {
+	batteries.clear();
+	modules.clear();
+	for(size_t b = 0; b < layout.size(); ++b) {
+		SRscpBattery battery;
+		battery.index = layout[b].first;
+		battery.firstModule = modules.size();
+		battery.modules = 0;
+		battery.updated = 0;
+		for(uint32_t i = 0; i < RSCP_BATTERY_FIELDS; ++i) {
+			battery.values[i] = NAN;
+		}
+		// the same limit as the requests, so every requested module has its place in the columns
+		for(uint8_t dcb = 0; dcb < layout[b].second && modules.size() < RSCP_BATTERY_MAX_MODULES; ++dcb) {
+			SRscpBatteryModule module;
+			module.battery = battery.index;
+			module.dcb = dcb;
+			module.voltages = 0;
+			module.temperatures = 0;
+			module.updated = 0;
+			for(uint32_t i = 0; i < RSCP_BATTERY_MODULE_FIELDS; ++i) {
+				module.values[i] = NAN;
+			}
+			modules.push_back(module);
+			++battery.modules;
+		}
+		batteries.push_back(battery);
+	}
+	voltageColumn.assign(modules.size() * RSCP_BATTERY_MAX_CELLS, 0.0f);
+	temperatureColumn.assign(modules.size() * RSCP_BATTERY_MAX_CELLS, 0.0f);
+}
+
+int32_t RscpBatteryDetail::handleFrame(const uint8_t *data, uint32_t length, int64_t received) {
+	RscpProtocol protocol;
+	walkReceived = received;
+	walkBattery = NULL;
+	walkContainer = 0;
+	// the CRC was checked already while the frame was decrypted (RscpDecryptor)
+	int32_t iResult = protocol.visitFrame(data, length, *this, false);
+	if(iResult >= 0) {
+		++decodedFrames;
+	}
+	return iResult;
+}
+
+bool RscpBatteryDetail::complete() const {
+	for(size_t i = 0; i < modules.size(); ++i) {
+		if(modules[i].updated == 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool RscpBatteryDetail::enterContainer(const SRscpValue & container, uint32_t depth) {
+	if(depth == 0) {
+		walkBattery = NULL;
+		return (container.tag == TAG_BAT_DATA);
+	}
+	if(depth > 1) {
+		// the cell values are inside a TAG_BAT_DATA of the module container
+		return (walkContainer != 0);
+	}
+	switch(container.tag) {
+	case TAG_BAT_DCB_INFO:
+	case TAG_BAT_DCB_ALL_CELL_TEMPERATURES:
+	case TAG_BAT_DCB_ALL_CELL_VOLTAGES:
+		// the index of the module may follow its values, they are kept until the container is left
+		walkContainer = container.tag;
+		walkDcb = -1;
+		walkCells = 0;
+		for(uint32_t i = 0; i < RSCP_BATTERY_MODULE_FIELDS; ++i) {
+			walkModuleValues[i] = NAN;
+		}
+		return true;
+	case TAG_BAT_INFO:
+		return true;
+	default:
+		return false;
+	}
+}
+
+void RscpBatteryDetail::value(const SRscpValue & value, uint32_t depth) {
+	if(value.dataType == RSCP::eTypeError) {
+		++errorValues;
+		return;
+	}
+	double dValue = 0.0;
+	if(walkContainer != 0) {
+		if(value.tag == TAG_BAT_DCB_INDEX) {
+			walkDcb = getValueAsDouble(value, dValue) ? (int32_t)dValue : -1;
+		}
+		else if((value.tag == TAG_BAT_DCB_CELL_VOLTAGE && walkContainer == TAG_BAT_DCB_ALL_CELL_VOLTAGES)
+				|| (value.tag == TAG_BAT_DCB_CELL_TEMPERATURE && walkContainer == TAG_BAT_DCB_ALL_CELL_TEMPERATURES)) {
+			if(walkCells >= RSCP_BATTERY_MAX_CELLS) {
+				++droppedCells;
+			}
+			else if(getValueAsDouble(value, dValue)) {
+				walkCellValues[walkCells++] = (float)dValue;
+			}
+		}
+		else if(walkContainer == TAG_BAT_DCB_INFO) {
+			int32_t iField = findField(moduleFields, RSCP_BATTERY_MODULE_FIELDS, value.tag);
+			if(iField >= 0 && getValueAsDouble(value, dValue)) {
+				walkModuleValues[iField] = dValue;
+			}
+		}
+		return;
+	}
+	if(value.tag == TAG_BAT_INDEX && depth == 1) {
+		walkBattery = NULL;
+		uint32_t uiIndex = getValueAsDouble(value, dValue) ? (uint32_t)dValue : 0xFFFFFFFF;
+		for(size_t i = 0; i < batteries.size(); ++i) {
+			if(batteries[i].index == uiIndex) {
+				walkBattery = &batteries[i];
+			}
+		}
+		if(walkBattery == NULL) {
+			++errorValues;
+		}
+		return;
+	}
+	int32_t iField = findField(batteryFields, RSCP_BATTERY_FIELDS, value.tag);
+	if(walkBattery != NULL && iField >= 0 && getValueAsDouble(value, dValue)) {
+		walkBattery->values[iField] = dValue;
+		walkBattery->updated = walkReceived;
+	}
+}
+
+void RscpBatteryDetail::leaveContainer(const SRscpValue & container, uint32_t depth) {
+	if(depth == 0) {
+		walkBattery = NULL;
+		return;
+	}
+	if(depth != 1 || container.tag != walkContainer) {
+		return;
+	}
+	walkContainer = 0;
+	SRscpBatteryModule *module = findModule(walkDcb);
+	if(module == NULL) {
+		++errorValues;
+		return;
+	}
+	size_t uiModule = module - &modules[0];
+	switch(container.tag) {
+	case TAG_BAT_DCB_ALL_CELL_VOLTAGES:
+		memcpy(&voltageColumn[uiModule * RSCP_BATTERY_MAX_CELLS], walkCellValues, walkCells * sizeof(float));
+		module->voltages = walkCells;
+		break;
+	case TAG_BAT_DCB_ALL_CELL_TEMPERATURES:
+		memcpy(&temperatureColumn[uiModule * RSCP_BATTERY_MAX_CELLS], walkCellValues, walkCells * sizeof(float));
+		module->temperatures = walkCells;
+		break;
+	default:
+		for(uint32_t i = 0; i < RSCP_BATTERY_MODULE_FIELDS; ++i) {
+			if(!isnan(walkModuleValues[i])) {
+				module->values[i] = walkModuleValues[i];
+			}
+		}
+		break;
+	}
+	module->updated = walkReceived;
+}
+
+SRscpBatteryModule * RscpBatteryDetail::findModule(int32_t dcb) {
+	if(walkBattery == NULL || dcb < 0 || dcb >= walkBattery->modules) {
+		return NULL;
+	}
+	return &modules[walkBattery->firstModule + dcb];
+}
@@ -0,0 +1,132 @@
+/*
+ * RscpBatteryDetail.h
+ *
+ * DCB module and cell values of every battery. They change slowly and are large compared to the live values, so
+ * they are polled on an own schedule and not with the poll request of the fetch cycle. A round requests for every
+ * battery the number of modules, the minimum and maximum cell temperature and TAG_BAT_REQ_INFO and for every
+ * module TAG_BAT_REQ_DCB_INFO and its cell voltages and temperatures, batched over several modules per frame.
+ * The responses are decoded with a walk over the frame (RscpVisitor.h) into contiguous columns: the cell voltages
+ * and the cell temperatures of all modules are two float arrays, one module behind the other.
+ */
+
+#ifndef RSCPBATTERYDETAIL_H_
+#define RSCPBATTERYDETAIL_H_
+
+#include <utility>
+#include <vector>
+#include <stdint.h>
+#include "RscpTypes.h"
+#include "RscpVisitor.h"
+
+/*
+ * Cell values of a module which are kept per column, further values of a response are counted as dropped.
+ */
+#define RSCP_BATTERY_MAX_CELLS      64
+/*
+ * Modules of all batteries which are polled, the modules behind are left out.
+ */
+#define RSCP_BATTERY_MAX_MODULES    64
+/*
+ * Number of the battery and module values, see RscpBatteryDetail::batteryField and moduleField.
+ */
+#define RSCP_BATTERY_FIELDS         14
+#define RSCP_BATTERY_MODULE_FIELDS  12
+
+struct SRscpBattery {
+	uint8_t index;
+	// modules which are polled and the first of them in the modules of all batteries
+	uint8_t modules;
+	uint16_t firstModule;
+	// monotonic ns of the last response, 0 before the first one
+	int64_t updated;
+	// values in the order of RscpBatteryDetail::batteryField, NaN until they are answered
+	double values[RSCP_BATTERY_FIELDS];
+};
+
+struct SRscpBatteryModule {
+	uint8_t battery;
+	uint8_t dcb;
+	// cell values of the module in the voltage and the temperature column
+	uint8_t voltages;
+	uint8_t temperatures;
+	// monotonic ns of the last response, 0 before the first one
+	int64_t updated;
+	// values of TAG_BAT_DCB_INFO in the order of RscpBatteryDetail::moduleField, NaN until they are answered
+	double values[RSCP_BATTERY_MODULE_FIELDS];
+};
+
+class RscpBatteryDetail : private RscpVisitor {
+public:
+	RscpBatteryDetail();
+	/*
+	 * \brief Serialized values of the request frames of one round for \var batteries (index and number of modules),
+	 *        \var batch modules per frame.
+	 * @return - RSCP error code if a request could not be created else RSCP::OK
+	 */
+	static int32_t createRequests(const std::vector<std::pair<uint8_t, uint8_t> > & batteries, uint32_t batch,
+			std::vector<std::vector<uint8_t> > & frames);
+	/*
+	 * \brief True if the decrypted frame \var data answers a request of createRequests, its first value is
+	 *        TAG_BAT_DATA. The responses of the poll request start with TAG_INFO_TIME.
+	 */
+	static bool isResponse(const uint8_t *data, uint32_t length);
+	/*
+	 * \brief Name of the battery value \var field (json key) and its response tag.
+	 */
+	static const char * batteryField(uint32_t field, SRscpTag *tag = NULL);
+	/*
+	 * \brief Name of the module value \var field (json key) and its response tag inside TAG_BAT_DCB_INFO.
+	 */
+	static const char * moduleField(uint32_t field, SRscpTag *tag = NULL);
+
+	/*
+	 * \brief Modules and columns for \var layout (index and number of modules of every battery), the values decoded
+	 *        so far are dropped. Allocates.
+	 */
+	void setLayout(const std::vector<std::pair<uint8_t, uint8_t> > & layout);
+	/*
+	 * \brief Decode the response frame \var data which was received at \var received into the columns.
+	 *        Values of batteries and modules which are not in the layout are counted as errors. Does not allocate.
+	 * @return - RSCP error code if the frame is invalid or incomplete else its length in bytes
+	 */
+	int32_t handleFrame(const uint8_t *data, uint32_t length, int64_t received);
+	/*
+	 * \brief True if every module of the layout was answered at least once.
+	 */
+	bool complete() const;
+
+	size_t batteryCount() const { return batteries.size(); }
+	const SRscpBattery & battery(size_t index) const { return batteries[index]; }
+	size_t moduleCount() const { return modules.size(); }
+	const SRscpBatteryModule & module(size_t index) const { return modules[index]; }
+	// cell values of module \var index, SRscpBatteryModule::voltages and temperatures of them are valid
+	const float * cellVoltages(size_t index) const { return &voltageColumn[index * RSCP_BATTERY_MAX_CELLS]; }
+	const float * cellTemperatures(size_t index) const { return &temperatureColumn[index * RSCP_BATTERY_MAX_CELLS]; }
+	// decoded frames, values answered with an error or not in the layout, cell values beyond RSCP_BATTERY_MAX_CELLS
+	uint64_t frames() const { return decodedFrames; }
+	uint64_t errors() const { return errorValues; }
+	uint64_t dropped() const { return droppedCells; }
+private:
+	bool enterContainer(const SRscpValue & container, uint32_t depth);
+	void value(const SRscpValue & value, uint32_t depth);
+	void leaveContainer(const SRscpValue & container, uint32_t depth);
+	SRscpBatteryModule * findModule(int32_t dcb);
+
+	std::vector<SRscpBattery> batteries;
+	std::vector<SRscpBatteryModule> modules;
+	std::vector<float> voltageColumn;
+	std::vector<float> temperatureColumn;
+	uint64_t decodedFrames;
+	uint64_t errorValues;
+	uint64_t droppedCells;
+	// state of the walk: battery of the current TAG_BAT_DATA and the module container which is decoded
+	int64_t walkReceived;
+	SRscpBattery *walkBattery;
+	SRscpTag walkContainer;
+	int32_t walkDcb;
+	uint32_t walkCells;
+	float walkCellValues[RSCP_BATTERY_MAX_CELLS];
+	double walkModuleValues[RSCP_BATTERY_MODULE_FIELDS];
+};
+
+#endif /* RSCPBATTERYDETAIL_H_ */
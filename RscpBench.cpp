@@ -0,0 +1,1464 @@
+/*
+	Microbenchmarks of the protocol, crypto and output paths.
+
+	Every benchmark runs a calibrated number of operations in several batches and reports the median
+	time per operation, the throughput and the heap allocations per operation. The frames have the layout
+	of the responses of an E3DC S10 to the requests of this client, so results are comparable between runs.
+
+	Usage: RscpBench [--json] [--time <ms per batch>] [filter]
+
+	Copyright (c) 2018 Thomas Bella <thomas@bella.network>
+
+	MIT Licence
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "RscpProtocol.h"
+#include "RscpTags.h"
+#include "RscpMetrics.h"
+#include "RscpDecryptor.h"
+#include "RscpSendSlab.h"
+#include "RscpVisitor.h"
+#include "RscpTopology.h"
+#include "RscpCodec.h"
+#include "RscpWallbox.h"
+#include "RscpBatteryDetail.h"
+#include "RscpEnergyCounters.h"
+#include "AES.h"
+#include "json.hpp"
+
+#define AES_KEY_SIZE        32
+#define AES_BLOCK_SIZE      32
+#define BENCH_BATCHES       5
+
+// response handling and the json data of the client (RscpExampleMain.cpp built with RSCP_NO_MAIN)
+extern nlohmann::json mainJSONObject;
+int handleResponseValue(RscpProtocol *protocol, SRscpValue *response);
+int32_t createPollRequest(std::vector<uint8_t> & data, const SRscpTopology & devices, bool serialNumberKnown);
+void setPVILayout(const SRscpTopology & devices);
+
+struct SBenchResult {
+	std::string name;
+	uint64_t operations;
+	double nsPerOp;
+	double bytesPerSecond;
+	double allocationsPerOp;
+};
+
+static bool bJsonOutput = false;
+static int64_t iBatchNs = 100000000;
+static const char *cFilter = NULL;
+
+static uint64_t threadAllocations(void)
+{
+	std::vector<SRscpThreadCounters> counters;
+	RscpMetrics::getThreadCounters(counters);
+	for(size_t i = 0; i < counters.size(); ++i) {
+		if(counters[i].name == "bench") {
+			return counters[i].allocations;
+		}
+	}
+	return 0;
+}
+
+/*
+ * \brief Run \var op in batches of a calibrated size and record the median time per operation.
+ * @param - Bytes processed by one operation, 0 if no throughput is reported
+ * @return - the result, no operations if \var name is filtered out
+ */
+template<class TOperation>
+static SBenchResult bench(const char *name, uint64_t bytesPerOp, TOperation op)
+{
+	SBenchResult result;
+	result.name = name;
+	result.operations = 0;
+	result.nsPerOp = 0.0;
+	result.bytesPerSecond = 0.0;
+	result.allocationsPerOp = 0.0;
+	if(cFilter != NULL && strstr(name, cFilter) == NULL) {
+		return result;
+	}
+	// warm up caches and the allocator, then grow the batch until it takes long enough to measure
+	uint64_t uiBatch = 1;
+	while(true) {
+		int64_t start = RscpMetrics::now();
+		for(uint64_t i = 0; i < uiBatch; ++i) {
+			op();
+		}
+		int64_t elapsed = RscpMetrics::now() - start;
+		if(elapsed >= iBatchNs / 10 || uiBatch >= (1ULL << 30)) {
+			uiBatch = std::max<uint64_t>(1, uiBatch * iBatchNs / std::max<int64_t>(elapsed, 1));
+			break;
+		}
+		uiBatch *= 2;
+	}
+
+	std::vector<double> nsPerOp;
+	uint64_t uiAllocations = threadAllocations();
+	for(int n = 0; n < BENCH_BATCHES; ++n) {
+		int64_t start = RscpMetrics::now();
+		for(uint64_t i = 0; i < uiBatch; ++i) {
+			op();
+		}
+		nsPerOp.push_back((double)(RscpMetrics::now() - start) / uiBatch);
+	}
+	uiAllocations = threadAllocations() - uiAllocations;
+	std::sort(nsPerOp.begin(), nsPerOp.end());
+
+	result.operations = uiBatch * BENCH_BATCHES;
+	result.nsPerOp = nsPerOp[BENCH_BATCHES / 2];
+	result.bytesPerSecond = bytesPerOp ? bytesPerOp * 1e9 / result.nsPerOp : 0.0;
+	result.allocationsPerOp = (double)uiAllocations / result.operations;
+
+	if(bJsonOutput) {
+		printf("{\"name\":\"%s\",\"operations\":%llu,\"ns_per_op\":%.1f,\"bytes_per_s\":%.0f,\"allocs_per_op\":%.2f}\n", name,
+				(unsigned long long)result.operations, result.nsPerOp, result.bytesPerSecond, result.allocationsPerOp);
+	}
+	else {
+		printf("%-32s %12.1f ns/op %10.2f MB/s %8.2f allocs/op\n", name, result.nsPerOp, result.bytesPerSecond / 1e6, result.allocationsPerOp);
+	}
+	fflush(stdout);
+	return result;
+}
+
+// indexed PVI values are answered as container with the index and the value
+static void appendIndexedValue(RscpProtocol & protocol, SRscpValue * container, const SRscpTag & tag, uint16_t index, float value)
+{
+	SRscpValue indexed;
+	protocol.createContainerValue(&indexed, tag);
+	protocol.appendValue(&indexed, TAG_PVI_INDEX, index);
+	protocol.appendValue(&indexed, TAG_PVI_VALUE, value);
+	protocol.appendValue(container, indexed);
+	protocol.destroyValueData(indexed);
+}
+
+// response to the poll request of the client: EMS and INFO values, battery, PV inverter with three phases, two strings and
+// two temperature sensors, DC/DC converter, two power meters with energy counters
+static void createPollResponse(RscpProtocol & protocol, SRscpValue * root)
+{
+	protocol.createContainerValue(root, 0);
+	protocol.appendValue(root, TAG_INFO_TIME, (int32_t)1532904452);
+	protocol.appendValue(root, TAG_INFO_SERIAL_NUMBER, "S10-BENCHMARK000");
+	protocol.appendValue(root, TAG_EMS_POWER_PV, (int32_t)4312);
+	protocol.appendValue(root, TAG_EMS_POWER_BAT, (int32_t)-1499);
+	protocol.appendValue(root, TAG_EMS_POWER_HOME, (int32_t)1413);
+	protocol.appendValue(root, TAG_EMS_POWER_GRID, (int32_t)-8);
+	protocol.appendValue(root, TAG_EMS_POWER_ADD, (int32_t)0);
+	protocol.appendValue(root, TAG_EMS_AUTARKY, 99.1f);
+	protocol.appendValue(root, TAG_EMS_SELF_CONSUMPTION, 99.4f);
+	protocol.appendValue(root, TAG_EMS_COUPLING_MODE, (uint8_t)3);
+
+	SRscpValue battery;
+	protocol.createContainerValue(&battery, TAG_BAT_DATA);
+	protocol.appendValue(&battery, TAG_BAT_INDEX, (uint16_t)0);
+	protocol.appendValue(&battery, TAG_BAT_RSOC, 74.2f);
+	protocol.appendValue(&battery, TAG_BAT_MODULE_VOLTAGE, 48.8f);
+	protocol.appendValue(&battery, TAG_BAT_CURRENT, -30.7f);
+	protocol.appendValue(&battery, TAG_BAT_CHARGE_CYCLES, (uint32_t)167);
+	protocol.appendValue(&battery, TAG_BAT_TRAINING_MODE, (uint8_t)0);
+	protocol.appendValue(root, battery);
+	protocol.destroyValueData(battery);
+
+	SRscpValue pvi;
+	protocol.createContainerValue(&pvi, TAG_PVI_DATA);
+	protocol.appendValue(&pvi, TAG_PVI_INDEX, (uint16_t)0);
+	protocol.appendValue(&pvi, TAG_PVI_ON_GRID, true);
+	protocol.appendValue(&pvi, TAG_PVI_SYSTEM_MODE, (uint8_t)2);
+	for(uint16_t i = 0; i < 3; ++i) {
+		appendIndexedValue(protocol, &pvi, TAG_PVI_AC_POWER, i, 1437.0f);
+		appendIndexedValue(protocol, &pvi, TAG_PVI_AC_VOLTAGE, i, 231.0f);
+		appendIndexedValue(protocol, &pvi, TAG_PVI_AC_CURRENT, i, 6.2f);
+		appendIndexedValue(protocol, &pvi, TAG_PVI_AC_APPARENTPOWER, i, 1450.0f);
+		appendIndexedValue(protocol, &pvi, TAG_PVI_AC_REACTIVEPOWER, i, -15.0f);
+	}
+	for(uint16_t i = 0; i < 2; ++i) {
+		appendIndexedValue(protocol, &pvi, TAG_PVI_DC_POWER, i, 2156.0f);
+		appendIndexedValue(protocol, &pvi, TAG_PVI_DC_VOLTAGE, i, 380.0f);
+		appendIndexedValue(protocol, &pvi, TAG_PVI_DC_CURRENT, i, 5.7f);
+		appendIndexedValue(protocol, &pvi, TAG_PVI_DC_STRING_ENERGY_ALL, i, 8250000.0f);
+	}
+	for(uint16_t i = 0; i < 2; ++i) {
+		appendIndexedValue(protocol, &pvi, TAG_PVI_TEMPERATURE, i, 38.5f);
+	}
+	protocol.appendValue(root, pvi);
+	protocol.destroyValueData(pvi);
+
+	SRscpValue dcdc, status;
+	protocol.createContainerValue(&dcdc, TAG_DCDC_DATA);
+	protocol.appendValue(&dcdc, TAG_DCDC_INDEX, (uint8_t)0);
+	protocol.appendValue(&dcdc, TAG_DCDC_I_BAT, -30.7f);
+	protocol.appendValue(&dcdc, TAG_DCDC_U_BAT, 48.8f);
+	protocol.appendValue(&dcdc, TAG_DCDC_P_BAT, -1499.0f);
+	protocol.appendValue(&dcdc, TAG_DCDC_I_DCL, -2.2f);
+	protocol.appendValue(&dcdc, TAG_DCDC_U_DCL, 700.0f);
+	protocol.appendValue(&dcdc, TAG_DCDC_P_DCL, -1530.0f);
+	protocol.createContainerValue(&status, TAG_DCDC_STATUS);
+	protocol.appendValue(&status, TAG_DCDC_STATE, (uint32_t)7);
+	protocol.appendValue(&status, TAG_DCDC_SUBSTATE, (uint32_t)0);
+	protocol.appendValue(&dcdc, status);
+	protocol.destroyValueData(status);
+	protocol.appendValue(root, dcdc);
+	protocol.destroyValueData(dcdc);
+
+	for(uint8_t i = 0; i < 2; ++i) {
+		SRscpValue pm;
+		protocol.createContainerValue(&pm, TAG_PM_DATA);
+		protocol.appendValue(&pm, TAG_PM_INDEX, i);
+		protocol.appendValue(&pm, TAG_PM_DEVICE_STATE, true);
+		protocol.appendValue(&pm, TAG_PM_ACTIVE_PHASES, (int32_t)7);
+		protocol.appendValue(&pm, TAG_PM_POWER_L1, -179.0);
+		protocol.appendValue(&pm, TAG_PM_POWER_L2, -134.0);
+		protocol.appendValue(&pm, TAG_PM_POWER_L3, 265.0);
+		protocol.appendValue(&pm, TAG_PM_VOLTAGE_L1, 231.28f);
+		protocol.appendValue(&pm, TAG_PM_VOLTAGE_L2, 232.23f);
+		protocol.appendValue(&pm, TAG_PM_VOLTAGE_L3, 229.01f);
+		protocol.appendValue(&pm, TAG_PM_ENERGY_L1, 1250000.5);
+		protocol.appendValue(&pm, TAG_PM_ENERGY_L2, 1180000.25);
+		protocol.appendValue(&pm, TAG_PM_ENERGY_L3, 1320000.0);
+		protocol.appendValue(root, pm);
+		protocol.destroyValueData(pm);
+	}
+}
+
+// history chunk of the backfill which fills most of a frame
+static void createHistoryResponse(RscpProtocol & protocol, SRscpValue * root)
+{
+	protocol.createContainerValue(root, 0);
+	SRscpValue history;
+	protocol.createContainerValue(&history, TAG_DB_HISTORY_DATA_DAY);
+	for(int row = 0; row < 400; ++row) {
+		SRscpValue values;
+		protocol.createContainerValue(&values, (row == 0) ? TAG_DB_SUM_CONTAINER : TAG_DB_VALUE_CONTAINER);
+		float fBase = (row % 96) / 96.0f;
+		protocol.appendValue(&values, TAG_DB_GRAPH_INDEX, (float)row);
+		protocol.appendValue(&values, TAG_DB_BAT_POWER_IN, 1200.0f * fBase);
+		protocol.appendValue(&values, TAG_DB_BAT_POWER_OUT, 800.0f * (1.0f - fBase));
+		protocol.appendValue(&values, TAG_DB_DC_POWER, 4500.0f * fBase);
+		protocol.appendValue(&values, TAG_DB_GRID_POWER_IN, 300.0f * fBase);
+		protocol.appendValue(&values, TAG_DB_GRID_POWER_OUT, 150.0f * (1.0f - fBase));
+		protocol.appendValue(&values, TAG_DB_CONSUMPTION, 900.0f + 100.0f * fBase);
+		protocol.appendValue(&values, TAG_DB_PM_0_POWER, 0.0f);
+		protocol.appendValue(&values, TAG_DB_PM_1_POWER, 0.0f);
+		protocol.appendValue(&values, TAG_DB_BAT_CHARGE_LEVEL, 100.0f * fBase);
+		protocol.appendValue(&values, TAG_DB_BAT_CYCLE_COUNT, 167.0f);
+		protocol.appendValue(&values, TAG_DB_CONSUMED_PRODUCTION, 80.0f);
+		protocol.appendValue(&values, TAG_DB_AUTARKY, 95.0f);
+		protocol.appendValue(&history, values);
+		protocol.destroyValueData(values);
+	}
+	protocol.appendValue(root, history);
+	protocol.destroyValueData(history);
+}
+
+// poll request of the client without the authentication
+static void createPollRequest(RscpProtocol & protocol, SRscpValue * root)
+{
+	protocol.createContainerValue(root, 0);
+	const SRscpTag emsRequests[] = { TAG_INFO_REQ_TIME, TAG_EMS_REQ_POWER_PV, TAG_EMS_REQ_POWER_BAT, TAG_EMS_REQ_POWER_HOME,
+			TAG_EMS_REQ_POWER_GRID, TAG_EMS_REQ_POWER_ADD, TAG_EMS_REQ_AUTARKY, TAG_EMS_REQ_SELF_CONSUMPTION, TAG_EMS_REQ_COUPLING_MODE };
+	for(size_t i = 0; i < sizeof(emsRequests) / sizeof(emsRequests[0]); ++i) {
+		protocol.appendValue(root, emsRequests[i]);
+	}
+	SRscpValue battery;
+	protocol.createContainerValue(&battery, TAG_BAT_REQ_DATA);
+	protocol.appendValue(&battery, TAG_BAT_INDEX, (uint8_t)0);
+	protocol.appendValue(&battery, TAG_BAT_REQ_RSOC);
+	protocol.appendValue(&battery, TAG_BAT_REQ_MODULE_VOLTAGE);
+	protocol.appendValue(&battery, TAG_BAT_REQ_CURRENT);
+	protocol.appendValue(&battery, TAG_BAT_REQ_CHARGE_CYCLES);
+	protocol.appendValue(&battery, TAG_BAT_REQ_TRAINING_MODE);
+	protocol.appendValue(root, battery);
+	protocol.destroyValueData(battery);
+	SRscpValue pvi;
+	protocol.createContainerValue(&pvi, TAG_PVI_REQ_DATA);
+	protocol.appendValue(&pvi, TAG_PVI_INDEX, (uint8_t)0);
+	protocol.appendValue(&pvi, TAG_PVI_REQ_ON_GRID);
+	protocol.appendValue(&pvi, TAG_PVI_REQ_SYSTEM_MODE);
+	for(uint8_t i = 0; i < 3; ++i) {
+		protocol.appendValue(&pvi, TAG_PVI_REQ_AC_POWER, i);
+		protocol.appendValue(&pvi, TAG_PVI_REQ_AC_VOLTAGE, i);
+		protocol.appendValue(&pvi, TAG_PVI_REQ_AC_CURRENT, i);
+		protocol.appendValue(&pvi, TAG_PVI_REQ_AC_APPARENTPOWER, i);
+		protocol.appendValue(&pvi, TAG_PVI_REQ_AC_REACTIVEPOWER, i);
+	}
+	for(uint8_t i = 0; i < 2; ++i) {
+		protocol.appendValue(&pvi, TAG_PVI_REQ_DC_POWER, i);
+		protocol.appendValue(&pvi, TAG_PVI_REQ_DC_VOLTAGE, i);
+		protocol.appendValue(&pvi, TAG_PVI_REQ_DC_CURRENT, i);
+		protocol.appendValue(&pvi, TAG_PVI_REQ_DC_STRING_ENERGY_ALL, i);
+	}
+	for(uint8_t i = 0; i < 2; ++i) {
+		protocol.appendValue(&pvi, TAG_PVI_REQ_TEMPERATURE, i);
+	}
+	protocol.appendValue(root, pvi);
+	protocol.destroyValueData(pvi);
+}
+
+static std::vector<uint8_t> createFrame(const SRscpValue & root)
+{
+	RscpProtocol protocol;
+	SRscpFrameBuffer frameBuffer;
+	memset(&frameBuffer, 0, sizeof(frameBuffer));
+	protocol.createFrameAsBuffer(&frameBuffer, root.data, root.length, true);
+	std::vector<uint8_t> frame(frameBuffer.data, frameBuffer.data + frameBuffer.dataLength);
+	protocol.destroyFrameData(&frameBuffer);
+	// frames are sent zero padded to the AES block size
+	frame.resize(ROUNDUP(frame.size(), AES_BLOCK_SIZE), 0);
+	return frame;
+}
+
+static void benchProtocol(const std::vector<uint8_t> & pollFrame, const std::vector<uint8_t> & historyFrame)
+{
+	RscpProtocol protocol;
+
+	bench("crc32/1k", pollFrame.size(), [&]() {
+		volatile uint32_t crc = protocol.calculateCRC32(&pollFrame[0], pollFrame.size());
+		(void)crc;
+	});
+	bench("crc32/60k", historyFrame.size(), [&]() {
+		volatile uint32_t crc = protocol.calculateCRC32(&historyFrame[0], historyFrame.size());
+		(void)crc;
+	});
+
+	SRscpValue request;
+	createPollRequest(protocol, &request);
+	bench("createFrameAsBuffer/request", request.length, [&]() {
+		SRscpFrameBuffer frameBuffer;
+		memset(&frameBuffer, 0, sizeof(frameBuffer));
+		protocol.createFrameAsBuffer(&frameBuffer, request.data, request.length, true);
+		protocol.destroyFrameData(&frameBuffer);
+	});
+	protocol.destroyValueData(request);
+
+	bench("parseFrame/poll_1k", pollFrame.size(), [&]() {
+		SRscpFrame frame;
+		protocol.parseFrame(&pollFrame[0], pollFrame.size(), &frame);
+		protocol.destroyFrameData(frame);
+	});
+	bench("parseFrame/history_60k", historyFrame.size(), [&]() {
+		SRscpFrame frame;
+		protocol.parseFrame(&historyFrame[0], historyFrame.size(), &frame);
+		protocol.destroyFrameData(frame);
+	});
+
+	SRscpFrame frame;
+	protocol.parseFrame(&pollFrame[0], pollFrame.size(), &frame);
+	const SRscpValue *pvi = NULL;
+	for(size_t i = 0; i < frame.data.size(); ++i) {
+		if(frame.data[i].tag == TAG_PVI_DATA) {
+			pvi = &frame.data[i];
+		}
+	}
+	bench("getValueAsContainer/pvi", pvi->length, [&]() {
+		std::vector<SRscpValue> data = protocol.getValueAsContainer(pvi);
+		protocol.destroyValueData(data);
+	});
+	// the PVI arrays of the devices in the poll response, a string beyond them is not requested and left out
+	SRscpTopology devices;
+	devices.pviStrings = 2;
+	devices.pviTemperatures = 2;
+	setPVILayout(devices);
+	bench("handleResponseValue/poll", pollFrame.size(), [&]() {
+		for(size_t i = 0; i < frame.data.size(); ++i) {
+			handleResponseValue(&protocol, &frame.data[i]);
+		}
+	});
+	protocol.destroyFrameData(frame);
+	SRscpValue unknownString;
+	protocol.createContainerValue(&unknownString, TAG_PVI_DATA);
+	protocol.appendValue(&unknownString, TAG_PVI_INDEX, (uint16_t)0);
+	appendIndexedValue(protocol, &unknownString, TAG_PVI_DC_POWER, 7, 100.0f);
+	handleResponseValue(&protocol, &unknownString);
+	protocol.destroyValueData(unknownString);
+	const nlohmann::json & pviJSON = mainJSONObject["pvi"];
+	if(pviJSON["ac"]["reactive_power"].size() != 3 || pviJSON["ac"]["power"][2] != 1437.0 || pviJSON["dc"]["power"].size() != 2
+			|| pviJSON["dc"]["energy_all"][1] != 8250000.0 || pviJSON["temperature"].size() != 2 || pviJSON["temperature"][1] != 38.5) {
+		printf("The PVI values are not decoded into their arrays: %s\n", pviJSON.dump().c_str());
+		exit(EXIT_FAILURE);
+	}
+
+	// throughput of the rendered output
+	std::string text = mainJSONObject.dump(4);
+	bench("json_dump/mainJSONObject", text.size(), [&]() {
+		text = mainJSONObject.dump(4);
+	});
+}
+
+// counts the values and the data bytes which are reported by a walk
+class RscpCountingVisitor : public RscpVisitor {
+public:
+	RscpCountingVisitor() : values(0), bytes(0) {}
+	void value(const SRscpValue & value, uint32_t depth) {
+		++values;
+		bytes += value.length;
+	}
+	uint64_t values;
+	uint64_t bytes;
+};
+
+// values and data bytes of \var data with every nested container materialized
+static void countTree(RscpProtocol & protocol, std::vector<SRscpValue> & data, uint64_t & values, uint64_t & bytes)
+{
+	for(size_t i = 0; i < data.size(); ++i) {
+		if(data[i].dataType == RSCP::eTypeContainer) {
+			std::vector<SRscpValue> container = protocol.getValueAsContainer(&data[i]);
+			countTree(protocol, container, values, bytes);
+			protocol.destroyValueData(container);
+		}
+		else {
+			++values;
+			bytes += data[i].length;
+		}
+	}
+}
+
+/*
+ * \brief Every value of a frame with a tree of vectors for every container compared to a single walk with a
+ *        visitor, and a walk which only reports the values at a path and skips everything else. The walks do not
+ *        check the CRC, it is measured by the crc32 benchmarks.
+ */
+static void benchVisit(const std::vector<uint8_t> & pollFrame, const std::vector<uint8_t> & historyFrame)
+{
+	RscpProtocol protocol;
+	const std::vector<uint8_t> *frames[2] = { &pollFrame, &historyFrame };
+	const char *names[2][3] = { { "tree/poll_1k", "visitFrame/poll_1k", "visitFrame/poll_1k_path" },
+			{ "tree/history_60k", "visitFrame/history_60k", "visitFrame/history_60k_path" } };
+	for(int n = 0; n < 2; ++n) {
+		const std::vector<uint8_t> & frame = *frames[n];
+		uint64_t uiTreeValues = 0;
+		uint64_t uiTreeBytes = 0;
+		bench(names[n][0], frame.size(), [&]() {
+			SRscpFrame tree;
+			protocol.parseFrame(&frame[0], frame.size(), &tree);
+			uiTreeValues = 0;
+			uiTreeBytes = 0;
+			countTree(protocol, tree.data, uiTreeValues, uiTreeBytes);
+			protocol.destroyFrameData(tree);
+		});
+		RscpCountingVisitor all;
+		bench(names[n][1], frame.size(), [&]() {
+			all.values = 0;
+			all.bytes = 0;
+			protocol.visitFrame(&frame[0], frame.size(), all, false);
+		});
+		RscpCountingVisitor selected;
+		RscpPathFilter filter(selected);
+		if(n == 0) {
+			filter.addPath({ TAG_BAT_DATA, TAG_BAT_RSOC });
+		}
+		else {
+			filter.addPath({ TAG_DB_HISTORY_DATA_DAY, TAG_DB_VALUE_CONTAINER, TAG_DB_BAT_CHARGE_LEVEL });
+		}
+		bench(names[n][2], frame.size(), [&]() {
+			selected.values = 0;
+			protocol.visitFrame(&frame[0], frame.size(), filter, false);
+		});
+
+		// a fast but wrong walk must not pass: the same values as the tree, one per battery or per history row
+		uint64_t uiSelected = (n == 0) ? 1 : 399;
+		if((cFilter == NULL) && (all.values != uiTreeValues || all.bytes != uiTreeBytes || selected.values != uiSelected)) {
+			printf("Walk of %s failed: %llu values, %llu expected, %llu selected\n", names[n][1], (unsigned long long)all.values,
+					(unsigned long long)uiTreeValues, (unsigned long long)selected.values);
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+// xorshift32, the checks of the wire format use a fixed seed so every run tests the same values
+static uint32_t nextRandom(uint32_t & state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static bool equalBytes(const uint8_t *data, const uint8_t *expected, size_t length, const char *what)
+{
+	if(memcmp(data, expected, length) == 0) {
+		return true;
+	}
+	printf("Wire format of %s:", what);
+	for(size_t i = 0; i < length; ++i) {
+		printf(" %02X", data[i]);
+	}
+	printf("\n");
+	return false;
+}
+
+// value layout of the encoder before RscpCodec.h: the packed SRscpValue header copied in host byte order
+static void appendLegacyValue(std::vector<uint8_t> & out, SRscpTag tag, uint8_t dataType, const void *data, uint16_t length)
+{
+	SRscpValue header;
+	header.tag = tag;
+	header.dataType = dataType;
+	header.length = length;
+	size_t sPos = out.size();
+	out.resize(sPos + sizeof(SRscpValue) - sizeof(uint8_t *) + length);
+	memcpy(&out[sPos], &header, sizeof(SRscpValue) - sizeof(uint8_t *));
+	if(length > 0) {
+		memcpy(&out[sPos + sizeof(SRscpValue) - sizeof(uint8_t *)], data, length);
+	}
+}
+
+// one random value of every data type: appended by the encoder and by the legacy layout, decoded and compared
+struct SCodecValue {
+	SRscpTag tag;
+	uint8_t dataType;
+	uint64_t bits;
+	std::string text;
+};
+
+static void appendRandomValue(RscpProtocol & protocol, SRscpValue *root, std::vector<uint8_t> & legacy, SCodecValue & value, uint32_t & state)
+{
+	static const uint8_t types[] = { RSCP::eTypeBool, RSCP::eTypeChar8, RSCP::eTypeUChar8, RSCP::eTypeInt16, RSCP::eTypeUInt16,
+			RSCP::eTypeInt32, RSCP::eTypeUInt32, RSCP::eTypeInt64, RSCP::eTypeUInt64, RSCP::eTypeFloat32, RSCP::eTypeDouble64,
+			RSCP::eTypeTimestamp, RSCP::eTypeString };
+	value.tag = nextRandom(state);
+	value.dataType = types[nextRandom(state) % sizeof(types)];
+	value.bits = ((uint64_t)nextRandom(state) << 32) | nextRandom(state);
+	value.text.clear();
+	switch(value.dataType) {
+	case RSCP::eTypeBool: { bool v = (value.bits & 1) != 0; value.bits = v; protocol.appendValue(root, value.tag, v); appendLegacyValue(legacy, value.tag, value.dataType, &v, sizeof(v)); break; }
+	case RSCP::eTypeChar8: { int8_t v = (int8_t)value.bits; protocol.appendValue(root, value.tag, v); appendLegacyValue(legacy, value.tag, value.dataType, &v, sizeof(v)); break; }
+	case RSCP::eTypeUChar8: { uint8_t v = (uint8_t)value.bits; protocol.appendValue(root, value.tag, v); appendLegacyValue(legacy, value.tag, value.dataType, &v, sizeof(v)); break; }
+	case RSCP::eTypeInt16: { int16_t v = (int16_t)value.bits; protocol.appendValue(root, value.tag, v); appendLegacyValue(legacy, value.tag, value.dataType, &v, sizeof(v)); break; }
+	case RSCP::eTypeUInt16: { uint16_t v = (uint16_t)value.bits; protocol.appendValue(root, value.tag, v); appendLegacyValue(legacy, value.tag, value.dataType, &v, sizeof(v)); break; }
+	case RSCP::eTypeInt32: { int32_t v = (int32_t)value.bits; protocol.appendValue(root, value.tag, v); appendLegacyValue(legacy, value.tag, value.dataType, &v, sizeof(v)); break; }
+	case RSCP::eTypeUInt32: { uint32_t v = (uint32_t)value.bits; protocol.appendValue(root, value.tag, v); appendLegacyValue(legacy, value.tag, value.dataType, &v, sizeof(v)); break; }
+	case RSCP::eTypeInt64: { int64_t v = (int64_t)value.bits; protocol.appendValue(root, value.tag, v); appendLegacyValue(legacy, value.tag, value.dataType, &v, sizeof(v)); break; }
+	case RSCP::eTypeUInt64: { uint64_t v = value.bits; protocol.appendValue(root, value.tag, v); appendLegacyValue(legacy, value.tag, value.dataType, &v, sizeof(v)); break; }
+	case RSCP::eTypeFloat32: {
+		// the float is compared by its bits, a NaN would not compare equal to itself
+		float v = (float)(int32_t)value.bits / 1024.0f;
+		uint32_t uiBits;
+		memcpy(&uiBits, &v, sizeof(uiBits));
+		value.bits = uiBits;
+		protocol.appendValue(root, value.tag, v);
+		appendLegacyValue(legacy, value.tag, value.dataType, &v, sizeof(v));
+		break;
+	}
+	case RSCP::eTypeDouble64: {
+		double v = (double)(int64_t)value.bits / 1048576.0;
+		memcpy(&value.bits, &v, sizeof(v));
+		protocol.appendValue(root, value.tag, v);
+		appendLegacyValue(legacy, value.tag, value.dataType, &v, sizeof(v));
+		break;
+	}
+	case RSCP::eTypeTimestamp: {
+		SRscpTimestamp v;
+		v.seconds = value.bits;
+		v.nanoseconds = nextRandom(state);
+		value.text.assign((const char *)&v.nanoseconds, sizeof(v.nanoseconds));
+		protocol.appendValue(root, value.tag, v);
+		appendLegacyValue(legacy, value.tag, value.dataType, &v, sizeof(v));
+		break;
+	}
+	default: {
+		value.text.assign(nextRandom(state) % 40, 'a' + (char)(value.bits % 26));
+		protocol.appendValue(root, value.tag, value.text);
+		appendLegacyValue(legacy, value.tag, value.dataType, value.text.data(), value.text.size());
+		break;
+	}
+	}
+}
+
+static bool checkDecodedValue(RscpProtocol & protocol, const SRscpValue & decoded, const SCodecValue & value)
+{
+	if(decoded.tag != value.tag || decoded.dataType != value.dataType) {
+		return false;
+	}
+	switch(value.dataType) {
+	case RSCP::eTypeBool: return protocol.getValueAsBool(&decoded) == (value.bits != 0);
+	case RSCP::eTypeChar8: return protocol.getValueAsChar8(&decoded) == (int8_t)value.bits;
+	case RSCP::eTypeUChar8: return protocol.getValueAsUChar8(&decoded) == (uint8_t)value.bits;
+	case RSCP::eTypeInt16: return protocol.getValueAsInt16(&decoded) == (int16_t)value.bits;
+	case RSCP::eTypeUInt16: return protocol.getValueAsUInt16(&decoded) == (uint16_t)value.bits;
+	case RSCP::eTypeInt32: return protocol.getValueAsInt32(&decoded) == (int32_t)value.bits;
+	case RSCP::eTypeUInt32: return protocol.getValueAsUInt32(&decoded) == (uint32_t)value.bits;
+	case RSCP::eTypeInt64: return protocol.getValueAsInt64(&decoded) == (int64_t)value.bits;
+	case RSCP::eTypeUInt64: return protocol.getValueAsUInt64(&decoded) == value.bits;
+	case RSCP::eTypeFloat32: {
+		float f = protocol.getValueAsFloat32(&decoded);
+		uint32_t uiBits;
+		memcpy(&uiBits, &f, sizeof(uiBits));
+		return uiBits == (uint32_t)value.bits;
+	}
+	case RSCP::eTypeDouble64: {
+		double d = protocol.getValueAsDouble64(&decoded);
+		uint64_t uiBits;
+		memcpy(&uiBits, &d, sizeof(uiBits));
+		return uiBits == value.bits;
+	}
+	case RSCP::eTypeTimestamp: {
+		SRscpTimestamp timestamp = protocol.getValueAsTimestamp(&decoded);
+		return timestamp.seconds == value.bits && memcmp(&timestamp.nanoseconds, value.text.data(), sizeof(timestamp.nanoseconds)) == 0;
+	}
+	default:
+		return protocol.getValueAsString(&decoded) == value.text;
+	}
+}
+
+/*
+ * \brief Checks of the wire format (RscpCodec.h), not timed:
+ *        - the bytes of values and frame headers are compared with the little endian layout written out by hand,
+ *        - random values of every type are decoded to the same values and on a little endian host encoded to the same
+ *          bytes as by the encoder before RscpCodec.h,
+ *        - mutated and truncated frames are rejected or decoded inside their bounds by every decoder.
+ */
+static void checkCodec(const std::vector<uint8_t> & pollFrame, const std::vector<uint8_t> & historyFrame)
+{
+	RscpProtocol protocol;
+	bool bValid = true;
+
+	// hand written layouts
+	SRscpValue root;
+	protocol.createContainerValue(&root, 0);
+	protocol.appendValue(&root, 0x01020304, (int32_t)-2);
+	protocol.appendValue(&root, 0x0A0B0C0D, (uint16_t)0x1234);
+	protocol.appendValue(&root, 0x00800001, 1.0f);
+	protocol.appendValue(&root, 0x00800002, -2.0);
+	SRscpTimestamp timestamp;
+	timestamp.seconds = 0x0102030405060708ULL;
+	timestamp.nanoseconds = 0x0A0B0C0D;
+	protocol.appendValue(&root, 0x00800003, timestamp);
+	const uint8_t ucValues[] = {
+		0x04, 0x03, 0x02, 0x01, RSCP::eTypeInt32, 0x04, 0x00, 0xFE, 0xFF, 0xFF, 0xFF,
+		0x0D, 0x0C, 0x0B, 0x0A, RSCP::eTypeUInt16, 0x02, 0x00, 0x34, 0x12,
+		0x01, 0x00, 0x80, 0x00, RSCP::eTypeFloat32, 0x04, 0x00, 0x00, 0x00, 0x80, 0x3F,
+		0x02, 0x00, 0x80, 0x00, RSCP::eTypeDouble64, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xC0,
+		0x03, 0x00, 0x80, 0x00, RSCP::eTypeTimestamp, 0x0C, 0x00, 0x08, 0x07, 0x06, 0x05, 0x04, 0x03, 0x02, 0x01, 0x0D, 0x0C, 0x0B, 0x0A };
+	bValid &= (root.length == sizeof(ucValues)) && equalBytes(root.data, ucValues, sizeof(ucValues), "values");
+
+	uint8_t ucFrame[RSCP_FRAME_HEADER_SIZE + sizeof(ucValues) + RSCP_CRC_SIZE];
+	int32_t iLength = protocol.createFrameInBuffer(ucFrame, sizeof(ucFrame), root.data, root.length, true);
+	const uint8_t ucHeader[] = { 0xE3, 0xDC, 0x00, 0x11 };
+	uint32_t uiCRC = protocol.calculateCRC32(ucFrame, RSCP_FRAME_HEADER_SIZE + sizeof(ucValues));
+	const uint8_t ucCRC[] = { (uint8_t)uiCRC, (uint8_t)(uiCRC >> 8), (uint8_t)(uiCRC >> 16), (uint8_t)(uiCRC >> 24) };
+	bValid &= (iLength == (int32_t)sizeof(ucFrame)) && equalBytes(ucFrame, ucHeader, sizeof(ucHeader), "frame header")
+			&& ucFrame[16] == sizeof(ucValues) && ucFrame[17] == 0
+			&& equalBytes(ucFrame + sizeof(ucFrame) - RSCP_CRC_SIZE, ucCRC, sizeof(ucCRC), "frame CRC");
+	SRscpFrame frame;
+	bValid &= (protocol.parseFrame(ucFrame, sizeof(ucFrame), &frame) == (int32_t)sizeof(ucFrame)) && frame.data.size() == 5
+			&& protocol.getValueAsInt32(&frame.data[0]) == -2 && protocol.getValueAsUInt16(&frame.data[1]) == 0x1234
+			&& protocol.getValueAsFloat32(&frame.data[2]) == 1.0f && protocol.getValueAsDouble64(&frame.data[3]) == -2.0
+			&& protocol.getValueAsTimestamp(&frame.data[4]).seconds == timestamp.seconds
+			&& protocol.getValueAsTimestamp(&frame.data[4]).nanoseconds == timestamp.nanoseconds;
+	protocol.destroyFrameData(frame);
+	protocol.destroyValueData(root);
+	if(!bValid) {
+		printf("The wire format differs from the little endian layout\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// random values: decoded to the same values and the same bytes as the legacy layout
+	uint32_t uiState = 0x9E3779B9;
+	uint32_t uiRoundTrips = 0;
+	for(int i = 0; i < 2000 && bValid; ++i) {
+		SCodecValue values[24];
+		uint32_t uiValues = 1 + nextRandom(uiState) % 24;
+		std::vector<uint8_t> legacy;
+		protocol.createContainerValue(&root, 0);
+		for(uint32_t n = 0; n < uiValues; ++n) {
+			appendRandomValue(protocol, &root, legacy, values[n], uiState);
+		}
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		bValid &= (legacy.size() == root.length) && (memcmp(&legacy[0], root.data, root.length) == 0);
+#endif
+		std::vector<SRscpValue> decoded;
+		bValid &= (protocol.parseData(root.data, root.length, decoded) == root.length) && (decoded.size() == uiValues);
+		for(size_t n = 0; bValid && n < decoded.size(); ++n) {
+			bValid &= checkDecodedValue(protocol, decoded[n], values[n]);
+		}
+		std::vector<SRscpValue> views;
+		bValid &= (protocol.parseDataViews(root.data, root.length, views) == root.length) && (views.size() == uiValues);
+		for(size_t n = 0; bValid && n < views.size(); ++n) {
+			bValid &= checkDecodedValue(protocol, views[n], values[n]);
+		}
+		uiRoundTrips += uiValues;
+		protocol.destroyValueData(decoded);
+		protocol.destroyValueData(root);
+	}
+	if(!bValid) {
+		printf("Round trip of random values failed after %u values\n", uiRoundTrips);
+		exit(EXIT_FAILURE);
+	}
+
+	// mutated frames: every decoder stays inside the buffer, which is exactly as long as the frame, and they agree
+	const std::vector<uint8_t> *frames[2] = { &pollFrame, &historyFrame };
+	for(int i = 0; i < 4000; ++i) {
+		const std::vector<uint8_t> & source = *frames[i & 1];
+		uint32_t uiLength = RSCP_FRAME_HEADER_SIZE + RscpCodec::load16(&source[16]);
+		std::vector<uint8_t> mutated(source.begin(), source.begin() + uiLength);
+		uint32_t uiFlips = 1 + nextRandom(uiState) % 8;
+		for(uint32_t n = 0; n < uiFlips; ++n) {
+			// mostly the value headers and lengths near the start, sometimes anywhere
+			uint32_t uiRange = (nextRandom(uiState) & 1) ? 256 : uiLength;
+			uint32_t uiPos = RSCP_FRAME_HEADER_SIZE + nextRandom(uiState) % (uiRange - RSCP_FRAME_HEADER_SIZE);
+			mutated[uiPos] ^= (uint8_t)(1 << (nextRandom(uiState) % 8));
+		}
+		if(nextRandom(uiState) % 4 == 0) {
+			mutated.resize(RSCP_FRAME_HEADER_SIZE + nextRandom(uiState) % (uiLength - RSCP_FRAME_HEADER_SIZE));
+			mutated.shrink_to_fit();
+		}
+		const uint8_t *data = &mutated[0] + RSCP_FRAME_HEADER_SIZE;
+		uint32_t uiData = mutated.size() - RSCP_FRAME_HEADER_SIZE;
+
+		std::vector<SRscpValue> views;
+		int32_t iViews = protocol.parseDataViews(data, uiData, views);
+		std::vector<SRscpValue> values;
+		int32_t iValues = protocol.parseData(data, uiData, values);
+		bValid &= (iViews == iValues) && (views.size() == values.size()) && (iViews >= 0) && ((uint32_t)iViews <= uiData);
+		for(size_t n = 0; n < views.size(); ++n) {
+			bValid &= (views[n].data == NULL) || (views[n].data + views[n].length <= data + uiData);
+		}
+		protocol.destroyValueData(values);
+		RscpCountingVisitor counter;
+		int32_t iVisited = protocol.visitData(data, uiData, counter);
+		// a walk which succeeds has checked every container, so the flat parse reached the end as well
+		bValid &= (iVisited < 0) || ((uint32_t)iVisited == uiData && (uint32_t)iViews == uiData);
+		SRscpFrame parsed;
+		protocol.parseFrameViews(&mutated[0], mutated.size(), &parsed, false);
+		if(!bValid) {
+			printf("Decoders disagree on mutated frame %i: %i views, %i values, walk %i\n", i, iViews, iValues, iVisited);
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+static void benchCrypto(const std::vector<uint8_t> & pollFrame, const std::vector<uint8_t> & historyFrame)
+{
+	uint8_t ucKey[AES_KEY_SIZE];
+	memset(ucKey, 0xff, AES_KEY_SIZE);
+	memcpy(ucKey, "benchmark", 9);
+	uint8_t ucIV[AES_BLOCK_SIZE];
+	memset(ucIV, 0xff, AES_BLOCK_SIZE);
+	AES encrypter;
+	AES decrypter;
+	encrypter.SetParameters(AES_KEY_SIZE * 8, AES_BLOCK_SIZE * 8);
+	decrypter.SetParameters(AES_KEY_SIZE * 8, AES_BLOCK_SIZE * 8);
+	encrypter.StartEncryption(ucKey);
+	decrypter.StartDecryption(ucKey);
+
+	const std::vector<uint8_t> *frames[2] = { &pollFrame, &historyFrame };
+	const char *names[2][2] = { { "aes_encrypt/1k", "aes_decrypt/1k" }, { "aes_encrypt/60k", "aes_decrypt/60k" } };
+	for(int n = 0; n < 2; ++n) {
+		const std::vector<uint8_t> & plain = *frames[n];
+		std::vector<uint8_t> cipher(plain.size());
+		std::vector<uint8_t> output(plain.size());
+		bench(names[n][0], plain.size(), [&]() {
+			encrypter.SetIV(ucIV, AES_BLOCK_SIZE);
+			encrypter.Encrypt(&plain[0], &cipher[0], plain.size() / AES_BLOCK_SIZE);
+		});
+		bench(names[n][1], plain.size(), [&]() {
+			decrypter.SetIV(ucIV, AES_BLOCK_SIZE);
+			decrypter.Decrypt(&cipher[0], &output[0], plain.size() / AES_BLOCK_SIZE);
+		});
+
+		// a fast but wrong implementation must not pass
+		encrypter.SetIV(ucIV, AES_BLOCK_SIZE);
+		encrypter.Encrypt(&plain[0], &cipher[0], plain.size() / AES_BLOCK_SIZE);
+		decrypter.SetIV(ucIV, AES_BLOCK_SIZE);
+		decrypter.Decrypt(&cipher[0], &output[0], plain.size() / AES_BLOCK_SIZE);
+		if(output != plain) {
+			printf("AES round trip of %s failed\n", names[n][1]);
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+/*
+ * \brief Receive path of a frame: decryption, CRC check and parsing in separate passes over the frame compared to
+ *        the decryption and CRC check in a single pass (RscpDecryptor) followed by the parsing.
+ */
+static void benchReceive(const std::vector<uint8_t> & pollFrame, const std::vector<uint8_t> & historyFrame)
+{
+	RscpProtocol protocol;
+	uint8_t ucKey[AES_KEY_SIZE];
+	memset(ucKey, 0xff, AES_KEY_SIZE);
+	memcpy(ucKey, "benchmark", 9);
+	uint8_t ucIV[AES_BLOCK_SIZE];
+	memset(ucIV, 0xff, AES_BLOCK_SIZE);
+	AES encrypter;
+	AES decrypter;
+	encrypter.SetParameters(AES_KEY_SIZE * 8, AES_BLOCK_SIZE * 8);
+	decrypter.SetParameters(AES_KEY_SIZE * 8, AES_BLOCK_SIZE * 8);
+	encrypter.StartEncryption(ucKey);
+	decrypter.StartDecryption(ucKey);
+	RscpDecryptor decryptor(decrypter);
+
+	const std::vector<uint8_t> *frames[2] = { &pollFrame, &historyFrame };
+	const char *names[2][2] = { { "receive/1k_multi_pass", "receive/1k_fused" }, { "receive/60k_multi_pass", "receive/60k_fused" } };
+	for(int n = 0; n < 2; ++n) {
+		const std::vector<uint8_t> & plain = *frames[n];
+		uint32_t uiBlocks = plain.size() / AES_BLOCK_SIZE;
+		std::vector<uint8_t> cipher(plain.size());
+		std::vector<uint8_t> output(plain.size());
+		encrypter.SetIV(ucIV, AES_BLOCK_SIZE);
+		encrypter.Encrypt(&plain[0], &cipher[0], uiBlocks);
+
+		SRscpFrame frame;
+		bench(names[n][0], plain.size(), [&]() {
+			decrypter.SetIV(ucIV, AES_BLOCK_SIZE);
+			decrypter.Decrypt(&cipher[0], &output[0], uiBlocks);
+			protocol.parseFrameViews(&output[0], output.size(), &frame);
+		});
+		bench(names[n][1], plain.size(), [&]() {
+			decryptor.reset(ucIV);
+			decryptor.decrypt(&cipher[0], &output[0], uiBlocks);
+			protocol.parseFrameViews(&output[0], output.size(), &frame, false);
+		});
+
+		// a fast but wrong implementation must not pass: the frame must be restored and a broken CRC detected
+		std::fill(output.begin(), output.end(), 0);
+		decryptor.reset(ucIV);
+		int32_t iBlocks = decryptor.decrypt(&cipher[0], &output[0], uiBlocks);
+		if(iBlocks != (int32_t)uiBlocks || !decryptor.complete() || output != plain) {
+			printf("Decryption of %s failed: %i\n", names[n][1], iBlocks);
+			exit(EXIT_FAILURE);
+		}
+		std::vector<uint8_t> corrupted(plain);
+		corrupted[plain.size() / 2] ^= 0x01;
+		encrypter.SetIV(ucIV, AES_BLOCK_SIZE);
+		encrypter.Encrypt(&corrupted[0], &cipher[0], uiBlocks);
+		decryptor.reset(ucIV);
+		iBlocks = decryptor.decrypt(&cipher[0], &output[0], uiBlocks);
+		if(iBlocks != RSCP::ERR_INVALID_CRC) {
+			printf("CRC error of %s not detected: %i\n", names[n][1], iBlocks);
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+/*
+ * \brief Transmit path of the poll request: a frame buffer and a padded copy of it are allocated for every request
+ *        compared to the frame created, encrypted and sent inside the send slab. The frames are sent through a
+ *        socket pair and drained on the other end, which is part of both results.
+ */
+static void benchTransmit(void)
+{
+	RscpProtocol protocol;
+	uint8_t ucKey[AES_KEY_SIZE];
+	memset(ucKey, 0xff, AES_KEY_SIZE);
+	memcpy(ucKey, "benchmark", 9);
+	uint8_t ucIV[AES_BLOCK_SIZE];
+	memset(ucIV, 0xff, AES_BLOCK_SIZE);
+	AES encrypter;
+	encrypter.SetParameters(AES_KEY_SIZE * 8, AES_BLOCK_SIZE * 8);
+	encrypter.StartEncryption(ucKey);
+	RscpSendSlab slab(encrypter);
+	slab.reset(ucIV);
+
+	int iSockets[2];
+	if(socketpair(AF_UNIX, SOCK_STREAM, 0, iSockets) != 0) {
+		printf("socketpair failed\n");
+		exit(EXIT_FAILURE);
+	}
+	SRscpValue request;
+	createPollRequest(protocol, &request);
+	uint8_t ucDrain[ROUNDUP(RSCP_MAX_FRAME_LENGTH, AES_BLOCK_SIZE)];
+	bool bSent = true;
+
+	bench("transmit/poll_request_copy", request.length, [&]() {
+		SRscpFrameBuffer frameBuffer;
+		memset(&frameBuffer, 0, sizeof(frameBuffer));
+		protocol.createFrameAsBuffer(&frameBuffer, request.data, request.length, true);
+		std::vector<uint8_t> buffer(ROUNDUP(frameBuffer.dataLength, AES_BLOCK_SIZE), 0);
+		memcpy(&buffer[0], frameBuffer.data, frameBuffer.dataLength);
+		encrypter.SetIV(ucIV, AES_BLOCK_SIZE);
+		encrypter.Encrypt(&buffer[0], &buffer[0], buffer.size() / AES_BLOCK_SIZE);
+		memcpy(ucIV, &buffer[0] + buffer.size() - AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+		bSent &= (send(iSockets[0], &buffer[0], buffer.size(), 0) == (ssize_t)buffer.size());
+		bSent &= (recv(iSockets[1], ucDrain, buffer.size(), MSG_WAITALL) == (ssize_t)buffer.size());
+		protocol.destroyFrameData(&frameBuffer);
+	});
+	auto sendSlab = [&]() {
+		uint32_t uiLength = slab.encrypt(slab.createFrame(request.data, request.length));
+		bSent &= (send(iSockets[0], slab.data(), uiLength, 0) == (ssize_t)uiLength);
+		bSent &= (recv(iSockets[1], ucDrain, uiLength, MSG_WAITALL) == (ssize_t)uiLength);
+	};
+	bench("transmit/poll_request_slab", request.length, sendSlab);
+
+	// the slab path must neither allocate nor lose data, every allocation inside the scope is counted
+	RscpMetrics::setHeapPolicy(eHeapCounted);
+	uint64_t uiViolations = RscpMetrics::heapViolations();
+	{
+		RscpNoHeapScope noHeap;
+		for(int i = 0; i < 1000; ++i) {
+			sendSlab();
+		}
+	}
+	uiViolations = RscpMetrics::heapViolations() - uiViolations;
+	protocol.destroyValueData(request);
+	close(iSockets[0]);
+	close(iSockets[1]);
+	if(!bSent || uiViolations > 0) {
+		printf("Transmit through the send slab failed: %s, %llu allocations in 1000 sends\n", bSent ? "sent" : "not sent",
+				(unsigned long long)uiViolations);
+		exit(EXIT_FAILURE);
+	}
+}
+
+// poll request of the client for \var devices, every value is created and appended at runtime
+static void appendPollRequest(RscpProtocol & protocol, SRscpValue * root, const SRscpTopology & devices, bool serialNumberKnown)
+{
+	protocol.createContainerValue(root, 0);
+	protocol.appendValue(root, TAG_INFO_REQ_TIME);
+	if(!serialNumberKnown) {
+		protocol.appendValue(root, TAG_INFO_REQ_SERIAL_NUMBER);
+	}
+	const SRscpTag emsRequests[] = { TAG_EMS_REQ_POWER_PV, TAG_EMS_REQ_POWER_BAT, TAG_EMS_REQ_POWER_HOME, TAG_EMS_REQ_POWER_GRID,
+			TAG_EMS_REQ_POWER_ADD, TAG_EMS_REQ_POWER_WB_ALL, TAG_EMS_REQ_POWER_WB_SOLAR, TAG_EMS_REQ_AUTARKY,
+			TAG_EMS_REQ_SELF_CONSUMPTION, TAG_EMS_REQ_COUPLING_MODE, TAG_EMS_REQ_GET_IDLE_PERIODS };
+	for(size_t i = 0; i < sizeof(emsRequests) / sizeof(emsRequests[0]); ++i) {
+		protocol.appendValue(root, emsRequests[i]);
+	}
+	for(size_t i = 0; i < devices.batteries.size(); ++i) {
+		SRscpValue battery;
+		protocol.createContainerValue(&battery, TAG_BAT_REQ_DATA);
+		protocol.appendValue(&battery, TAG_BAT_INDEX, devices.batteries[i].first);
+		protocol.appendValue(&battery, TAG_BAT_REQ_RSOC);
+		protocol.appendValue(&battery, TAG_BAT_REQ_MODULE_VOLTAGE);
+		protocol.appendValue(&battery, TAG_BAT_REQ_CURRENT);
+		protocol.appendValue(&battery, TAG_BAT_REQ_CHARGE_CYCLES);
+		protocol.appendValue(&battery, TAG_BAT_REQ_TRAINING_MODE);
+		protocol.appendValue(root, battery);
+		protocol.destroyValueData(battery);
+	}
+	SRscpValue pvi;
+	protocol.createContainerValue(&pvi, TAG_PVI_REQ_DATA);
+	protocol.appendValue(&pvi, TAG_PVI_INDEX, (uint8_t)0);
+	protocol.appendValue(&pvi, TAG_PVI_REQ_ON_GRID);
+	protocol.appendValue(&pvi, TAG_PVI_REQ_SYSTEM_MODE);
+	for(uint8_t i = 0; i < devices.pviPhases; ++i) {
+		protocol.appendValue(&pvi, TAG_PVI_REQ_AC_POWER, i);
+		protocol.appendValue(&pvi, TAG_PVI_REQ_AC_VOLTAGE, i);
+		protocol.appendValue(&pvi, TAG_PVI_REQ_AC_CURRENT, i);
+		protocol.appendValue(&pvi, TAG_PVI_REQ_AC_APPARENTPOWER, i);
+		protocol.appendValue(&pvi, TAG_PVI_REQ_AC_REACTIVEPOWER, i);
+	}
+	for(uint8_t i = 0; i < devices.pviStrings; ++i) {
+		protocol.appendValue(&pvi, TAG_PVI_REQ_DC_POWER, i);
+		protocol.appendValue(&pvi, TAG_PVI_REQ_DC_VOLTAGE, i);
+		protocol.appendValue(&pvi, TAG_PVI_REQ_DC_CURRENT, i);
+		protocol.appendValue(&pvi, TAG_PVI_REQ_DC_STRING_ENERGY_ALL, i);
+	}
+	for(uint8_t i = 0; i < devices.pviTemperatures; ++i) {
+		protocol.appendValue(&pvi, TAG_PVI_REQ_TEMPERATURE, i);
+	}
+	protocol.appendValue(root, pvi);
+	protocol.destroyValueData(pvi);
+	const SRscpTag dcdcRequests[] = { TAG_DCDC_REQ_I_BAT, TAG_DCDC_REQ_U_BAT, TAG_DCDC_REQ_P_BAT, TAG_DCDC_REQ_I_DCL, TAG_DCDC_REQ_U_DCL,
+			TAG_DCDC_REQ_P_DCL, TAG_DCDC_REQ_STATUS };
+	for(size_t i = 0; i < devices.dcdcs.size(); ++i) {
+		SRscpValue dcdc;
+		protocol.createContainerValue(&dcdc, TAG_DCDC_REQ_DATA);
+		protocol.appendValue(&dcdc, TAG_DCDC_INDEX, devices.dcdcs[i]);
+		for(size_t n = 0; n < sizeof(dcdcRequests) / sizeof(dcdcRequests[0]); ++n) {
+			protocol.appendValue(&dcdc, dcdcRequests[n]);
+		}
+		protocol.appendValue(root, dcdc);
+		protocol.destroyValueData(dcdc);
+	}
+	const SRscpTag pmRequests[] = { TAG_PM_REQ_DEVICE_STATE, TAG_PM_REQ_ACTIVE_PHASES, TAG_PM_REQ_POWER_L1, TAG_PM_REQ_POWER_L2,
+			TAG_PM_REQ_POWER_L3, TAG_PM_REQ_VOLTAGE_L1, TAG_PM_REQ_VOLTAGE_L2, TAG_PM_REQ_VOLTAGE_L3, TAG_PM_REQ_ENERGY_L1,
+			TAG_PM_REQ_ENERGY_L2, TAG_PM_REQ_ENERGY_L3 };
+	for(size_t i = 0; i < devices.powerMeters.size(); ++i) {
+		SRscpValue pm;
+		protocol.createContainerValue(&pm, TAG_PM_REQ_DATA);
+		protocol.appendValue(&pm, TAG_PM_INDEX, devices.powerMeters[i]);
+		for(size_t n = 0; n < sizeof(pmRequests) / sizeof(pmRequests[0]); ++n) {
+			protocol.appendValue(&pm, pmRequests[n]);
+		}
+		protocol.appendValue(root, pm);
+		protocol.destroyValueData(pm);
+	}
+	const SRscpTag wbRequests[] = { TAG_WB_REQ_PM_ACTIVE_PHASES, TAG_WB_REQ_PM_POWER_L1, TAG_WB_REQ_PM_POWER_L2, TAG_WB_REQ_PM_POWER_L3,
+			TAG_WB_REQ_EXTERN_DATA_SUN, TAG_WB_REQ_EXTERN_DATA_NET, TAG_WB_REQ_EXTERN_DATA_ALL };
+	for(size_t i = 0; i < devices.wallboxes.size(); ++i) {
+		SRscpValue wb;
+		protocol.createContainerValue(&wb, TAG_WB_REQ_DATA);
+		protocol.appendValue(&wb, TAG_WB_INDEX, devices.wallboxes[i]);
+		for(size_t n = 0; n < sizeof(wbRequests) / sizeof(wbRequests[0]); ++n) {
+			protocol.appendValue(&wb, wbRequests[n]);
+		}
+		protocol.appendValue(root, wb);
+		protocol.destroyValueData(wb);
+	}
+}
+
+/*
+ * \brief Creation of the values of the poll request: appended value by value compared to the byte images which are
+ *        computed at compile time (RscpRequestImage.h). Both must create the same bytes for every topology.
+ */
+static void benchRequest(void)
+{
+	RscpProtocol protocol;
+	SRscpTopology devices;
+	devices.battery = true;
+	devices.pviStrings = 2;
+	devices.pviTemperatures = 2;
+	devices.powerMeters.push_back(0);
+	devices.powerMeters.push_back(6);
+	devices.wallboxes.push_back(0);
+
+	// every combination of the optional parts of the request
+	bool bEqual = true;
+	for(int i = 0; i < 32; ++i) {
+		SRscpTopology variant;
+		variant.battery = (i & 1) != 0;
+		variant.batteries.clear();
+		variant.dcdcs.clear();
+		if(i & 1) {
+			variant.batteries.push_back(std::make_pair((uint8_t)0, (uint8_t)3));
+			variant.batteries.push_back(std::make_pair((uint8_t)2, (uint8_t)3));
+			variant.dcdcs.push_back(0);
+			variant.dcdcs.push_back(2);
+		}
+		variant.pviStrings = (i & 2) ? 3 : 0;
+		variant.pviPhases = (i & 2) ? 1 : 3;
+		variant.pviTemperatures = (i & 2) ? 0 : 4;
+		if(i & 4) {
+			variant.powerMeters = devices.powerMeters;
+		}
+		if(i & 16) {
+			variant.wallboxes.push_back(0);
+			variant.wallboxes.push_back(2);
+		}
+		SRscpValue root;
+		appendPollRequest(protocol, &root, variant, (i & 8) != 0);
+		std::vector<uint8_t> data;
+		bEqual &= (createPollRequest(data, variant, (i & 8) != 0) == RSCP::OK);
+		bEqual &= (data.size() == root.length && memcmp(data.data(), root.data, root.length) == 0);
+		protocol.destroyValueData(root);
+	}
+	if(!bEqual) {
+		printf("The byte images of the poll request differ from the appended values\n");
+		exit(EXIT_FAILURE);
+	}
+
+	std::vector<uint8_t> data;
+	createPollRequest(data, devices, true);
+	bench("request/poll_append", data.size(), [&]() {
+		SRscpValue root;
+		appendPollRequest(protocol, &root, devices, true);
+		protocol.destroyValueData(root);
+	});
+	bench("request/poll_image", data.size(), [&]() {
+		createPollRequest(data, devices, true);
+	});
+}
+
+// response of the device to a wallbox setpoint, accepted or answered with an error
+static std::vector<uint8_t> createSetExternResponse(uint8_t index, bool accepted)
+{
+	RscpProtocol protocol;
+	SRscpValue root, wb;
+	protocol.createContainerValue(&root, 0);
+	protocol.createContainerValue(&wb, TAG_WB_DATA);
+	protocol.appendValue(&wb, TAG_WB_INDEX, index);
+	if(accepted) {
+		protocol.appendValue(&wb, TAG_WB_SET_EXTERN, true);
+	}
+	else {
+		protocol.appendErrorValue(&wb, TAG_WB_SET_EXTERN, RSCP_ERR_ACCESS_DENIED);
+	}
+	protocol.appendValue(&root, wb);
+	protocol.destroyValueData(wb);
+	std::vector<uint8_t> frame = createFrame(root);
+	protocol.destroyValueData(root);
+	return frame;
+}
+
+/*
+ * \brief Solar surplus control of a wallbox: the charge current of a surplus, the setpoints of a sequence of samples,
+ *        the patched request image compared to the appended values and the handling of the acknowledgement.
+ */
+static void checkWallbox(void)
+{
+	bool bValid = true;
+	const struct {
+		int32_t surplus;
+		uint8_t phases;
+		uint8_t current;
+	} currents[] = {
+		{ -500, 3, 0 }, { 0, 1, 0 }, { 1379, 1, 0 }, { 1380, 1, 6 }, { 3000, 1, 13 }, { 4600, 1, 16 }, { 4139, 3, 0 },
+		{ 4140, 3, 6 }, { 11040, 3, 16 }, { 20000, 3, 16 },
+	};
+	for(size_t i = 0; i < sizeof(currents) / sizeof(currents[0]); ++i) {
+		uint8_t ucCurrent = RscpWallboxControl::chargeCurrent(currents[i].surplus, currents[i].phases, 6, 16);
+		if(ucCurrent != currents[i].current) {
+			printf("Wallbox current of %i W on %u phases is %u A instead of %u A\n", currents[i].surplus, currents[i].phases,
+					ucCurrent, currents[i].current);
+			bValid = false;
+		}
+	}
+
+	// surplus 4000 + 200 - 1200 - 200 = 2800 W on one phase
+	RscpWallboxControl control(2, 200, 6, 16);
+	control.setActivePhases(0, 7);
+	control.setActivePhases(2, 1);
+	control.beginSample(1000);
+	control.setPower(TAG_EMS_POWER_PV, 4000);
+	control.setPower(TAG_EMS_POWER_ADD, 200);
+	control.setPower(TAG_EMS_POWER_HOME, 1200);
+	control.setPower(TAG_EMS_POWER_GRID, -3000);
+	SRscpWallboxSetpoint setpoint;
+	bValid &= control.endSample() && control.takeSetpoint(setpoint);
+	bValid &= (setpoint.index == 2 && setpoint.current == 12 && setpoint.surplus == 2800 && setpoint.sampled == 1000);
+
+	RscpProtocol protocol;
+	SRscpValue root, wb, setExtern;
+	const uint8_t ucExternData[RSCP_WALLBOX_EXTERN_DATA_SIZE] = { RSCP_WALLBOX_MODE_SUN, 12, 0, 0, 0, 0 };
+	protocol.createContainerValue(&root, 0);
+	protocol.createContainerValue(&wb, TAG_WB_REQ_DATA);
+	protocol.appendValue(&wb, TAG_WB_INDEX, (uint8_t)2);
+	protocol.createContainerValue(&setExtern, TAG_WB_REQ_SET_EXTERN);
+	protocol.appendValue(&setExtern, TAG_WB_EXTERN_DATA, ucExternData, sizeof(ucExternData));
+	protocol.appendValue(&setExtern, TAG_WB_EXTERN_DATA_LEN, (uint8_t)RSCP_WALLBOX_EXTERN_DATA_SIZE);
+	protocol.appendValue(&wb, setExtern);
+	protocol.appendValue(&root, wb);
+	uint16_t uiLength = 0;
+	const uint8_t *request = control.createRequest(setpoint, uiLength);
+	bValid &= (uiLength == root.length) && equalBytes(request, root.data, root.length, "TAG_WB_REQ_SET_EXTERN");
+	protocol.destroyValueData(setExtern);
+	protocol.destroyValueData(wb);
+	protocol.destroyValueData(root);
+
+	// the same current is not sent again, a sample without the home consumption keeps the current
+	std::vector<uint8_t> accepted = createSetExternResponse(2, true);
+	bValid &= (control.handleResponse(accepted.data(), accepted.size(), setpoint) > 0) && control.accepted() == 1;
+	control.beginSample(2000);
+	control.setPower(TAG_EMS_POWER_PV, 4100);
+	control.setPower(TAG_EMS_POWER_ADD, 200);
+	control.setPower(TAG_EMS_POWER_HOME, 1200);
+	bValid &= !control.endSample() && !control.takeSetpoint(setpoint);
+	control.beginSample(3000);
+	control.setPower(TAG_EMS_POWER_PV, 0);
+	control.setPower(TAG_EMS_POWER_ADD, 0);
+	bValid &= !control.endSample() && control.current() == 12;
+
+	// a rejected setpoint is sent again with the next sample
+	std::vector<uint8_t> rejected = createSetExternResponse(2, false);
+	bValid &= (control.handleResponse(rejected.data(), rejected.size(), setpoint) > 0) && control.rejected() == 1;
+	control.beginSample(4000);
+	control.setPower(TAG_EMS_POWER_PV, 4100);
+	control.setPower(TAG_EMS_POWER_ADD, 200);
+	control.setPower(TAG_EMS_POWER_HOME, 1200);
+	bValid &= control.endSample() && control.takeSetpoint(setpoint) && setpoint.current == 12 && control.setpoints() == 2;
+	if(!bValid) {
+		printf("The solar surplus control of the wallbox failed\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * \brief Decode thread part of the surplus control for every sample and the request of a changed setpoint.
+ */
+static void benchWallbox(void)
+{
+	RscpWallboxControl control(0, 0, 6, 16);
+	control.setActivePhases(0, 1);
+	int32_t iPower = 0;
+	bench("wallbox/sample_setpoint", 0, [&]() {
+		control.beginSample(0);
+		control.setPower(TAG_EMS_POWER_PV, iPower);
+		control.setPower(TAG_EMS_POWER_ADD, 0);
+		control.setPower(TAG_EMS_POWER_HOME, 400);
+		control.endSample();
+		SRscpWallboxSetpoint setpoint;
+		if(control.takeSetpoint(setpoint)) {
+			uint16_t uiLength;
+			control.createRequest(setpoint, uiLength);
+		}
+		iPower = (iPower + 97) % 5000;
+	});
+}
+
+/*
+ * \brief Energy counters: the energy of completed intervals, a rollover at the modulus, a reset of a meter, a clock
+ *        which goes back, a gap of several intervals and more power meters than are tracked.
+ */
+static void checkEnergyCounters(void)
+{
+	bool bValid = true;
+	// counters of 1000 Wh, 100 s intervals
+	RscpEnergyCounters counters(100, 1000.0);
+	counters.setTime(1050);
+	counters.setCounter(3, 0, 990.0);
+	counters.setCounter(3, 1, 500.0);
+	counters.setCounter(3, 2, 10.0);
+	bValid &= (counters.meter(0).used && counters.meter(0).index == 3 && counters.meter(0).open[0] == 0);
+	counters.setTime(1080);
+	counters.setCounter(3, 0, 995.5);
+	// the first counter rolled over, the third one fell by less than the half modulus: the meter was reset
+	counters.setTime(1120);
+	counters.setCounter(3, 0, 2.25);
+	counters.setCounter(3, 1, 500.125);
+	counters.setCounter(3, 2, 4.0);
+	bValid &= (counters.completedStart() == 1000 && counters.meter(0).completed[0] == 5500);
+	bValid &= (counters.meter(0).completedIncomplete && counters.meter(0).openIncomplete);
+	bValid &= (counters.meter(0).open[0] == 6750 && counters.meter(0).open[1] == 125 && counters.meter(0).open[2] == 0);
+	bValid &= (counters.meter(0).rollovers == 1 && counters.meter(0).resets == 1);
+	// a clock which goes back keeps the open interval
+	counters.setTime(1090);
+	counters.setTime(1130);
+	counters.setCounter(3, 2, 6.0);
+	bValid &= (counters.completedStart() == 1000 && counters.meter(0).open[2] == 2000);
+	// a gap of several intervals completes the open one, the difference across the gap is not assigned
+	counters.setTime(1420);
+	bValid &= (counters.completedStart() == 1100 && counters.meter(0).completed[0] == 6750 && counters.meter(0).open[0] == 0);
+	counters.setCounter(3, 0, 100.0);
+	counters.setCounter(3, 0, 100.5);
+	bValid &= (counters.meter(0).open[0] == 500 && counters.meter(0).openIncomplete);
+	counters.setTime(1510);
+	counters.setCounter(3, 0, 101.0);
+	counters.setTime(1600);
+	bValid &= (counters.completedStart() == 1500 && counters.meter(0).completed[0] == 500 && !counters.meter(0).completedIncomplete);
+	for(uint8_t i = 0; i < RSCP_ENERGY_MAX_METERS + 2; ++i) {
+		counters.setCounter(10 + i, 0, 1.0);
+	}
+	bValid &= (counters.meter(RSCP_ENERGY_MAX_METERS - 1).index == 10 + RSCP_ENERGY_MAX_METERS - 2);
+	bValid &= (RscpEnergyCounters::delta(100, 40, 0) < 0 && RscpEnergyCounters::delta(900000, 100000, 1000000) == 200000);
+	if(!bValid) {
+		printf("The energy counters failed\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * \brief The counters of two power meters with three phases per sample.
+ */
+static void benchEnergyCounters(void)
+{
+	RscpEnergyCounters counters(300, 0.0);
+	int64_t iTime = 1532904452;
+	double dEnergy = 1250000.0;
+	bench("energy/sample_counters", 0, [&]() {
+		counters.setTime(iTime++);
+		for(uint8_t meter = 0; meter < 2; ++meter) {
+			for(uint8_t phase = 0; phase < RSCP_ENERGY_PHASES; ++phase) {
+				counters.setCounter(meter, phase, dEnergy + phase);
+			}
+		}
+		dEnergy += 0.125;
+	});
+}
+
+// module container of a battery detail response, the index follows the values if \var indexLast is set
+static void appendDcbResponse(RscpProtocol & protocol, SRscpValue * battery, SRscpTag tag, uint16_t dcb, uint32_t cells, bool indexLast)
+{
+	SRscpValue module, data;
+	protocol.createContainerValue(&module, tag);
+	if(!indexLast) {
+		protocol.appendValue(&module, TAG_BAT_DCB_INDEX, dcb);
+	}
+	if(tag == TAG_BAT_DCB_INFO) {
+		protocol.appendValue(&module, TAG_BAT_DCB_SOC, 50.0f + dcb);
+		protocol.appendValue(&module, TAG_BAT_DCB_SOH, 97.5f);
+		protocol.appendValue(&module, TAG_BAT_DCB_CYCLE_COUNT, (uint32_t)160);
+		protocol.appendValue(&module, TAG_BAT_DCB_VOLTAGE, 52.0f);
+		protocol.appendValue(&module, TAG_BAT_DCB_CURRENT, -3.5f);
+		protocol.appendValue(&module, TAG_BAT_DCB_FULL_CHARGE_CAPACITY, 56.0f);
+		protocol.appendValue(&module, TAG_BAT_DCB_REMAINING_CAPACITY, 28.0f);
+		protocol.appendValue(&module, TAG_BAT_DCB_NR_SERIES_CELL, (uint16_t)cells);
+		protocol.appendValue(&module, TAG_BAT_DCB_MANUFACTURE_DATE, (uint64_t)0);
+	}
+	else {
+		bool bVoltages = (tag == TAG_BAT_DCB_ALL_CELL_VOLTAGES);
+		protocol.createContainerValue(&data, TAG_BAT_DATA);
+		for(uint32_t cell = 0; cell < cells; ++cell) {
+			protocol.appendValue(&data, bVoltages ? TAG_BAT_DCB_CELL_VOLTAGE : TAG_BAT_DCB_CELL_TEMPERATURE,
+					bVoltages ? 3.2f + 0.001f * (dcb * 100 + cell) : 20.0f + 0.1f * (dcb * 100 + cell));
+		}
+		protocol.appendValue(&module, data);
+		protocol.destroyValueData(data);
+	}
+	if(indexLast) {
+		protocol.appendValue(&module, TAG_BAT_DCB_INDEX, dcb);
+	}
+	protocol.appendValue(battery, module);
+	protocol.destroyValueData(module);
+}
+
+// response to a battery detail round: every module of \var batteries with \var cells cell voltages and half as many temperatures
+static std::vector<uint8_t> createBatteryDetailResponse(const std::vector<std::pair<uint8_t, uint8_t> > & batteries, uint32_t cells)
+{
+	RscpProtocol protocol;
+	SRscpValue root, battery, info;
+	protocol.createContainerValue(&root, 0);
+	for(size_t b = 0; b < batteries.size(); ++b) {
+		protocol.createContainerValue(&battery, TAG_BAT_DATA);
+		protocol.appendValue(&battery, TAG_BAT_INDEX, (uint16_t)batteries[b].first);
+		protocol.appendValue(&battery, TAG_BAT_DCB_COUNT, batteries[b].second);
+		protocol.appendValue(&battery, TAG_BAT_MAX_DCB_CELL_TEMPERATURE, 31.5f);
+		protocol.appendValue(&battery, TAG_BAT_MIN_DCB_CELL_TEMPERATURE, 20.0f);
+		protocol.createContainerValue(&info, TAG_BAT_INFO);
+		protocol.appendValue(&info, TAG_BAT_RSOC, 55.0f);
+		protocol.appendValue(&info, TAG_BAT_CHARGE_CYCLES, (uint32_t)167);
+		protocol.appendValue(&info, TAG_BAT_DEVICE_NAME, "BAT");
+		protocol.appendValue(&battery, info);
+		protocol.destroyValueData(info);
+		for(uint8_t dcb = 0; dcb < batteries[b].second; ++dcb) {
+			appendDcbResponse(protocol, &battery, TAG_BAT_DCB_INFO, dcb, cells, false);
+			appendDcbResponse(protocol, &battery, TAG_BAT_DCB_ALL_CELL_TEMPERATURES, dcb, cells / 2, false);
+			appendDcbResponse(protocol, &battery, TAG_BAT_DCB_ALL_CELL_VOLTAGES, dcb, cells, false);
+		}
+		protocol.appendValue(&root, battery);
+		protocol.destroyValueData(battery);
+	}
+	std::vector<uint8_t> frame = createFrame(root);
+	protocol.destroyValueData(root);
+	return frame;
+}
+
+// requests of every module and every battery inside the request frames of a battery detail round
+class RscpBatteryRequestCounter : public RscpVisitor {
+public:
+	RscpBatteryRequestCounter() : batteries(0), modules(0) {}
+	void value(const SRscpValue & value, uint32_t depth) {
+		batteries += (value.tag == TAG_BAT_REQ_INFO);
+		modules += (value.tag == TAG_BAT_REQ_DCB_ALL_CELL_VOLTAGES);
+	}
+	uint32_t batteries;
+	uint32_t modules;
+};
+
+/*
+ * \brief Battery detail: the batches of the requests, the columns of a decoded response including values in an
+ *        unexpected order, cells beyond RSCP_BATTERY_MAX_CELLS and modules which are not in the layout.
+ */
+static void checkBatteryDetail(void)
+{
+	bool bValid = true;
+	std::vector<std::pair<uint8_t, uint8_t> > layout;
+	layout.push_back(std::make_pair((uint8_t)0, (uint8_t)3));
+	layout.push_back(std::make_pair((uint8_t)1, (uint8_t)2));
+
+	// 5 modules in batches of 2, the battery values are requested once per battery
+	RscpProtocol protocol;
+	std::vector<std::vector<uint8_t> > requests;
+	bValid &= (RscpBatteryDetail::createRequests(layout, 2, requests) == RSCP::OK) && requests.size() == 3;
+	RscpBatteryRequestCounter total;
+	for(size_t i = 0; i < requests.size(); ++i) {
+		RscpBatteryRequestCounter counter;
+		bValid &= (protocol.visitData(requests[i].data(), requests[i].size(), counter) == (int32_t)requests[i].size());
+		bValid &= (counter.modules == ((i < 2) ? 2u : 1u));
+		total.batteries += counter.batteries;
+		total.modules += counter.modules;
+	}
+	bValid &= (total.batteries == 2 && total.modules == 5);
+
+	RscpBatteryDetail detail;
+	detail.setLayout(layout);
+	SRscpValue root, battery;
+	protocol.createContainerValue(&root, 0);
+	protocol.createContainerValue(&battery, TAG_BAT_DATA);
+	protocol.appendValue(&battery, TAG_BAT_INDEX, (uint16_t)0);
+	protocol.appendValue(&battery, TAG_BAT_DCB_COUNT, (uint8_t)3);
+	protocol.appendValue(&battery, TAG_BAT_MAX_DCB_CELL_TEMPERATURE, 31.5f);
+	appendDcbResponse(protocol, &battery, TAG_BAT_DCB_INFO, 0, 16, true);
+	appendDcbResponse(protocol, &battery, TAG_BAT_DCB_ALL_CELL_VOLTAGES, 0, 16, true);
+	appendDcbResponse(protocol, &battery, TAG_BAT_DCB_ALL_CELL_VOLTAGES, 1, RSCP_BATTERY_MAX_CELLS + 6, false);
+	protocol.appendErrorValue(&battery, TAG_BAT_DCB_INFO, RSCP_ERR_NOT_AVAILABLE);
+	appendDcbResponse(protocol, &battery, TAG_BAT_DCB_ALL_CELL_TEMPERATURES, 7, 8, false);
+	protocol.appendValue(&root, battery);
+	protocol.destroyValueData(battery);
+	protocol.createContainerValue(&battery, TAG_BAT_DATA);
+	protocol.appendValue(&battery, TAG_BAT_INDEX, (uint16_t)3);
+	protocol.appendValue(&battery, TAG_BAT_DCB_COUNT, (uint8_t)1);
+	protocol.appendValue(&root, battery);
+	protocol.destroyValueData(battery);
+	std::vector<uint8_t> frame = createFrame(root);
+	protocol.destroyValueData(root);
+
+	bValid &= RscpBatteryDetail::isResponse(frame.data(), frame.size());
+	bValid &= (detail.handleFrame(frame.data(), frame.size(), 1000) > 0);
+	const SRscpBatteryModule & first = detail.module(0);
+	const SRscpBatteryModule & second = detail.module(1);
+	SRscpTag tag = 0;
+	bValid &= (detail.battery(0).values[0] == 3 && detail.battery(0).values[1] == 31.5 && detail.battery(1).updated == 0);
+	bValid &= (first.dcb == 0 && first.updated == 1000 && first.voltages == 16 && first.values[0] == 50.0);
+	bValid &= (RscpBatteryDetail::moduleField(10, &tag) != NULL && tag == TAG_BAT_DCB_NR_SERIES_CELL && first.values[10] == 16);
+	bValid &= (second.voltages == RSCP_BATTERY_MAX_CELLS && second.temperatures == 0 && detail.dropped() == 6);
+	// the columns hold the modules one behind the other
+	bValid &= (detail.cellVoltages(1) == detail.cellVoltages(0) + RSCP_BATTERY_MAX_CELLS);
+	bValid &= (detail.cellVoltages(0)[15] == 3.2f + 0.001f * 15 && detail.cellVoltages(1)[63] == 3.2f + 0.001f * 163);
+	// the error of TAG_BAT_DCB_INFO, module 7 and battery 3 are not in the layout
+	bValid &= (detail.errors() == 3 && detail.frames() == 1 && !detail.complete());
+
+	std::vector<uint8_t> roundFrame = createBatteryDetailResponse(layout, 16);
+	bValid &= (detail.handleFrame(roundFrame.data(), roundFrame.size(), 2000) > 0) && detail.complete();
+	bValid &= (detail.module(4).battery == 1 && detail.module(4).dcb == 1 && detail.module(4).temperatures == 8);
+	if(!bValid) {
+		printf("The battery detail failed\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * \brief Decoding of the battery detail response of two batteries with 8 modules of 16 cells into the columns.
+ */
+static void benchBatteryDetail(const std::vector<uint8_t> & pollFrame)
+{
+	std::vector<std::pair<uint8_t, uint8_t> > layout;
+	layout.push_back(std::make_pair((uint8_t)0, (uint8_t)8));
+	layout.push_back(std::make_pair((uint8_t)1, (uint8_t)8));
+	std::vector<uint8_t> frame = createBatteryDetailResponse(layout, 16);
+	RscpBatteryDetail detail;
+	detail.setLayout(layout);
+	if(RscpBatteryDetail::isResponse(pollFrame.data(), pollFrame.size())) {
+		printf("The poll response is taken as battery detail response\n");
+		exit(EXIT_FAILURE);
+	}
+	bench("battery/detail_decode", frame.size(), [&]() {
+		detail.handleFrame(frame.data(), frame.size(), 0);
+	});
+}
+
+int main(int argc, char *argv[])
+{
+	for(int i = 1; i < argc; ++i) {
+		if(strcmp(argv[i], "--json") == 0) {
+			bJsonOutput = true;
+		}
+		else if(strcmp(argv[i], "--time") == 0 && i + 1 < argc) {
+			iBatchNs = strtoll(argv[++i], NULL, 10) * 1000000;
+		}
+		else {
+			cFilter = argv[i];
+		}
+	}
+	RscpMetrics::registerThread("bench");
+
+	RscpProtocol protocol;
+	SRscpValue root;
+	createPollResponse(protocol, &root);
+	std::vector<uint8_t> pollFrame = createFrame(root);
+	protocol.destroyValueData(root);
+	createHistoryResponse(protocol, &root);
+	std::vector<uint8_t> historyFrame = createFrame(root);
+	protocol.destroyValueData(root);
+
+	checkCodec(pollFrame, historyFrame);
+	benchProtocol(pollFrame, historyFrame);
+	benchVisit(pollFrame, historyFrame);
+	benchCrypto(pollFrame, historyFrame);
+	benchReceive(pollFrame, historyFrame);
+	benchTransmit();
+	benchRequest();
+	checkWallbox();
+	benchWallbox();
+	checkBatteryDetail();
+	benchBatteryDetail(pollFrame);
+	checkEnergyCounters();
+	benchEnergyCounters();
+	return EXIT_SUCCESS;
+}
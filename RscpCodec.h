@@ -0,0 +1,197 @@
+/*
+ * RscpCodec.h
+ *
+ * Wire format of RSCP: every number is little endian and unaligned, a value starts with a header of 7 bytes (tag,
+ * data type, length of the data) and a frame with a header of 18 bytes (magic, control word, timestamp, length of
+ * the values). The functions load and store the fields byte by byte instead of casting the wire bytes to the
+ * structs of RscpTypes.h, so the result does not depend on the layout of the structs, the size of a pointer or
+ * the byte order of the host. On a little endian host the compiler turns every load and store into a single move.
+ */
+
+#ifndef RSCPCODEC_H_
+#define RSCPCODEC_H_
+
+#include <stdint.h>
+#include <string.h>
+#include "RscpTypes.h"
+
+/*
+ * Bytes of a value header on the wire: tag (4), data type (1) and length (2).
+ */
+#define RSCP_VALUE_HEADER_SIZE      7
+/*
+ * Bytes of a frame header on the wire: magic (2), control (2), seconds (8), nanoseconds (4) and length (2).
+ */
+#define RSCP_FRAME_HEADER_SIZE      18
+/*
+ * Bytes of the CRC32 behind the values of a frame.
+ */
+#define RSCP_CRC_SIZE               4
+/*
+ * Fields of the control word of a frame.
+ */
+#define RSCP_CTRL_VERSION_SHIFT     8
+#define RSCP_CTRL_VERSION_MASK      0x0F00
+#define RSCP_CTRL_CRC               0x1000
+
+namespace RscpCodec {
+
+inline uint16_t load16(const uint8_t *p) {
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+inline uint32_t load32(const uint8_t *p) {
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+inline uint64_t load64(const uint8_t *p) {
+	return (uint64_t)load32(p) | ((uint64_t)load32(p + 4) << 32);
+}
+
+inline void store16(uint8_t *p, uint16_t value) {
+	p[0] = (uint8_t)value;
+	p[1] = (uint8_t)(value >> 8);
+}
+
+inline void store32(uint8_t *p, uint32_t value) {
+	p[0] = (uint8_t)value;
+	p[1] = (uint8_t)(value >> 8);
+	p[2] = (uint8_t)(value >> 16);
+	p[3] = (uint8_t)(value >> 24);
+}
+
+inline void store64(uint8_t *p, uint64_t value) {
+	store32(p, (uint32_t)value);
+	store32(p + 4, (uint32_t)(value >> 32));
+}
+
+/*
+ * \brief Data of a value of type \var T, only the types of RSCP values are defined. \var p holds sizeof(T) bytes.
+ */
+template<class T> T load(const uint8_t *p);
+template<class T> void store(uint8_t *p, const T & value);
+
+template<> inline bool load<bool>(const uint8_t *p) { return p[0] != 0; }
+template<> inline int8_t load<int8_t>(const uint8_t *p) { return (int8_t)p[0]; }
+template<> inline char load<char>(const uint8_t *p) { return (char)p[0]; }
+template<> inline uint8_t load<uint8_t>(const uint8_t *p) { return p[0]; }
+template<> inline int16_t load<int16_t>(const uint8_t *p) { return (int16_t)load16(p); }
+template<> inline uint16_t load<uint16_t>(const uint8_t *p) { return load16(p); }
+template<> inline int32_t load<int32_t>(const uint8_t *p) { return (int32_t)load32(p); }
+template<> inline uint32_t load<uint32_t>(const uint8_t *p) { return load32(p); }
+template<> inline int64_t load<int64_t>(const uint8_t *p) { return (int64_t)load64(p); }
+template<> inline uint64_t load<uint64_t>(const uint8_t *p) { return load64(p); }
+template<> inline float load<float>(const uint8_t *p) {
+	uint32_t uiBits = load32(p);
+	float fValue;
+	memcpy(&fValue, &uiBits, sizeof(fValue));
+	return fValue;
+}
+template<> inline double load<double>(const uint8_t *p) {
+	uint64_t uiBits = load64(p);
+	double dValue;
+	memcpy(&dValue, &uiBits, sizeof(dValue));
+	return dValue;
+}
+template<> inline SRscpTimestamp load<SRscpTimestamp>(const uint8_t *p) {
+	SRscpTimestamp timestamp;
+	timestamp.seconds = load64(p);
+	timestamp.nanoseconds = load32(p + 8);
+	return timestamp;
+}
+
+template<> inline void store<bool>(uint8_t *p, const bool & value) { p[0] = value ? 1 : 0; }
+template<> inline void store<int8_t>(uint8_t *p, const int8_t & value) { p[0] = (uint8_t)value; }
+template<> inline void store<char>(uint8_t *p, const char & value) { p[0] = (uint8_t)value; }
+template<> inline void store<uint8_t>(uint8_t *p, const uint8_t & value) { p[0] = value; }
+template<> inline void store<int16_t>(uint8_t *p, const int16_t & value) { store16(p, (uint16_t)value); }
+template<> inline void store<uint16_t>(uint8_t *p, const uint16_t & value) { store16(p, value); }
+template<> inline void store<int32_t>(uint8_t *p, const int32_t & value) { store32(p, (uint32_t)value); }
+template<> inline void store<uint32_t>(uint8_t *p, const uint32_t & value) { store32(p, value); }
+template<> inline void store<int64_t>(uint8_t *p, const int64_t & value) { store64(p, (uint64_t)value); }
+template<> inline void store<uint64_t>(uint8_t *p, const uint64_t & value) { store64(p, value); }
+template<> inline void store<float>(uint8_t *p, const float & value) {
+	uint32_t uiBits;
+	memcpy(&uiBits, &value, sizeof(uiBits));
+	store32(p, uiBits);
+}
+template<> inline void store<double>(uint8_t *p, const double & value) {
+	uint64_t uiBits;
+	memcpy(&uiBits, &value, sizeof(uiBits));
+	store64(p, uiBits);
+}
+template<> inline void store<SRscpTimestamp>(uint8_t *p, const SRscpTimestamp & value) {
+	store64(p, value.seconds);
+	store32(p + 8, value.nanoseconds);
+}
+
+/*
+ * \brief Tag, data type and length of the value header at \var p (RSCP_VALUE_HEADER_SIZE bytes). The data of
+ *        \var value points behind the header into the same buffer, NULL if the value has no data.
+ */
+inline void readValueHeader(const uint8_t *p, SRscpValue & value) {
+	value.tag = load32(p);
+	value.dataType = p[4];
+	value.length = load16(p + 5);
+	value.data = (value.length > 0) ? (uint8_t *)(p + RSCP_VALUE_HEADER_SIZE) : NULL;
+}
+
+inline uint16_t valueLength(const uint8_t *p) {
+	return load16(p + 5);
+}
+
+inline void writeValueHeader(uint8_t *p, SRscpTag tag, uint8_t dataType, uint16_t length) {
+	store32(p, tag);
+	p[4] = dataType;
+	store16(p + 5, length);
+}
+
+/*
+ * \brief Header of the value \var value followed by its data, RSCP_VALUE_HEADER_SIZE + value.length bytes.
+ * @return - bytes written
+ */
+inline uint32_t writeValue(uint8_t *p, const SRscpValue & value) {
+	writeValueHeader(p, value.tag, value.dataType, value.length);
+	if(value.length > 0) {
+		memcpy(p + RSCP_VALUE_HEADER_SIZE, value.data, value.length);
+	}
+	return RSCP_VALUE_HEADER_SIZE + value.length;
+}
+
+/*
+ * \brief Frame header at \var p (RSCP_FRAME_HEADER_SIZE bytes) in host byte order.
+ */
+inline void readFrameHeader(const uint8_t *p, SRscpFrameHeader & header) {
+	header.magic = load16(p);
+	header.ctrl.value = load16(p + 2);
+	header.timestamp.seconds = load64(p + 4);
+	header.timestamp.nanoseconds = load32(p + 12);
+	header.dataLength = load16(p + 16);
+}
+
+inline void writeFrameHeader(uint8_t *p, const SRscpFrameHeader & header) {
+	store16(p, header.magic);
+	store16(p + 2, header.ctrl.value);
+	store64(p + 4, header.timestamp.seconds);
+	store32(p + 12, header.timestamp.nanoseconds);
+	store16(p + 16, header.dataLength);
+}
+
+/*
+ * \brief Control word of a frame of this protocol version, with or without CRC.
+ */
+inline uint16_t frameControl(bool crc) {
+	return (uint16_t)((RSCP::VERSION << RSCP_CTRL_VERSION_SHIFT) | (crc ? RSCP_CTRL_CRC : 0));
+}
+
+inline uint8_t frameVersion(const SRscpFrameHeader & header) {
+	return (uint8_t)((header.ctrl.value & RSCP_CTRL_VERSION_MASK) >> RSCP_CTRL_VERSION_SHIFT);
+}
+
+inline bool frameHasCRC(const SRscpFrameHeader & header) {
+	return (header.ctrl.value & RSCP_CTRL_CRC) != 0;
+}
+
+}
+
+#endif /* RSCPCODEC_H_ */
@@ -0,0 +1,310 @@
+/*
+ * RscpCommand.cpp
+ *
+ * Local command socket for setpoints which must reach the device without waiting for the next poll cycle.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "RscpCommand.h"
+#include "RscpTags.h"
+#include "RscpMetrics.h"
+#include "json.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+int64_t monotonicNs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+std::string tagName(const SRscpTag & tag) {
+	char cName[11];
+	snprintf(cName, sizeof(cName), "0x%08X", tag);
+	return cName;
+}
+
+json valueAsJson(RscpProtocol *protocol, const SRscpValue *value) {
+	switch(value->dataType) {
+	case RSCP::eTypeBool:
+		return protocol->getValueAsBool(value);
+	case RSCP::eTypeChar8:
+		return protocol->getValueAsChar8(value);
+	case RSCP::eTypeUChar8:
+		return protocol->getValueAsUChar8(value);
+	case RSCP::eTypeInt16:
+		return protocol->getValueAsInt16(value);
+	case RSCP::eTypeUInt16:
+		return protocol->getValueAsUInt16(value);
+	case RSCP::eTypeInt32:
+		return protocol->getValueAsInt32(value);
+	case RSCP::eTypeUInt32:
+		return protocol->getValueAsUInt32(value);
+	case RSCP::eTypeInt64:
+		return protocol->getValueAsInt64(value);
+	case RSCP::eTypeUInt64:
+		return protocol->getValueAsUInt64(value);
+	case RSCP::eTypeFloat32:
+		return protocol->getValueAsFloat32(value);
+	case RSCP::eTypeDouble64:
+		return protocol->getValueAsDouble64(value);
+	case RSCP::eTypeString:
+		return protocol->getValueAsString(value);
+	case RSCP::eTypeError: {
+		json error;
+		error["error"] = protocol->getValueAsUInt32(value);
+		return error;
+	}
+	case RSCP::eTypeContainer: {
+		json container = json::object();
+		std::vector<SRscpValue> data = protocol->getValueAsContainer(value);
+		for(size_t i = 0; i < data.size(); ++i) {
+			container[tagName(data[i].tag)] = valueAsJson(protocol, &data[i]);
+		}
+		protocol->destroyValueData(data);
+		return container;
+	}
+	default:
+		return nullptr;
+	}
+}
+}
+
+RscpCommandServer::RscpCommandServer() :
+		listenSocket(-1), nextClientId(1) {
+}
+
+RscpCommandServer::~RscpCommandServer() {
+	close();
+}
+
+bool RscpCommandServer::open(const char *path) {
+	close();
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if(strlen(path) >= sizeof(addr.sun_path)) {
+		printf("Command socket path %s is too long\n", path);
+		return false;
+	}
+	strcpy(addr.sun_path, path);
+
+	listenSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if(listenSocket < 0) {
+		printf("Cannot create command socket. errno %i\n", errno);
+		return false;
+	}
+	unlink(path);
+	if(bind(listenSocket, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(listenSocket, RSCP_COMMAND_MAX_CLIENTS) < 0) {
+		printf("Cannot listen on command socket %s. errno %i\n", path, errno);
+		::close(listenSocket);
+		listenSocket = -1;
+		return false;
+	}
+	this->path = path;
+	return true;
+}
+
+void RscpCommandServer::close() {
+	for(size_t i = 0; i < clients.size(); ++i) {
+		::close(clients[i].socket);
+	}
+	clients.clear();
+	pending.clear();
+	if(listenSocket >= 0) {
+		::close(listenSocket);
+		unlink(path.c_str());
+		listenSocket = -1;
+	}
+}
+
+size_t RscpCommandServer::wait(int timeoutMs) {
+	if(!pending.empty()) {
+		timeoutMs = 0;
+	}
+	struct pollfd fds[RSCP_COMMAND_MAX_CLIENTS + 1];
+	nfds_t nfds = 0;
+	if(listenSocket >= 0) {
+		fds[nfds].fd = listenSocket;
+		fds[nfds].events = POLLIN;
+		++nfds;
+	}
+	for(size_t i = 0; i < clients.size(); ++i) {
+		fds[nfds].fd = clients[i].socket;
+		fds[nfds].events = POLLIN;
+		++nfds;
+	}
+	// without the command socket this is a plain sleep
+	int iResult = poll(fds, nfds, timeoutMs);
+	RscpMetrics::countSyscalls(1);
+	if(iResult <= 0) {
+		return pending.size();
+	}
+
+	// the client list is not changed before every polled client was read
+	size_t sFirstClient = (listenSocket >= 0) ? 1 : 0;
+	std::vector<SClient>::iterator it = clients.begin();
+	for(nfds_t n = sFirstClient; n < nfds; ++n) {
+		if((fds[n].revents != 0) && !readClient(*it)) {
+			::close(it->socket);
+			it = clients.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+	if((listenSocket >= 0) && (fds[0].revents & POLLIN)) {
+		acceptClients();
+	}
+	return pending.size();
+}
+
+bool RscpCommandServer::nextCommand(SRscpCommand & command) {
+	if(pending.empty()) {
+		return false;
+	}
+	command = pending.front();
+	pending.pop_front();
+	return true;
+}
+
+int32_t RscpCommandServer::appendRequest(RscpProtocol *protocol, SRscpValue *rootValue, const SRscpCommand & command) {
+	SRscpValue setPowerContainer;
+	int32_t iResult = protocol->createContainerValue(&setPowerContainer, TAG_EMS_REQ_SET_POWER);
+	if(iResult < 0) {
+		return iResult;
+	}
+	protocol->appendValue(&setPowerContainer, TAG_EMS_REQ_SET_POWER_MODE, command.mode);
+	protocol->appendValue(&setPowerContainer, TAG_EMS_REQ_SET_POWER_VALUE, command.value);
+	iResult = protocol->appendValue(rootValue, setPowerContainer);
+	protocol->destroyValueData(setPowerContainer);
+	return iResult;
+}
+
+bool RscpCommandServer::reply(RscpProtocol *protocol, const SRscpCommand & command, const std::vector<SRscpValue> & response) {
+	// a late response of an earlier request is no acknowledgement, even if it arrives first
+	bool bAnswered = false;
+	for(size_t i = 0; i < response.size(); ++i) {
+		bAnswered |= (response[i].tag == TAG_EMS_SET_POWER);
+	}
+	if(!bAnswered) {
+		return false;
+	}
+	json ack;
+	ack["command"] = "SET_POWER";
+	ack["mode"] = command.mode;
+	ack["value"] = command.value;
+	ack["status"] = "ok";
+	ack["response"] = json::object();
+	for(size_t i = 0; i < response.size(); ++i) {
+		if(response[i].dataType == RSCP::eTypeError) {
+			ack["status"] = "error";
+		}
+		ack["response"][tagName(response[i].tag)] = valueAsJson(protocol, &response[i]);
+	}
+	ack["latency_us"] = (monotonicNs() - command.received) / 1000.0;
+	sendLine(command.client, ack.dump());
+	return true;
+}
+
+void RscpCommandServer::replyError(const SRscpCommand & command, const char *error) {
+	json ack;
+	ack["status"] = "error";
+	ack["error"] = error;
+	ack["latency_us"] = (monotonicNs() - command.received) / 1000.0;
+	sendLine(command.client, ack.dump());
+}
+
+void RscpCommandServer::acceptClients() {
+	while(true) {
+		int iSocket = accept4(listenSocket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		RscpMetrics::countSyscalls(1);
+		if(iSocket < 0) {
+			return;
+		}
+		if(clients.size() >= RSCP_COMMAND_MAX_CLIENTS) {
+			printf("Too many command clients\n");
+			::close(iSocket);
+			continue;
+		}
+		SClient client;
+		client.socket = iSocket;
+		client.id = nextClientId++;
+		clients.push_back(client);
+	}
+}
+
+bool RscpCommandServer::readClient(SClient & client) {
+	char cBuffer[RSCP_COMMAND_MAX_LINE];
+	while(true) {
+		ssize_t iResult = recv(client.socket, cBuffer, sizeof(cBuffer), 0);
+		RscpMetrics::countSyscalls(1);
+		if(iResult == 0) {
+			return false;
+		}
+		if(iResult < 0) {
+			return (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR);
+		}
+		// all commands of this read share the receive time, which is the start of the latency measurement
+		int64_t received = monotonicNs();
+		client.line.append(cBuffer, iResult);
+		size_t sEnd;
+		while((sEnd = client.line.find('\n')) != std::string::npos) {
+			parseLine(client, client.line.substr(0, sEnd), received);
+			client.line.erase(0, sEnd + 1);
+		}
+		if(client.line.size() >= RSCP_COMMAND_MAX_LINE) {
+			printf("Command line too long\n");
+			return false;
+		}
+	}
+}
+
+void RscpCommandServer::parseLine(const SClient & client, const std::string & line, int64_t received) {
+	SRscpCommand command;
+	command.client = client.id;
+	command.received = received;
+
+	char cName[32];
+	int iMode = 0;
+	int iValue = 0;
+	int iEnd = -1;
+	// decimal fields only, %n is the end of the line if nothing but whitespace follows the value
+	int iFields = sscanf(line.c_str(), "%31s %d %d %n", cName, &iMode, &iValue, &iEnd);
+	if(iFields <= 0) {
+		// empty line
+		return;
+	}
+	if(strcmp(cName, "SET_POWER") != 0) {
+		replyError(command, "unknown command");
+		return;
+	}
+	if(iFields != 3 || iEnd < 0 || line[iEnd] != '\0' || iMode < 0 || iMode > 4) {
+		replyError(command, "usage: SET_POWER <mode 0-4> <value>");
+		return;
+	}
+	command.mode = iMode;
+	command.value = iValue;
+	pending.push_back(command);
+}
+
+void RscpCommandServer::sendLine(uint32_t client, const std::string & line) {
+	for(size_t i = 0; i < clients.size(); ++i) {
+		if(clients[i].id == client) {
+			std::string data = line + "\n";
+			// the acknowledge is small, a client which does not read it loses it
+			send(clients[i].socket, data.c_str(), data.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+			RscpMetrics::countSyscalls(1);
+			return;
+		}
+	}
+}
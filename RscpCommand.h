@@ -0,0 +1,95 @@
+/*
+ * RscpCommand.h
+ *
+ * Local command socket for setpoints which must reach the device without waiting for the next poll cycle.
+ * Clients connect to a unix domain socket and send one command per line:
+ *
+ *   SET_POWER <mode> <value>
+ *
+ * The command is sent as TAG_EMS_REQ_SET_POWER with TAG_EMS_REQ_SET_POWER_MODE and TAG_EMS_REQ_SET_POWER_VALUE
+ * on the established session. Every command is acknowledged with one json line containing the response of the
+ * device and the latency from receiving the command until the response of the device was decoded.
+ */
+
+#ifndef RSCPCOMMAND_H_
+#define RSCPCOMMAND_H_
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "RscpProtocol.h"
+
+/*
+ * Maximum number of clients connected to the command socket at the same time.
+ */
+#define RSCP_COMMAND_MAX_CLIENTS    8
+/*
+ * Maximum length of one command line.
+ */
+#define RSCP_COMMAND_MAX_LINE       256
+
+struct SRscpCommand {
+	// id of the client connection which sent the command
+	uint32_t client;
+	uint8_t mode;
+	int32_t value;
+	// monotonic time in ns when the command was read from the socket
+	int64_t received;
+};
+
+class RscpCommandServer {
+public:
+	RscpCommandServer();
+	virtual ~RscpCommandServer();
+	/*
+	 * \brief Create the unix domain socket \var path and listen for clients. An existing file is replaced.
+	 * @return - false if the socket could not be created, wait() then only sleeps
+	 */
+	bool open(const char *path);
+	void close();
+	/*
+	 * \brief Wait up to \var timeoutMs milliseconds for new clients and commands.
+	 *        Returns as soon as at least one command is pending.
+	 * @return - Number of pending commands
+	 */
+	size_t wait(int timeoutMs);
+	/*
+	 * \brief Take the oldest pending command.
+	 * @return - false if no command is pending
+	 */
+	bool nextCommand(SRscpCommand & command);
+	/*
+	 * \brief Append the request of \var command to \var rootValue.
+	 * @return - RSCP error code if the function fails else RSCP::OK
+	 */
+	int32_t appendRequest(RscpProtocol *protocol, SRscpValue *rootValue, const SRscpCommand & command);
+	/*
+	 * \brief Acknowledge \var command with the values of the device response \var response.
+	 * @return - false without an acknowledgement if \var response does not answer TAG_EMS_REQ_SET_POWER
+	 */
+	bool reply(RscpProtocol *protocol, const SRscpCommand & command, const std::vector<SRscpValue> & response);
+	/*
+	 * \brief Reject \var command with the message \var error.
+	 */
+	void replyError(const SRscpCommand & command, const char *error);
+private:
+	struct SClient {
+		int socket;
+		uint32_t id;
+		std::string line;
+	};
+
+	void acceptClients();
+	bool readClient(SClient & client);
+	void parseLine(const SClient & client, const std::string & line, int64_t received);
+	void sendLine(uint32_t client, const std::string & line);
+
+	int listenSocket;
+	std::string path;
+	uint32_t nextClientId;
+	std::vector<SClient> clients;
+	std::deque<SRscpCommand> pending;
+};
+
+#endif /* RSCPCOMMAND_H_ */
@@ -0,0 +1,101 @@
+/*
+ * RscpDecryptor.cpp
+ *
+ * Decryption of the frames received from a device in a single pass.
+ */
+
+#include <string.h>
+#include "RscpDecryptor.h"
+#include "RscpProtocol.h"
+
+/*
+ * Blocks which are decrypted before they are added to the CRC, they stay in the L1 cache in between.
+ */
+#define RSCP_DECRYPTOR_RUN_BLOCKS   16
+
+RscpDecryptor::RscpDecryptor(AES & aes) : aes(aes), frameLength(0), decrypted(0), crcEnd(0), crc(0), crcOffset(0) {
+	memset(chain, 0xff, sizeof(chain));
+	memset(frameCRC, 0, sizeof(frameCRC));
+}
+
+void RscpDecryptor::reset(const uint8_t *iv) {
+	memcpy(chain, iv, sizeof(chain));
+	nextFrame();
+}
+
+void RscpDecryptor::nextFrame() {
+	frameLength = 0;
+	decrypted = 0;
+	crcEnd = 0;
+	crc = 0;
+	crcOffset = 0;
+}
+
+void RscpDecryptor::decryptBlocks(const uint8_t *cipher, uint8_t *plain, uint32_t blocks) {
+	for(uint32_t n = 0; n < blocks; ++n) {
+		// CBC: the decrypted block is XORed with the previous cipher block
+		aes.DecryptBlock(cipher, plain);
+		for(uint32_t i = 0; i < RSCP_CIPHER_BLOCK_SIZE; ++i) {
+			plain[i] ^= chain[i];
+		}
+		memcpy(chain, cipher, RSCP_CIPHER_BLOCK_SIZE);
+		cipher += RSCP_CIPHER_BLOCK_SIZE;
+		plain += RSCP_CIPHER_BLOCK_SIZE;
+	}
+}
+
+int32_t RscpDecryptor::decrypt(const uint8_t *cipher, uint8_t *plain, uint32_t blocks) {
+	uint32_t done = 0;
+	if(blocks > 0 && frameLength == 0) {
+		// the first block of a frame holds its header
+		decryptBlocks(cipher, plain, 1);
+		RscpProtocol protocol;
+		int32_t iLength = protocol.getFrameLength(plain, RSCP_CIPHER_BLOCK_SIZE);
+		if(iLength < 0) {
+			return iLength;
+		}
+		SRscpFrameHeader header;
+		RscpCodec::readFrameHeader(plain, header);
+		crcOffset = RscpCodec::frameHasCRC(header) ? iLength - RSCP_CRC_SIZE : 0;
+		crcEnd = (crcOffset != 0) ? crcOffset : iLength;
+		frameLength = ROUNDUP(iLength, RSCP_CIPHER_BLOCK_SIZE);
+		done = 1;
+	}
+
+	// continue with runs of blocks up to the end of the frame, the first block of it is part of the first run
+	const uint8_t *crcData = plain;
+	uint32_t uiStart = decrypted;
+	decrypted += done * RSCP_CIPHER_BLOCK_SIZE;
+	while(frameLength > 0) {
+		uint32_t uiRun = (frameLength - decrypted) / RSCP_CIPHER_BLOCK_SIZE;
+		if(uiRun > blocks - done) {
+			uiRun = blocks - done;
+		}
+		if(uiRun > RSCP_DECRYPTOR_RUN_BLOCKS) {
+			uiRun = RSCP_DECRYPTOR_RUN_BLOCKS;
+		}
+		decryptBlocks(cipher + done * RSCP_CIPHER_BLOCK_SIZE, plain + done * RSCP_CIPHER_BLOCK_SIZE, uiRun);
+		done += uiRun;
+		decrypted += uiRun * RSCP_CIPHER_BLOCK_SIZE;
+
+		// the CRC covers the frame up to the CRC field, the field itself may be split over two calls
+		uint32_t uiEnd = (decrypted < crcEnd) ? decrypted : crcEnd;
+		if(uiStart < uiEnd) {
+			crc = RscpProtocol::updateCRC32(crc, crcData, uiEnd - uiStart);
+		}
+		for(uint32_t i = 0; crcOffset != 0 && i < sizeof(frameCRC); ++i) {
+			if(crcOffset + i >= uiStart && crcOffset + i < decrypted) {
+				frameCRC[i] = crcData[crcOffset + i - uiStart];
+			}
+		}
+		crcData += decrypted - uiStart;
+		uiStart = decrypted;
+		if(uiRun == 0 || complete()) {
+			break;
+		}
+	}
+	if(complete() && crcOffset != 0 && RscpCodec::load32(frameCRC) != crc) {
+		return RSCP::ERR_INVALID_CRC;
+	}
+	return done;
+}
@@ -0,0 +1,59 @@
+/*
+ * RscpDecryptor.h
+ *
+ * Decryption of the frames received from a device in a single pass. The cipher blocks are decrypted one by one
+ * and every short run of blocks is added to the CRC of its frame right after its decryption while it is in the L1 cache, so a
+ * frame is not read a second time to check its CRC. The first block holds the frame header, from then on the
+ * padded length of the frame is known and the decryption stops at the end of every frame.
+ */
+
+#ifndef RSCPDECRYPTOR_H_
+#define RSCPDECRYPTOR_H_
+
+#include <stdint.h>
+#include "AES.h"
+#include "RscpTypes.h"
+#include "RscpCodec.h"
+
+class RscpDecryptor {
+public:
+	/*
+	 * \brief \var aes must be prepared with StartDecryption and is only used for single blocks.
+	 */
+	explicit RscpDecryptor(AES & aes);
+	/*
+	 * \brief Start a new CBC chain with \var iv (RSCP_CIPHER_BLOCK_SIZE bytes) and a new frame.
+	 */
+	void reset(const uint8_t *iv);
+	/*
+	 * \brief Decrypt up to \var blocks blocks of \var cipher to \var plain, the blocks continue the previous call.
+	 *        Stops after the last block of the current frame.
+	 * @return - number of decrypted blocks, RSCP::ERR_* if the frame header is invalid or the CRC does not match
+	 */
+	int32_t decrypt(const uint8_t *cipher, uint8_t *plain, uint32_t blocks);
+	/*
+	 * \brief Padded length of the current frame, 0 as long as its first block was not decrypted.
+	 */
+	uint32_t frameBytes() const { return frameLength; }
+	/*
+	 * \brief True if every block of the current frame is decrypted and its CRC matches, call nextFrame() then.
+	 */
+	bool complete() const { return frameLength > 0 && decrypted == frameLength; }
+	void nextFrame();
+private:
+	void decryptBlocks(const uint8_t *cipher, uint8_t *plain, uint32_t blocks);
+
+	AES & aes;
+	// last cipher block, the IV of the next block
+	uint8_t chain[RSCP_CIPHER_BLOCK_SIZE];
+	// of the current frame: padded length, decrypted bytes, bytes covered by the CRC and the CRC so far
+	uint32_t frameLength;
+	uint32_t decrypted;
+	uint32_t crcEnd;
+	uint32_t crc;
+	// position of the CRC in the frame, 0 if the frame has none
+	uint32_t crcOffset;
+	uint8_t frameCRC[RSCP_CRC_SIZE];
+};
+
+#endif /* RSCPDECRYPTOR_H_ */
@@ -0,0 +1,89 @@
+/*
+ * RscpEnergyCounters.cpp
+ *
+ * Energy per interval from the energy counters of the power meters.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "RscpEnergyCounters.h"
+
+RscpEnergyCounters::RscpEnergyCounters(uint32_t intervalSeconds, double rolloverWh) :
+		intervalSeconds((intervalSeconds > 0) ? intervalSeconds : 1), rolloverMWh(llround(rolloverWh * 1000.0)),
+		openAt(0), completedAt(0) {
+	memset(meters, 0, sizeof(meters));
+}
+
+void RscpEnergyCounters::setTime(int64_t unixTime) {
+	int64_t start = unixTime - unixTime % intervalSeconds;
+	// a device clock which went back keeps the open interval
+	if(start <= openAt) {
+		return;
+	}
+	// the first sample only opens an interval
+	if(openAt != 0) {
+		// the difference across a gap belongs to the missing intervals, the next counters only start anew
+		bool bGap = (start != openAt + intervalSeconds);
+		for(size_t i = 0; i < RSCP_ENERGY_MAX_METERS; ++i) {
+			memcpy(meters[i].completed, meters[i].open, sizeof(meters[i].completed));
+			memset(meters[i].open, 0, sizeof(meters[i].open));
+			meters[i].completedIncomplete = meters[i].openIncomplete;
+			meters[i].openIncomplete = bGap;
+			if(bGap) {
+				memset(meters[i].counter, 0xFF, sizeof(meters[i].counter));
+			}
+		}
+		completedAt = openAt;
+	}
+	openAt = start;
+}
+
+void RscpEnergyCounters::setCounter(uint8_t meter, uint8_t phase, double wh) {
+	SRscpEnergyMeter *entry = findMeter(meter);
+	if(entry == NULL || phase >= RSCP_ENERGY_PHASES || !(wh >= 0.0)) {
+		return;
+	}
+	int64_t counter = llround(wh * 1000.0);
+	int64_t previous = entry->counter[phase];
+	entry->counter[phase] = counter;
+	if(previous < 0) {
+		return;
+	}
+	int64_t energy = delta(previous, counter, rolloverMWh);
+	if(energy < 0) {
+		++entry->resets;
+		entry->openIncomplete = true;
+		return;
+	}
+	if(counter < previous) {
+		++entry->rollovers;
+	}
+	entry->open[phase] += energy;
+}
+
+int64_t RscpEnergyCounters::delta(int64_t previous, int64_t counter, int64_t rolloverMWh) {
+	if(counter >= previous) {
+		return counter - previous;
+	}
+	// a rollover starts again near 0, a small step back is a reset or a replaced meter
+	if(rolloverMWh > 0 && previous <= rolloverMWh && previous - counter > rolloverMWh / 2) {
+		return rolloverMWh - previous + counter;
+	}
+	return -1;
+}
+
+SRscpEnergyMeter * RscpEnergyCounters::findMeter(uint8_t index) {
+	for(size_t i = 0; i < RSCP_ENERGY_MAX_METERS; ++i) {
+		if(!meters[i].used) {
+			meters[i].used = true;
+			meters[i].index = index;
+			meters[i].openIncomplete = true;
+			memset(meters[i].counter, 0xFF, sizeof(meters[i].counter));
+			return &meters[i];
+		}
+		if(meters[i].index == index) {
+			return &meters[i];
+		}
+	}
+	return NULL;
+}
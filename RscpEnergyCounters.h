@@ -0,0 +1,81 @@
+/*
+ * RscpEnergyCounters.h
+ *
+ * Energy per interval from the energy counters of the power meters (TAG_PM_ENERGY_L1..L3). The counters are polled
+ * with the other power meter values, the difference of two samples is the energy in between, so consumers do not
+ * integrate the power samples. The counters are kept as integer mWh, the energy of an interval is the sum of the
+ * differences of its samples and is exact apart from the rounding of each counter value.
+ * A counter which falls by more than half of its modulus rolled over, a counter which falls otherwise was reset or
+ * its meter replaced and starts anew without energy for that sample.
+ * After a gap of whole intervals without samples the difference across the gap cannot be assigned to an interval,
+ * the first counters after the gap only start anew. An interval which misses energy is marked as incomplete.
+ */
+
+#ifndef RSCPENERGYCOUNTERS_H_
+#define RSCPENERGYCOUNTERS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Power meters with energy counters which are tracked, further ones are ignored.
+ */
+#define RSCP_ENERGY_MAX_METERS  8
+#define RSCP_ENERGY_PHASES      3
+
+struct SRscpEnergyMeter {
+	// power meter index, only valid if used is set
+	uint8_t index;
+	bool used;
+	// last counter value per phase in mWh, -1 until the first sample
+	int64_t counter[RSCP_ENERGY_PHASES];
+	// energy of the open interval and of the last completed one per phase in mWh
+	int64_t open[RSCP_ENERGY_PHASES];
+	int64_t completed[RSCP_ENERGY_PHASES];
+	// the interval misses energy: the first one of the meter, one after a gap or with a reset counter
+	bool openIncomplete;
+	bool completedIncomplete;
+	uint64_t rollovers;
+	uint64_t resets;
+};
+
+class RscpEnergyCounters {
+public:
+	/*
+	 * \brief Intervals of \var intervalSeconds aligned to the unix time, counters which roll over after
+	 *        \var rolloverWh Wh (0 if they do not roll over).
+	 */
+	RscpEnergyCounters(uint32_t intervalSeconds, double rolloverWh);
+	/*
+	 * \brief Unix time of the sample (TAG_INFO_TIME), a new interval completes the open one. The counters of
+	 *        a sample are assigned to the interval of its time, the first counters of an interval which does not
+	 *        follow the open one only start anew.
+	 */
+	void setTime(int64_t unixTime);
+	/*
+	 * \brief Counter \var wh in Wh of phase \var phase (0..2) of power meter \var meter.
+	 */
+	void setCounter(uint8_t meter, uint8_t phase, double wh);
+	/*
+	 * \brief Energy in mWh between two counter values, \var rolloverMWh is the modulus of the counter or 0.
+	 * @return - the energy or -1 if the counter was reset
+	 */
+	static int64_t delta(int64_t previous, int64_t counter, int64_t rolloverMWh);
+
+	uint32_t interval() const { return intervalSeconds; }
+	// unix time of the start of the last completed interval, 0 before the first one completed
+	int64_t completedStart() const { return completedAt; }
+	// power meters in the order of their first counter, entries without used are free
+	const SRscpEnergyMeter & meter(size_t slot) const { return meters[slot]; }
+private:
+	SRscpEnergyMeter * findMeter(uint8_t index);
+
+	uint32_t intervalSeconds;
+	int64_t rolloverMWh;
+	// start of the open interval, 0 before the first sample
+	int64_t openAt;
+	int64_t completedAt;
+	SRscpEnergyMeter meters[RSCP_ENERGY_MAX_METERS];
+};
+
+#endif /* RSCPENERGYCOUNTERS_H_ */
@@ -29,20 +29,44 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <math.h>
 #include <unistd.h>
 #include "RscpProtocol.h"
 #include "RscpTags.h"
+#include "RscpHistory.h"
+#include "RscpPipeline.h"
+#include "RscpCommand.h"
+#include "RscpProxy.h"
+#include "RscpTopology.h"
+#include "RscpMetrics.h"
+#include "RscpExporter.h"
+#include "RscpQuality.h"
+#include "RscpReconnect.h"
+#include "RscpDecryptor.h"
+#include "RscpSendSlab.h"
+#include "RscpRequestImage.h"
+#include "RscpWallbox.h"
+#include "RscpBatteryDetail.h"
+#include "RscpEnergyCounters.h"
 #include "SocketConnection.h"
 #include "AES.h"
 #include "json.hpp"
+#include <algorithm>
+#include <atomic>
 #include <iostream>
-#include <fstream>
 #include <string>
 #include "settings.h"
 
 #define AES_KEY_SIZE        32
 #define AES_BLOCK_SIZE      32
+// receive buffer for a frame of maximum length and the start of the next one
+#define RECEIVE_BUFFER_SIZE (ROUNDUP(RSCP_MAX_FRAME_LENGTH, AES_BLOCK_SIZE) + 4096)
+// a frame can not hold more values, the views of the static memory mode are reserved for it
+#define MAX_FRAME_VALUES    (0xFFFF / RSCP_VALUE_HEADER_SIZE)
 
 #ifndef SERVER_IP
 printf("SERVER_IP is not defined. Check settings.h within source code")
@@ -50,111 +74,278 @@ exit(EXIT_FAILURE);
 #endif
 
 static int iSocket = -1;
-static int iAuthenticated = 0;
+// set by the decode thread, read by the I/O thread when the next request is created
+static std::atomic<int> iAuthenticated(0);
+static std::atomic<bool> bSerialNumberKnown(false);
 static AES aesEncrypter;
 static AES aesDecrypter;
 static uint8_t ucEncryptionIV[AES_BLOCK_SIZE];
 static uint8_t ucDecryptionIV[AES_BLOCK_SIZE];
 static char TAG_EMS_OUT_SERIAL_NUMBER[17];
 static bool gotData = false;
-static uint8_t gotDataFailed = 0;
 static uint16_t printStats = 0;
+// history backfill which is active if the program was started with --backfill
+static RscpHistoryBackfill *pHistoryBackfill = NULL;
+// decode and output stage of the live data, the I/O stage is the main loop
+static RscpPipeline *pPipeline = NULL;
+// setpoints of the local command socket and the command whose response is awaited
+static RscpCommandServer commandServer;
+static SRscpCommand *pActiveCommand = NULL;
+// devices of the system, written by the I/O thread before the first poll request of a session
+static SRscpTopology topology;
+// OpenMetrics endpoint, NULL if disabled
+static RscpExporter *pExporter = NULL;
+
+// quality of the received values, only used by the thread which handles the responses
+static RscpQuality tagQuality;
+// backoff of the connection attempts and the gap of a reconnect, only used by the I/O thread
+static RscpReconnect deviceReconnect(RECONNECT_MIN_DELAY, RECONNECT_MAX_DELAY);
+// solar surplus charging, the decode thread computes the setpoints and the I/O thread sends them
+static RscpWallboxControl wallboxControl(WALLBOX_CONTROL_INDEX, WALLBOX_BATTERY_RESERVE, WALLBOX_MIN_CURRENT, WALLBOX_MAX_CURRENT);
+static bool bWallboxControl = (WALLBOX_SURPLUS_CONTROL != 0);
+// modules and cells of the batteries, requested in the wait of the fetch cycle and decoded by the decode thread
+static RscpBatteryDetail batteryDetail;
+static int64_t iBatteryDetailIntervalMs = BATTERY_DETAIL_INTERVAL * 1000;
+static const char *pBatteryDetailFile = BATTERY_DETAIL_FILE;
+// energy per interval from the counters of the power meters, only used by the decode thread
+static RscpEnergyCounters energyCounters(ENERGY_INTERVAL, PM_ENERGY_ROLLOVER);
+// sink, cycle time and number of poll cycles of a session (0 for no limit), changed by the end-to-end harness
+static const char *pTargetFile = TARGET_FILE;
+static int64_t iFetchIntervalMs = FETCH_INTERVAL * 1000;
+static uint32_t uiSessionCycles = 0;
+static bool bTopologyCache = true;
+// start of the current poll cycle on the I/O thread, passed with the response to the decode thread
+static int64_t iCycleStartedAt = 0;
+
+// STATIC_MEMORY mode of this run, the decode thread starts its warm-up again when the session changes
+static int iStaticMemory = STATIC_MEMORY;
+static std::atomic<uint32_t> uiSession(0);
+// incremented by every discovery, the decode thread renders the topology only when it changed
+static std::atomic<uint32_t> uiTopologyVersion(0);
 
 using json = nlohmann::json;
 json mainJSONObject;
+// content of BATTERY_DETAIL_FILE, only used by the decode thread
+static json batteryDetailJSON;
 
 using namespace std;
 
-int createRequestExample(SRscpFrameBuffer * frameBuffer) {
+// values of the poll request which do not depend on the devices, their byte images are built by the compiler
+typedef RscpRequestImage<RscpReq<TAG_INFO_REQ_TIME> > TimeRequest;
+typedef RscpRequestImage<RscpReq<TAG_INFO_REQ_SERIAL_NUMBER> > SerialNumberRequest;
+typedef RscpRequestImage<
+	RscpReq<TAG_EMS_REQ_POWER_PV>,
+	RscpReq<TAG_EMS_REQ_POWER_BAT>,
+	RscpReq<TAG_EMS_REQ_POWER_HOME>,
+	RscpReq<TAG_EMS_REQ_POWER_GRID>,
+	RscpReq<TAG_EMS_REQ_POWER_ADD>,
+	RscpReq<TAG_EMS_REQ_POWER_WB_ALL>,
+	RscpReq<TAG_EMS_REQ_POWER_WB_SOLAR>,
+	RscpReq<TAG_EMS_REQ_AUTARKY>,
+	RscpReq<TAG_EMS_REQ_SELF_CONSUMPTION>,
+	RscpReq<TAG_EMS_REQ_COUPLING_MODE>,
+	RscpReq<TAG_EMS_REQ_GET_IDLE_PERIODS> > EmsRequest;
+typedef RscpRequestImage<
+	RscpContainer<TAG_BAT_REQ_DATA,
+		RscpUChar8<TAG_BAT_INDEX, 0>,
+		RscpReq<TAG_BAT_REQ_RSOC>,
+		RscpReq<TAG_BAT_REQ_MODULE_VOLTAGE>,
+		RscpReq<TAG_BAT_REQ_CURRENT>,
+		RscpReq<TAG_BAT_REQ_CHARGE_CYCLES>,
+		RscpReq<TAG_BAT_REQ_TRAINING_MODE> > > BatteryRequest;
+typedef RscpRequestImage<
+	RscpContainer<TAG_PM_REQ_DATA,
+		RscpUChar8<TAG_PM_INDEX, 0>,
+		RscpReq<TAG_PM_REQ_DEVICE_STATE>,
+		RscpReq<TAG_PM_REQ_ACTIVE_PHASES>,
+		RscpReq<TAG_PM_REQ_POWER_L1>,
+		RscpReq<TAG_PM_REQ_POWER_L2>,
+		RscpReq<TAG_PM_REQ_POWER_L3>,
+		RscpReq<TAG_PM_REQ_VOLTAGE_L1>,
+		RscpReq<TAG_PM_REQ_VOLTAGE_L2>,
+		RscpReq<TAG_PM_REQ_VOLTAGE_L3>,
+		RscpReq<TAG_PM_REQ_ENERGY_L1>,
+		RscpReq<TAG_PM_REQ_ENERGY_L2>,
+		RscpReq<TAG_PM_REQ_ENERGY_L3> > > PowerMeterRequest;
+typedef RscpRequestImage<
+	RscpContainer<TAG_DCDC_REQ_DATA,
+		RscpUChar8<TAG_DCDC_INDEX, 0>,
+		RscpReq<TAG_DCDC_REQ_I_BAT>,
+		RscpReq<TAG_DCDC_REQ_U_BAT>,
+		RscpReq<TAG_DCDC_REQ_P_BAT>,
+		RscpReq<TAG_DCDC_REQ_I_DCL>,
+		RscpReq<TAG_DCDC_REQ_U_DCL>,
+		RscpReq<TAG_DCDC_REQ_P_DCL>,
+		RscpReq<TAG_DCDC_REQ_STATUS> > > DcdcRequest;
+typedef RscpRequestImage<
+	RscpContainer<TAG_WB_REQ_DATA,
+		RscpUChar8<TAG_WB_INDEX, 0>,
+		RscpReq<TAG_WB_REQ_PM_ACTIVE_PHASES>,
+		RscpReq<TAG_WB_REQ_PM_POWER_L1>,
+		RscpReq<TAG_WB_REQ_PM_POWER_L2>,
+		RscpReq<TAG_WB_REQ_PM_POWER_L3>,
+		RscpReq<TAG_WB_REQ_EXTERN_DATA_SUN>,
+		RscpReq<TAG_WB_REQ_EXTERN_DATA_NET>,
+		RscpReq<TAG_WB_REQ_EXTERN_DATA_ALL> > > WallboxRequest;
+// the index of a battery, DC/DC converter, power meter or wallbox is the data of the first value inside the container, behind two value headers
+#define DEVICE_REQUEST_INDEX_OFFSET (2 * RSCP_VALUE_HEADER_SIZE)
+
+// indexed values of the PV inverter, requested once per discovered phase, string or temperature sensor
+enum EPVICount {
+	ePVIPhases,
+	ePVIStrings,
+	ePVITemperatures
+};
+
+struct SPVIIndexedValue {
+	SRscpTag request;
+	SRscpTag response;
+	EPVICount count;
+	// the values are kept in the array pvi[group][key] or pvi[key] without group, one entry per index
+	const char *group;
+	const char *key;
+};
+
+static const SPVIIndexedValue pviIndexedValues[] = {
+	{ TAG_PVI_REQ_AC_POWER, TAG_PVI_AC_POWER, ePVIPhases, "ac", "power" },
+	{ TAG_PVI_REQ_AC_VOLTAGE, TAG_PVI_AC_VOLTAGE, ePVIPhases, "ac", "voltage" },
+	{ TAG_PVI_REQ_AC_CURRENT, TAG_PVI_AC_CURRENT, ePVIPhases, "ac", "current" },
+	{ TAG_PVI_REQ_AC_APPARENTPOWER, TAG_PVI_AC_APPARENTPOWER, ePVIPhases, "ac", "apparent_power" },
+	{ TAG_PVI_REQ_AC_REACTIVEPOWER, TAG_PVI_AC_REACTIVEPOWER, ePVIPhases, "ac", "reactive_power" },
+	{ TAG_PVI_REQ_DC_POWER, TAG_PVI_DC_POWER, ePVIStrings, "dc", "power" },
+	{ TAG_PVI_REQ_DC_VOLTAGE, TAG_PVI_DC_VOLTAGE, ePVIStrings, "dc", "voltage" },
+	{ TAG_PVI_REQ_DC_CURRENT, TAG_PVI_DC_CURRENT, ePVIStrings, "dc", "current" },
+	{ TAG_PVI_REQ_DC_STRING_ENERGY_ALL, TAG_PVI_DC_STRING_ENERGY_ALL, ePVIStrings, "dc", "energy_all" },
+	{ TAG_PVI_REQ_TEMPERATURE, TAG_PVI_TEMPERATURE, ePVITemperatures, NULL, "temperature" }
+};
+#define PVI_INDEXED_VALUES (sizeof(pviIndexedValues) / sizeof(pviIndexedValues[0]))
+
+static uint8_t getPVICount(const SRscpTopology & devices, EPVICount count)
+{
+	switch (count) {
+	case ePVIPhases:
+		return devices.pviPhases;
+	case ePVIStrings:
+		return devices.pviStrings;
+	default:
+		return devices.pviTemperatures;
+	}
+}
+
+template<typename IMAGE>
+static void appendRequestImage(std::vector<uint8_t> & data)
+{
+	data.insert(data.end(), IMAGE::data, IMAGE::data + IMAGE::size);
+}
+
+/*
+ * \brief Serialized values of the poll request for the devices of \var devices, the serial number is requested
+ *        until it is known. Only the indexed values of the PV inverter are appended at runtime.
+ * @return - RSCP error code if the request could not be created else RSCP::OK
+ */
+int32_t createPollRequest(std::vector<uint8_t> & data, const SRscpTopology & devices, bool serialNumberKnown)
+{
+	data.clear();
+	appendRequestImage<TimeRequest>(data);
+
+	// Only get special results once because they do not change in time
+	if (!serialNumberKnown) {
+		appendRequestImage<SerialNumberRequest>(data);
+	}
+
+	// request power data information
+	appendRequestImage<EmsRequest>(data);
+
+	// request battery information of every connected battery
+	for (size_t i = 0; i < devices.batteries.size(); ++i) {
+		appendRequestImage<BatteryRequest>(data);
+		data[data.size() - BatteryRequest::size + DEVICE_REQUEST_INDEX_OFFSET] = devices.batteries[i].first;
+	}
+
+	// PVI (PV MPP-Tracker / Strings), the indexed values of every discovered phase, string and temperature sensor
+	// of inverter 0, the discovery only probes this one
 	RscpProtocol protocol;
 	SRscpValue rootValue;
-	// The root container is create with the TAG ID 0 which is not used by any device.
+	SRscpValue PVIContainer;
 	protocol.createContainerValue(&rootValue, 0);
+	protocol.createContainerValue(&PVIContainer, TAG_PVI_REQ_DATA);
+	protocol.appendValue(&PVIContainer, TAG_PVI_INDEX, (uint8_t)0);
+	protocol.appendValue(&PVIContainer, TAG_PVI_REQ_ON_GRID);
+	protocol.appendValue(&PVIContainer, TAG_PVI_REQ_SYSTEM_MODE);
+	const EPVICount counts[] = { ePVIPhases, ePVIStrings, ePVITemperatures };
+	for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+		uint8_t ucCount = getPVICount(devices, counts[c]);
+		for (uint8_t index = 0; index < ucCount; ++index) {
+			for (size_t n = 0; n < PVI_INDEXED_VALUES; ++n) {
+				if (pviIndexedValues[n].count == counts[c]) {
+					protocol.appendValue(&PVIContainer, pviIndexedValues[n].request, index);
+				}
+			}
+		}
+	}
+	int32_t iResult = protocol.appendValue(&rootValue, PVIContainer);
+	if (iResult >= 0) {
+		data.insert(data.end(), rootValue.data, rootValue.data + rootValue.length);
+	}
+	protocol.destroyValueData(PVIContainer);
+	protocol.destroyValueData(rootValue);
+
+	// DCDC, every connected DC/DC converter
+	for (size_t i = 0; i < devices.dcdcs.size(); ++i) {
+		appendRequestImage<DcdcRequest>(data);
+		data[data.size() - DcdcRequest::size + DEVICE_REQUEST_INDEX_OFFSET] = devices.dcdcs[i];
+	}
+
+	// PM, every connected power meter with its energy counters
+	for (size_t i = 0; i < devices.powerMeters.size(); ++i) {
+		appendRequestImage<PowerMeterRequest>(data);
+		data[data.size() - PowerMeterRequest::size + DEVICE_REQUEST_INDEX_OFFSET] = devices.powerMeters[i];
+	}
+
+	// WB, every connected wallbox
+	for (size_t i = 0; i < devices.wallboxes.size(); ++i) {
+		appendRequestImage<WallboxRequest>(data);
+		data[data.size() - WallboxRequest::size + DEVICE_REQUEST_INDEX_OFFSET] = devices.wallboxes[i];
+	}
+
+	if (data.size() > 0xFFFF) {
+		return RSCP::ERR_DATA_LIMIT_EXCEEDED;
+	}
+	return (iResult < 0) ? iResult : RSCP::OK;
+}
+
+int createRequestExample(SRscpFrameBuffer * frameBuffer) {
+	RscpProtocol protocol;
 
 	//---------------------------------------------------------------------------------------------------------
 	// Create a request frame
 	//---------------------------------------------------------------------------------------------------------
-	if(iAuthenticated == 0)
-	{
-		printf("\nRequest authentication\n");
-		// authentication request
-		SRscpValue authenContainer;
-		protocol.createContainerValue(&authenContainer, TAG_RSCP_REQ_AUTHENTICATION);
-		protocol.appendValue(&authenContainer, TAG_RSCP_AUTHENTICATION_USER, E3DC_USER);
-		protocol.appendValue(&authenContainer, TAG_RSCP_AUTHENTICATION_PASSWORD, E3DC_PASSWORD);
-		// append sub-container to root container
-		protocol.appendValue(&rootValue, authenContainer);
-		// free memory of sub-container as it is now copied to rootValue
-		protocol.destroyValueData(authenContainer);
-	}
-	else
+	if(iAuthenticated != 0)
 	{
-		protocol.appendValue(&rootValue, TAG_INFO_REQ_TIME);
-
-		// Only get special results once because they do not change in time
-		if (strlen(TAG_EMS_OUT_SERIAL_NUMBER) == 0) {
-			protocol.appendValue(&rootValue, TAG_INFO_REQ_SERIAL_NUMBER);
-		}
-
-		// request power data information
-		protocol.appendValue(&rootValue, TAG_EMS_REQ_POWER_PV);
-		protocol.appendValue(&rootValue, TAG_EMS_REQ_POWER_BAT);
-		protocol.appendValue(&rootValue, TAG_EMS_REQ_POWER_HOME);
-		protocol.appendValue(&rootValue, TAG_EMS_REQ_POWER_GRID);
-		protocol.appendValue(&rootValue, TAG_EMS_REQ_POWER_ADD);
-		protocol.appendValue(&rootValue, TAG_EMS_REQ_AUTARKY);
-		protocol.appendValue(&rootValue, TAG_EMS_REQ_SELF_CONSUMPTION);
-		protocol.appendValue(&rootValue, TAG_EMS_REQ_COUPLING_MODE);
-		protocol.appendValue(&rootValue, TAG_EMS_REQ_GET_IDLE_PERIODS);
-
-		// request battery information
-		SRscpValue batteryContainer;
-		protocol.createContainerValue(&batteryContainer, TAG_BAT_REQ_DATA);
-		protocol.appendValue(&batteryContainer, TAG_BAT_INDEX, (uint8_t)0);
-		protocol.appendValue(&batteryContainer, TAG_BAT_REQ_RSOC);
-		protocol.appendValue(&batteryContainer, TAG_BAT_REQ_MODULE_VOLTAGE);
-		protocol.appendValue(&batteryContainer, TAG_BAT_REQ_CURRENT);
-		protocol.appendValue(&batteryContainer, TAG_BAT_REQ_CHARGE_CYCLES);
-		protocol.appendValue(&batteryContainer, TAG_BAT_REQ_TRAINING_MODE);
-		protocol.appendValue(&rootValue, batteryContainer);
-		protocol.destroyValueData(batteryContainer);
-
-		// PVI (PV MPP-Tracker / Strings)
-		SRscpValue PVIContainer;
-		protocol.createContainerValue(&PVIContainer, TAG_PVI_REQ_DATA);
-		protocol.appendValue(&PVIContainer, TAG_PVI_INDEX, (uint8_t)0);
-		protocol.appendValue(&PVIContainer, TAG_PVI_REQ_ON_GRID);
-		protocol.appendValue(&PVIContainer, TAG_PVI_REQ_SYSTEM_MODE);
-
-		if (PVI_TRACKER == 2)
-			protocol.appendValue(&PVIContainer, TAG_PVI_REQ_DC_POWER, (uint8_t)1);
-		protocol.appendValue(&PVIContainer, TAG_PVI_REQ_DC_POWER, (uint8_t)0);
-		if (PVI_TRACKER == 2)
-			protocol.appendValue(&PVIContainer, TAG_PVI_REQ_DC_VOLTAGE, (uint8_t)1);
-		protocol.appendValue(&PVIContainer, TAG_PVI_REQ_DC_VOLTAGE, (uint8_t)0);
-		if (PVI_TRACKER == 2)
-			protocol.appendValue(&PVIContainer, TAG_PVI_REQ_DC_CURRENT, (uint8_t)1);
-		protocol.appendValue(&PVIContainer, TAG_PVI_REQ_DC_CURRENT, (uint8_t)0);
-
-		protocol.appendValue(&rootValue, PVIContainer);
-		protocol.destroyValueData(PVIContainer);
-
-		// PM
-		SRscpValue PMContainer;
-		protocol.createContainerValue(&PMContainer, TAG_PM_REQ_DATA);
-		protocol.appendValue(&PMContainer, TAG_PM_INDEX, (uint8_t)0);
-		protocol.appendValue(&PMContainer, TAG_PM_REQ_DEVICE_STATE);
-		protocol.appendValue(&PMContainer, TAG_PM_REQ_ACTIVE_PHASES);
-		protocol.appendValue(&PMContainer, TAG_PM_REQ_POWER_L1);
-		protocol.appendValue(&PMContainer, TAG_PM_REQ_POWER_L2);
-		protocol.appendValue(&PMContainer, TAG_PM_REQ_POWER_L3);
-		protocol.appendValue(&PMContainer, TAG_PM_REQ_VOLTAGE_L1);
-		protocol.appendValue(&PMContainer, TAG_PM_REQ_VOLTAGE_L2);
-		protocol.appendValue(&PMContainer, TAG_PM_REQ_VOLTAGE_L3);
-		protocol.appendValue(&rootValue, PMContainer);
-		protocol.destroyValueData(PMContainer);
+		// the poll request is assembled from the byte images of its values
+		std::vector<uint8_t> data;
+		int32_t iResult = createPollRequest(data, topology, bSerialNumberKnown);
+		if(iResult == RSCP::OK) {
+			iResult = protocol.createFrameAsBuffer(frameBuffer, data.data(), data.size(), true);
+		}
+		return (iResult < 0) ? iResult : 0;
 	}
 
+	SRscpValue rootValue;
+	// The root container is create with the TAG ID 0 which is not used by any device.
+	protocol.createContainerValue(&rootValue, 0);
+
+	printf("\nRequest authentication\n");
+	// authentication request
+	SRscpValue authenContainer;
+	protocol.createContainerValue(&authenContainer, TAG_RSCP_REQ_AUTHENTICATION);
+	protocol.appendValue(&authenContainer, TAG_RSCP_AUTHENTICATION_USER, E3DC_USER);
+	protocol.appendValue(&authenContainer, TAG_RSCP_AUTHENTICATION_PASSWORD, E3DC_PASSWORD);
+	// append sub-container to root container
+	protocol.appendValue(&rootValue, authenContainer);
+	// free memory of sub-container as it is now copied to rootValue
+	protocol.destroyValueData(authenContainer);
+
 	// create buffer frame to send data to the S10
 	protocol.createFrameAsBuffer(frameBuffer, rootValue.data, rootValue.length, true); // true to calculate CRC on for transfer
 	// the root value object should be destroyed after the data is copied into the frameBuffer and is not needed anymore
@@ -163,15 +354,137 @@ int createRequestExample(SRscpFrameBuffer * frameBuffer) {
 	return 0;
 }
 
+// the values of the containers are views into the received frame, one reused vector per nesting level
+static thread_local std::vector<SRscpValue> containerViews[3];
+
+// replace the text of a string node in place, assigning a new string would allocate it on every sample
+static void setJsonString(json & node, const char *value)
+{
+	if (node.is_string()) {
+		node.get_ref<std::string &>().assign(value);
+	}
+	else {
+		node = value;
+	}
+}
+
+// an error answer of a value inside a container is counted for its tag and index, the other values are still used
+static bool checkValue(RscpProtocol *protocol, const SRscpValue & value, uint16_t index)
+{
+	if (value.dataType == RSCP::eTypeError) {
+		// handle error for example access denied errors
+		uint32_t uiErrorCode = protocol->getValueAsUInt32(&value);
+		printf("Tag 0x%08X received error code %u.\n", value.tag, uiErrorCode);
+		tagQuality.error(value.tag, index, uiErrorCode);
+		return false;
+	}
+	if (value.dataType != RSCP::eTypeContainer) {
+		tagQuality.good(value.tag, index);
+	}
+	return true;
+}
+
+static json & getPVIArray(const SPVIIndexedValue & field)
+{
+	json & pvi = mainJSONObject["pvi"];
+	return (field.group != NULL) ? pvi[field.group][field.key] : pvi[field.key];
+}
+
+/*
+ * \brief Arrays of the indexed PVI values with one entry per phase, string and temperature sensor of \var devices.
+ *        Entries stay null until they are answered. Allocates, the decode thread calls it after every discovery.
+ */
+void setPVILayout(const SRscpTopology & devices)
+{
+	for (size_t n = 0; n < PVI_INDEXED_VALUES; ++n) {
+		getPVIArray(pviIndexedValues[n]) = json::array();
+		getPVIArray(pviIndexedValues[n]).get_ref<json::array_t &>().resize(getPVICount(devices, pviIndexedValues[n].count));
+	}
+}
+
+// indexed PVI containers hold the index and the value of one phase, string or sensor, the quality is kept per container tag and index
+static void handlePVIIndexedValue(RscpProtocol *protocol, const SRscpValue & indexedValue, const SPVIIndexedValue & field)
+{
+	int index = -1;
+	std::vector<SRscpValue> & container = containerViews[1];
+	protocol->getContainerViews(&indexedValue, container);
+	for (size_t n = 0; n < container.size(); n++)
+	{
+		if (container[n].dataType == RSCP::eTypeError)
+		{
+			uint32_t uiErrorCode = protocol->getValueAsUInt32(&container[n]);
+			printf("Tag 0x%08X received error code %u.\n", container[n].tag, uiErrorCode);
+			tagQuality.error(indexedValue.tag, (index < 0) ? 0 : index, uiErrorCode);
+			// without the index the value can not be assigned to an entry
+			if (container[n].tag == TAG_PVI_INDEX) {
+				break;
+			}
+		}
+		else if (container[n].tag == TAG_PVI_INDEX)
+		{
+			index = protocol->getValueAsUInt16(&container[n]);
+		}
+		else if (container[n].tag == TAG_PVI_VALUE && index >= 0)
+		{
+			// the arrays are sized by the discovery, an index beyond them was not requested
+			json & values = getPVIArray(field);
+			if ((size_t)index < values.size()) {
+				values[index] = protocol->getValueAsFloat32(&container[n]);
+				tagQuality.good(indexedValue.tag, index);
+			}
+		}
+	}
+}
+
+// TAG_WB_EXTERN_DATA_* containers hold the extern data of a wallbox, its first two bytes are the power in W
+static void handleWallboxExternValue(RscpProtocol *protocol, const SRscpValue & externValue, uint8_t index, json & wb, const char *key)
+{
+	std::vector<SRscpValue> & container = containerViews[1];
+	protocol->getContainerViews(&externValue, container);
+	for (size_t n = 0; n < container.size(); n++)
+	{
+		if (container[n].dataType == RSCP::eTypeError)
+		{
+			uint32_t uiErrorCode = protocol->getValueAsUInt32(&container[n]);
+			printf("Tag 0x%08X received error code %u.\n", container[n].tag, uiErrorCode);
+			tagQuality.error(externValue.tag, index, uiErrorCode);
+			return;
+		}
+		if (container[n].tag == TAG_WB_EXTERN_DATA && container[n].length >= 2)
+		{
+			wb[key] = RscpCodec::load16(container[n].data);
+			tagQuality.good(externValue.tag, index);
+		}
+	}
+}
+
 int handleResponseValue(RscpProtocol *protocol, SRscpValue *response) {
 
+	// history chunks keep track of their own errors
+	if((pHistoryBackfill != NULL) && (response->tag == TAG_DB_HISTORY_DATA_DAY || response->tag == TAG_DB_HISTORY_DATA_WEEK
+			|| response->tag == TAG_DB_HISTORY_DATA_MONTH || response->tag == TAG_DB_HISTORY_DATA_YEAR)) {
+		return pHistoryBackfill->handleResponse(protocol, response);
+	}
+
+	// every answer except the authentication belongs to a sample, which is rendered even if some values failed
+	// the authentication and the serial number are requested once per session and have no quality
+	bool bSampled = (response->tag != TAG_RSCP_AUTHENTICATION && response->tag != TAG_INFO_SERIAL_NUMBER);
+	if(response->tag != TAG_RSCP_AUTHENTICATION) {
+		gotData = true;
+	}
+
 	// check if any of the response has the error flag set and react accordingly
 	if(response->dataType == RSCP::eTypeError) {
 		// handle error for example access denied errors
 		uint32_t uiErrorCode = protocol->getValueAsUInt32(response);
 		printf("Tag 0x%08X received error code %u.\n", response->tag, uiErrorCode);
+		if(bSampled) {
+			tagQuality.error(response->tag, 0, uiErrorCode);
+		}
 		return -1;
 	}
+	// false if the value is invalid, the output keeps the last good value
+	bool bValid = true;
 
 	// check the SRscpValue TAG to detect which response it is
 	switch(response->tag) {
@@ -192,6 +505,7 @@ int handleResponseValue(RscpProtocol *protocol, SRscpValue *response) {
 			// response for TAG_EMS_REQ_POWER_PV
 			int32_t iPower = protocol->getValueAsInt32(response);
 			mainJSONObject["power"]["pv"] = iPower;
+			wallboxControl.setPower(response->tag, iPower);
 			break;
 		}
 		case TAG_EMS_POWER_BAT:
@@ -206,6 +520,7 @@ int handleResponseValue(RscpProtocol *protocol, SRscpValue *response) {
 			// response for TAG_EMS_REQ_POWER_HOME
 			int32_t iPower = protocol->getValueAsInt32(response);
 			mainJSONObject["power"]["home"] = iPower;
+			wallboxControl.setPower(response->tag, iPower);
 			break;
 		}
 		case TAG_EMS_POWER_GRID:
@@ -220,6 +535,21 @@ int handleResponseValue(RscpProtocol *protocol, SRscpValue *response) {
 			// response for TAG_EMS_REQ_POWER_ADD
 			int32_t iPower = protocol->getValueAsInt32(response);
 			mainJSONObject["power"]["add"] = iPower;
+			wallboxControl.setPower(response->tag, iPower);
+			break;
+		}
+		case TAG_EMS_POWER_WB_ALL:
+		{
+			// response for TAG_EMS_REQ_POWER_WB_ALL
+			int32_t iPower = protocol->getValueAsInt32(response);
+			mainJSONObject["power"]["wb_all"] = iPower;
+			break;
+		}
+		case TAG_EMS_POWER_WB_SOLAR:
+		{
+			// response for TAG_EMS_REQ_POWER_WB_SOLAR
+			int32_t iPower = protocol->getValueAsInt32(response);
+			mainJSONObject["power"]["wb_solar"] = iPower;
 			break;
 		}
 		case TAG_EMS_AUTARKY:
@@ -245,13 +575,14 @@ int handleResponseValue(RscpProtocol *protocol, SRscpValue *response) {
 		}
 		case TAG_INFO_TIME:
 		{
-			// response for TAG_INFO_REQ_TIME
-			gotData = true;
+			// response for TAG_INFO_REQ_TIME, a device without a valid time keeps the last timestamp
 			int32_t unixTimestamp = protocol->getValueAsInt32(response);
 			if (unixTimestamp == 0) {
-				exit(EXIT_FAILURE);
+				bValid = false;
+				break;
 			}
 			mainJSONObject["meta"]["timestamp"] = unixTimestamp;
+			energyCounters.setTime(unixTimestamp);
 			break;
 		}
 		case TAG_INFO_SERIAL_NUMBER:
@@ -259,61 +590,134 @@ int handleResponseValue(RscpProtocol *protocol, SRscpValue *response) {
 			std::string serialNumber = protocol->getValueAsString(response);
 			strcpy(TAG_EMS_OUT_SERIAL_NUMBER, serialNumber.c_str());
 			mainJSONObject["meta"]["serial_number"] = TAG_EMS_OUT_SERIAL_NUMBER;
+			bSerialNumberKnown = true;
+			break;
+		}
+		case TAG_DCDC_DATA:
+		{
+			// response for TAG_DCDC_REQ_DATA
+			uint8_t ucDCDCIndex = 0;
+			// DC/DC converter 0 is provided as "dcdc", further ones as "dcdc<index>"
+			json *dcdc = &mainJSONObject["dcdc"];
+			std::vector<SRscpValue> & DCDCData = containerViews[0];
+			protocol->getContainerViews(response, DCDCData);
+
+			for (size_t i = 0; i < DCDCData.size(); ++i) {
+				if(!checkValue(protocol, DCDCData[i], ucDCDCIndex)) {
+					// the following values can not be assigned to a converter without the index
+					if(DCDCData[i].tag == TAG_DCDC_INDEX) {
+						return -1;
+					}
+					continue;
+				}
+				switch(DCDCData[i].tag) {
+				case TAG_DCDC_INDEX:
+				{
+					ucDCDCIndex = protocol->getValueAsUChar8(&DCDCData[i]);
+					if (ucDCDCIndex > 0) {
+						dcdc = &mainJSONObject["dcdc" + std::to_string(ucDCDCIndex)];
+					}
+					break;
+				}
+				case TAG_DCDC_I_BAT:
+				case TAG_DCDC_U_BAT:
+				case TAG_DCDC_P_BAT:
+				case TAG_DCDC_I_DCL:
+				case TAG_DCDC_U_DCL:
+				case TAG_DCDC_P_DCL:
+				{
+					// current, voltage and power of the battery side and of the DC link
+					static const char *dcdcKeys[] = { "i_bat", "u_bat", "p_bat", "i_dcl", "u_dcl", "p_dcl" };
+					(*dcdc)[dcdcKeys[DCDCData[i].tag - TAG_DCDC_I_BAT]] = protocol->getValueAsFloat32(&DCDCData[i]);
+					break;
+				}
+				case TAG_DCDC_STATUS:
+				{
+					// response for TAG_DCDC_REQ_STATUS, a container with the state and the substate
+					std::vector<SRscpValue> & status = containerViews[1];
+					protocol->getContainerViews(&DCDCData[i], status);
+					for (size_t n = 0; n < status.size(); ++n) {
+						if (!checkValue(protocol, status[n], ucDCDCIndex)) {
+							continue;
+						}
+						if (status[n].tag == TAG_DCDC_STATE) {
+							(*dcdc)["state"] = protocol->getValueAsUInt32(&status[n]);
+						}
+						else if (status[n].tag == TAG_DCDC_SUBSTATE) {
+							(*dcdc)["substate"] = protocol->getValueAsUInt32(&status[n]);
+						}
+					}
+					break;
+				}
+				// ...
+				default:
+					// default behaviour
+					printf("Unknown DCDC tag %08X\n", response->tag);
+					break;
+				}
+			}
 			break;
 		}
 		case TAG_PM_DATA:
 		{
 			// resposne for TAG_PM_REQ_DATA
 			uint8_t ucPMIndex = 0;
-			std::vector<SRscpValue> PMData = protocol->getValueAsContainer(response);
+			// power meter 0 is provided as "pm", further power meters as "pm<index>"
+			json *pm = &mainJSONObject["pm"];
+			std::vector<SRscpValue> & PMData = containerViews[0];
+			protocol->getContainerViews(response, PMData);
 
 			for (size_t i = 0; i < PMData.size(); ++i) {
-				if(PMData[i].dataType == RSCP::eTypeError) {
-					// handle error for example access denied errors
-					uint32_t uiErrorCode = protocol->getValueAsUInt32(&PMData[i]);
-					printf("Tag 0x%08X received error code %u.\n", PMData[i].tag, uiErrorCode);
-					return -1;
+				if(!checkValue(protocol, PMData[i], ucPMIndex)) {
+					// the following values can not be assigned to a power meter without the index
+					if(PMData[i].tag == TAG_PM_INDEX) {
+						return -1;
+					}
+					continue;
 				}
 				// check each battery sub tag
 				switch(PMData[i].tag) {
 				case TAG_PM_INDEX:
 				{
 					ucPMIndex = protocol->getValueAsUChar8(&PMData[i]);
+					if (ucPMIndex > 0) {
+						pm = &mainJSONObject["pm" + std::to_string(ucPMIndex)];
+					}
 					break;
 				}
 				case TAG_PM_DEVICE_STATE:
 				{
 					// response for TAG_PM_REQ_DEVICE_STATE
 					bool devState = protocol->getValueAsBool(&PMData[i]);
-					mainJSONObject["pm"]["lm0_state"] = devState;
+					(*pm)["lm0_state"] = devState;
 					break;
 				}
 				case TAG_PM_ACTIVE_PHASES:
 				{
 					// response for TAG_PM_REQ_ACTIVE_PHASES
 					int32_t activePhases = protocol->getValueAsInt32(&PMData[i]);
-					mainJSONObject["pm"]["active_phases"] = activePhases;
+					(*pm)["active_phases"] = activePhases;
 					break;
 				}
 				case TAG_PM_POWER_L1:
 				{
 					// response for TAG_PM_POWER_L1
 					double iPower = protocol->getValueAsDouble64(&PMData[i]);
-					mainJSONObject["pm"]["power1"] = iPower;
+					(*pm)["power1"] = iPower;
 					break;
 				}
 				case TAG_PM_POWER_L2:
 				{
 					// response for TAG_PM_POWER_L2
 					double iPower = protocol->getValueAsDouble64(&PMData[i]);
-					mainJSONObject["pm"]["power2"] = iPower;
+					(*pm)["power2"] = iPower;
 					break;
 				}
 				case TAG_PM_POWER_L3:
 				{
 					// response for TAG_PM_POWER_L3
 					double iPower = protocol->getValueAsDouble64(&PMData[i]);
-					mainJSONObject["pm"]["power3"] = iPower;
+					(*pm)["power3"] = iPower;
 					break;
 				}
 
@@ -321,21 +725,33 @@ int handleResponseValue(RscpProtocol *protocol, SRscpValue *response) {
 				{
 					// response for TAG_PM_VOLTAGE_L1
 					float iPower = protocol->getValueAsFloat32(&PMData[i]);
-					mainJSONObject["pm"]["voltage1"] = iPower;
+					(*pm)["voltage1"] = iPower;
 					break;
 				}
 				case TAG_PM_VOLTAGE_L2:
 				{
 					// response for TAG_PM_VOLTAGE_L2
 					float iPower = protocol->getValueAsFloat32(&PMData[i]);
-					mainJSONObject["pm"]["voltage2"] = iPower;
+					(*pm)["voltage2"] = iPower;
 					break;
 				}
 				case TAG_PM_VOLTAGE_L3:
 				{
 					// response for TAG_PM_VOLTAGE_L3
 					float iPower = protocol->getValueAsFloat32(&PMData[i]);
-					mainJSONObject["pm"]["voltage3"] = iPower;
+					(*pm)["voltage3"] = iPower;
+					break;
+				}
+				case TAG_PM_ENERGY_L1:
+				case TAG_PM_ENERGY_L2:
+				case TAG_PM_ENERGY_L3:
+				{
+					// response for TAG_PM_REQ_ENERGY_L1..L3, counters in Wh, the energy per interval is added by addEnergyCounters
+					static const char *energyKeys[] = { "energy1", "energy2", "energy3" };
+					uint8_t ucPhase = PMData[i].tag - TAG_PM_ENERGY_L1;
+					double dEnergy = protocol->getValueAsDouble64(&PMData[i]);
+					(*pm)[energyKeys[ucPhase]] = dEnergy;
+					energyCounters.setCounter(ucPMIndex, ucPhase, dEnergy);
 					break;
 				}
 
@@ -346,58 +762,142 @@ int handleResponseValue(RscpProtocol *protocol, SRscpValue *response) {
 					break;
 				}
 			}
-			protocol->destroyValueData(PMData);
+			break;
+		}
+		case TAG_WB_DATA:
+		{
+			// response for TAG_WB_REQ_DATA
+			uint8_t ucWBIndex = 0;
+			// wallbox 0 is provided as "wb", further wallboxes as "wb<index>"
+			json *wb = &mainJSONObject["wb"];
+			std::vector<SRscpValue> & WBData = containerViews[0];
+			protocol->getContainerViews(response, WBData);
+
+			for (size_t i = 0; i < WBData.size(); ++i) {
+				if(!checkValue(protocol, WBData[i], ucWBIndex)) {
+					if(WBData[i].tag == TAG_WB_INDEX) {
+						return -1;
+					}
+					continue;
+				}
+				switch(WBData[i].tag) {
+				case TAG_WB_INDEX:
+				{
+					ucWBIndex = protocol->getValueAsUChar8(&WBData[i]);
+					if (ucWBIndex > 0) {
+						wb = &mainJSONObject["wb" + std::to_string(ucWBIndex)];
+					}
+					break;
+				}
+				case TAG_WB_PM_ACTIVE_PHASES:
+				{
+					// response for TAG_WB_REQ_PM_ACTIVE_PHASES, one bit per phase
+					uint8_t activePhases = protocol->getValueAsUChar8(&WBData[i]);
+					(*wb)["active_phases"] = activePhases;
+					wallboxControl.setActivePhases(ucWBIndex, activePhases);
+					break;
+				}
+				case TAG_WB_PM_POWER_L1:
+				{
+					// response for TAG_WB_REQ_PM_POWER_L1
+					double iPower = protocol->getValueAsDouble64(&WBData[i]);
+					(*wb)["power1"] = iPower;
+					break;
+				}
+				case TAG_WB_PM_POWER_L2:
+				{
+					// response for TAG_WB_REQ_PM_POWER_L2
+					double iPower = protocol->getValueAsDouble64(&WBData[i]);
+					(*wb)["power2"] = iPower;
+					break;
+				}
+				case TAG_WB_PM_POWER_L3:
+				{
+					// response for TAG_WB_REQ_PM_POWER_L3
+					double iPower = protocol->getValueAsDouble64(&WBData[i]);
+					(*wb)["power3"] = iPower;
+					break;
+				}
+				case TAG_WB_EXTERN_DATA_SUN:
+				{
+					handleWallboxExternValue(protocol, WBData[i], ucWBIndex, *wb, "power_sun");
+					break;
+				}
+				case TAG_WB_EXTERN_DATA_NET:
+				{
+					handleWallboxExternValue(protocol, WBData[i], ucWBIndex, *wb, "power_net");
+					break;
+				}
+				case TAG_WB_EXTERN_DATA_ALL:
+				{
+					handleWallboxExternValue(protocol, WBData[i], ucWBIndex, *wb, "power_all");
+					break;
+				}
+
+				// ...
+				default:
+					// default behaviour
+					printf("Unknown WB tag %08X\n", WBData[i].tag);
+					break;
+				}
+			}
 			break;
 		}
 		case TAG_BAT_DATA:
 		{
 			// resposne for TAG_BAT_REQ_DATA
 			uint8_t ucBatteryIndex = 0;
-			std::vector<SRscpValue> batteryData = protocol->getValueAsContainer(response);
+			// battery 0 is provided as "battery", further ones as "battery<index>"
+			json *battery = &mainJSONObject["battery"];
+			std::vector<SRscpValue> & batteryData = containerViews[0];
+			protocol->getContainerViews(response, batteryData);
 			for (size_t i = 0; i < batteryData.size(); ++i) {
-				if(batteryData[i].dataType == RSCP::eTypeError) {
-					// handle error for example access denied errors
-					uint32_t uiErrorCode = protocol->getValueAsUInt32(&batteryData[i]);
-					printf("Tag 0x%08X received error code %u.\n", batteryData[i].tag, uiErrorCode);
-					return -1;
+				if(!checkValue(protocol, batteryData[i], ucBatteryIndex)) {
+					if(batteryData[i].tag == TAG_BAT_INDEX) {
+						return -1;
+					}
+					continue;
 				}
 				// check each battery sub tag
 				switch(batteryData[i].tag) {
 					case TAG_BAT_INDEX:
 					{
 						ucBatteryIndex = protocol->getValueAsUChar8(&batteryData[i]);
+						if (ucBatteryIndex > 0) {
+							battery = &mainJSONObject["battery" + std::to_string(ucBatteryIndex)];
+						}
 						break;
 					}
 					case TAG_BAT_RSOC:
 					{
 						// response for TAG_BAT_REQ_RSOC
 						float fSOC = protocol->getValueAsFloat32(&batteryData[i]);
-						mainJSONObject["battery"]["charge"] = fSOC;
+						(*battery)["charge"] = fSOC;
 						break;
 					}
 					case TAG_BAT_MODULE_VOLTAGE:
 					{
 						// response for TAG_BAT_REQ_MODULE_VOLTAGE
 						float fVoltage = protocol->getValueAsFloat32(&batteryData[i]);
-						mainJSONObject["battery"]["voltage"] = fVoltage;
+						(*battery)["voltage"] = fVoltage;
 						break;
 					}
 					case TAG_BAT_CURRENT:
 					{
 						// response for TAG_BAT_REQ_CURRENT
 						float fVoltage = protocol->getValueAsFloat32(&batteryData[i]);
-						mainJSONObject["battery"]["current"] = fVoltage;
+						(*battery)["current"] = fVoltage;
 						break;
 					}
 					case TAG_BAT_CHARGE_CYCLES:	{ // response for TAG_BAT_CHARGE_CYCLES
 						uint32_t bCycles = protocol->getValueAsUInt32(&batteryData[i]);
-						mainJSONObject["battery"]["cycles"] = bCycles;
+						(*battery)["cycles"] = bCycles;
 						break;
 					}
 					case TAG_BAT_TRAINING_MODE:
 					{
 						uint32_t trainingMode = protocol->getValueAsUChar8(&batteryData[i]);
-						mainJSONObject["battery"]["training"] = trainingMode;
+						(*battery)["training"] = trainingMode;
 						break;
 					}
 
@@ -408,34 +908,39 @@ int handleResponseValue(RscpProtocol *protocol, SRscpValue *response) {
 						break;
 				}
 			}
-			protocol->destroyValueData(batteryData);
 			break;
 		}
 		case TAG_EMS_GET_IDLE_PERIODS:
 		{
-			std::vector<SRscpValue> EMSIdlePeriods = protocol->getValueAsContainer(response);
+			std::vector<SRscpValue> & EMSIdlePeriods = containerViews[0];
+			protocol->getContainerViews(response, EMSIdlePeriods);
 			for (size_t i = 0; i < EMSIdlePeriods.size(); ++i)
 			{
-				uint8_t idlePeriodDay;
-				uint8_t idlePeriodType;
-				uint8_t idlePeriodStartHour;
-				uint8_t idlePeriodStartMinute;
-				uint8_t idlePeriodEndHour;
-				uint8_t idlePeriodEndMinute;
-				bool idlePeriodActive;
+				uint8_t idlePeriodDay = 0;
+				uint8_t idlePeriodType = 0;
+				uint8_t idlePeriodStartHour = 0;
+				uint8_t idlePeriodStartMinute = 0;
+				uint8_t idlePeriodEndHour = 0;
+				uint8_t idlePeriodEndMinute = 0;
+				bool idlePeriodActive = false;
+				// a period with an error keeps its last complete answer, the quality is kept per period
+				bool bPeriodValid = true;
+				uint32_t uiPeriodError = 0;
 
 				if (EMSIdlePeriods[i].dataType == RSCP::eTypeError)
 				{
 					// handle error for example access denied errors
 					uint32_t uiErrorCode = protocol->getValueAsUInt32(&EMSIdlePeriods[i]);
 					printf("Tag 0x%08X received error code %u.\n", EMSIdlePeriods[i].tag, uiErrorCode);
-					return -1;
+					tagQuality.error(TAG_EMS_IDLE_PERIOD, i, uiErrorCode);
+					continue;
 				}
 				switch (EMSIdlePeriods[i].tag)
 				{
 					case TAG_EMS_IDLE_PERIOD:
 					{
-						std::vector<SRscpValue> container = protocol->getValueAsContainer(&EMSIdlePeriods[i]);
+						std::vector<SRscpValue> & container = containerViews[1];
+						protocol->getContainerViews(&EMSIdlePeriods[i], container);
 						for (size_t n = 0; n < container.size(); n++)
 						{
 							if (container[n].dataType == RSCP::eTypeError)
@@ -443,7 +948,9 @@ int handleResponseValue(RscpProtocol *protocol, SRscpValue *response) {
 								// handle error for example access denied errors
 								uint32_t uiErrorCode = protocol->getValueAsUInt32(&container[n]);
 								printf("Tag 0x%08X received error code %u.\n", container[n].tag, uiErrorCode);
-								return -1;
+								bPeriodValid = false;
+								uiPeriodError = uiErrorCode;
+								continue;
 							}
 							switch (container[n].tag) {
 								case TAG_EMS_IDLE_PERIOD_TYPE:
@@ -463,7 +970,8 @@ int handleResponseValue(RscpProtocol *protocol, SRscpValue *response) {
 								}
 								case TAG_EMS_IDLE_PERIOD_START:
 								{
-									std::vector<SRscpValue> container2 = protocol->getValueAsContainer(&container[n]);
+									std::vector<SRscpValue> & container2 = containerViews[2];
+									protocol->getContainerViews(&container[n], container2);
 									for (size_t o = 0; o < container2.size(); o++)
 									{
 										if (container2[o].dataType == RSCP::eTypeError)
@@ -471,7 +979,8 @@ int handleResponseValue(RscpProtocol *protocol, SRscpValue *response) {
 											// handle error for example access denied errors
 											uint32_t uiErrorCode = protocol->getValueAsUInt32(&container2[o]);
 											printf("Tag 0x%08X received error code %u.\n", container2[o].tag, uiErrorCode);
-											return -1;
+											bPeriodValid = false;
+											uiPeriodError = uiErrorCode;
 										}
 										else if (container2[o].tag == TAG_EMS_IDLE_PERIOD_HOUR)
 										{
@@ -482,12 +991,12 @@ int handleResponseValue(RscpProtocol *protocol, SRscpValue *response) {
 											idlePeriodStartMinute = protocol->getValueAsUChar8(&container2[o]);
 										}
 									}
-									protocol->destroyValueData(container2);
 									break;
 								}
 								case TAG_EMS_IDLE_PERIOD_END:
 								{
-									std::vector<SRscpValue> container2 = protocol->getValueAsContainer(&container[n]);
+									std::vector<SRscpValue> & container2 = containerViews[2];
+									protocol->getContainerViews(&container[n], container2);
 									for (size_t o = 0; o < container2.size(); o++)
 									{
 										if (container2[o].dataType == RSCP::eTypeError)
@@ -495,7 +1004,8 @@ int handleResponseValue(RscpProtocol *protocol, SRscpValue *response) {
 											// handle error for example access denied errors
 											uint32_t uiErrorCode = protocol->getValueAsUInt32(&container2[o]);
 											printf("Tag 0x%08X received error code %u.\n", container2[o].tag, uiErrorCode);
-											return -1;
+											bPeriodValid = false;
+											uiPeriodError = uiErrorCode;
 										}
 										else if (container2[o].tag == TAG_EMS_IDLE_PERIOD_HOUR)
 										{
@@ -506,7 +1016,6 @@ int handleResponseValue(RscpProtocol *protocol, SRscpValue *response) {
 											idlePeriodEndMinute = protocol->getValueAsUChar8(&container2[o]);
 										}
 									}
-									protocol->destroyValueData(container2);
 									break;
 								}
 								default:
@@ -516,7 +1025,6 @@ int handleResponseValue(RscpProtocol *protocol, SRscpValue *response) {
 								}
 							}
 						}
-						protocol->destroyValueData(container);
 						break;
 					}
 					default:
@@ -526,6 +1034,12 @@ int handleResponseValue(RscpProtocol *protocol, SRscpValue *response) {
 					}
 				}
 
+				if (!bPeriodValid) {
+					tagQuality.error(TAG_EMS_IDLE_PERIOD, i, uiPeriodError);
+					continue;
+				}
+				tagQuality.good(TAG_EMS_IDLE_PERIOD, i);
+
 				std::string name;
 				if (idlePeriodType == 0) {
 					name = "charge";
@@ -537,25 +1051,28 @@ int handleResponseValue(RscpProtocol *protocol, SRscpValue *response) {
 				mainJSONObject["idle_block"][name]["day"] = idlePeriodDay;
 				mainJSONObject["idle_block"][name]["active"] = idlePeriodActive;
 				mainJSONObject["idle_block"][name]["type"] = idlePeriodType;
-				mainJSONObject["idle_block"][name]["start"] = std::to_string(idlePeriodStartHour) + ":" + std::to_string(idlePeriodStartMinute);
-				mainJSONObject["idle_block"][name]["end"] = std::to_string(idlePeriodEndHour) + ":" + std::to_string(idlePeriodEndMinute);
+				char cTime[8];
+				snprintf(cTime, sizeof(cTime), "%u:%u", idlePeriodStartHour, idlePeriodStartMinute);
+				setJsonString(mainJSONObject["idle_block"][name]["start"], cTime);
+				snprintf(cTime, sizeof(cTime), "%u:%u", idlePeriodEndHour, idlePeriodEndMinute);
+				setJsonString(mainJSONObject["idle_block"][name]["end"], cTime);
 			}
-			protocol->destroyValueData(EMSIdlePeriods);
 			break;
 		}
 		case TAG_PVI_DATA:
 		{
 			// resposne for TAG_PVI_REQ_DATA
 			uint8_t ucPVIIndex = 0;
-			std::vector<SRscpValue> PVIData = protocol->getValueAsContainer(response);
+			std::vector<SRscpValue> & PVIData = containerViews[0];
+			protocol->getContainerViews(response, PVIData);
 			for (size_t i = 0; i < PVIData.size(); ++i)
 			{
-				if (PVIData[i].dataType == RSCP::eTypeError)
+				if (!checkValue(protocol, PVIData[i], ucPVIIndex))
 				{
-					// handle error for example access denied errors
-					uint32_t uiErrorCode = protocol->getValueAsUInt32(&PVIData[i]);
-					printf("Tag 0x%08X received error code %u.\n", PVIData[i].tag, uiErrorCode);
-					return -1;
+					if (PVIData[i].tag == TAG_PVI_INDEX) {
+						return -1;
+					}
+					continue;
 				}
 				// check each battery sub tag
 				switch (PVIData[i].tag)
@@ -578,95 +1095,24 @@ int handleResponseValue(RscpProtocol *protocol, SRscpValue *response) {
 						mainJSONObject["pvi"]["on_grid"] = onGrid;
 						break;
 					}
-					case TAG_PVI_DC_POWER:
+					// ...
+					default:
 					{
-						int index = -1;
-						float TAG_OUT_PVI_DC_POWER = 0;
-						std::vector<SRscpValue> container = protocol->getValueAsContainer(&PVIData[i]);
-						for (size_t n = 0; n < container.size(); n++)
-						{
-							if ((container[n].tag == TAG_PVI_INDEX))
-							{
-								index = protocol->getValueAsUInt16(&container[n]);
-							}
-							else if ((container[n].tag == TAG_PVI_VALUE))
-							{
-								TAG_OUT_PVI_DC_POWER = protocol->getValueAsFloat32(&container[n]);
-								if (index == 0)
-								{
-									mainJSONObject["pvi"]["dc0_power"] = TAG_OUT_PVI_DC_POWER;
-								}
-								else if (index == 1)
-								{
-									mainJSONObject["pvi"]["dc1_power"] = TAG_OUT_PVI_DC_POWER;
-								}
-							}
+						size_t n = 0;
+						while (n < PVI_INDEXED_VALUES && pviIndexedValues[n].response != PVIData[i].tag) {
+							++n;
 						}
-						protocol->destroyValueData(container);
-						break;
-					}
-					case TAG_PVI_DC_VOLTAGE:
-					{
-						int index = -1;
-						float TAG_OUT_PVI_DC_VOLTAGE = 0;
-						std::vector<SRscpValue> container = protocol->getValueAsContainer(&PVIData[i]);
-						for (size_t n = 0; n < container.size(); n++)
-						{
-							if ((container[n].tag == TAG_PVI_INDEX))
-							{
-								index = protocol->getValueAsUInt16(&container[n]);
-							}
-							else if ((container[n].tag == TAG_PVI_VALUE))
-							{
-								TAG_OUT_PVI_DC_VOLTAGE = protocol->getValueAsFloat32(&container[n]);
-								if (index == 0)
-								{
-									mainJSONObject["pvi"]["dc0_voltage"] = TAG_OUT_PVI_DC_VOLTAGE;
-								}
-								if (index == 1)
-								{
-									mainJSONObject["pvi"]["dc1_voltage"] = TAG_OUT_PVI_DC_VOLTAGE;
-								}
-							}
+						if (n < PVI_INDEXED_VALUES) {
+							handlePVIIndexedValue(protocol, PVIData[i], pviIndexedValues[n]);
 						}
-						protocol->destroyValueData(container);
-						break;
-					}
-					case TAG_PVI_DC_CURRENT:
-					{
-						int index = -1;
-						float TAG_OUT_PVI_DC_CURRENT = 0;
-						std::vector<SRscpValue> container = protocol->getValueAsContainer(&PVIData[i]);
-						for (size_t n = 0; n < container.size(); n++)
-						{
-							if ((container[n].tag == TAG_PVI_INDEX))
-							{
-								index = protocol->getValueAsUInt16(&container[n]);
-							}
-							else if ((container[n].tag == TAG_PVI_VALUE))
-							{
-								TAG_OUT_PVI_DC_CURRENT = protocol->getValueAsFloat32(&container[n]);
-								if (index == 0)
-								{
-									mainJSONObject["pvi"]["dc0_current"] = TAG_OUT_PVI_DC_CURRENT;
-								}
-								if (index == 1)
-								{
-									mainJSONObject["pvi"]["dc1_current"] = TAG_OUT_PVI_DC_CURRENT;
-								}
-							}
+						else {
+							// default behaviour
+							printf("Unknown PVI tag %08X\n", response->tag);
 						}
-						protocol->destroyValueData(container);
 						break;
 					}
-					// ...
-					default:
-						// default behaviour
-						printf("Unknown PVI tag %08X\n", response->tag);
-						break;
 				}
 			}
-			protocol->destroyValueData(PVIData);
 			break;
 		}
 		// ...
@@ -675,15 +1121,32 @@ int handleResponseValue(RscpProtocol *protocol, SRscpValue *response) {
 			printf("Unknown tag %08X\n", response->tag);
 			break;
 	}
-
+	if(bSampled && response->dataType != RSCP::eTypeContainer) {
+		if(bValid) {
+			tagQuality.good(response->tag, 0);
+		}
+		else {
+			tagQuality.error(response->tag, 0, 0);
+		}
+	}
+	return bValid ? 0 : -1;
 }
 
 static int processReceiveBuffer(const unsigned char * ucBuffer, int iLength)
 {
 	RscpProtocol protocol;
-	SRscpFrame frame;
+	// the values are views into ucBuffer, the frame keeps its capacity for the next one
+	static thread_local SRscpFrame frame;
+	if (iStaticMemory != 0 && frame.data.capacity() < MAX_FRAME_VALUES) {
+		frame.data.reserve(MAX_FRAME_VALUES);
+		for (int i = 0; i < 3; ++i) {
+			containerViews[i].reserve(MAX_FRAME_VALUES);
+		}
+	}
 
-	int iResult = protocol.parseFrame(ucBuffer, iLength, &frame);
+	int64_t start = RscpMetrics::now();
+	// the CRC was checked already while the frame was decrypted (RscpDecryptor)
+	int iResult = protocol.parseFrameViews(ucBuffer, iLength, &frame, false);
 	if(iResult < 0) {
 		// check if frame length error occured
 		// in that case the full frame length was not received yet
@@ -698,270 +1161,1435 @@ static int processReceiveBuffer(const unsigned char * ucBuffer, int iLength)
 	}
 
 	int iProcessedBytes = iResult;
+	start = RscpMetrics::record(eStageParse, start);
 
-	// process each SRscpValue struct seperately
-	for(unsigned int i; i < frame.data.size(); i++) {
+	// process each SRscpValue struct seperately, an error of one value does not discard the others
+	tagQuality.beginSample(start);
+	for(unsigned int i = 0; i < frame.data.size(); i++) {
 		handleResponseValue(&protocol, &frame.data[i]);
 	}
-
-	// Write data to json file if data was correctly received
-	if (gotData) {
-		std::ofstream o(TARGET_FILE);
-		o << std::setw(4) << mainJSONObject << std::endl;
-		gotData = false;
-		gotDataFailed = 0;
-	} else {
-		// Increase failure counter
-		++gotDataFailed;
-
-		// If failure appeared multiple times in a row we have a basic communication problem with E3DC
-		// Exit application. Start script should restart this program shortly after exit
-		if (gotDataFailed > 10) {
-			printf("Failed to receive data multiple times. Exiting with error");
-			exit(EXIT_FAILURE);
-		}
-	}
-
-	// destroy frame data and free memory
-	protocol.destroyFrameData(frame);
+	RscpMetrics::record(eStageDispatch, start);
 
 	// returned processed amount of bytes
 	return iProcessedBytes;
 }
 
-static void receiveLoop(bool & bStopExecution)
+void process_mem_usage(double &vm_usage, double &resident_set)
 {
-	//--------------------------------------------------------------------------------------------------------------
-	// RSCP Receive Frame Block Data
-	//--------------------------------------------------------------------------------------------------------------
-	// setup a static dynamic buffer which is dynamically expanded (re-allocated) on demand
-	// the data inside this buffer is not released when this function is left
-	static int iReceivedBytes = 0;
-	static std::vector<uint8_t> vecDynamicBuffer;
+	vm_usage = 0.0;
+	resident_set = 0.0;
 
-	// check how many RSCP frames are received, must be at least 1
-	// multiple frames can only occur in this example if one or more frames are received with a big time delay
-	// this should usually not occur but handling this is shown in this example
-	int iReceivedRscpFrames = 0;
-	while(!bStopExecution && ((iReceivedBytes > 0) || iReceivedRscpFrames == 0))
+	// the two fields we want, read without streams which would allocate
+	unsigned long vsize = 0;
+	long rss = 0;
 	{
-		// check and expand buffer
-		if((vecDynamicBuffer.size() - iReceivedBytes) < 4096) {
-			// check maximum size
-			if(vecDynamicBuffer.size() > RSCP_MAX_FRAME_LENGTH) {
-				// something went wrong and the size is more than possible by the RSCP protocol
-				printf("Maximum buffer size exceeded %i\n", vecDynamicBuffer.size());
-				bStopExecution = true;
-				break;
-			}
-			// increase buffer size by 4096 bytes each time the remaining size is smaller than 4096
-			vecDynamicBuffer.resize(vecDynamicBuffer.size() + 4096);
+		char cStat[1024];
+		int iFile = open("/proc/self/stat", O_RDONLY | O_CLOEXEC);
+		if (iFile < 0) {
+			return;
 		}
-		// receive data
-		int iResult = SocketRecvData(iSocket, &vecDynamicBuffer[0] + iReceivedBytes, vecDynamicBuffer.size() - iReceivedBytes);
-		if(iResult < 0)
-		{
-			// check errno for the error code to detect if this is a timeout or a socket error
-			if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
-				// receive timed out -> continue with re-sending the initial block
-				printf("Response receive timeout (retry)\n");
-				break;
-			}
-			// socket error -> check errno for failure code if needed
-			printf("Socket receive error. errno %i\n", errno);
-			bStopExecution = true;
-			break;
+		ssize_t iLength = read(iFile, cStat, sizeof(cStat) - 1);
+		close(iFile);
+		RscpMetrics::countSyscalls(3);
+		if (iLength <= 0) {
+			return;
 		}
-		else if(iResult == 0)
-		{
-			// connection was closed regularly by peer
-			// if this happens on startup each time the possible reason is
-			// wrong AES password or wrong network subnet (adapt hosts.allow file required)
-			printf("Connection closed by peer\n");
-			bStopExecution = true;
+		cStat[iLength] = '\0';
+		// the command name in field 2 can contain spaces, the remaining fields follow its closing parenthesis
+		const char *fields = strrchr(cStat, ')');
+		if (fields == NULL || sscanf(fields + 1, " %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %lu %ld", &vsize, &rss) != 2) {
+			return;
+		}
+	}
+
+	long page_size_kb = sysconf(_SC_PAGE_SIZE) / 1024; // in case x86-64 is configured to use 2MB pages
+	vm_usage = vsize / 1024.0;
+	resident_set = rss * page_size_kb;
+}
+
+static void addPipelineStatistics(void)
+{
+	SRscpPipelineStageStatistics stages[2];
+	pPipeline->getStatistics(stages[0], stages[1]);
+	const char *names[2] = { "decode", "output" };
+	for (int i = 0; i < 2; ++i) {
+		json & stage = mainJSONObject["prog"]["pipeline"][names[i]];
+		stage["queue_depth"] = stages[i].queueDepth;
+		stage["queue_depth_max"] = stages[i].maxQueueDepth;
+		stage["processed"] = stages[i].processed;
+		stage["dropped"] = stages[i].dropped;
+		stage["latency_avg_us"] = stages[i].averageLatencyNs / 1000.0;
+		stage["latency_max_us"] = stages[i].maxLatencyNs / 1000.0;
+	}
+}
+
+static void addMetrics(void)
+{
+	json & metrics = mainJSONObject["prog"]["metrics"];
+	for (int i = 0; i < RSCP_METRICS_STAGES; ++i) {
+		const RscpHistogram & histogram = RscpMetrics::histogram((ERscpStage)i);
+		json & stage = metrics["stages"][RscpMetrics::stageName((ERscpStage)i)];
+		uint64_t count = histogram.count();
+		stage["count"] = count;
+		stage["avg_us"] = count ? histogram.sum() / 1000.0 / count : 0.0;
+		stage["p50_us"] = histogram.percentile(0.5) / 1000.0;
+		stage["p99_us"] = histogram.percentile(0.99) / 1000.0;
+		stage["p999_us"] = histogram.percentile(0.999) / 1000.0;
+		stage["max_us"] = histogram.max() / 1000.0;
+	}
+	// kept to reuse the vector and the names
+	static std::vector<SRscpThreadCounters> threads;
+	RscpMetrics::getThreadCounters(threads);
+	for (size_t i = 0; i < threads.size(); ++i) {
+		json & thread = metrics["threads"][threads[i].name];
+		thread["allocations"] = threads[i].allocations;
+		thread["allocated_bytes"] = threads[i].allocatedBytes;
+		thread["frees"] = threads[i].frees;
+		thread["syscalls"] = threads[i].syscalls;
+	}
+	json & receive = metrics["receive"];
+	uint64_t frames = RscpMetrics::receivedFrames();
+	receive["frames"] = frames;
+	receive["calls"] = RscpMetrics::receiveCalls();
+	receive["calls_per_frame"] = frames ? (double)RscpMetrics::receiveCalls() / frames : 0.0;
+	json & heap = metrics["heap"];
+	heap["static_memory"] = iStaticMemory;
+	heap["violations"] = RscpMetrics::heapViolations();
+}
+
+// every number and bool of the json data becomes a gauge named by its path, for example e3dc_power_pv, the entries of
+// an array are one family with their position as label, for example e3dc_pvi_ac_power{index="0"}
+// \var arrays is the number of arrays around \var value, an entry of a nested array is labeled index1, index2, ...
+static void appendJsonMetrics(std::vector<SRscpMetric> & metrics, const json & value, const std::string & path,
+		const std::string & labels, int arrays)
+{
+	if (value.is_array()) {
+		std::string name = (arrays == 0) ? "index" : "index" + std::to_string(arrays);
+		size_t index = 0;
+		for (json::const_iterator it = value.begin(); it != value.end(); ++it, ++index) {
+			std::string label = name + "=\"" + std::to_string(index) + "\"";
+			appendJsonMetrics(metrics, *it, path, labels.empty() ? label : labels + "," + label, arrays + 1);
+		}
+		return;
+	}
+	if (value.is_object()) {
+		for (json::const_iterator it = value.begin(); it != value.end(); ++it) {
+			const std::string & key = it.key();
+			// the health data of the program and the quality are exported with proper types by appendHealthMetrics
+			if ((path == "e3dc_prog" && (key == "metrics" || key == "pipeline")) || (path == "e3dc" && key == "quality")) {
+				continue;
+			}
+			appendJsonMetrics(metrics, *it, path + "_" + RscpExporter::sanitizeName(key), labels, arrays);
+		}
+		return;
+	}
+	if (!value.is_number() && !value.is_boolean()) {
+		return;
+	}
+	SRscpMetric metric;
+	metric.family = path;
+	metric.type = eMetricGauge;
+	metric.labels = labels;
+	metric.value = value.is_boolean() ? (value.get<bool>() ? 1.0 : 0.0) : value.get<double>();
+	metrics.push_back(metric);
+}
+
+static void appendHealthMetrics(std::vector<SRscpMetric> & metrics)
+{
+	for (int i = 0; i < RSCP_METRICS_STAGES; ++i) {
+		ERscpStage stage = (ERscpStage)i;
+		RscpExporter::appendHistogram(metrics, "rscp_stage_duration_seconds", "Duration of the stages of a fetch cycle",
+				std::string("stage=\"") + RscpMetrics::stageName(stage) + "\"", RscpMetrics::histogram(stage));
+	}
+
+	std::vector<SRscpThreadCounters> threads;
+	RscpMetrics::getThreadCounters(threads);
+	SRscpMetric metric;
+	metric.type = eMetricCounter;
+	for (size_t i = 0; i < threads.size(); ++i) {
+		metric.labels = "thread=\"" + threads[i].name + "\"";
+		metric.family = "rscp_thread_allocations";
+		metric.help = "Heap allocations";
+		metric.value = threads[i].allocations;
+		metrics.push_back(metric);
+		metric.family = "rscp_thread_allocated_bytes";
+		metric.help = "Allocated heap memory";
+		metric.value = threads[i].allocatedBytes;
+		metrics.push_back(metric);
+		metric.family = "rscp_thread_frees";
+		metric.help = "Heap frees";
+		metric.value = threads[i].frees;
+		metrics.push_back(metric);
+		metric.family = "rscp_thread_syscalls";
+		metric.help = "Socket and file system calls";
+		metric.value = threads[i].syscalls;
+		metrics.push_back(metric);
+	}
+
+	metric.labels.clear();
+	metric.family = "rscp_receive_calls";
+	metric.help = "Receive calls of the device connection, each one wakes the I/O thread";
+	metric.value = RscpMetrics::receiveCalls();
+	metrics.push_back(metric);
+	metric.family = "rscp_received_frames";
+	metric.help = "Frames received from the device";
+	metric.value = RscpMetrics::receivedFrames();
+	metrics.push_back(metric);
+
+	SRscpPipelineStageStatistics stages[2];
+	pPipeline->getStatistics(stages[0], stages[1]);
+	const char *names[2] = { "decode", "output" };
+	for (int i = 0; i < 2; ++i) {
+		metric.labels = std::string("stage=\"") + names[i] + "\"";
+		metric.type = eMetricCounter;
+		metric.family = "rscp_pipeline_processed";
+		metric.help = "Buffers processed by a pipeline stage";
+		metric.value = stages[i].processed;
+		metrics.push_back(metric);
+		metric.family = "rscp_pipeline_dropped";
+		metric.help = "Buffers dropped because a pipeline stage was full";
+		metric.value = stages[i].dropped;
+		metrics.push_back(metric);
+		metric.type = eMetricGauge;
+		metric.family = "rscp_pipeline_queue_depth";
+		metric.help = "Buffers waiting for a pipeline stage";
+		metric.value = stages[i].queueDepth;
+		metrics.push_back(metric);
+	}
+
+	int64_t now = RscpMetrics::now();
+	for (size_t i = 0; i < tagQuality.size(); ++i) {
+		const SRscpTagQuality & entry = tagQuality.at(i);
+		char cTag[16];
+		snprintf(cTag, sizeof(cTag), "0x%08X", entry.tag);
+		metric.labels = std::string("tag=\"") + cTag + "\",index=\"" + std::to_string(entry.index) + "\"";
+		metric.type = eMetricCounter;
+		metric.family = "rscp_value_errors";
+		metric.help = "Values answered with an error";
+		metric.value = entry.errors;
+		metrics.push_back(metric);
+		metric.type = eMetricGauge;
+		metric.family = "rscp_value_age_seconds";
+		metric.help = "Age of the last good value, -1 if there was none";
+		metric.value = (entry.lastGood != 0) ? (now - entry.lastGood) / 1e9 : -1.0;
+		metrics.push_back(metric);
+	}
+
+	metric.labels.clear();
+	metric.type = eMetricCounter;
+	metric.family = "rscp_heap_violations";
+	metric.help = "Heap allocations and frees inside a static memory cycle";
+	metric.value = RscpMetrics::heapViolations();
+	metrics.push_back(metric);
+
+	metric.labels = "serial_number=\"" + RscpExporter::escapeLabel(TAG_EMS_OUT_SERIAL_NUMBER) + "\"";
+	// OpenMetrics info type, the sample is e3dc_info
+	metric.type = eMetricInfo;
+	metric.family = "e3dc";
+	metric.help = "Device information";
+	metric.value = 1;
+	metrics.push_back(metric);
+}
+
+static void publishMetrics(void)
+{
+	static const std::string device = std::string(SERVER_IP) + ":" + std::to_string(SERVER_PORT);
+	std::vector<SRscpMetric> metrics;
+	appendJsonMetrics(metrics, mainJSONObject, "e3dc", std::string(), 0);
+	appendHealthMetrics(metrics);
+	pExporter->publish(device, metrics);
+}
+
+// entries of tagQuality which are in the output, they stay listed to keep the node order stable
+static bool qualityListed[RSCP_QUALITY_MAX_TAGS];
+
+static void addQuality(void)
+{
+	// only values which failed or were stale are listed, a healthy sample renders no entry
+	json & quality = mainJSONObject["quality"];
+	int64_t now = RscpMetrics::now();
+	for (size_t i = 0; i < tagQuality.size(); ++i) {
+		const SRscpTagQuality & entry = tagQuality.at(i);
+		ERscpQuality state = RscpQuality::quality(entry, now, QUALITY_STALE_SECONDS * 1000000000LL);
+		if (entry.errors == 0 && state == eQualityGood && !qualityListed[i]) {
+			continue;
+		}
+		qualityListed[i] = true;
+		char cName[24];
+		RscpQuality::name(entry, cName, sizeof(cName));
+		json & value = quality[(const char *)cName];
+		setJsonString(value["state"], RscpQuality::qualityName(state));
+		value["errors"] = entry.errors;
+		value["error_code"] = entry.errorCode;
+		value["age_s"] = (entry.lastGood != 0) ? (now - entry.lastGood) / 1e9 : -1.0;
+	}
+}
+
+static void addWallboxControl(void)
+{
+	if (!bWallboxControl) {
+		return;
+	}
+	json & control = mainJSONObject["wb_control"];
+	control["index"] = wallboxControl.wallbox();
+	control["surplus"] = wallboxControl.surplus();
+	control["current"] = wallboxControl.current();
+	control["setpoints"] = wallboxControl.setpoints();
+	control["accepted"] = wallboxControl.accepted();
+	control["rejected"] = wallboxControl.rejected();
+}
+
+static void addEnergyCounters(void)
+{
+	// the counters are integer mWh, the output is in Wh
+	for (size_t slot = 0; slot < RSCP_ENERGY_MAX_METERS; ++slot) {
+		const SRscpEnergyMeter & meter = energyCounters.meter(slot);
+		if (!meter.used) {
+			continue;
+		}
+		json & energy = ((meter.index == 0) ? mainJSONObject["pm"] : mainJSONObject["pm" + std::to_string(meter.index)])["energy"];
+		for (int phase = 0; phase < RSCP_ENERGY_PHASES; ++phase) {
+			energy["open"][phase] = meter.open[phase] / 1000.0;
+			energy["interval"][phase] = meter.completed[phase] / 1000.0;
+		}
+		energy["interval_start"] = energyCounters.completedStart();
+		energy["incomplete"] = meter.completedIncomplete;
+		energy["open_incomplete"] = meter.openIncomplete;
+		energy["interval_s"] = energyCounters.interval();
+		energy["rollovers"] = meter.rollovers;
+		energy["resets"] = meter.resets;
+	}
+}
+
+static void addTopology(void)
+{
+	// the lists are rendered as new arrays, so only after a discovery
+	static uint32_t uiRenderedVersion = 0;
+	uint32_t uiVersion = uiTopologyVersion.load();
+	if (uiVersion == uiRenderedVersion) {
+		return;
+	}
+	uiRenderedVersion = uiVersion;
+	json & meta = mainJSONObject["meta"]["topology"];
+	meta["battery"] = topology.battery;
+	meta["dcb_count"] = topology.dcbCount;
+	meta["batteries"] = topology.batteries;
+	meta["pvi_strings"] = topology.pviStrings;
+	meta["pvi_phases"] = topology.pviPhases;
+	meta["pvi_temperatures"] = topology.pviTemperatures;
+	meta["dcdcs"] = topology.dcdcs;
+	meta["power_meters"] = topology.powerMeters;
+	meta["wallboxes"] = topology.wallboxes;
+	for (size_t i = 0; i < topology.sysSpecs.size(); ++i) {
+		meta["sys_specs"][topology.sysSpecs[i].first] = topology.sysSpecs[i].second;
+	}
+}
+
+// output adapter of the json serializer which appends to the text of the current pipeline buffer
+class RscpTextOutput : public nlohmann::detail::output_adapter_protocol<char> {
+public:
+	RscpTextOutput() : target(NULL) {}
+	void write_character(char c) override {
+		target->push_back(c);
+	}
+	void write_characters(const char *s, std::size_t length) override {
+		target->append(s, length);
+	}
+	std::string *target;
+};
+
+// render \var value into \var text, indented by \var indent spaces per level or in one line if it is -1
+static void serializeJson(const json & value, std::string & text, int indent)
+{
+	// the serializer and its adapter are kept, dump() would create both and a new string for every sample
+	static std::shared_ptr<RscpTextOutput> textOutput = std::make_shared<RscpTextOutput>();
+	static nlohmann::detail::serializer<json> serializer(textOutput, ' ');
+	text.clear();
+	textOutput->target = &text;
+	serializer.dump(value, indent >= 0, false, (indent >= 0) ? indent : 0);
+}
+
+static bool renderOutput(std::string & text)
+{
+	// Render json data if the frame answered a sample, failed values keep their last good value
+	if (!gotData) {
+		return false;
+	}
+	gotData = false;
+
+	// Print periodic statistics about memory consumption (yeah, looks like we could have a memory-leak)
+	// the first sample creates the nodes, later samples only update them
+	if (printStats == 0) {
+		// Get current memory consumption
+		double vm, rss;
+		process_mem_usage(vm, rss);
+
+		mainJSONObject["prog"]["mem_vm"] = vm;
+		mainJSONObject["prog"]["mem_rss"] = rss;
+	}
+	if (++printStats >= 300) {
+		printStats = 0;
+	}
+	addPipelineStatistics();
+	addTopology();
+	addQuality();
+	addWallboxControl();
+	addEnergyCounters();
+	addMetrics();
+
+	int64_t start = RscpMetrics::now();
+	serializeJson(mainJSONObject, text, 4);
+	RscpMetrics::record(eStageSerialize, start);
+	return true;
+}
+
+// integral values are rendered without a fraction, e.g. the number of modules
+static void setJsonNumber(json & node, double value)
+{
+	if (value == floor(value) && fabs(value) < 9007199254740992.0) {
+		node = (int64_t)value;
+	}
+	else {
+		node = value;
+	}
+}
+
+// the array is only created again if the number of cells changed
+static void setJsonArray(json & node, const float *values, uint32_t count)
+{
+	if (!node.is_array() || node.size() != count) {
+		node = json::array();
+		for (uint32_t i = 0; i < count; ++i) {
+			node.push_back(values[i]);
+		}
+		return;
+	}
+	for (uint32_t i = 0; i < count; ++i) {
+		node[i] = values[i];
+	}
+}
+
+static void renderBatteryDetail(std::string & text)
+{
+	// battery <index> is provided as "bat<index>", its modules as "dcb<index>" inside
+	int64_t now = RscpMetrics::now();
+	char cKey[16];
+	for (size_t b = 0; b < batteryDetail.batteryCount(); ++b) {
+		const SRscpBattery & battery = batteryDetail.battery(b);
+		snprintf(cKey, sizeof(cKey), "bat%u", battery.index);
+		json & node = batteryDetailJSON[(const char *)cKey];
+		for (uint32_t i = 0; i < RSCP_BATTERY_FIELDS; ++i) {
+			if (!isnan(battery.values[i])) {
+				setJsonNumber(node[RscpBatteryDetail::batteryField(i)], battery.values[i]);
+			}
+		}
+		for (uint32_t m = 0; m < battery.modules; ++m) {
+			size_t uiModule = battery.firstModule + m;
+			const SRscpBatteryModule & module = batteryDetail.module(uiModule);
+			if (module.updated == 0) {
+				continue;
+			}
+			snprintf(cKey, sizeof(cKey), "dcb%u", module.dcb);
+			json & dcb = node[(const char *)cKey];
+			for (uint32_t i = 0; i < RSCP_BATTERY_MODULE_FIELDS; ++i) {
+				if (!isnan(module.values[i])) {
+					setJsonNumber(dcb[RscpBatteryDetail::moduleField(i)], module.values[i]);
+				}
+			}
+			setJsonArray(dcb["voltages"], batteryDetail.cellVoltages(uiModule), module.voltages);
+			setJsonArray(dcb["temperatures"], batteryDetail.cellTemperatures(uiModule), module.temperatures);
+			dcb["age_s"] = (now - module.updated) / 1e9;
+		}
+	}
+	json & stats = batteryDetailJSON["stats"];
+	stats["frames"] = batteryDetail.frames();
+	stats["errors"] = batteryDetail.errors();
+	stats["dropped"] = batteryDetail.dropped();
+	// the file holds hundreds of cell values, so it is written without indentation
+	serializeJson(batteryDetailJSON, text, -1);
+}
+
+// decode stage of a battery detail response, it is rendered into BATTERY_DETAIL_FILE
+static bool decodeBatteryDetail(SRscpPipelineBuffer *buffer)
+{
+	// the modules follow the topology, the first response after a discovery creates the json nodes
+	static uint32_t uiLayoutVersion = 0;
+	uint32_t uiVersion = uiTopologyVersion.load();
+	if (uiVersion != uiLayoutVersion) {
+		uiLayoutVersion = uiVersion;
+		batteryDetail.setLayout(topology.batteries);
+		batteryDetailJSON = json::object();
+	}
+	RscpNoHeapScope noHeap(iStaticMemory != 0 && batteryDetail.frames() > 0 && batteryDetail.complete());
+	int64_t start = RscpMetrics::now();
+	int iResult = batteryDetail.handleFrame(&buffer->data[0], buffer->length, buffer->received);
+	if (iResult <= 0) {
+		printf("Error parsing battery detail frame: %i\n", iResult);
+		return false;
+	}
+	renderBatteryDetail(buffer->text);
+	buffer->target = pBatteryDetailFile;
+	RscpMetrics::record(eStageBatteryDetail, start);
+	return true;
+}
+
+// decode stage: runs on the decode thread and is the only place which touches mainJSONObject
+static bool decodeFrame(SRscpPipelineBuffer *buffer)
+{
+	buffer->target = NULL;
+	if (RscpBatteryDetail::isResponse(&buffer->data[0], buffer->length)) {
+		return decodeBatteryDetail(buffer);
+	}
+	// the first frames of a session create the json nodes, the following ones must not use the heap
+	static uint32_t uiDecodedSession = 0;
+	static uint32_t uiSessionFrames = 0;
+	uint32_t uiCurrentSession = uiSession.load();
+	if (uiCurrentSession != uiDecodedSession) {
+		uiDecodedSession = uiCurrentSession;
+		uiSessionFrames = 0;
+	}
+	// the PVI arrays follow the topology
+	static uint32_t uiPVIVersion = 0;
+	uint32_t uiVersion = uiTopologyVersion.load();
+	if (uiVersion != uiPVIVersion) {
+		uiPVIVersion = uiVersion;
+		setPVILayout(topology);
+	}
+	{
+		RscpNoHeapScope noHeap(iStaticMemory != 0 && ++uiSessionFrames > STATIC_MEMORY_WARMUP);
+		if (bWallboxControl) {
+			wallboxControl.beginSample(buffer->received);
+		}
+		int iResult = processReceiveBuffer(&buffer->data[0], buffer->length);
+		if (iResult <= 0) {
+			printf("Error parsing RSCP frame: %i\n", iResult);
+			return false;
+		}
+		// the setpoint of the sample is pending before the I/O thread waits for the next cycle
+		if (bWallboxControl) {
+			wallboxControl.endSample();
+		}
+		if (!renderOutput(buffer->text)) {
+			return false;
+		}
+		if (buffer->requested != 0) {
+			RscpMetrics::record(eStageCycle, buffer->requested);
+		}
+	}
+	// the exporter renders its response from the samples, it is not part of the static memory cycle
+	if (pExporter != NULL) {
+		publishMetrics();
+	}
+	return true;
+}
+
+// output stage: runs on the output thread, a slow sink only delays this thread
+static void writeOutput(SRscpPipelineBuffer *buffer)
+{
+	RscpNoHeapScope noHeap(iStaticMemory != 0);
+	int64_t start = RscpMetrics::now();
+	buffer->text += '\n';
+	const char *pTarget = (buffer->target != NULL) ? buffer->target : pTargetFile;
+	int iFile = open(pTarget, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (iFile < 0) {
+		RscpMetrics::countSyscalls(1);
+		printf("Cannot write %s. errno %i\n", pTarget, errno);
+		return;
+	}
+	const char *data = buffer->text.c_str();
+	size_t remaining = buffer->text.size();
+	uint32_t uiSyscalls = 2;
+	while (remaining > 0) {
+		ssize_t written = write(iFile, data, remaining);
+		++uiSyscalls;
+		if (written < 0 && errno == EINTR) {
+			continue;
+		}
+		if (written <= 0) {
+			printf("Cannot write %s. errno %i\n", pTarget, errno);
 			break;
 		}
-		// increment amount of received bytes
-		iReceivedBytes += iResult;
+		data += written;
+		remaining -= written;
+	}
+	close(iFile);
+	RscpMetrics::countSyscalls(uiSyscalls);
+	RscpMetrics::record(eStageWrite, start);
+}
+
+// I/O stage: only the frame length is checked here, the frame is parsed by the decode thread
+static int submitReceiveBuffer(const unsigned char * ucBuffer, int iLength)
+{
+	RscpProtocol protocol;
+	int iFrameLength = protocol.getFrameLength(ucBuffer, iLength);
+	if (iFrameLength == RSCP::ERR_INVALID_FRAME_LENGTH || iFrameLength > iLength) {
+		// the full frame was not received yet
+		return 0;
+	}
+	if (iFrameLength < 0) {
+		return iFrameLength;
+	}
+	if (!pPipeline->submit(ucBuffer, iFrameLength, iCycleStartedAt)) {
+		printf("Decode stage full, frame dropped\n");
+	}
+	return iFrameLength;
+}
+
+// end of the last request send, the first receive after it is the device round trip
+static int64_t iRequestSentAt = 0;
+// received and not yet processed bytes, kept when receiveLoop is left and dropped with the connection
+static int iReceivedBytes = 0;
+// the received bytes which are decrypted already, the decryptor continues behind them
+static int iDecryptedBytes = 0;
+// decrypts the received frames and checks their CRC in the same pass
+static RscpDecryptor frameDecryptor(aesDecrypter);
+
+// a deadline (CLOCK_MONOTONIC in ns, 0 for none) bounds the wait for data, otherwise the socket receive timeout applies
+static int receiveLoop(bool & bStopExecution, int (*handleFrame)(const unsigned char *, int), int64_t iDeadline)
+{
+	//--------------------------------------------------------------------------------------------------------------
+	// RSCP Receive Frame Block Data
+	//--------------------------------------------------------------------------------------------------------------
+	// the buffers are allocated once for a frame of maximum length
+	// the data inside the receive buffer is kept when this function is left
+	static uint8_t ucReceiveBuffer[RECEIVE_BUFFER_SIZE];
+	static uint8_t ucDecryptionBuffer[RECEIVE_BUFFER_SIZE];
 
-		// process all received frames
-		while (!bStopExecution)
+	// check how many RSCP frames are received, must be at least 1
+	// multiple frames can only occur in this example if one or more frames are received with a big time delay
+	// this should usually not occur but handling this is shown in this example
+	int iReceivedRscpFrames = 0;
+	uint32_t uiReceiveCalls = 0;
+	while(!bStopExecution)
+	{
+		// decrypt the blocks which were not decrypted yet, the CRC of a frame is checked with its last block
+		int iLength = ROUNDDOWN(iReceivedBytes, AES_BLOCK_SIZE);
+		int iFrameStart = 0;
+		while(!bStopExecution && iDecryptedBytes < iLength)
 		{
-			// round down to a multiple of AES_BLOCK_SIZE
-			int iLength = ROUNDDOWN(iReceivedBytes, AES_BLOCK_SIZE);
-			// if not even 32 bytes were received then the frame is still incomplete
-			if(iLength == 0) {
+			int64_t start = RscpMetrics::now();
+			int32_t iBlocks = frameDecryptor.decrypt(ucReceiveBuffer + iDecryptedBytes, ucDecryptionBuffer + iDecryptedBytes,
+					(iLength - iDecryptedBytes) / AES_BLOCK_SIZE);
+			RscpMetrics::record(eStageDecrypt, start);
+			if(iBlocks < 0 || iFrameStart + frameDecryptor.frameBytes() > sizeof(ucReceiveBuffer)) {
+				// the data received is not RSCP data, the CRC does not match or the size is more than possible by the RSCP protocol
+				printf("Error parsing RSCP frame: %i\n", (iBlocks < 0) ? iBlocks : RSCP::ERR_INVALID_FRAME_LENGTH);
+				bStopExecution = true;
+				iReceivedBytes = 0;
+				iDecryptedBytes = 0;
+				iFrameStart = 0;
 				break;
 			}
-			// resize temporary decryption buffer
-			std::vector<uint8_t> decryptionBuffer;
-			decryptionBuffer.resize(iLength);
-			// initialize encryption sequence IV value with value of previous block
-			aesDecrypter.SetIV(ucDecryptionIV, AES_BLOCK_SIZE);
-			// decrypt data from vecDynamicBuffer to temporary decryptionBuffer
-			aesDecrypter.Decrypt(&vecDynamicBuffer[0], &decryptionBuffer[0], iLength / AES_BLOCK_SIZE);
-
-			// data was received, check if we received all data
-			int iProcessedBytes = processReceiveBuffer(&decryptionBuffer[0], iLength);
-			if(iProcessedBytes < 0) {
+			iDecryptedBytes += iBlocks * AES_BLOCK_SIZE;
+			if(!frameDecryptor.complete()) {
+				// the rest of the frame is received next
+				break;
+			}
+
+			// the frame is complete
+			int iFrameBytes = frameDecryptor.frameBytes();
+			frameDecryptor.nextFrame();
+			int iProcessedBytes = handleFrame(ucDecryptionBuffer + iFrameStart, iFrameBytes);
+			if(iProcessedBytes <= 0) {
 				// an error occured;
 				printf("Error parsing RSCP frame: %i\n", iProcessedBytes);
 				// stop execution as the data received is not RSCP data
 				bStopExecution = true;
+				iReceivedBytes = 0;
+				iDecryptedBytes = 0;
+				iFrameStart = 0;
 				break;
+			}
+			// increment a counter that a valid frame was received and
+			// continue the decryption in case a 2nd frame is in the buffer as well
+			iFrameStart += iFrameBytes;
+			iReceivedRscpFrames++;
+		}
+		if(iFrameStart > 0) {
+			// move the data behind the handled frames (if any received) to the front, the decrypted part of it as well
+			memmove(ucReceiveBuffer, ucReceiveBuffer + iFrameStart, iReceivedBytes - iFrameStart);
+			memmove(ucDecryptionBuffer, ucDecryptionBuffer + iFrameStart, iDecryptedBytes - iFrameStart);
+			iReceivedBytes -= iFrameStart;
+			iDecryptedBytes -= iFrameStart;
+		}
+		// receive until at least one frame is complete and no frame is received partly
+		if(bStopExecution || (iReceivedRscpFrames > 0 && iReceivedBytes == 0)) {
+			break;
+		}
 
+		// check the remaining space
+		if(iReceivedBytes >= (int)sizeof(ucReceiveBuffer)) {
+			// something went wrong and the size is more than possible by the RSCP protocol
+			printf("Maximum buffer size exceeded %i\n", iReceivedBytes);
+			bStopExecution = true;
+			iReceivedBytes = 0;
+			iDecryptedBytes = 0;
+			break;
+		}
+		// receive data: as much as is available while the length of the frame is unknown, otherwise exactly
+		// the rest of the frame with a single call
+		int64_t start = RscpMetrics::now();
+		if(iDeadline != 0) {
+			// a bounded receive does not block in the receive call, a partial frame is continued by the next one
+			int64_t iWaitMs = (iDeadline - start) / 1000000;
+			if(iWaitMs <= 0 || SocketWaitData(iSocket, (int)iWaitMs) == 0) {
+				break;
 			}
-			else if(iProcessedBytes > 0) {
-				// round up the processed bytes as iProcessedBytes does not include the zero padding bytes
-				iProcessedBytes = ROUNDUP(iProcessedBytes, AES_BLOCK_SIZE);
-				// store the IV value from encrypted buffer for next block decryption
-				memcpy(ucDecryptionIV, &vecDynamicBuffer[0] + iProcessedBytes - AES_BLOCK_SIZE, AES_BLOCK_SIZE);
-				// move the encrypted data behind the current frame data (if any received) to the front
-				memcpy(&vecDynamicBuffer[0], &vecDynamicBuffer[0] + iProcessedBytes, vecDynamicBuffer.size() - iProcessedBytes);
-				// decrement the total received bytes by the amount of processed bytes
-				iReceivedBytes -= iProcessedBytes;
-				// increment a counter that a valid frame was received and
-				// continue parsing process in case a 2nd valid frame is in the buffer as well
-				iReceivedRscpFrames++;
+			start = RscpMetrics::now();
+		}
+		int iResult;
+		int iFrameBytes = frameDecryptor.frameBytes();
+		if(iFrameBytes > 0 && iDeadline == 0) {
+			iResult = SocketRecvAll(iSocket, ucReceiveBuffer + iReceivedBytes, iFrameBytes - iReceivedBytes);
+		}
+		else if(iFrameBytes > 0) {
+			iResult = SocketRecvData(iSocket, ucReceiveBuffer + iReceivedBytes, iFrameBytes - iReceivedBytes);
+		}
+		else {
+			iResult = SocketRecvData(iSocket, ucReceiveBuffer + iReceivedBytes, sizeof(ucReceiveBuffer) - iReceivedBytes);
+		}
+		++uiReceiveCalls;
+		if(iResult > 0) {
+			if(iRequestSentAt != 0) {
+				RscpMetrics::record(eStageRoundTrip, iRequestSentAt);
+				iRequestSentAt = 0;
 			}
 			else {
-				// iProcessedBytes is 0
-				// not enough data of the next frame received, go back to receive mode if iReceivedRscpFrames == 0
-				// or transmit mode if iReceivedRscpFrames > 0
+				RscpMetrics::record(eStageReceive, start);
+			}
+		}
+		if(iResult < 0)
+		{
+			// check errno for the error code to detect if this is a timeout or a socket error
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+				// receive timed out -> continue with re-sending the initial block
+				printf("Response receive timeout (retry)\n");
 				break;
 			}
+			// socket error -> check errno for failure code if needed
+			printf("Socket receive error. errno %i\n", errno);
+			bStopExecution = true;
+			// a partial frame of this connection must not be continued by the next one
+			iReceivedBytes = 0;
+			iDecryptedBytes = 0;
+			break;
+		}
+		else if(iResult == 0)
+		{
+			// connection was closed regularly by peer
+			// if this happens on startup each time the possible reason is
+			// wrong AES password or wrong network subnet (adapt hosts.allow file required)
+			printf("Connection closed by peer\n");
+			bStopExecution = true;
+			iReceivedBytes = 0;
+			iDecryptedBytes = 0;
+			break;
 		}
+		// increment amount of received bytes
+		iReceivedBytes += iResult;
 	}
+	RscpMetrics::countReceive(uiReceiveCalls, iReceivedRscpFrames);
+	return iReceivedRscpFrames;
 }
 
-void process_mem_usage(double &vm_usage, double &resident_set)
+// transmit slab of the device connection, every request is created, encrypted and sent inside it
+static RscpSendSlab sendSlab(aesEncrypter);
+
+static int sendFrame(int32_t length)
 {
-	vm_usage = 0.0;
-	resident_set = 0.0;
+	int64_t start = RscpMetrics::now();
+	// pad and encrypt the frame in place, the encrypted length is a multiple of AES_BLOCK_SIZE
+	uint32_t uiLength = (length > 0) ? sendSlab.encrypt(length) : 0;
+	if(uiLength == 0) {
+		return -1;
+	}
+	start = RscpMetrics::record(eStageEncrypt, start);
 
-	// the two fields we want
-	unsigned long vsize;
-	long rss;
-	{
-		std::string ignore;
-		std::ifstream ifs("/proc/self/stat", std::ios_base::in);
-		ifs >> ignore >> ignore >> ignore >> ignore >> ignore >> ignore >> ignore >> ignore >> ignore >> ignore >> ignore >> ignore >> ignore >> ignore >> ignore >> ignore >> ignore >> ignore >> ignore >> ignore >> ignore >> ignore >> vsize >> rss;
+	// send data on socket
+	int iResult = SocketSendData(iSocket, sendSlab.data(), uiLength);
+	iRequestSentAt = RscpMetrics::record(eStageSend, start);
+	return iResult;
+}
+
+static int sendValue(const SRscpValue & rootValue)
+{
+	return sendFrame(sendSlab.createFrame(rootValue.data, rootValue.length));
+}
+
+// values of the poll request of the current state, only the frame header and the CRC are created for every cycle
+static std::vector<uint8_t> vecRequestData;
+static int iRequestState = -1;
+// values of the authentication request, built once and reused by every reconnect
+static std::vector<uint8_t> vecAuthenticationData;
+
+static bool createRequestData(std::vector<uint8_t> & data)
+{
+	RscpProtocol protocol;
+	SRscpFrameBuffer frameBuffer;
+	memset(&frameBuffer, 0, sizeof(frameBuffer));
+	createRequestExample(&frameBuffer);
+	bool bValid = (frameBuffer.dataLength >= sizeof(SRscpFrameHeader) + sizeof(uint32_t));
+	if(bValid) {
+		data.assign(frameBuffer.data + sizeof(SRscpFrameHeader), frameBuffer.data + frameBuffer.dataLength - sizeof(uint32_t));
 	}
+	protocol.destroyFrameData(&frameBuffer);
+	return bValid;
+}
 
-	long page_size_kb = sysconf(_SC_PAGE_SIZE) / 1024; // in case x86-64 is configured to use 2MB pages
-	vm_usage = vsize / 1024.0;
-	resident_set = rss * page_size_kb;
+static int createRequestFrame(void)
+{
+	const std::vector<uint8_t> *pData = &vecRequestData;
+	if(iAuthenticated == 0) {
+		if(vecAuthenticationData.empty() && !createRequestData(vecAuthenticationData)) {
+			return 0;
+		}
+		pData = &vecAuthenticationData;
+	}
+	else {
+		// the poll request changes with the serial number and the topology (iRequestState = -1)
+		int iState = bSerialNumberKnown ? 1 : 0;
+		if(iState != iRequestState) {
+			if(createPollRequest(vecRequestData, topology, bSerialNumberKnown) != RSCP::OK) {
+				return 0;
+			}
+			iRequestState = iState;
+		}
+	}
+	int iLength = sendSlab.createFrame(pData->data(), pData->size());
+	return (iLength < 0) ? 0 : iLength;
 }
 
-static void mainLoop(void)
+// tag of the first value of a complete frame, the response to a request starts with the answer to its first value
+static uint32_t responseTag(const unsigned char * ucBuffer, int iLength)
+{
+	if(iLength < (int)(sizeof(SRscpFrameHeader) + RSCP_VALUE_HEADER_SIZE)) {
+		return 0;
+	}
+	return RscpCodec::load32(ucBuffer + sizeof(SRscpFrameHeader));
+}
+
+// the response the I/O thread waits for, the frames which arrive before it answer earlier requests
+static uint32_t uiAwaitedTag = 0;
+static int (*pAwaitedHandler)(const unsigned char *, int) = NULL;
+static bool bAwaitedReceived = false;
+
+static int routeFrame(const unsigned char * ucBuffer, int iLength)
+{
+	uint32_t uiTag = responseTag(ucBuffer, iLength);
+	if(uiTag == uiAwaitedTag) {
+		bAwaitedReceived = true;
+		return pAwaitedHandler(ucBuffer, iLength);
+	}
+	if(uiTag == TAG_EMS_SET_POWER || uiTag == TAG_WB_DATA) {
+		// the command or setpoint was already answered as not acknowledged
+		printf("Late response 0x%08X dropped\n", uiTag);
+		return iLength;
+	}
+	// a poll or battery detail response which arrives after its receive ended is decoded like in time
+	return submitReceiveBuffer(ucBuffer, iLength);
+}
+
+// tag of the first value of the response to the poll request, the authentication until it succeeded
+static uint32_t pollResponseTag(void)
+{
+	return (iAuthenticated == 0) ? TAG_RSCP_AUTHENTICATION : TAG_INFO_TIME;
+}
+
+// receive until the response starting with \var uiTag is handled by \var handleFrame, the receive times out or
+// \var iDeadline (see receiveLoop) passed
+static bool receiveResponse(bool & bStopExecution, uint32_t uiTag, int (*handleFrame)(const unsigned char *, int), int64_t iDeadline)
+{
+	uiAwaitedTag = uiTag;
+	pAwaitedHandler = handleFrame;
+	bAwaitedReceived = false;
+	while(!bStopExecution && !bAwaitedReceived && receiveLoop(bStopExecution, routeFrame, iDeadline) > 0) {
+	}
+	uiAwaitedTag = 0;
+	pAwaitedHandler = NULL;
+	return bAwaitedReceived;
+}
+
+static int handleCommandResponse(const unsigned char * ucBuffer, int iLength)
 {
 	RscpProtocol protocol;
-	bool bStopExecution = false;
+	SRscpFrame frame;
+
+	int iResult = protocol.parseFrame(ucBuffer, iLength, &frame);
+	if(iResult < 0) {
+		// wait for the rest of the frame
+		return (iResult == RSCP::ERR_INVALID_FRAME_LENGTH) ? 0 : iResult;
+	}
+	if(!commandServer.reply(&protocol, *pActiveCommand, frame.data)) {
+		// not the acknowledgement, the command keeps waiting for it
+		bAwaitedReceived = false;
+	}
+	protocol.destroyFrameData(frame);
+	return iResult;
+}
+
+static void sendCommand(SRscpCommand & command, bool & bStopExecution)
+{
+	if(iAuthenticated == 0) {
+		commandServer.replyError(command, "not authenticated");
+		return;
+	}
+	RscpProtocol protocol;
+	SRscpValue rootValue;
+	protocol.createContainerValue(&rootValue, 0);
+	commandServer.appendRequest(&protocol, &rootValue, command);
+
+	int iResult = sendValue(rootValue);
+	protocol.destroyValueData(rootValue);
+	if(iResult < 0) {
+		printf("Socket send error %i. errno %i\n", iResult, errno);
+		commandServer.replyError(command, "send failed");
+		bStopExecution = true;
+		return;
+	}
+	// a late poll response can still arrive before the acknowledgement, it is passed on to the decode thread
+	pActiveCommand = &command;
+	if(!receiveResponse(bStopExecution, TAG_EMS_SET_POWER, handleCommandResponse, 0)) {
+		commandServer.replyError(command, "no response");
+	}
+	pActiveCommand = NULL;
+}
 
+// setpoint of the surplus control whose response is awaited
+static SRscpWallboxSetpoint activeSetpoint;
+
+static int handleWallboxResponse(const unsigned char * ucBuffer, int iLength)
+{
+	return wallboxControl.handleResponse(ucBuffer, iLength, activeSetpoint);
+}
+
+static void sendWallboxSetpoint(bool & bStopExecution)
+{
+	// the decode thread computes the setpoint from the poll response which was just received
+	pPipeline->flush();
+	if(!wallboxControl.takeSetpoint(activeSetpoint)
+			|| std::find(topology.wallboxes.begin(), topology.wallboxes.end(), activeSetpoint.index) == topology.wallboxes.end()) {
+		return;
+	}
+	uint16_t uiLength = 0;
+	const uint8_t *request = wallboxControl.createRequest(activeSetpoint, uiLength);
+	int iResult = sendFrame(sendSlab.createFrame(request, uiLength));
+	if(iResult < 0) {
+		printf("Socket send error %i. errno %i\n", iResult, errno);
+		bStopExecution = true;
+		return;
+	}
+	if(!receiveResponse(bStopExecution, TAG_WB_DATA, handleWallboxResponse, 0)) {
+		printf("No response to the wallbox setpoint\n");
+		wallboxControl.failed();
+	}
+}
+
+static int handleDiscoveryFrame(const unsigned char * ucBuffer, int iLength)
+{
+	RscpProtocol protocol;
+	SRscpFrame frame;
+
+	int iResult = protocol.parseFrame(ucBuffer, iLength, &frame);
+	if(iResult < 0) {
+		// wait for the rest of the frame
+		return (iResult == RSCP::ERR_INVALID_FRAME_LENGTH) ? 0 : iResult;
+	}
+	for(size_t i = 0; i < frame.data.size(); ++i) {
+		topology.handleDiscoveryResponse(&protocol, &frame.data[i]);
+	}
+	protocol.destroyFrameData(frame);
+	return iResult;
+}
+
+static void discoverTopology(bool & bStopExecution)
+{
+	// the cache belongs to the configured device, a restart skips the discovery round trip
+	char cDevice[64];
+	snprintf(cDevice, sizeof(cDevice), "%s:%i", SERVER_IP, SERVER_PORT);
+	if(bTopologyCache && topology.load(TOPOLOGY_CACHE_FILE, cDevice)) {
+		printf("Topology loaded from %s\n", TOPOLOGY_CACHE_FILE);
+		return;
+	}
+
+	RscpProtocol protocol;
+	SRscpValue rootValue;
+	protocol.createContainerValue(&rootValue, 0);
+	topology.appendDiscoveryRequest(&protocol, &rootValue);
+	int iResult = sendValue(rootValue);
+	protocol.destroyValueData(rootValue);
+	if(iResult < 0) {
+		printf("Socket send error %i. errno %i\n", iResult, errno);
+		bStopExecution = true;
+		return;
+	}
+	receiveLoop(bStopExecution, handleDiscoveryFrame, 0);
+	if(!topology.valid) {
+		// not cached and not valid, the next session discovers again
+		printf("Topology discovery failed, using defaults for this session\n");
+		topology.setDefault();
+		return;
+	}
+	printf("Topology: %s, %u DCBs, %u batteries, %u PV strings, %u AC phases, %u PV temperatures, %u DC/DC converters, %u power meters, %u wallboxes\n",
+			topology.battery ? "battery" : "no battery", topology.dcbCount, (unsigned int)topology.batteries.size(), topology.pviStrings, topology.pviPhases,
+			topology.pviTemperatures, (unsigned int)topology.dcdcs.size(),
+			(unsigned int)topology.powerMeters.size(), (unsigned int)topology.wallboxes.size());
+	if(bTopologyCache) {
+		topology.save(TOPOLOGY_CACHE_FILE, cDevice);
+	}
+}
+
+// requests of a battery detail round for the current topology and the next one to send, only used by the I/O thread
+static std::vector<std::vector<uint8_t> > vecBatteryDetailData;
+static uint32_t uiBatteryDetailVersion = 0;
+static size_t uiBatteryDetailNext = 0;
+static int64_t iBatteryDetailDueAt = 0;
+
+// the response is awaited until \var iDeadline (see receiveLoop), the caller only sends if the budget remains
+static void sendBatteryDetail(bool & bStopExecution, int64_t iDeadline)
+{
+	if(iBatteryDetailIntervalMs <= 0 || iAuthenticated == 0 || !topology.valid) {
+		return;
+	}
+	uint32_t uiVersion = uiTopologyVersion.load();
+	if(uiVersion != uiBatteryDetailVersion) {
+		uiBatteryDetailVersion = uiVersion;
+		uiBatteryDetailNext = 0;
+		if(RscpBatteryDetail::createRequests(topology.batteries, BATTERY_DETAIL_BATCH, vecBatteryDetailData) != RSCP::OK) {
+			printf("Cannot create the battery detail request\n");
+			vecBatteryDetailData.clear();
+		}
+	}
+	// a round starts every BATTERY_DETAIL_INTERVAL, its further frames follow in the waits of the next cycles
+	int64_t iNow = RscpMetrics::now();
+	if(vecBatteryDetailData.empty() || (uiBatteryDetailNext == 0 && iNow < iBatteryDetailDueAt)) {
+		return;
+	}
+	if(uiBatteryDetailNext == 0) {
+		iBatteryDetailDueAt = iNow + iBatteryDetailIntervalMs * 1000000;
+	}
+	const std::vector<uint8_t> & data = vecBatteryDetailData[uiBatteryDetailNext];
+	uiBatteryDetailNext = (uiBatteryDetailNext + 1) % vecBatteryDetailData.size();
+	int iResult = sendFrame(sendSlab.createFrame(data.data(), data.size()));
+	if(iResult < 0) {
+		printf("Socket send error %i. errno %i\n", iResult, errno);
+		bStopExecution = true;
+		return;
+	}
+	// the response is decoded and written by the pipeline like a poll response
+	if(!receiveResponse(bStopExecution, TAG_BAT_DATA, submitReceiveBuffer, iDeadline)) {
+		printf("No response to the battery detail request before the next cycle\n");
+	}
+}
+
+static void waitForNextCycle(bool & bStopExecution)
+{
+	// commands are sent as soon as they arrive instead of waiting for the end of the cycle time
+	// the battery detail is requested once per wait if its budget remains, the end of the cycle does not move with it
+	bool bBatteryDetail = true;
+	struct timespec tsNow, tsNextCycle;
+	clock_gettime(CLOCK_MONOTONIC, &tsNextCycle);
+	tsNextCycle.tv_sec += iFetchIntervalMs / 1000;
+	tsNextCycle.tv_nsec += (iFetchIntervalMs % 1000) * 1000000;
+	if(tsNextCycle.tv_nsec >= 1000000000) {
+		tsNextCycle.tv_sec += 1;
+		tsNextCycle.tv_nsec -= 1000000000;
+	}
+	while(!bStopExecution)
+	{
+		SRscpCommand command;
+		while(!bStopExecution && commandServer.nextCommand(command)) {
+			sendCommand(command, bStopExecution);
+		}
+		if(bBatteryDetail && !bStopExecution) {
+			bBatteryDetail = false;
+			// without a cycle time the next request waits at most the budget
+			int64_t iNow = RscpMetrics::now();
+			int64_t iBudget = BATTERY_DETAIL_BUDGET * 1000000LL;
+			int64_t iDeadline = (iFetchIntervalMs == 0) ? iNow + iBudget : tsNextCycle.tv_sec * 1000000000LL + tsNextCycle.tv_nsec;
+			if(iDeadline - iNow >= iBudget) {
+				sendBatteryDetail(bStopExecution, iDeadline);
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &tsNow);
+		int64_t iRemainingMs = (tsNextCycle.tv_sec - tsNow.tv_sec) * 1000 + (tsNextCycle.tv_nsec - tsNow.tv_nsec) / 1000000;
+		if(iRemainingMs <= 0) {
+			break;
+		}
+		commandServer.wait(iRemainingMs);
+	}
+}
+
+static void mainLoop(void)
+{
+	bool bStopExecution = false;
+	bool bCyclesDone = false;
+	uint32_t uiCycles = 0;
+	int iTimeouts = 0;
+
+	// a new session authenticates again, the topology of the device is kept over reconnects
+	++uiSession;
+	// the defaults of a failed discovery are not valid, they are only used until the next session discovers again
+	bool bDiscovered = topology.valid;
 	while(!bStopExecution)
 	{
 		//--------------------------------------------------------------------------------------------------------------
 		// RSCP Transmit Frame Block Data
 		//--------------------------------------------------------------------------------------------------------------
-		SRscpFrameBuffer frameBuffer;
-		memset(&frameBuffer, 0, sizeof(frameBuffer));
+		// the poll request is built for the devices which are really present
+		if(iAuthenticated != 0 && !bDiscovered) {
+			bDiscovered = true;
+			discoverTopology(bStopExecution);
+			++uiTopologyVersion;
+			iRequestState = -1;
+			if(bStopExecution) {
+				break;
+			}
+		}
+
+		bool bPoll = (iAuthenticated != 0);
+		{
+			// after the warm-up of a session the poll cycles only use the buffers which exist already
+			RscpNoHeapScope noHeap(iStaticMemory != 0 && bPoll && uiCycles >= STATIC_MEMORY_WARMUP);
+
+			// create an RSCP frame with requests to some example data
+			iCycleStartedAt = RscpMetrics::now();
+			int iFrameLength = createRequestFrame();
+			RscpMetrics::record(eStageBuild, iCycleStartedAt);
+
+			// check that frame data was created
+			if(iFrameLength > 0)
+			{
+				// encrypt and send data on socket
+				int iResult = sendFrame(iFrameLength);
+				if(iResult < 0) {
+					printf("Socket send error %i. errno %i\n", iResult, errno);
+					bStopExecution = true;
+				}
+				else {
+					// go into receive loop and pass the responses to the decode thread
+					// a late response of an earlier request which arrives first is decoded and does not count as the answer
+					if(receiveResponse(bStopExecution, pollResponseTag(), submitReceiveBuffer, 0)) {
+						iTimeouts = 0;
+						if(bPoll && deviceReconnect.state() != eConnectionOnline) {
+							int64_t iNow = RscpMetrics::now();
+							int64_t iGap = deviceReconnect.online(iNow);
+							if(iGap > 0) {
+								RscpMetrics::record(eStageReconnect, iNow - iGap);
+								printf("Reconnected after %.3f s\n", iGap / 1e9);
+							}
+						}
+					}
+					else if(!bStopExecution && ++iTimeouts >= RECONNECT_TIMEOUTS) {
+						// a device which rebooted or a lost route does not close the connection
+						printf("No response to %i requests, reconnecting\n", iTimeouts);
+						bStopExecution = true;
+					}
+					// the next request depends on the authentication response, without a cycle time the next request
+					// is sent when the sample is rendered so the cycles do not overtake the decode stage
+					if (iAuthenticated == 0 || iFetchIntervalMs == 0) {
+						pPipeline->flush();
+					}
+					// the wallbox follows the surplus of this response before the cycle time starts
+					if (bPoll && bWallboxControl && !bStopExecution) {
+						sendWallboxSetpoint(bStopExecution);
+					}
+				}
+			}
+		}
+		if (bPoll && ++uiCycles >= uiSessionCycles && uiSessionCycles > 0) {
+			bStopExecution = true;
+			bCyclesDone = true;
+		}
+
+		// the first poll of a session follows the authentication at once
+		if(!bPoll && iAuthenticated != 0) {
+			continue;
+		}
+		// main loop cycle time before next request, setpoints of the command socket are handled meanwhile
+		waitForNextCycle(bStopExecution);
+	}
+	if(!bCyclesDone) {
+		deviceReconnect.lost(RscpMetrics::now());
+	}
+}
+
+static void initEncryption(void)
+{
+	// initialize AES encryptor and decryptor IV
+	memset(ucDecryptionIV, 0xff, AES_BLOCK_SIZE);
+	memset(ucEncryptionIV, 0xff, AES_BLOCK_SIZE);
+	frameDecryptor.reset(ucDecryptionIV);
+	sendSlab.reset(ucEncryptionIV);
+
+	// the key schedule does not change, it is expanded for the first connection and reused by every reconnect
+	static bool bKeyExpanded = false;
+	if(bKeyExpanded) {
+		return;
+	}
+	bKeyExpanded = true;
+
+	// limit password length to AES_KEY_SIZE
+	int iPasswordLength = strlen(AES_PASSWORD);
+	if(iPasswordLength > AES_KEY_SIZE)
+		iPasswordLength = AES_KEY_SIZE;
+
+	// copy up to 32 bytes of AES key password
+	uint8_t ucAesKey[AES_KEY_SIZE];
+	memset(ucAesKey, 0xff, AES_KEY_SIZE);
+	memcpy(ucAesKey, AES_PASSWORD, iPasswordLength);
+
+	// set encryptor and decryptor parameters
+	aesDecrypter.SetParameters(AES_KEY_SIZE * 8, AES_BLOCK_SIZE * 8);
+	aesEncrypter.SetParameters(AES_KEY_SIZE * 8, AES_BLOCK_SIZE * 8);
+	aesDecrypter.StartDecryption(ucAesKey);
+	aesEncrypter.StartEncryption(ucAesKey);
+}
+
+static void initConnection(void)
+{
+	// a new connection authenticates again, starts new CBC chains and drops a partial frame of the previous one
+	iAuthenticated = 0;
+	iReceivedBytes = 0;
+	iDecryptedBytes = 0;
+	iRequestSentAt = 0;
+	initEncryption();
+}
+
+static void initStaticMemory(RscpPipeline & pipeline)
+{
+	if (iStaticMemory == 0) {
+		return;
+	}
+	// every pooled buffer takes a frame of maximum length and an output of STATIC_OUTPUT_BYTES
+	pipeline.reserve(RSCP_MAX_FRAME_LENGTH, STATIC_OUTPUT_BYTES);
+	RscpMetrics::setHeapPolicy(iStaticMemory >= 2 ? eHeapAbort : eHeapCounted);
+}
+
+/*
+ * \brief Override STATIC_MEMORY for the next sessions, used by the end-to-end harness (RscpLoadTest.cpp).
+ */
+void setStaticMemory(int mode)
+{
+	iStaticMemory = mode;
+}
+
+/*
+ * \brief Override WALLBOX_SURPLUS_CONTROL for the next sessions, used by the end-to-end harness (RscpLoadTest.cpp).
+ */
+void setWallboxControl(bool enabled)
+{
+	bWallboxControl = enabled;
+}
+
+/*
+ * \brief Override BATTERY_DETAIL_INTERVAL (\var intervalMs, 0 to disable) and BATTERY_DETAIL_FILE for the next sessions,
+ *        used by the end-to-end harness (RscpLoadTest.cpp).
+ */
+void setBatteryDetail(uint32_t intervalMs, const char *targetFile)
+{
+	iBatteryDetailIntervalMs = intervalMs;
+	pBatteryDetailFile = targetFile;
+	iBatteryDetailDueAt = 0;
+}
 
-		// create an RSCP frame with requests to some example data
-		createRequestExample(&frameBuffer);
+/*
+ * \brief Connect once to \var host:\var port and fetch \var cycles samples through the pipeline like main does,
+ *        without command socket, exporter and topology cache. Used by the end-to-end harness (RscpLoadTest.cpp).
+ *        Further calls are reconnects of the same device, they keep its topology and measure the reconnect gap.
+ * @param intervalMs - cycle time, 0 to send the next request as soon as the previous response is received
+ * @return - number of rendered samples of this session, -1 if the connection failed
+ */
+int runLiveSession(const char *host, int port, uint32_t cycles, uint32_t intervalMs, const char *targetFile)
+{
+	RscpMetrics::registerThread("io");
+	uint64_t uiSamples = RscpMetrics::histogram(eStageCycle).count();
+	pTargetFile = targetFile;
+	iFetchIntervalMs = intervalMs;
+	uiSessionCycles = cycles;
+	bTopologyCache = false;
+
+	iSocket = SocketConnect(host, port);
+	if(iSocket < 0) {
+		printf("Connection to %s:%i failed\n", host, port);
+		deviceReconnect.failed();
+		return -1;
+	}
+	RscpPipeline pipeline(decodeFrame, writeOutput);
+	pPipeline = &pipeline;
+	initStaticMemory(pipeline);
+	pipeline.start();
+	initConnection();
+
+	mainLoop();
+
+	pipeline.flush();
+	pipeline.stop();
+	pPipeline = NULL;
+	SocketClose(iSocket);
+	iSocket = -1;
+	return RscpMetrics::histogram(eStageCycle).count() - uiSamples;
+}
 
-		// check that frame data was created
-		if(frameBuffer.dataLength > 0)
+// the benchmarks link this file without its main function
+#ifndef RSCP_NO_MAIN
+static bool backfillLoop(RscpHistoryBackfill & backfill)
+{
+	RscpProtocol protocol;
+	bool bStopExecution = false;
+	int iTimeouts = 0;
+
+	while(!bStopExecution && !backfill.finished() && !backfill.failed())
+	{
+		if(iAuthenticated == 0)
 		{
-			// resize temporary encryption buffer to a multiple of AES_BLOCK_SIZE
-			std::vector<uint8_t> encryptionBuffer;
-			encryptionBuffer.resize(ROUNDUP(frameBuffer.dataLength, AES_BLOCK_SIZE));
-			// zero padding for data above the desired length
-			memset(&encryptionBuffer[0] + frameBuffer.dataLength, 0, encryptionBuffer.size() - frameBuffer.dataLength);
-			// copy desired data length
-			memcpy(&encryptionBuffer[0], frameBuffer.data, frameBuffer.dataLength);
-			// set continues encryption IV
-			aesEncrypter.SetIV(ucEncryptionIV, AES_BLOCK_SIZE);
-			// start encryption from encryptionBuffer to encryptionBuffer, blocks = encryptionBuffer.size() / AES_BLOCK_SIZE
-			aesEncrypter.Encrypt(&encryptionBuffer[0], &encryptionBuffer[0], encryptionBuffer.size() / AES_BLOCK_SIZE);
-			// save new IV for next encryption block
-			memcpy(ucEncryptionIV, &encryptionBuffer[0] + encryptionBuffer.size() - AES_BLOCK_SIZE, AES_BLOCK_SIZE);
-
-			// send data on socket
-			int iResult = SocketSendData(iSocket, &encryptionBuffer[0], encryptionBuffer.size());
+			// as long as the connection is not authenticated only the authentication request is created
+			int iResult = sendFrame(createRequestFrame());
 			if(iResult < 0) {
 				printf("Socket send error %i. errno %i\n", iResult, errno);
-				bStopExecution = true;
+				break;
 			}
-			else {
-				// go into receive loop and wait for response
-				receiveLoop(bStopExecution);
+			receiveLoop(bStopExecution, processReceiveBuffer, 0);
+			if(!bStopExecution && iAuthenticated == 0) {
+				printf("Authentication failed\n");
+				break;
 			}
+			continue;
 		}
-		// free frame buffer memory
-		protocol.destroyFrameData(&frameBuffer);
 
-		// Print periodic statistics about memory consumption (yeah, looks like we could have a memory-leak)
-		if (printStats >= 300) {
-			// Get current memory consumption
-			double vm, rss;
-			process_mem_usage(vm, rss);
+		// keep up to HISTORY_INFLIGHT chunk requests in flight, every chunk is sent in its own frame
+		// because the response of a single chunk already fills most of a frame
+		while(backfill.hasPendingChunk() && backfill.inFlightCount() < HISTORY_INFLIGHT)
+		{
+			SRscpValue rootValue;
+			protocol.createContainerValue(&rootValue, 0);
+			backfill.appendNextRequest(&protocol, &rootValue);
+			int iResult = sendValue(rootValue);
+			protocol.destroyValueData(rootValue);
+			if(iResult < 0) {
+				printf("Socket send error %i. errno %i\n", iResult, errno);
+				bStopExecution = true;
+				break;
+			}
+		}
+		if(bStopExecution) {
+			break;
+		}
 
-			printStats = 0;
-			mainJSONObject["prog"]["mem_vm"] = vm;
-			mainJSONObject["prog"]["mem_rss"] = rss;
-		} else {
-			++printStats;
+		// wait for at least one of the responses
+		if(receiveLoop(bStopExecution, processReceiveBuffer, 0) > 0) {
+			iTimeouts = 0;
+		}
+		else if(++iTimeouts >= 3) {
+			printf("History backfill timed out\n");
+			break;
 		}
+	}
+	return backfill.finished() && !backfill.failed();
+}
+
+static int runBackfill(int64_t start, int64_t end)
+{
+	RscpHistoryBackfill backfill;
+	if(!backfill.begin(start, end, HISTORY_INTERVAL, HISTORY_CHECKPOINT_FILE, HISTORY_TARGET_FILE)) {
+		printf("Invalid history range or target file\n");
+		return EXIT_FAILURE;
+	}
+	if(backfill.finished()) {
+		printf("History backfill already completed\n");
+		return EXIT_SUCCESS;
+	}
 
-		// main loop sleep / cycle time before next request
-		sleep(FETCH_INTERVAL);
+	printf("Connecting to server %s:%i\n", SERVER_IP, SERVER_PORT);
+	iSocket = SocketConnect(SERVER_IP, SERVER_PORT);
+	if(iSocket < 0) {
+		printf("Connection failed\n");
+		return EXIT_FAILURE;
 	}
+	initConnection();
+	pHistoryBackfill = &backfill;
+
+	printf("History backfill with %u rows per chunk and %i chunks in flight\n", backfill.rowsPerChunk(), HISTORY_INFLIGHT);
+	struct timespec tsStart, tsEnd;
+	clock_gettime(CLOCK_MONOTONIC, &tsStart);
+	bool bFinished = backfillLoop(backfill);
+	clock_gettime(CLOCK_MONOTONIC, &tsEnd);
+
+	pHistoryBackfill = NULL;
+	SocketClose(iSocket);
+	iSocket = -1;
+
+	// report the throughput of this run, an interrupted run continues from the checkpoint on next start
+	double dSeconds = (tsEnd.tv_sec - tsStart.tv_sec) + (tsEnd.tv_nsec - tsStart.tv_nsec) / 1e9;
+	printf("History backfill %s: %llu samples in %.3f s (%.0f samples/s)\n", bFinished ? "finished" : "interrupted",
+			(unsigned long long)backfill.samples(), dSeconds, dSeconds > 0 ? backfill.samples() / dSeconds : 0.0);
+	return bFinished ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 int main(int argc, char *argv[])
 {
+	// the main thread sends and receives in every mode
+	RscpMetrics::registerThread("io");
+
+	// one-shot history backfill: RscpExample --backfill <start timestamp> <end timestamp>
+	if(argc == 4 && strcmp(argv[1], "--backfill") == 0) {
+		return runBackfill(strtoll(argv[2], NULL, 10), strtoll(argv[3], NULL, 10));
+	}
+
+	// share one device session between local clients: RscpExample --proxy
+	if(argc == 2 && strcmp(argv[1], "--proxy") == 0) {
+		RscpProxy proxy;
+		if(!proxy.open(PROXY_BIND_IP, PROXY_PORT, PROXY_PLAIN_PORT)) {
+			return EXIT_FAILURE;
+		}
+		printf("RSCP proxy listening on %s:%i (plain %i)\n", PROXY_BIND_IP, PROXY_PORT, PROXY_PLAIN_PORT);
+		proxy.run();
+		return EXIT_SUCCESS;
+	}
+
+	// scrapes are served by an own thread from the response rendered by the decode thread
+	RscpExporter exporter;
+	if (METRICS_PORT > 0 && exporter.open(METRICS_BIND_IP, METRICS_PORT)) {
+		pExporter = &exporter;
+	}
+
+	// decode and output threads are kept over reconnects
+	RscpPipeline pipeline(decodeFrame, writeOutput);
+	pPipeline = &pipeline;
+	initStaticMemory(pipeline);
+	pipeline.start();
+
+	// setpoints are accepted over reconnects and rejected while the session is not authenticated
+	commandServer.open(COMMAND_SOCKET);
+
 	// endless application which re-connections to server on connection lost
 	while(true)
 	{
+		// a lost session is reconnected at once, failed attempts back off
+		int64_t iDelayMs = deviceReconnect.delayMs();
+		if(iDelayMs > 0) {
+			usleep(iDelayMs * 1000);
+		}
+
 		// connect to server
 		printf("Connecting to server %s:%i\n", SERVER_IP, SERVER_PORT);
 		iSocket = SocketConnect(SERVER_IP, SERVER_PORT);
 		if(iSocket < 0) {
 			printf("Connection failed\n");
-			sleep(1);
+			deviceReconnect.failed();
 			continue;
 		}
 		printf("Connected successfully\n");
 
-		// reset authentication flag
-		iAuthenticated = 0;
-
-		// create AES key and set AES parameters
-		{
-			// initialize AES encryptor and decryptor IV
-			memset(ucDecryptionIV, 0xff, AES_BLOCK_SIZE);
-			memset(ucEncryptionIV, 0xff, AES_BLOCK_SIZE);
-
-			// limit password length to AES_KEY_SIZE
-			int iPasswordLength = strlen(AES_PASSWORD);
-			if(iPasswordLength > AES_KEY_SIZE)
-				iPasswordLength = AES_KEY_SIZE;
-
-			// copy up to 32 bytes of AES key password
-			uint8_t ucAesKey[AES_KEY_SIZE];
-			memset(ucAesKey, 0xff, AES_KEY_SIZE);
-			memcpy(ucAesKey, AES_PASSWORD, iPasswordLength);
-
-			// set encryptor and decryptor parameters
-			aesDecrypter.SetParameters(AES_KEY_SIZE * 8, AES_BLOCK_SIZE * 8);
-			aesEncrypter.SetParameters(AES_KEY_SIZE * 8, AES_BLOCK_SIZE * 8);
-			aesDecrypter.StartDecryption(ucAesKey);
-			aesEncrypter.StartEncryption(ucAesKey);
-		}
+		// reset authentication flag and the AES IVs, the key schedule, the prepared requests, the serial number
+		// and the topology of the device are kept
+		initConnection();
 
 		// enter the main transmit / receive loop
 		mainLoop();
 
+		// frames of the lost connection must not change the state of the next one
+		pipeline.flush();
+
 		// close socket connection
 		SocketClose(iSocket);
 		iSocket = -1;
@@ -969,3 +2597,4 @@ int main(int argc, char *argv[])
 
 	return 0;
 }
+#endif /* RSCP_NO_MAIN */
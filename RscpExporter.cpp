@@ -0,0 +1,419 @@
+/*
+ * RscpExporter.cpp
+ *
+ * OpenMetrics endpoint with a pre-rendered double buffered response.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "RscpExporter.h"
+
+namespace {
+const char * const typeNames[] = { "gauge", "counter", "histogram", "info" };
+const char * const notFoundResponse = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+// buckets of the exported histograms: 2^10 ns (about 1 us) up to 2^34 ns (about 17 s)
+const uint32_t histogramFirstBit = 10;
+const uint32_t histogramLastBit = 34;
+
+void appendValue(std::string & text, double value) {
+	char cValue[32];
+	if(isnan(value)) {
+		text += "NaN";
+		return;
+	}
+	if(isinf(value)) {
+		text += (value > 0) ? "+Inf" : "-Inf";
+		return;
+	}
+	snprintf(cValue, sizeof(cValue), "%.15g", value);
+	text += cValue;
+}
+
+void appendResponse(std::string & response, const std::string & body) {
+	char cHeader[160];
+	snprintf(cHeader, sizeof(cHeader), "HTTP/1.1 200 OK\r\nContent-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+			"Content-Length: %u\r\n\r\n", (unsigned int)body.size());
+	response.assign(cHeader);
+	response += body;
+}
+
+bool containsIgnoreCase(const std::string & text, const char *pattern) {
+	size_t sLength = strlen(pattern);
+	for(size_t i = 0; i + sLength <= text.size(); ++i) {
+		if(strncasecmp(text.c_str() + i, pattern, sLength) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+}
+
+RscpExporter::RscpExporter() :
+		listenSocket(-1), bRunning(false), front(0), skippedRenders(0), scrapes(0) {
+	for(int i = 0; i < 2; ++i) {
+		buffers[i].readers = 0;
+		appendResponse(buffers[i].response, "# EOF\n");
+	}
+}
+
+RscpExporter::~RscpExporter() {
+	close();
+}
+
+bool RscpExporter::open(const char *bindIp, int port) {
+	close();
+	listenSocket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+	if(listenSocket < 0) {
+		printf("Cannot create metrics socket. errno %i\n", errno);
+		return false;
+	}
+	int enable = 1;
+	setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	if(inet_pton(AF_INET, bindIp, &addr.sin_addr) <= 0
+			|| bind(listenSocket, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(listenSocket, RSCP_EXPORTER_MAX_CLIENTS) < 0) {
+		printf("Cannot listen for metrics on %s:%i. errno %i\n", bindIp, port, errno);
+		::close(listenSocket);
+		listenSocket = -1;
+		return false;
+	}
+	bRunning = true;
+	server = std::thread(&RscpExporter::serve, this);
+	return true;
+}
+
+void RscpExporter::close() {
+	if(bRunning.exchange(false)) {
+		server.join();
+	}
+	for(size_t i = 0; i < clients.size(); ++i) {
+		unpin(clients[i]);
+		::close(clients[i].socket);
+	}
+	clients.clear();
+	if(listenSocket >= 0) {
+		::close(listenSocket);
+		listenSocket = -1;
+	}
+}
+
+void RscpExporter::publish(const std::string & device, const std::vector<SRscpMetric> & metrics) {
+	std::lock_guard<std::mutex> lock(publishMutex);
+	devices[device] = metrics;
+	render();
+}
+
+void RscpExporter::render() {
+	// a scraper which still sends the previous response keeps the back buffer, the next sample renders again
+	uint32_t uiBack = 1 - front.load();
+	if(buffers[uiBack].readers.load() != 0) {
+		++skippedRenders;
+		return;
+	}
+
+	// every family must be rendered as one block, samples of all devices are grouped by family
+	typedef std::pair<const std::string *, const SRscpMetric *> SSample;
+	std::map<std::string, std::vector<SSample> > families;
+	std::map<std::string, std::vector<SRscpMetric> >::const_iterator device;
+	for(device = devices.begin(); device != devices.end(); ++device) {
+		for(size_t i = 0; i < device->second.size(); ++i) {
+			families[device->second[i].family].push_back(SSample(&device->first, &device->second[i]));
+		}
+	}
+
+	body.clear();
+	std::map<std::string, std::vector<SSample> >::const_iterator family;
+	for(family = families.begin(); family != families.end(); ++family) {
+		const SRscpMetric *first = family->second[0].second;
+		body += "# TYPE " + family->first + " " + typeNames[first->type] + "\n";
+		if(!first->help.empty()) {
+			body += "# HELP " + family->first + " " + first->help + "\n";
+		}
+		for(size_t i = 0; i < family->second.size(); ++i) {
+			const SRscpMetric *metric = family->second[i].second;
+			body += family->first;
+			if(!metric->suffix.empty()) {
+				body += metric->suffix;
+			}
+			else if(metric->type == eMetricCounter) {
+				body += "_total";
+			}
+			else if(metric->type == eMetricInfo) {
+				body += "_info";
+			}
+			body += "{device=\"" + escapeLabel(*family->second[i].first) + "\"";
+			if(!metric->labels.empty()) {
+				body += "," + metric->labels;
+			}
+			body += "} ";
+			appendValue(body, metric->value);
+			body += "\n";
+		}
+	}
+	// counters of the exporter itself
+	body += "# TYPE rscp_exporter_scrapes counter\nrscp_exporter_scrapes_total ";
+	appendValue(body, scrapes.load(std::memory_order_relaxed));
+	body += "\n# TYPE rscp_exporter_skipped_renders counter\nrscp_exporter_skipped_renders_total ";
+	appendValue(body, skippedRenders);
+	body += "\n# EOF\n";
+
+	appendResponse(buffers[uiBack].response, body);
+	front.store(uiBack);
+}
+
+int RscpExporter::pinFront() {
+	while(true) {
+		uint32_t uiFront = front.load();
+		buffers[uiFront].readers.fetch_add(1);
+		// the renderer may have swapped meanwhile and started to write this buffer
+		if(front.load() == uiFront) {
+			return uiFront;
+		}
+		buffers[uiFront].readers.fetch_sub(1);
+	}
+}
+
+void RscpExporter::unpin(SClient & client) {
+	if(client.buffer >= 0) {
+		buffers[client.buffer].readers.fetch_sub(1);
+		client.buffer = -1;
+	}
+}
+
+void RscpExporter::serve() {
+	RscpMetrics::registerThread("metrics");
+	struct pollfd fds[RSCP_EXPORTER_MAX_CLIENTS + 1];
+	while(bRunning) {
+		fds[0].fd = listenSocket;
+		fds[0].events = POLLIN;
+		for(size_t i = 0; i < clients.size(); ++i) {
+			bool bSending = (clients[i].buffer >= 0) || !clients[i].error.empty();
+			fds[i + 1].fd = clients[i].socket;
+			fds[i + 1].events = bSending ? POLLOUT : POLLIN;
+		}
+		// the timeout bounds the time close() waits for this thread and the check of the client timeouts
+		int iResult = poll(fds, clients.size() + 1, 100);
+		RscpMetrics::countSyscalls(1);
+		if(iResult < 0) {
+			continue;
+		}
+
+		int64_t iExpired = RscpMetrics::now() - RSCP_EXPORTER_CLIENT_TIMEOUT * 1000000000LL;
+		for(size_t i = clients.size(); i > 0; --i) {
+			SClient & client = clients[i - 1];
+			bool bKeep = true;
+			if(fds[i].revents != 0) {
+				bKeep = (fds[i].events == POLLOUT) ? writeClient(client) && processRequests(client) : readClient(client);
+			}
+			if(!bKeep || (!idle(client) && client.lastActivity < iExpired)) {
+				dropClient(i - 1);
+			}
+		}
+		if(fds[0].revents & POLLIN) {
+			acceptClients();
+		}
+	}
+}
+
+void RscpExporter::dropClient(size_t index) {
+	unpin(clients[index]);
+	::close(clients[index].socket);
+	clients.erase(clients.begin() + index);
+}
+
+void RscpExporter::acceptClients() {
+	while(true) {
+		int iSocket = accept4(listenSocket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		RscpMetrics::countSyscalls(1);
+		if(iSocket < 0) {
+			return;
+		}
+		if(clients.size() >= RSCP_EXPORTER_MAX_CLIENTS) {
+			// idle connections are not closed by the timeout, the longest idle one gives its slot to the new one
+			size_t sOldest = clients.size();
+			for(size_t i = 0; i < clients.size(); ++i) {
+				if(idle(clients[i]) && (sOldest == clients.size() || clients[i].lastActivity < clients[sOldest].lastActivity)) {
+					sOldest = i;
+				}
+			}
+			if(sOldest == clients.size()) {
+				::close(iSocket);
+				continue;
+			}
+			dropClient(sOldest);
+		}
+		SClient client;
+		client.socket = iSocket;
+		client.buffer = -1;
+		client.sent = 0;
+		client.close = false;
+		client.lastActivity = RscpMetrics::now();
+		clients.push_back(client);
+	}
+}
+
+bool RscpExporter::idle(const SClient & client) {
+	return client.request.empty() && (client.buffer < 0) && client.error.empty();
+}
+
+bool RscpExporter::readClient(SClient & client) {
+	char cBuffer[1024];
+	while(true) {
+		ssize_t iResult = recv(client.socket, cBuffer, sizeof(cBuffer), 0);
+		RscpMetrics::countSyscalls(1);
+		if(iResult == 0) {
+			return false;
+		}
+		if(iResult < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			if((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+				return false;
+			}
+			break;
+		}
+		client.request.append(cBuffer, iResult);
+		client.lastActivity = RscpMetrics::now();
+		if(client.request.size() > RSCP_EXPORTER_MAX_REQUEST) {
+			return false;
+		}
+	}
+	return processRequests(client);
+}
+
+bool RscpExporter::processRequests(SClient & client) {
+	// one response at a time, pipelined requests wait until the previous response is sent
+	while((client.buffer < 0) && client.error.empty()) {
+		size_t sEnd = client.request.find("\r\n\r\n");
+		if(sEnd == std::string::npos) {
+			return true;
+		}
+		std::string header = client.request.substr(0, sEnd);
+		client.request.erase(0, sEnd + 4);
+
+		char cMethod[8];
+		char cPath[256];
+		char cVersion[16];
+		if(sscanf(header.c_str(), "%7s %255s %15s", cMethod, cPath, cVersion) != 3) {
+			return false;
+		}
+		client.close = containsIgnoreCase(header, "connection: close")
+				|| ((strcmp(cVersion, "HTTP/1.0") == 0) && !containsIgnoreCase(header, "connection: keep-alive"));
+		if((strcmp(cMethod, "GET") == 0) && (strcmp(cPath, "/metrics") == 0 || strncmp(cPath, "/metrics?", 9) == 0)) {
+			client.buffer = pinFront();
+			scrapes.fetch_add(1, std::memory_order_relaxed);
+		}
+		else {
+			client.error = notFoundResponse;
+		}
+		client.sent = 0;
+		if(!writeClient(client)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool RscpExporter::writeClient(SClient & client) {
+	// the rendered response including the headers is sent with one call as long as the socket buffer takes it
+	const std::string & data = (client.buffer >= 0) ? buffers[client.buffer].response : client.error;
+	while(client.sent < data.size()) {
+		ssize_t iResult = send(client.socket, data.c_str() + client.sent, data.size() - client.sent, MSG_NOSIGNAL);
+		RscpMetrics::countSyscalls(1);
+		if(iResult < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return (errno == EAGAIN) || (errno == EWOULDBLOCK);
+		}
+		client.sent += iResult;
+		client.lastActivity = RscpMetrics::now();
+	}
+	unpin(client);
+	client.error.clear();
+	return !client.close;
+}
+
+void RscpExporter::appendHistogram(std::vector<SRscpMetric> & metrics, const std::string & family, const std::string & help,
+		const std::string & labels, const RscpHistogram & histogram) {
+	std::vector<uint64_t> buckets;
+	histogram.getBuckets(buckets);
+	SRscpMetric metric;
+	metric.family = family;
+	metric.type = eMetricHistogram;
+	metric.help = help;
+	metric.suffix = "_bucket";
+	std::string separator = labels.empty() ? "" : ",";
+
+	// the power of two boundaries are boundaries of the log-linear buckets, the cumulative counts are exact
+	uint64_t uiCumulative = 0;
+	uint32_t uiBucket = 0;
+	for(uint32_t uiBit = histogramFirstBit; uiBit <= histogramLastBit; ++uiBit) {
+		uint32_t uiEnd = RscpHistogram::bucketIndex((uint64_t)1 << uiBit);
+		for(; uiBucket < uiEnd; ++uiBucket) {
+			uiCumulative += buckets[uiBucket];
+		}
+		char cBound[32];
+		snprintf(cBound, sizeof(cBound), "%g", ((uint64_t)1 << uiBit) / 1e9);
+		metric.labels = labels + separator + "le=\"" + cBound + "\"";
+		metric.value = uiCumulative;
+		metrics.push_back(metric);
+	}
+	for(; uiBucket < buckets.size(); ++uiBucket) {
+		uiCumulative += buckets[uiBucket];
+	}
+	metric.labels = labels + separator + "le=\"+Inf\"";
+	metric.value = uiCumulative;
+	metrics.push_back(metric);
+
+	metric.labels = labels;
+	metric.suffix = "_count";
+	metric.value = uiCumulative;
+	metrics.push_back(metric);
+	metric.suffix = "_sum";
+	metric.value = histogram.sum() / 1e9;
+	metrics.push_back(metric);
+}
+
+std::string RscpExporter::sanitizeName(const std::string & name) {
+	std::string result = name;
+	for(size_t i = 0; i < result.size(); ++i) {
+		if(!isalnum((unsigned char)result[i]) && result[i] != '_') {
+			result[i] = '_';
+		}
+	}
+	return result.empty() ? std::string("_") : result;
+}
+
+std::string RscpExporter::escapeLabel(const std::string & value) {
+	std::string result;
+	for(size_t i = 0; i < value.size(); ++i) {
+		switch(value[i]) {
+		case '\\':
+			result += "\\\\";
+			break;
+		case '"':
+			result += "\\\"";
+			break;
+		case '\n':
+			result += "\\n";
+			break;
+		default:
+			result += value[i];
+			break;
+		}
+	}
+	return result;
+}
@@ -0,0 +1,131 @@
+/*
+ * RscpExporter.h
+ *
+ * Embedded HTTP endpoint which serves the telemetry of one or more devices and the internal health counters
+ * in the OpenMetrics text format (GET /metrics). The samplers publish their values once per sample, the
+ * complete HTTP response is rendered into the back buffer of a double buffer and swapped in. A scrape only
+ * pins the current front buffer and sends it, it never renders and never waits for a sampler.
+ */
+
+#ifndef RSCPEXPORTER_H_
+#define RSCPEXPORTER_H_
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include "RscpMetrics.h"
+
+/*
+ * Maximum number of scrapers connected at the same time.
+ */
+#define RSCP_EXPORTER_MAX_CLIENTS   64
+/*
+ * Maximum size of the request headers of one scrape.
+ */
+#define RSCP_EXPORTER_MAX_REQUEST   4096
+/*
+ * Seconds without data received or sent after which a scraper in the middle of a request or response is disconnected,
+ * so stuck clients do not hold the slots. Idle keep-alive connections stay open for the next scrape.
+ */
+#define RSCP_EXPORTER_CLIENT_TIMEOUT 5
+
+enum ERscpMetricType {
+	eMetricGauge = 0,
+	eMetricCounter,
+	eMetricHistogram,
+	eMetricInfo
+};
+
+/*
+ * One sample. Samples with the same family are grouped in the output, the type and help of the first sample
+ * of a family are used. Counters get the suffix _total, info metrics _info, histograms _bucket, _sum and _count.
+ */
+struct SRscpMetric {
+	std::string family;
+	ERscpMetricType type;
+	std::string help;
+	std::string suffix;
+	// additional labels without braces, for example: thread="io"
+	std::string labels;
+	double value;
+};
+
+class RscpExporter {
+public:
+	RscpExporter();
+	virtual ~RscpExporter();
+	/*
+	 * \brief Listen on \var bindIp:\var port and serve the scrapes on an own thread.
+	 * @return - false if the socket could not be opened
+	 */
+	bool open(const char *bindIp, int port);
+	void close();
+	/*
+	 * \brief Replace the samples of \var device and render the response for the next scrapes.
+	 *        Can be called from any thread, every sample gets the label device="<device>".
+	 */
+	void publish(const std::string & device, const std::vector<SRscpMetric> & metrics);
+	/*
+	 * \brief Append \var histogram (values in ns) as histogram in seconds with power of two buckets.
+	 */
+	static void appendHistogram(std::vector<SRscpMetric> & metrics, const std::string & family, const std::string & help,
+			const std::string & labels, const RscpHistogram & histogram);
+	/*
+	 * \brief Replace the characters of \var name which are not allowed in metric names.
+	 *        Used for parts of a name, the first character of a complete name must not be a digit.
+	 */
+	static std::string sanitizeName(const std::string & name);
+	/*
+	 * \brief Escape \var value for a quoted label value.
+	 */
+	static std::string escapeLabel(const std::string & value);
+private:
+	struct SBuffer {
+		std::string response;
+		std::atomic<uint32_t> readers;
+	};
+	struct SClient {
+		int socket;
+		std::string request;
+		// pinned buffer while a response is sent, -1 if none
+		int buffer;
+		std::string error;
+		size_t sent;
+		bool close;
+		// RscpMetrics::now() of the last data received or sent
+		int64_t lastActivity;
+	};
+
+	void render();
+	void serve();
+	int pinFront();
+	void acceptClients();
+	static bool idle(const SClient & client);
+	bool readClient(SClient & client);
+	bool processRequests(SClient & client);
+	bool writeClient(SClient & client);
+	void unpin(SClient & client);
+	void dropClient(size_t index);
+
+	int listenSocket;
+	std::atomic<bool> bRunning;
+	std::thread server;
+
+	// samplers
+	std::mutex publishMutex;
+	std::map<std::string, std::vector<SRscpMetric> > devices;
+	std::string body;
+	SBuffer buffers[2];
+	std::atomic<uint32_t> front;
+	uint64_t skippedRenders;
+
+	// server thread
+	std::vector<SClient> clients;
+	std::atomic<uint64_t> scrapes;
+};
+
+#endif /* RSCPEXPORTER_H_ */
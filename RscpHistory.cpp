@@ -0,0 +1,502 @@
+/*
+ * RscpHistory.cpp
+ *
+ * Paged history backfill for the TAG_DB_REQ_HISTORY_DATA_* database queries.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include "RscpHistory.h"
+#include "RscpCodec.h"
+#include "RscpTags.h"
+#include "RscpVisitor.h"
+
+void SRscpHistoryColumns::clear() {
+	timestamp.clear();
+	batPowerIn.clear();
+	batPowerOut.clear();
+	dcPower.clear();
+	gridPowerIn.clear();
+	gridPowerOut.clear();
+	consumption.clear();
+	pm0Power.clear();
+	pm1Power.clear();
+	batChargeLevel.clear();
+	batCycleCount.clear();
+	consumedProduction.clear();
+	autarky.clear();
+}
+
+void SRscpHistoryColumns::reserve(size_t rows) {
+	timestamp.reserve(rows);
+	batPowerIn.reserve(rows);
+	batPowerOut.reserve(rows);
+	dcPower.reserve(rows);
+	gridPowerIn.reserve(rows);
+	gridPowerOut.reserve(rows);
+	consumption.reserve(rows);
+	pm0Power.reserve(rows);
+	pm1Power.reserve(rows);
+	batChargeLevel.reserve(rows);
+	batCycleCount.reserve(rows);
+	consumedProduction.reserve(rows);
+	autarky.reserve(rows);
+}
+
+std::vector<float> * SRscpHistoryColumns::column(const SRscpTag & tag) {
+	switch(tag) {
+	case TAG_DB_BAT_POWER_IN:
+		return &batPowerIn;
+	case TAG_DB_BAT_POWER_OUT:
+		return &batPowerOut;
+	case TAG_DB_DC_POWER:
+		return &dcPower;
+	case TAG_DB_GRID_POWER_IN:
+		return &gridPowerIn;
+	case TAG_DB_GRID_POWER_OUT:
+		return &gridPowerOut;
+	case TAG_DB_CONSUMPTION:
+		return &consumption;
+	case TAG_DB_PM_0_POWER:
+		return &pm0Power;
+	case TAG_DB_PM_1_POWER:
+		return &pm1Power;
+	case TAG_DB_BAT_CHARGE_LEVEL:
+		return &batChargeLevel;
+	case TAG_DB_BAT_CYCLE_COUNT:
+		return &batCycleCount;
+	case TAG_DB_CONSUMED_PRODUCTION:
+		return &consumedProduction;
+	case TAG_DB_AUTARKY:
+		return &autarky;
+	default:
+		return NULL;
+	}
+}
+
+size_t SRscpHistoryColumns::grow(size_t rows) {
+	size_t first = timestamp.size();
+	size_t total = first + rows;
+	timestamp.resize(total, 0);
+	batPowerIn.resize(total, 0.0f);
+	batPowerOut.resize(total, 0.0f);
+	dcPower.resize(total, 0.0f);
+	gridPowerIn.resize(total, 0.0f);
+	gridPowerOut.resize(total, 0.0f);
+	consumption.resize(total, 0.0f);
+	pm0Power.resize(total, 0.0f);
+	pm1Power.resize(total, 0.0f);
+	batChargeLevel.resize(total, 0.0f);
+	batCycleCount.resize(total, 0.0f);
+	consumedProduction.resize(total, 0.0f);
+	autarky.resize(total, 0.0f);
+	return first;
+}
+
+RscpHistoryBackfill::RscpHistoryBackfill() :
+	rangeStart(0), rangeEnd(0), nextStart(0), interval(0), chunkRows(0), sampleCount(0), bFailed(false) {
+}
+
+RscpHistoryBackfill::~RscpHistoryBackfill() {
+}
+
+bool RscpHistoryBackfill::begin(int64_t start, int64_t end, uint32_t interval, const char * checkpointFile, const char * targetFile) {
+	// sanity check
+	if((interval == 0) || (end <= start) || (checkpointFile == NULL) || (targetFile == NULL)) {
+		return false;
+	}
+	this->rangeStart = start;
+	this->rangeEnd = end;
+	this->nextStart = start;
+	this->interval = interval;
+	this->sampleCount = 0;
+	this->bFailed = false;
+	this->checkpointFile = checkpointFile;
+	this->targetFile = targetFile;
+	this->inFlight.clear();
+
+	// the response has to fit into one frame: the frame data is limited to 0xFFFF bytes and a single
+	// value to 0xFFF8 bytes, the history container itself and the sum container are subtracted as well
+	chunkRows = (0xFFF8 - 2 * RSCP_HISTORY_ROW_SIZE) / RSCP_HISTORY_ROW_SIZE;
+	columns.reserve(chunkRows);
+
+	// continue an earlier interrupted run of the same range
+	if(readCheckpoint()) {
+		printf("Resuming history backfill at %" PRId64 "\n", nextStart);
+		return true;
+	}
+	// a fresh start must not append to rows of another run, a checkpoint of another range is stale
+	FILE *file = fopen(targetFile, "w");
+	if(file == NULL) {
+		printf("Cannot create history target file %s\n", targetFile);
+		return false;
+	}
+	fclose(file);
+	remove(checkpointFile);
+	return true;
+}
+
+bool RscpHistoryBackfill::readCheckpoint() {
+	FILE *file = fopen(checkpointFile.c_str(), "r");
+	if(file == NULL) {
+		return false;
+	}
+	int64_t start = 0, end = 0, next = 0, offset = 0;
+	uint32_t checkInterval = 0;
+	int iResult = fscanf(file, "%" SCNd64 " %" SCNd64 " %" SCNu32 " %" SCNd64 " %" SCNd64,
+			&start, &end, &checkInterval, &next, &offset);
+	fclose(file);
+	// only resume if the checkpoint belongs to the same range
+	if((iResult != 5) || (start != rangeStart) || (end != rangeEnd) || (checkInterval != interval)) {
+		return false;
+	}
+	if((next < rangeStart) || (next > rangeEnd)) {
+		return false;
+	}
+	// drop rows which were written after the last checkpoint, they are requested again
+	if(truncate(targetFile.c_str(), offset) != 0) {
+		printf("Cannot truncate history target file %s\n", targetFile.c_str());
+		return false;
+	}
+	nextStart = next;
+	return true;
+}
+
+bool RscpHistoryBackfill::writeCheckpoint(int64_t completedUntil, int64_t targetOffset) {
+	// write to a temporary file first and rename it afterwards so a crash never leaves a broken checkpoint
+	std::string tmpFile = checkpointFile + ".tmp";
+	FILE *file = fopen(tmpFile.c_str(), "w");
+	if(file == NULL) {
+		printf("Cannot write history checkpoint %s\n", tmpFile.c_str());
+		return false;
+	}
+	fprintf(file, "%" PRId64 " %" PRId64 " %" PRIu32 " %" PRId64 " %" PRId64 "\n", rangeStart, rangeEnd, interval, completedUntil, targetOffset);
+	bool bWritten = (ferror(file) == 0);
+	if((fclose(file) != 0) || !bWritten || (rename(tmpFile.c_str(), checkpointFile.c_str()) != 0)) {
+		printf("Cannot write history checkpoint %s\n", checkpointFile.c_str());
+		return false;
+	}
+	return true;
+}
+
+int64_t RscpHistoryBackfill::writeRows(const SRscpHistoryColumns & columns) {
+	FILE *file = fopen(targetFile.c_str(), "a");
+	if(file == NULL) {
+		printf("Cannot open history target file %s\n", targetFile.c_str());
+		return -1;
+	}
+	// write the header line into new files
+	if(ftell(file) == 0) {
+		fprintf(file, "timestamp,bat_power_in,bat_power_out,dc_power,grid_power_in,grid_power_out,consumption,"
+				"pm0_power,pm1_power,bat_charge_level,bat_cycle_count,consumed_production,autarky\n");
+	}
+	for(size_t i = 0; i < columns.size(); ++i) {
+		fprintf(file, "%" PRId64 ",%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g\n", columns.timestamp[i],
+				columns.batPowerIn[i], columns.batPowerOut[i], columns.dcPower[i], columns.gridPowerIn[i],
+				columns.gridPowerOut[i], columns.consumption[i], columns.pm0Power[i], columns.pm1Power[i],
+				columns.batChargeLevel[i], columns.batCycleCount[i], columns.consumedProduction[i], columns.autarky[i]);
+	}
+	// the file size is stored in the checkpoint to cut off rows of an interrupted chunk
+	fflush(file);
+	int64_t offset = (ferror(file) == 0) ? ftell(file) : -1;
+	fclose(file);
+	return offset;
+}
+
+int32_t RscpHistoryBackfill::appendNextRequest(RscpProtocol *protocol, SRscpValue *rootValue) {
+	// sanity check
+	if((protocol == NULL) || (rootValue == NULL) || !hasPendingChunk()) {
+		return RSCP::ERR_INVALID_INPUT;
+	}
+	SRscpHistoryChunk chunk;
+	chunk.start = nextStart;
+	chunk.span = (int64_t)chunkRows * interval;
+	if(chunk.start + chunk.span > rangeEnd) {
+		chunk.span = rangeEnd - chunk.start;
+	}
+
+	SRscpTimestamp start, step, span;
+	start.seconds = chunk.start;
+	start.nanoseconds = 0;
+	step.seconds = interval;
+	step.nanoseconds = 0;
+	span.seconds = chunk.span;
+	span.nanoseconds = 0;
+
+	SRscpValue historyContainer;
+	protocol->createContainerValue(&historyContainer, TAG_DB_REQ_HISTORY_DATA_DAY);
+	protocol->appendValue(&historyContainer, TAG_DB_REQ_HISTORY_TIME_START, start);
+	protocol->appendValue(&historyContainer, TAG_DB_REQ_HISTORY_TIME_INTERVAL, step);
+	protocol->appendValue(&historyContainer, TAG_DB_REQ_HISTORY_TIME_SPAN, span);
+	int32_t iResult = protocol->appendValue(rootValue, historyContainer);
+	protocol->destroyValueData(historyContainer);
+	if(iResult != RSCP::OK) {
+		return iResult;
+	}
+
+	inFlight.push_back(chunk);
+	nextStart = chunk.start + chunk.span;
+	return RSCP::OK;
+}
+
+static float getValueAsNumber(RscpProtocol *protocol, const SRscpValue *value) {
+	// the database delivers most values as float but counters may use integer types
+	switch(value->dataType) {
+	case RSCP::eTypeFloat32:
+		return protocol->getValueAsFloat32(value);
+	case RSCP::eTypeDouble64:
+		return protocol->getValueAsDouble64(value);
+	case RSCP::eTypeInt32:
+		return protocol->getValueAsInt32(value);
+	case RSCP::eTypeUInt32:
+		return protocol->getValueAsUInt32(value);
+	case RSCP::eTypeInt16:
+		return protocol->getValueAsInt16(value);
+	case RSCP::eTypeUInt16:
+		return protocol->getValueAsUInt16(value);
+	case RSCP::eTypeUChar8:
+		return protocol->getValueAsUChar8(value);
+	default:
+		return 0.0f;
+	}
+}
+
+namespace {
+// rows of a history response, the values of every TAG_DB_VALUE_CONTAINER are stored in one row of the columns
+class RscpHistoryRowVisitor : public RscpVisitor {
+public:
+	RscpHistoryRowVisitor(RscpProtocol *protocol, const SRscpHistoryChunk & chunk, int64_t interval, SRscpHistoryColumns & columns) :
+			protocol(protocol), chunk(chunk), interval(interval), columns(columns), row(0), rows(0) {
+	}
+	bool enterContainer(const SRscpValue & container, uint32_t depth) {
+		if(depth > 0) {
+			return false;
+		}
+		row = columns.grow(1);
+		// rows without graph index are numbered in order of arrival
+		columns.timestamp[row] = chunk.start + (int64_t)rows * interval;
+		return true;
+	}
+	void value(const SRscpValue & value, uint32_t depth) {
+		float fValue = getValueAsNumber(protocol, &value);
+		if(value.tag == TAG_DB_GRAPH_INDEX) {
+			columns.timestamp[row] = chunk.start + (int64_t)fValue * interval;
+		}
+		else {
+			std::vector<float> *column = columns.column(value.tag);
+			if(column != NULL) {
+				(*column)[row] = fValue;
+			}
+		}
+	}
+	void leaveContainer(const SRscpValue & container, uint32_t depth) {
+		++rows;
+	}
+	int32_t rowCount() const { return rows; }
+private:
+	RscpProtocol *protocol;
+	const SRscpHistoryChunk & chunk;
+	int64_t interval;
+	SRscpHistoryColumns & columns;
+	size_t row;
+	int32_t rows;
+};
+}
+
+int32_t RscpHistoryBackfill::decodeRowsGeneric(RscpProtocol *protocol, const SRscpValue *response, const SRscpHistoryChunk & chunk, SRscpHistoryColumns & columns) {
+	// the sum container only holds the total of the requested span, it is skipped without reading it
+	RscpHistoryRowVisitor rows(protocol, chunk, interval, columns);
+	RscpPathFilter filter(rows);
+	filter.addPath({ TAG_DB_VALUE_CONTAINER });
+	int32_t iResult = protocol->visitData(response->data, response->length, filter);
+	return (iResult < 0) ? iResult : rows.rowCount();
+}
+
+namespace {
+// size of tag, data type and length in front of every value
+const uint32_t uiValueHeaderSize = RSCP_VALUE_HEADER_SIZE;
+// rows are gathered in blocks which stay inside the L1 cache while every column is copied
+const uint32_t uiRowBlock = 64;
+
+struct SHistoryField {
+	// offset of the field header inside the row data
+	uint32_t offset;
+	uint8_t dataType;
+	std::vector<float> *column;
+};
+
+inline float loadNumber(const uint8_t *data, uint8_t dataType) {
+	switch(dataType) {
+	case RSCP::eTypeFloat32:
+		return RscpCodec::load<float>(data);
+	case RSCP::eTypeInt32:
+		return RscpCodec::load<int32_t>(data);
+	default:
+		return RscpCodec::load<uint32_t>(data);
+	}
+}
+}
+
+int32_t RscpHistoryBackfill::decodeRowsBulk(const uint8_t *data, uint32_t length, const SRscpHistoryChunk & chunk, SRscpHistoryColumns & columns) {
+	if((data == NULL) && (length > 0)) {
+		return RSCP::ERR_INVALID_INPUT;
+	}
+	// skip the sum container and everything else in front of the first row
+	uint32_t uiPos = 0;
+	while(uiPos + uiValueHeaderSize <= length) {
+		SRscpValue value;
+		RscpCodec::readValueHeader(data + uiPos, value);
+		if(value.tag == TAG_DB_VALUE_CONTAINER) {
+			break;
+		}
+		uiPos += uiValueHeaderSize + value.length;
+	}
+	if(uiPos == length) {
+		// no rows inside the requested span
+		return 0;
+	}
+	if(uiPos + uiValueHeaderSize > length) {
+		return RSCP::ERR_INVALID_FRAME_LENGTH;
+	}
+
+	// all rows must have the size of the first row and fill the rest of the container
+	const uint8_t *firstRow = data + uiPos;
+	const uint32_t uiRowLength = RscpCodec::valueLength(firstRow);
+	const uint32_t uiStride = uiValueHeaderSize + uiRowLength;
+	if((length - uiPos) % uiStride != 0) {
+		return RSCP::ERR_INVALID_FRAME_LENGTH;
+	}
+	const uint32_t uiRows = (length - uiPos) / uiStride;
+
+	// learn the field layout from the first row, only 4 byte numbers are handled by the bulk decoder
+	SHistoryField fields[32];
+	uint32_t uiFields = 0;
+	int32_t iGraphIndexField = -1;
+	uint32_t uiFieldPos = 0;
+	while(uiFieldPos < uiRowLength) {
+		if((uiFields == sizeof(fields) / sizeof(fields[0])) || (uiFieldPos + uiValueHeaderSize > uiRowLength)) {
+			return RSCP::ERR_INVALID_FRAME_LENGTH;
+		}
+		SRscpValue field;
+		RscpCodec::readValueHeader(firstRow + uiValueHeaderSize + uiFieldPos, field);
+		if((field.length != 4) || ((field.dataType != RSCP::eTypeFloat32) && (field.dataType != RSCP::eTypeInt32)
+				&& (field.dataType != RSCP::eTypeUInt32))) {
+			return RSCP::ERR_INVALID_INPUT;
+		}
+		fields[uiFields].offset = uiFieldPos;
+		fields[uiFields].dataType = field.dataType;
+		fields[uiFields].column = columns.column(field.tag);
+		if(field.tag == TAG_DB_GRAPH_INDEX) {
+			iGraphIndexField = uiFields;
+		}
+		++uiFields;
+		uiFieldPos += uiValueHeaderSize + field.length;
+	}
+	if(uiFieldPos != uiRowLength) {
+		return RSCP::ERR_INVALID_FRAME_LENGTH;
+	}
+
+	// validate that every row has exactly the same headers as the first row
+	for(uint32_t r = 1; r < uiRows; ++r) {
+		const uint8_t *row = firstRow + r * uiStride;
+		if(memcmp(row, firstRow, uiValueHeaderSize) != 0) {
+			return RSCP::ERR_INVALID_INPUT;
+		}
+		for(uint32_t f = 0; f < uiFields; ++f) {
+			uint32_t uiOffset = uiValueHeaderSize + fields[f].offset;
+			if(memcmp(row + uiOffset, firstRow + uiOffset, uiValueHeaderSize) != 0) {
+				return RSCP::ERR_INVALID_INPUT;
+			}
+		}
+	}
+
+	// gather every field into its column, the shape is known so no per value checks are needed anymore
+	size_t first = columns.grow(uiRows);
+	for(uint32_t uiBlock = 0; uiBlock < uiRows; uiBlock += uiRowBlock) {
+		const uint32_t uiBlockEnd = (uiBlock + uiRowBlock < uiRows) ? uiBlock + uiRowBlock : uiRows;
+
+		int64_t *timestamp = &columns.timestamp[first];
+		if(iGraphIndexField >= 0) {
+			const SHistoryField & field = fields[iGraphIndexField];
+			const uint8_t *src = firstRow + 2 * uiValueHeaderSize + field.offset;
+			for(uint32_t r = uiBlock; r < uiBlockEnd; ++r) {
+				timestamp[r] = chunk.start + (int64_t)loadNumber(src + r * uiStride, field.dataType) * interval;
+			}
+		}
+		else {
+			for(uint32_t r = uiBlock; r < uiBlockEnd; ++r) {
+				timestamp[r] = chunk.start + (int64_t)r * interval;
+			}
+		}
+
+		for(uint32_t f = 0; f < uiFields; ++f) {
+			if(fields[f].column == NULL) {
+				continue;
+			}
+			float *dst = &(*fields[f].column)[first];
+			const uint8_t *src = firstRow + 2 * uiValueHeaderSize + fields[f].offset;
+			if(fields[f].dataType == RSCP::eTypeFloat32) {
+				// plain strided copy, the hot loop of the decoder
+				for(uint32_t r = uiBlock; r < uiBlockEnd; ++r) {
+					dst[r] = RscpCodec::load<float>(src + r * uiStride);
+				}
+			}
+			else {
+				for(uint32_t r = uiBlock; r < uiBlockEnd; ++r) {
+					dst[r] = loadNumber(src + r * uiStride, fields[f].dataType);
+				}
+			}
+		}
+	}
+	return uiRows;
+}
+
+int32_t RscpHistoryBackfill::decodeRows(RscpProtocol *protocol, const SRscpValue *response, const SRscpHistoryChunk & chunk, SRscpHistoryColumns & columns) {
+	// the bulk decoder handles the regular row layout of the device, everything else takes the generic path
+	int32_t iRows = decodeRowsBulk(response->data, response->length, chunk, columns);
+	if(iRows >= 0) {
+		return iRows;
+	}
+	return decodeRowsGeneric(protocol, response, chunk, columns);
+}
+
+int32_t RscpHistoryBackfill::handleResponse(RscpProtocol *protocol, const SRscpValue *response) {
+	// sanity check
+	if((protocol == NULL) || (response == NULL)) {
+		return RSCP::ERR_INVALID_INPUT;
+	}
+	if(inFlight.empty()) {
+		printf("History response 0x%08X without a pending request\n", response->tag);
+		return RSCP::ERR_INVALID_INPUT;
+	}
+	// responses are delivered in the order the requests were sent
+	SRscpHistoryChunk chunk = inFlight.front();
+	inFlight.pop_front();
+
+	// never write chunks behind a failed one, otherwise the checkpoint would skip the gap
+	if(bFailed) {
+		return RSCP::ERR_INVALID_INPUT;
+	}
+	if(response->dataType == RSCP::eTypeError) {
+		uint32_t uiErrorCode = protocol->getValueAsUInt32(response);
+		printf("History chunk %" PRId64 " received error code %u.\n", chunk.start, uiErrorCode);
+		bFailed = true;
+		return RSCP::ERR_INVALID_INPUT;
+	}
+
+	columns.clear();
+	int32_t iRows = decodeRows(protocol, response, chunk, columns);
+	int64_t offset = (iRows < 0) ? -1 : writeRows(columns);
+	if(offset < 0) {
+		bFailed = true;
+		return RSCP::ERR_INVALID_INPUT;
+	}
+	// without the checkpoint the next run would cut off or repeat these rows, so the backfill stops here
+	if(!writeCheckpoint(chunk.start + chunk.span, offset)) {
+		bFailed = true;
+		return RSCP::ERR_INVALID_INPUT;
+	}
+	sampleCount += iRows;
+	return iRows;
+}
@@ -0,0 +1,171 @@
+/*
+ * RscpHistory.h
+ *
+ * Paged history backfill for the TAG_DB_REQ_HISTORY_DATA_* database queries.
+ * A long time range is split into chunks whose responses fit into a single RSCP frame.
+ * Several chunks can be requested before the first response arrives, progress is
+ * checkpointed to disk after every completed chunk so an interrupted backfill resumes.
+ */
+
+#ifndef RSCPHISTORY_H_
+#define RSCPHISTORY_H_
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include "RscpProtocol.h"
+
+/*
+ * Estimated size in bytes of one TAG_DB_VALUE_CONTAINER row inside a history response.
+ * A row is a container header (7 bytes) with up to 13 float/uint32 values (7 + 4 bytes each).
+ */
+#define RSCP_HISTORY_ROW_SIZE       (7 + 13 * (7 + 4))
+
+/*
+ * Columnar storage of decoded history rows. Every vector has the same amount of entries.
+ */
+struct SRscpHistoryColumns {
+	std::vector<int64_t> timestamp;
+	std::vector<float> batPowerIn;
+	std::vector<float> batPowerOut;
+	std::vector<float> dcPower;
+	std::vector<float> gridPowerIn;
+	std::vector<float> gridPowerOut;
+	std::vector<float> consumption;
+	std::vector<float> pm0Power;
+	std::vector<float> pm1Power;
+	std::vector<float> batChargeLevel;
+	std::vector<float> batCycleCount;
+	std::vector<float> consumedProduction;
+	std::vector<float> autarky;
+
+	/*
+	 * \brief Returns the column of a TAG_DB_* row value or NULL if the value is not stored.
+	 */
+	std::vector<float> * column(const SRscpTag & tag);
+	size_t size() const {
+		return timestamp.size();
+	}
+	void clear();
+	void reserve(size_t rows);
+	/*
+	 * \brief Appends \var rows empty rows and returns the index of the first new row.
+	 */
+	size_t grow(size_t rows);
+};
+
+/*
+ * One requested time slice of the backfill range.
+ */
+struct SRscpHistoryChunk {
+	int64_t start;
+	int64_t span;
+};
+
+class RscpHistoryBackfill {
+public:
+	RscpHistoryBackfill();
+	virtual ~RscpHistoryBackfill();
+	/*
+	 * \brief Prepare a backfill of the range [\var start, \var end) with one sample every \var interval seconds.
+	 *        If \var checkpointFile contains progress of the same range the backfill resumes from there
+	 *        and rows written after that checkpoint are removed from \var targetFile, otherwise \var targetFile
+	 *        is truncated.
+	 * @param start          - Unix timestamp of the first sample
+	 * @param end            - Unix timestamp after the last sample
+	 * @param interval       - Sample interval in seconds
+	 * @param checkpointFile - File which stores the start of the first not yet completed chunk
+	 * @param targetFile     - CSV file the decoded rows are appended to
+	 * @return               - false if the range or interval is invalid or \var targetFile cannot be created
+	 */
+	bool begin(int64_t start, int64_t end, uint32_t interval, const char * checkpointFile, const char * targetFile);
+	/*
+	 * \brief Returns true as long as there are chunks which were not requested yet.
+	 */
+	bool hasPendingChunk() const {
+		return nextStart < rangeEnd;
+	}
+	/*
+	 * \brief Returns true if every chunk was requested and answered.
+	 */
+	bool finished() const {
+		return !hasPendingChunk() && inFlight.empty();
+	}
+	/*
+	 * \brief Returns true if a chunk failed. Later chunks are not written anymore so the
+	 *        checkpoint still points to the failed chunk on the next run.
+	 */
+	bool failed() const {
+		return bFailed;
+	}
+	/*
+	 * \brief Number of chunk requests which were sent but not answered yet.
+	 */
+	size_t inFlightCount() const {
+		return inFlight.size();
+	}
+	/*
+	 * \brief Append the request for the next chunk as TAG_DB_REQ_HISTORY_DATA_DAY container to \var rootValue.
+	 * @return - RSCP error code if the function fails else RSCP::OK
+	 */
+	int32_t appendNextRequest(RscpProtocol *protocol, SRscpValue *rootValue);
+	/*
+	 * \brief Handle a TAG_DB_HISTORY_DATA_* response. The response belongs to the oldest chunk in flight.
+	 *        The decoded rows are written to the target file and the checkpoint is advanced, the backfill fails
+	 *        if either cannot be written.
+	 * @return - Number of decoded rows or a negative RSCP error code
+	 */
+	int32_t handleResponse(RscpProtocol *protocol, const SRscpValue *response);
+	/*
+	 * \brief Decode the content of a TAG_DB_HISTORY_DATA_* container into \var columns.
+	 * @param chunk   - The chunk the response belongs to, used to calculate the row timestamps
+	 * @return        - Number of decoded rows or a negative RSCP error code
+	 */
+	int32_t decodeRows(RscpProtocol *protocol, const SRscpValue *response, const SRscpHistoryChunk & chunk, SRscpHistoryColumns & columns);
+	/*
+	 * \brief Bulk decoder for the raw data of a TAG_DB_HISTORY_DATA_* container.
+	 *        The row layout is learned from the first TAG_DB_VALUE_CONTAINER and validated once for all rows,
+	 *        afterwards every column is gathered with a strided copy without parsing single values.
+	 * @param data    - Data of the response container
+	 * @param length  - Length of \var data in bytes
+	 * @return        - Number of decoded rows or a negative RSCP error code if the rows are not uniform.
+	 *                  \var columns is only modified on success.
+	 */
+	int32_t decodeRowsBulk(const uint8_t *data, uint32_t length, const SRscpHistoryChunk & chunk, SRscpHistoryColumns & columns);
+	/*
+	 * \brief Value by value decoder which accepts any row layout.
+	 * @return        - Number of decoded rows or a negative RSCP error code
+	 */
+	int32_t decodeRowsGeneric(RscpProtocol *protocol, const SRscpValue *response, const SRscpHistoryChunk & chunk, SRscpHistoryColumns & columns);
+	/*
+	 * \brief Total number of samples decoded since begin().
+	 */
+	uint64_t samples() const {
+		return sampleCount;
+	}
+	/*
+	 * \brief Number of rows which fit into one chunk without exceeding the RSCP frame size.
+	 */
+	uint32_t rowsPerChunk() const {
+		return chunkRows;
+	}
+private:
+	bool readCheckpoint();
+	bool writeCheckpoint(int64_t completedUntil, int64_t targetOffset);
+	int64_t writeRows(const SRscpHistoryColumns & columns);
+
+	int64_t rangeStart;
+	int64_t rangeEnd;
+	int64_t nextStart;
+	uint32_t interval;
+	uint32_t chunkRows;
+	uint64_t sampleCount;
+	bool bFailed;
+	std::string checkpointFile;
+	std::string targetFile;
+	std::deque<SRscpHistoryChunk> inFlight;
+	SRscpHistoryColumns columns;
+};
+
+#endif /* RSCPHISTORY_H_ */
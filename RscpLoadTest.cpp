@@ -0,0 +1,386 @@
+/*
+	End-to-end cycle latency and throughput harness.
+
+	Every scenario starts RscpSimulator with a device latency, TCP segmentation and response size and runs
+	one client process per simulated device. The clients use the real path of RscpExample (mainLoop,
+	receiveLoop, the pipeline and the json output) and poll back to back. A cycle is measured from the start
+	of the request build until the response is rendered. Reported are the percentiles over the cycles of all
+	devices, the samples per second, the CPU time of the clients per sample, the receive calls per frame and
+	their maximum resident set.
+	The wallbox scenario runs the solar surplus control (RscpWallbox.h) against the simulated wallbox and reports
+	its reaction latency: from the receipt of the poll response whose surplus changed the charge current until the
+	simulator acknowledged the new setpoint.
+	The battery detail scenario requests the modules and cells of the simulated batteries (RscpBatteryDetail.h) in the
+	wait of every cycle and reports the decode time of these responses next to the cycles, which must not include them.
+	With --static-memory the clients run in STATIC_MEMORY mode 2 and abort on a heap operation inside a cycle.
+
+	Usage: RscpLoadTest [--json] [--cycles <per device>] [--interval <ms>] [--port <port>] [--static-memory]
+	                    [--simulator <path>] [--dir <output directory>] [--verbose] [filter]
+
+	Copyright (c) 2018 Thomas Bella <thomas@bella.network>
+
+	MIT Licence
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+#include "RscpMetrics.h"
+#include "SocketConnection.h"
+
+// live data session of the client (RscpExampleMain.cpp built with RSCP_NO_MAIN)
+int runLiveSession(const char *host, int port, uint32_t cycles, uint32_t intervalMs, const char *targetFile);
+void setStaticMemory(int mode);
+void setWallboxControl(bool enabled);
+void setBatteryDetail(uint32_t intervalMs, const char *targetFile);
+
+struct SScenario {
+	const char *name;
+	// response size, 0 for the natural size of a poll response
+	uint32_t frameBytes;
+	uint32_t delayMs;
+	// TCP segment size of the responses, 0 to send them at once
+	uint32_t segmentBytes;
+	uint32_t devices;
+	// solar surplus control of the wallbox
+	bool wallbox;
+	// interval of the battery detail rounds in ms, 0 to disable
+	uint32_t batteryDetailMs;
+};
+
+// one factor is changed at a time, the first scenario is the baseline
+static const SScenario scenarios[] = {
+	{ "baseline",        0,     0, 0,    1, false, 0 },
+	{ "frame/8k",        8192,  0, 0,    1, false, 0 },
+	{ "frame/32k",       32768, 0, 0,    1, false, 0 },
+	{ "frame/60k",       61440, 0, 0,    1, false, 0 },
+	{ "latency/1ms",     0,     1, 0,    1, false, 0 },
+	{ "latency/5ms",     0,     5, 0,    1, false, 0 },
+	{ "segment/1448",    0,     0, 1448, 1, false, 0 },
+	{ "segment/256",     0,     0, 256,  1, false, 0 },
+	{ "frame/60k+seg/1448", 61440, 0, 1448, 1, false, 0 },
+	{ "devices/4",       0,     0, 0,    4, false, 0 },
+	{ "devices/16",      0,     0, 0,    16, false, 0 },
+	{ "wallbox/surplus", 0,     0, 0,    1, true, 0 },
+	{ "battery/detail",  0,     0, 0,    1, false, 1 },
+};
+
+// result of one client process, written to the harness through a pipe
+struct SDeviceResult {
+	int64_t samples;
+	uint64_t receiveCalls;
+	uint64_t receivedFrames;
+	uint64_t buckets[RSCP_HISTOGRAM_BUCKETS];
+	// acknowledged setpoints of the wallbox and their reaction latency
+	uint64_t wallboxBuckets[RSCP_HISTOGRAM_BUCKETS];
+	// decoded battery detail responses and their decode time
+	uint64_t batteryDetailBuckets[RSCP_HISTOGRAM_BUCKETS];
+};
+
+static bool bJsonOutput = false;
+static bool bVerbose = false;
+static bool bStaticMemory = false;
+static uint32_t uiCycles = 2000;
+static uint32_t uiIntervalMs = 0;
+static int iPort = 15033;
+static const char *cSimulator = "./RscpSimulator";
+static const char *cDirectory = "/tmp";
+static const char *cFilter = NULL;
+
+static void silence(void)
+{
+	int iNull = open("/dev/null", O_WRONLY);
+	if(iNull >= 0) {
+		dup2(iNull, STDOUT_FILENO);
+		close(iNull);
+	}
+}
+
+static bool readAll(int iFile, void *data, size_t length)
+{
+	uint8_t *p = (uint8_t *)data;
+	while(length > 0) {
+		ssize_t iResult = read(iFile, p, length);
+		if(iResult < 0 && errno == EINTR) {
+			continue;
+		}
+		if(iResult <= 0) {
+			return false;
+		}
+		p += iResult;
+		length -= iResult;
+	}
+	return true;
+}
+
+static pid_t startSimulator(const SScenario & scenario)
+{
+	pid_t pid = fork();
+	if(pid != 0) {
+		return pid;
+	}
+	if(!bVerbose) {
+		silence();
+	}
+	std::string port = std::to_string(iPort);
+	std::string delay = std::to_string(scenario.delayMs);
+	std::string segment = std::to_string(scenario.segmentBytes);
+	std::string frame = std::to_string(scenario.frameBytes);
+	execl(cSimulator, cSimulator, port.c_str(), "--delay", delay.c_str(), "--segment", segment.c_str(),
+			"--frame", frame.c_str(), (char *)NULL);
+	fprintf(stderr, "Cannot start %s. errno %i\n", cSimulator, errno);
+	_exit(EXIT_FAILURE);
+}
+
+static bool waitForSimulator(pid_t simulator)
+{
+	// a simulator which is still running from elsewhere would answer instead
+	usleep(10000);
+	if(waitpid(simulator, NULL, WNOHANG) == simulator) {
+		printf("Port %i is in use\n", iPort);
+		return false;
+	}
+	for(int i = 0; i < 200; ++i) {
+		int iSocket = SocketConnect("127.0.0.1", iPort);
+		if(iSocket >= 0) {
+			SocketClose(iSocket);
+			return true;
+		}
+		if(waitpid(simulator, NULL, WNOHANG) == simulator) {
+			return false;
+		}
+		usleep(10000);
+	}
+	return false;
+}
+
+static pid_t startDevice(int iResultPipe, const SScenario & scenario)
+{
+	pid_t pid = fork();
+	if(pid != 0) {
+		return pid;
+	}
+	if(!bVerbose) {
+		silence();
+	}
+	std::string target = std::string(cDirectory) + "/rscp_loadtest_" + std::to_string(getpid()) + ".json";
+	std::string batteryTarget = std::string(cDirectory) + "/rscp_loadtest_battery_" + std::to_string(getpid()) + ".json";
+	SDeviceResult result;
+	memset(&result, 0, sizeof(result));
+	if(bStaticMemory) {
+		setStaticMemory(2);
+	}
+	setWallboxControl(scenario.wallbox);
+	setBatteryDetail(scenario.batteryDetailMs, batteryTarget.c_str());
+	result.samples = runLiveSession("127.0.0.1", iPort, uiCycles, uiIntervalMs, target.c_str());
+	std::vector<uint64_t> buckets;
+	RscpMetrics::histogram(eStageCycle).getBuckets(buckets);
+	result.receiveCalls = RscpMetrics::receiveCalls();
+	result.receivedFrames = RscpMetrics::receivedFrames();
+	memcpy(result.buckets, &buckets[0], sizeof(result.buckets));
+	RscpMetrics::histogram(eStageWallbox).getBuckets(buckets);
+	memcpy(result.wallboxBuckets, &buckets[0], sizeof(result.wallboxBuckets));
+	RscpMetrics::histogram(eStageBatteryDetail).getBuckets(buckets);
+	memcpy(result.batteryDetailBuckets, &buckets[0], sizeof(result.batteryDetailBuckets));
+	unlink(target.c_str());
+	unlink(batteryTarget.c_str());
+	bool bWritten = (write(iResultPipe, &result, sizeof(result)) == sizeof(result));
+	_exit((bWritten && result.samples == uiCycles) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+static uint64_t percentile(const std::vector<uint64_t> & buckets, uint64_t total, double q)
+{
+	uint64_t uiRank = (uint64_t)(q * total + 0.5);
+	if(uiRank == 0) {
+		uiRank = 1;
+	}
+	uint64_t uiSeen = 0;
+	for(uint32_t i = 0; i < buckets.size(); ++i) {
+		uiSeen += buckets[i];
+		if(uiSeen >= uiRank) {
+			return RscpHistogram::bucketUpperBound(i);
+		}
+	}
+	return 0;
+}
+
+static bool runScenario(const SScenario & scenario)
+{
+	pid_t simulator = startSimulator(scenario);
+	if(simulator < 0 || !waitForSimulator(simulator)) {
+		printf("%s: simulator did not start\n", scenario.name);
+		return false;
+	}
+
+	struct timespec tsStart, tsEnd;
+	clock_gettime(CLOCK_MONOTONIC, &tsStart);
+	std::vector<pid_t> devices;
+	std::vector<int> pipes;
+	for(uint32_t i = 0; i < scenario.devices; ++i) {
+		int fds[2];
+		if(pipe(fds) < 0) {
+			printf("Cannot create pipe. errno %i\n", errno);
+			break;
+		}
+		pid_t pid = startDevice(fds[1], scenario);
+		close(fds[1]);
+		if(pid < 0) {
+			close(fds[0]);
+			break;
+		}
+		devices.push_back(pid);
+		pipes.push_back(fds[0]);
+	}
+
+	// merge the histograms and the resource usage of all devices
+	std::vector<uint64_t> buckets(RSCP_HISTOGRAM_BUCKETS, 0);
+	std::vector<uint64_t> wallboxBuckets(RSCP_HISTOGRAM_BUCKETS, 0);
+	std::vector<uint64_t> batteryDetailBuckets(RSCP_HISTOGRAM_BUCKETS, 0);
+	uint64_t uiSamples = 0;
+	uint64_t uiSetpoints = 0;
+	uint64_t uiBatteryDetails = 0;
+	uint64_t uiReceiveCalls = 0, uiReceivedFrames = 0;
+	double dCpuSeconds = 0.0;
+	long lMaxRssKiB = 0;
+	uint32_t uiFailed = scenario.devices - devices.size();
+	for(size_t i = 0; i < devices.size(); ++i) {
+		SDeviceResult result;
+		bool bRead = readAll(pipes[i], &result, sizeof(result));
+		close(pipes[i]);
+		int iStatus = 0;
+		struct rusage usage;
+		memset(&usage, 0, sizeof(usage));
+		wait4(devices[i], &iStatus, 0, &usage);
+		if(!bRead || !WIFEXITED(iStatus) || WEXITSTATUS(iStatus) != EXIT_SUCCESS) {
+			++uiFailed;
+		}
+		if(bRead && result.samples > 0) {
+			uiSamples += result.samples;
+			uiReceiveCalls += result.receiveCalls;
+			uiReceivedFrames += result.receivedFrames;
+			for(uint32_t n = 0; n < RSCP_HISTOGRAM_BUCKETS; ++n) {
+				buckets[n] += result.buckets[n];
+				wallboxBuckets[n] += result.wallboxBuckets[n];
+				uiSetpoints += result.wallboxBuckets[n];
+				batteryDetailBuckets[n] += result.batteryDetailBuckets[n];
+				uiBatteryDetails += result.batteryDetailBuckets[n];
+			}
+		}
+		dCpuSeconds += usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+		if(usage.ru_maxrss > lMaxRssKiB) {
+			lMaxRssKiB = usage.ru_maxrss;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &tsEnd);
+	kill(simulator, SIGTERM);
+	waitpid(simulator, NULL, 0);
+
+	double dSeconds = (tsEnd.tv_sec - tsStart.tv_sec) + (tsEnd.tv_nsec - tsStart.tv_nsec) / 1e9;
+	double dSamplesPerSecond = dSeconds > 0 ? uiSamples / dSeconds : 0.0;
+	double dCpuPerSampleUs = uiSamples ? dCpuSeconds * 1e6 / uiSamples : 0.0;
+	double p50 = percentile(buckets, uiSamples, 0.5) / 1000.0;
+	double p99 = percentile(buckets, uiSamples, 0.99) / 1000.0;
+	double p999 = percentile(buckets, uiSamples, 0.999) / 1000.0;
+	double dReceiveCalls = uiReceivedFrames ? (double)uiReceiveCalls / uiReceivedFrames : 0.0;
+	// the synthetic surplus of the simulator changes the charge current several times per 300 cycles
+	if(scenario.wallbox && uiSetpoints == 0) {
+		++uiFailed;
+	}
+	if(scenario.batteryDetailMs > 0 && uiBatteryDetails == 0) {
+		++uiFailed;
+	}
+	if(bJsonOutput) {
+		printf("{\"name\":\"%s\",\"frame_bytes\":%u,\"delay_ms\":%u,\"segment_bytes\":%u,\"devices\":%u,\"samples\":%llu,"
+				"\"failed_devices\":%u,\"samples_per_s\":%.1f,\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f,"
+				"\"cpu_us_per_sample\":%.1f,\"recv_per_frame\":%.2f,\"max_rss_kib\":%ld}\n", scenario.name, scenario.frameBytes,
+				scenario.delayMs, scenario.segmentBytes, scenario.devices, (unsigned long long)uiSamples, uiFailed,
+				dSamplesPerSecond, p50, p99, p999, dCpuPerSampleUs, dReceiveCalls, lMaxRssKiB);
+	}
+	else {
+		printf("%-20s %8llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.2f %8ld %s\n", scenario.name, (unsigned long long)uiSamples,
+				dSamplesPerSecond, p50, p99, p999, dCpuPerSampleUs, dReceiveCalls, lMaxRssKiB, uiFailed ? "FAILED" : "");
+	}
+	if(scenario.wallbox) {
+		double dReactionP50 = percentile(wallboxBuckets, uiSetpoints, 0.5) / 1000.0;
+		double dReactionP99 = percentile(wallboxBuckets, uiSetpoints, 0.99) / 1000.0;
+		if(bJsonOutput) {
+			printf("{\"name\":\"%s/reaction\",\"setpoints\":%llu,\"p50_us\":%.1f,\"p99_us\":%.1f}\n", scenario.name,
+					(unsigned long long)uiSetpoints, dReactionP50, dReactionP99);
+		}
+		else {
+			printf("%-20s %8llu %10s %10.1f %10.1f\n", "  reaction", (unsigned long long)uiSetpoints, "", dReactionP50, dReactionP99);
+		}
+	}
+	if(scenario.batteryDetailMs > 0) {
+		double dDecodeP50 = percentile(batteryDetailBuckets, uiBatteryDetails, 0.5) / 1000.0;
+		double dDecodeP99 = percentile(batteryDetailBuckets, uiBatteryDetails, 0.99) / 1000.0;
+		if(bJsonOutput) {
+			printf("{\"name\":\"%s/decode\",\"frames\":%llu,\"p50_us\":%.1f,\"p99_us\":%.1f}\n", scenario.name,
+					(unsigned long long)uiBatteryDetails, dDecodeP50, dDecodeP99);
+		}
+		else {
+			printf("%-20s %8llu %10s %10.1f %10.1f\n", "  decode", (unsigned long long)uiBatteryDetails, "", dDecodeP50, dDecodeP99);
+		}
+	}
+	fflush(stdout);
+	return uiFailed == 0;
+}
+
+int main(int argc, char *argv[])
+{
+	for(int i = 1; i < argc; ++i) {
+		if(strcmp(argv[i], "--json") == 0) {
+			bJsonOutput = true;
+		}
+		else if(strcmp(argv[i], "--verbose") == 0) {
+			bVerbose = true;
+		}
+		else if(strcmp(argv[i], "--static-memory") == 0) {
+			bStaticMemory = true;
+		}
+		else if(strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+			uiCycles = strtoul(argv[++i], NULL, 10);
+		}
+		else if(strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+			uiIntervalMs = strtoul(argv[++i], NULL, 10);
+		}
+		else if(strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+			iPort = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "--simulator") == 0 && i + 1 < argc) {
+			cSimulator = argv[++i];
+		}
+		else if(strcmp(argv[i], "--dir") == 0 && i + 1 < argc) {
+			cDirectory = argv[++i];
+		}
+		else {
+			cFilter = argv[i];
+		}
+	}
+	if(uiCycles == 0) {
+		printf("At least one cycle is required\n");
+		return EXIT_FAILURE;
+	}
+
+	if(!bJsonOutput) {
+		printf("%-20s %8s %10s %10s %10s %10s %10s %10s %8s\n", "scenario", "samples", "samples/s", "p50_us", "p99_us",
+				"p999_us", "cpu_us", "recv/frame", "rss_kib");
+	}
+	bool bPassed = true;
+	for(size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); ++i) {
+		if(cFilter != NULL && strstr(scenarios[i].name, cFilter) == NULL) {
+			continue;
+		}
+		bPassed = runScenario(scenarios[i]) && bPassed;
+	}
+	return bPassed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,478 @@
+/*
+ * RscpMetrics.cpp
+ *
+ * Stage histograms and per thread allocation and system call counters.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <new>
+#include "RscpMetrics.h"
+
+namespace {
+const char * const stageNames[RSCP_METRICS_STAGES] = {
+	"build", "encrypt", "send", "round_trip", "receive", "decrypt", "parse", "dispatch", "serialize", "write", "cycle", "reconnect", "wallbox",
+	"battery_detail"
+};
+
+RscpHistogram stageHistograms[RSCP_METRICS_STAGES];
+
+// no constructor, the slots are zero initialized before any allocation of the static initialization happens
+struct SThreadSlot {
+	std::atomic<const char *> name;
+	std::atomic<uint64_t> allocations;
+	std::atomic<uint64_t> allocatedBytes;
+	std::atomic<uint64_t> frees;
+	std::atomic<uint64_t> syscalls;
+};
+
+// receive calls and completed frames of the device connection, written by the I/O thread only
+std::atomic<uint64_t> receiveCallCount(0);
+std::atomic<uint64_t> receivedFrameCount(0);
+
+// slot 0 is shared by all threads which are not registered
+SThreadSlot threadSlots[RSCP_METRICS_MAX_THREADS];
+std::atomic<uint32_t> usedThreadSlots(1);
+thread_local SThreadSlot *threadSlot = NULL;
+
+inline void addCounter(std::atomic<uint64_t> & counter, uint64_t value, bool shared) {
+	if(shared) {
+		counter.fetch_add(value, std::memory_order_relaxed);
+	}
+	else {
+		// single writer, a plain load and store avoids the locked read-modify-write
+		counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	}
+}
+
+inline SThreadSlot & currentSlot(bool & shared) {
+	SThreadSlot *slot = threadSlot;
+	shared = (slot == NULL);
+	return shared ? threadSlots[0] : *slot;
+}
+
+#ifdef RSCP_TRACK_ALLOCATIONS
+// live allocations by call site, the tables are shared by all threads and guarded by a spin lock
+#define RSCP_TRACK_SITE_BITS    12
+#define RSCP_TRACK_SITES        (1 << RSCP_TRACK_SITE_BITS)
+#define RSCP_TRACK_POINTER_BITS 16
+#define RSCP_TRACK_POINTERS     (1 << RSCP_TRACK_POINTER_BITS)
+
+struct SSite {
+	const void *site;
+	uint64_t allocations;
+	uint64_t liveAllocations;
+	uint64_t liveBytes;
+};
+
+struct SPointer {
+	uintptr_t pointer;
+	uint32_t size;
+	uint32_t site;
+};
+
+// open addressing without tombstones, removed entries are filled by shifting the following entries back
+SSite sites[RSCP_TRACK_SITES];
+SPointer pointers[RSCP_TRACK_POINTERS];
+uint32_t usedPointers = 0;
+uint64_t untracked = 0;
+std::atomic_flag trackLock = ATOMIC_FLAG_INIT;
+
+inline uint32_t hashAddress(uintptr_t address, uint32_t bits) {
+	return (uint32_t)(((address >> 4) * 0x9E3779B97F4A7C15ULL) >> (64 - bits));
+}
+
+inline void lockTracking() {
+	while(trackLock.test_and_set(std::memory_order_acquire)) {
+	}
+}
+
+inline void unlockTracking() {
+	trackLock.clear(std::memory_order_release);
+}
+
+// only the address of a block is tracked, its memory is never read
+void trackAllocation(uintptr_t address, size_t size, const void *site) {
+	lockTracking();
+	// keep the pointer table at most 3/4 full so the probes stay short
+	if(usedPointers >= RSCP_TRACK_POINTERS / 4 * 3) {
+		++untracked;
+		unlockTracking();
+		return;
+	}
+	uint32_t uiSite = hashAddress((uintptr_t)site, RSCP_TRACK_SITE_BITS);
+	while(sites[uiSite].site != site && sites[uiSite].site != NULL) {
+		uiSite = (uiSite + 1) & (RSCP_TRACK_SITES - 1);
+		if(uiSite == hashAddress((uintptr_t)site, RSCP_TRACK_SITE_BITS)) {
+			++untracked;
+			unlockTracking();
+			return;
+		}
+	}
+	sites[uiSite].site = site;
+	++sites[uiSite].allocations;
+	++sites[uiSite].liveAllocations;
+	sites[uiSite].liveBytes += size;
+
+	uint32_t i = hashAddress(address, RSCP_TRACK_POINTER_BITS);
+	while(pointers[i].pointer != 0) {
+		i = (i + 1) & (RSCP_TRACK_POINTERS - 1);
+	}
+	pointers[i].pointer = address;
+	pointers[i].size = size;
+	pointers[i].site = uiSite;
+	++usedPointers;
+	unlockTracking();
+}
+
+void trackFree(uintptr_t address) {
+	lockTracking();
+	uint32_t i = hashAddress(address, RSCP_TRACK_POINTER_BITS);
+	while(pointers[i].pointer != address) {
+		if(pointers[i].pointer == 0) {
+			// allocated before the tracking had room or by code which does not count
+			unlockTracking();
+			return;
+		}
+		i = (i + 1) & (RSCP_TRACK_POINTERS - 1);
+	}
+	SSite & site = sites[pointers[i].site];
+	--site.liveAllocations;
+	site.liveBytes -= pointers[i].size;
+	--usedPointers;
+
+	uint32_t j = i;
+	while(true) {
+		j = (j + 1) & (RSCP_TRACK_POINTERS - 1);
+		if(pointers[j].pointer == 0) {
+			break;
+		}
+		// move the entry into the gap if the gap lies between its home slot and its current slot
+		uint32_t k = hashAddress(pointers[j].pointer, RSCP_TRACK_POINTER_BITS);
+		if((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+			pointers[i] = pointers[j];
+			i = j;
+		}
+	}
+	pointers[i].pointer = 0;
+	unlockTracking();
+}
+#endif
+
+std::atomic<int> heapPolicyValue(eHeapAllowed);
+std::atomic<uint64_t> heapViolationCount(0);
+thread_local uint32_t noHeapDepth = 0;
+
+// called for every heap operation, only a thread inside a no heap scope does more than one compare
+inline void checkHeap(const char *operation, size_t size, const void *site) {
+	if(noHeapDepth == 0) {
+		return;
+	}
+	int iPolicy = heapPolicyValue.load(std::memory_order_relaxed);
+	if(iPolicy == eHeapAllowed) {
+		return;
+	}
+	heapViolationCount.fetch_add(1, std::memory_order_relaxed);
+	if(iPolicy == eHeapAbort) {
+		// no stdio, printf could allocate itself
+		char cMessage[128];
+		int iLength = snprintf(cMessage, sizeof(cMessage), "Heap %s of %lu bytes at %p inside a no heap scope\n",
+				operation, (unsigned long)size, site);
+		if(iLength > 0 && write(STDERR_FILENO, cMessage, iLength) < 0) {
+			// abort anyway
+		}
+		abort();
+	}
+}
+
+// the address is passed as integer, a pointer to the fresh block would be taken as a read of uninitialized memory
+inline void addAllocation(uintptr_t address, size_t size, const void *site) {
+	checkHeap("allocation", size, site);
+	bool shared;
+	SThreadSlot & slot = currentSlot(shared);
+	addCounter(slot.allocations, 1, shared);
+	addCounter(slot.allocatedBytes, size, shared);
+#ifdef RSCP_TRACK_ALLOCATIONS
+	trackAllocation(address, size, site);
+#endif
+}
+
+inline void addFree(uintptr_t address, const void *site) {
+	checkHeap("free", 0, site);
+	bool shared;
+	SThreadSlot & slot = currentSlot(shared);
+	addCounter(slot.frees, 1, shared);
+#ifdef RSCP_TRACK_ALLOCATIONS
+	trackFree(address);
+#endif
+}
+
+inline void * allocate(size_t size, const void *site) {
+	void *p = malloc(size ? size : 1);
+	if(p != NULL) {
+		addAllocation((uintptr_t)p, size, site);
+	}
+	return p;
+}
+}
+
+RscpHistogram::RscpHistogram() {
+	for(uint32_t i = 0; i < RSCP_HISTOGRAM_BUCKETS; ++i) {
+		counts[i].store(0, std::memory_order_relaxed);
+	}
+	total.store(0, std::memory_order_relaxed);
+	totalValue.store(0, std::memory_order_relaxed);
+	maxValue.store(0, std::memory_order_relaxed);
+}
+
+void RscpHistogram::add(std::atomic<uint64_t> & counter, uint64_t value) {
+	addCounter(counter, value, false);
+}
+
+void RscpHistogram::record(uint64_t value) {
+	add(counts[bucketIndex(value)], 1);
+	add(total, 1);
+	add(totalValue, value);
+	if(value > maxValue.load(std::memory_order_relaxed)) {
+		maxValue.store(value, std::memory_order_relaxed);
+	}
+}
+
+uint64_t RscpHistogram::count() const {
+	return total.load(std::memory_order_relaxed);
+}
+
+uint64_t RscpHistogram::sum() const {
+	return totalValue.load(std::memory_order_relaxed);
+}
+
+uint64_t RscpHistogram::max() const {
+	return maxValue.load(std::memory_order_relaxed);
+}
+
+uint64_t RscpHistogram::percentile(double q) const {
+	uint64_t uiTotal = count();
+	if(uiTotal == 0) {
+		return 0;
+	}
+	uint64_t uiRank = (uint64_t)(q * uiTotal + 0.5);
+	if(uiRank == 0) {
+		uiRank = 1;
+	}
+	uint64_t uiSeen = 0;
+	for(uint32_t i = 0; i < RSCP_HISTOGRAM_BUCKETS; ++i) {
+		uiSeen += counts[i].load(std::memory_order_relaxed);
+		if(uiSeen >= uiRank) {
+			uint64_t uiBound = bucketUpperBound(i);
+			return (uiBound < max()) ? uiBound : max();
+		}
+	}
+	// counts are read while the writer records, the maximum is always a valid answer
+	return max();
+}
+
+void RscpHistogram::getBuckets(std::vector<uint64_t> & buckets) const {
+	buckets.resize(RSCP_HISTOGRAM_BUCKETS);
+	for(uint32_t i = 0; i < RSCP_HISTOGRAM_BUCKETS; ++i) {
+		buckets[i] = counts[i].load(std::memory_order_relaxed);
+	}
+}
+
+uint32_t RscpHistogram::bucketIndex(uint64_t value) {
+	const uint64_t subBuckets = 1 << RSCP_HISTOGRAM_SUB_BITS;
+	if(value < subBuckets) {
+		return value;
+	}
+	uint32_t uiExponent = 63 - __builtin_clzll(value);
+	if(uiExponent > RSCP_HISTOGRAM_MAX_BITS) {
+		return RSCP_HISTOGRAM_BUCKETS - 1;
+	}
+	return ((uiExponent - RSCP_HISTOGRAM_SUB_BITS + 1) << RSCP_HISTOGRAM_SUB_BITS)
+			+ ((value >> (uiExponent - RSCP_HISTOGRAM_SUB_BITS)) & (subBuckets - 1));
+}
+
+uint64_t RscpHistogram::bucketUpperBound(uint32_t index) {
+	const uint32_t subBuckets = 1 << RSCP_HISTOGRAM_SUB_BITS;
+	if(index < subBuckets) {
+		return index;
+	}
+	uint32_t uiShift = (index >> RSCP_HISTOGRAM_SUB_BITS) - 1;
+	uint64_t uiLower = (uint64_t)(subBuckets + (index & (subBuckets - 1))) << uiShift;
+	return uiLower + ((uint64_t)1 << uiShift) - 1;
+}
+
+int64_t RscpMetrics::record(ERscpStage stage, int64_t start) {
+	int64_t end = now();
+	stageHistograms[stage].record((end > start) ? end - start : 0);
+	return end;
+}
+
+const RscpHistogram & RscpMetrics::histogram(ERscpStage stage) {
+	return stageHistograms[stage];
+}
+
+const char * RscpMetrics::stageName(ERscpStage stage) {
+	return stageNames[stage];
+}
+
+void RscpMetrics::registerThread(const char *name) {
+	// a restarted thread with the same name continues with its old counters
+	uint32_t uiUsed = usedThreadSlots.load();
+	for(uint32_t i = 1; i < uiUsed && i < RSCP_METRICS_MAX_THREADS; ++i) {
+		const char *slotName = threadSlots[i].name.load();
+		if((slotName != NULL) && (strcmp(slotName, name) == 0)) {
+			threadSlot = &threadSlots[i];
+			return;
+		}
+	}
+	uint32_t uiSlot = usedThreadSlots.fetch_add(1);
+	if(uiSlot >= RSCP_METRICS_MAX_THREADS) {
+		usedThreadSlots.store(RSCP_METRICS_MAX_THREADS);
+		return;
+	}
+	threadSlots[uiSlot].name.store(name);
+	threadSlot = &threadSlots[uiSlot];
+}
+
+void RscpMetrics::countSyscalls(uint32_t count) {
+	bool shared;
+	SThreadSlot & slot = currentSlot(shared);
+	addCounter(slot.syscalls, count, shared);
+}
+
+void RscpMetrics::countReceive(uint32_t calls, uint32_t frames) {
+	addCounter(receiveCallCount, calls, false);
+	addCounter(receivedFrameCount, frames, false);
+}
+
+uint64_t RscpMetrics::receiveCalls() {
+	return receiveCallCount.load(std::memory_order_relaxed);
+}
+
+uint64_t RscpMetrics::receivedFrames() {
+	return receivedFrameCount.load(std::memory_order_relaxed);
+}
+
+void RscpMetrics::countAllocation(void *p, size_t size, const void *site) {
+	addAllocation((uintptr_t)p, size, site);
+}
+
+void RscpMetrics::countFree(const void *p) {
+	addFree((uintptr_t)p, __builtin_return_address(0));
+}
+
+uint64_t RscpMetrics::getAllocationSites(std::vector<SRscpAllocationSite> & result) {
+	result.clear();
+#ifdef RSCP_TRACK_ALLOCATIONS
+	// the result is reserved before the lock because the allocation is tracked as well
+	result.reserve(RSCP_TRACK_SITES);
+	lockTracking();
+	for(uint32_t i = 0; i < RSCP_TRACK_SITES; ++i) {
+		if(sites[i].site != NULL) {
+			SRscpAllocationSite site;
+			site.site = sites[i].site;
+			site.allocations = sites[i].allocations;
+			site.liveAllocations = sites[i].liveAllocations;
+			site.liveBytes = sites[i].liveBytes;
+			result.push_back(site);
+		}
+	}
+	uint64_t uiUntracked = untracked;
+	unlockTracking();
+	return uiUntracked;
+#else
+	return 0;
+#endif
+}
+
+void RscpMetrics::setHeapPolicy(ERscpHeapPolicy policy) {
+	heapPolicyValue.store(policy);
+}
+
+ERscpHeapPolicy RscpMetrics::heapPolicy() {
+	return (ERscpHeapPolicy)heapPolicyValue.load();
+}
+
+void RscpMetrics::enterNoHeap() {
+	++noHeapDepth;
+}
+
+void RscpMetrics::leaveNoHeap() {
+	if(noHeapDepth > 0) {
+		--noHeapDepth;
+	}
+}
+
+uint64_t RscpMetrics::heapViolations() {
+	return heapViolationCount.load(std::memory_order_relaxed);
+}
+
+void RscpMetrics::getThreadCounters(std::vector<SRscpThreadCounters> & counters) {
+	uint32_t uiUsed = usedThreadSlots.load();
+	if(uiUsed > RSCP_METRICS_MAX_THREADS) {
+		uiUsed = RSCP_METRICS_MAX_THREADS;
+	}
+	counters.resize(uiUsed);
+	for(uint32_t i = 0; i < uiUsed; ++i) {
+		const char *name = threadSlots[i].name.load();
+		counters[i].name = (i == 0 || name == NULL) ? "other" : name;
+		counters[i].allocations = threadSlots[i].allocations.load(std::memory_order_relaxed);
+		counters[i].allocatedBytes = threadSlots[i].allocatedBytes.load(std::memory_order_relaxed);
+		counters[i].frees = threadSlots[i].frees.load(std::memory_order_relaxed);
+		counters[i].syscalls = threadSlots[i].syscalls.load(std::memory_order_relaxed);
+	}
+}
+
+// global allocation functions which count every heap allocation of the C++ code, the site is the caller
+void * operator new(size_t size) {
+	void *p = allocate(size, __builtin_return_address(0));
+	if(p == NULL) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void * operator new[](size_t size) {
+	void *p = allocate(size, __builtin_return_address(0));
+	if(p == NULL) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void * operator new(size_t size, const std::nothrow_t &) noexcept {
+	return allocate(size, __builtin_return_address(0));
+}
+
+void * operator new[](size_t size, const std::nothrow_t &) noexcept {
+	return allocate(size, __builtin_return_address(0));
+}
+
+void operator delete(void *p) noexcept {
+	if(p != NULL) {
+		addFree((uintptr_t)p, __builtin_return_address(0));
+		free(p);
+	}
+}
+
+void operator delete[](void *p) noexcept {
+	operator delete(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+	operator delete(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+	operator delete(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+	operator delete(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+	operator delete(p);
+}
@@ -0,0 +1,196 @@
+/*
+ * RscpMetrics.h
+ *
+ * Low overhead self monitoring of the client. Every stage of a fetch cycle records its duration into a
+ * log-linear histogram and every thread counts its heap allocations and system calls. Histograms and
+ * counters have a single writer each and are read without locks by the thread which exports them.
+ */
+
+#ifndef RSCPMETRICS_H_
+#define RSCPMETRICS_H_
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Linear sub buckets per power of two, 2^3 buckets give a resolution of 12.5%.
+ */
+#define RSCP_HISTOGRAM_SUB_BITS     3
+/*
+ * Values up to 2^40 ns (about 18 minutes) are resolved, larger values are counted in the last bucket.
+ */
+#define RSCP_HISTOGRAM_MAX_BITS     40
+#define RSCP_HISTOGRAM_BUCKETS      ((RSCP_HISTOGRAM_MAX_BITS - RSCP_HISTOGRAM_SUB_BITS + 2) << RSCP_HISTOGRAM_SUB_BITS)
+/*
+ * Maximum number of threads with own counters. Threads which are not registered share one slot.
+ */
+#define RSCP_METRICS_MAX_THREADS    8
+
+enum ERscpStage {
+	eStageBuild = 0,    // request frame creation
+	eStageEncrypt,      // padding and AES encryption of the request
+	eStageSend,         // socket send of the request
+	eStageRoundTrip,    // end of the send until the first response bytes arrive
+	eStageReceive,      // further socket receives of the response
+	eStageDecrypt,      // AES decryption of received data
+	eStageParse,        // RscpProtocol::parseFrame
+	eStageDispatch,     // handleResponseValue for all values of a frame
+	eStageSerialize,    // json rendering
+	eStageWrite,        // sink write
+	eStageCycle,        // start of the request build until the response is rendered (end to end)
+	eStageReconnect,    // loss of a session until the first response of the next one
+	eStageWallbox,      // poll response received until the wallbox acknowledged the setpoint computed from it
+	eStageBatteryDetail, // decoding and rendering of a battery detail response (RscpBatteryDetail)
+	RSCP_METRICS_STAGES
+};
+
+/*
+ * HDR style histogram: values below 2^RSCP_HISTOGRAM_SUB_BITS have their own bucket, above every
+ * power of two is split into 2^RSCP_HISTOGRAM_SUB_BITS linear buckets.
+ * Only one thread may record, any thread may read.
+ */
+class RscpHistogram {
+public:
+	RscpHistogram();
+	void record(uint64_t value);
+	uint64_t count() const;
+	uint64_t sum() const;
+	uint64_t max() const;
+	/*
+	 * \brief Upper bound of the bucket which contains the quantile \var q (0.0 - 1.0).
+	 * @return - 0 if nothing was recorded
+	 */
+	uint64_t percentile(double q) const;
+	/*
+	 * \brief Snapshot of the bucket counts, used by exporters which publish the whole distribution.
+	 */
+	void getBuckets(std::vector<uint64_t> & buckets) const;
+	static uint32_t bucketIndex(uint64_t value);
+	static uint64_t bucketUpperBound(uint32_t index);
+private:
+	static void add(std::atomic<uint64_t> & counter, uint64_t value);
+
+	std::atomic<uint64_t> counts[RSCP_HISTOGRAM_BUCKETS];
+	std::atomic<uint64_t> total;
+	std::atomic<uint64_t> totalValue;
+	std::atomic<uint64_t> maxValue;
+};
+
+/*
+ * Live heap allocations of one code address, see RscpMetrics::getAllocationSites.
+ */
+struct SRscpAllocationSite {
+	const void *site;
+	uint64_t allocations;
+	uint64_t liveAllocations;
+	uint64_t liveBytes;
+};
+
+/*
+ * Handling of heap allocations inside a no heap scope, see RscpMetrics::enterNoHeap.
+ */
+enum ERscpHeapPolicy {
+	eHeapAllowed = 0,   // scopes are ignored
+	eHeapCounted,       // allocations and frees inside a scope are counted as violations
+	eHeapAbort          // the first violation prints its size and call site and aborts (test builds)
+};
+
+struct SRscpThreadCounters {
+	std::string name;
+	uint64_t allocations;
+	uint64_t allocatedBytes;
+	uint64_t frees;
+	uint64_t syscalls;
+};
+
+namespace RscpMetrics {
+/*
+ * \brief Monotonic time in ns. clock_gettime is served by the vDSO and does not enter the kernel.
+ */
+inline int64_t now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * \brief Record the time since \var start (from now()) for \var stage.
+ * @return - the current time, which can be used as start of the next stage
+ */
+int64_t record(ERscpStage stage, int64_t start);
+const RscpHistogram & histogram(ERscpStage stage);
+const char * stageName(ERscpStage stage);
+
+/*
+ * \brief Give the calling thread its own counters, must be called once at the start of the thread.
+ */
+void registerThread(const char *name);
+/*
+ * \brief Count system calls which are made by the calling thread.
+ */
+void countSyscalls(uint32_t count);
+/*
+ * \brief Count the receive system calls of the device connection and the frames they completed.
+ *        Only the I/O thread counts, every receive call is one wakeup of it.
+ */
+void countReceive(uint32_t calls, uint32_t frames);
+uint64_t receiveCalls();
+uint64_t receivedFrames();
+/*
+ * \brief Count heap memory which is not allocated by operator new (malloc of RscpProtocol).
+ * @param site - code address which allocates, used by builds with RSCP_TRACK_ALLOCATIONS
+ */
+void countAllocation(void *p, size_t size, const void *site);
+void countFree(const void *p);
+/*
+ * \brief Live allocations grouped by the code address which allocated them. Only builds with
+ *        RSCP_TRACK_ALLOCATIONS (the soak test) track them, otherwise the list is empty.
+ * @return - number of allocations which could not be tracked because the tables were full
+ */
+uint64_t getAllocationSites(std::vector<SRscpAllocationSite> & sites);
+/*
+ * \brief Select how heap operations inside no heap scopes are handled, eHeapAllowed by default.
+ */
+void setHeapPolicy(ERscpHeapPolicy policy);
+ERscpHeapPolicy heapPolicy();
+/*
+ * \brief Mark the start and the end of a section of the calling thread which must not use the heap.
+ *        Scopes can be nested, RscpNoHeapScope pairs the calls.
+ */
+void enterNoHeap();
+void leaveNoHeap();
+/*
+ * \brief Heap operations of all threads which happened inside a no heap scope.
+ */
+uint64_t heapViolations();
+/*
+ * \brief Snapshot of the counters of all threads.
+ */
+void getThreadCounters(std::vector<SRscpThreadCounters> & counters);
+}
+
+/*
+ * Pairs RscpMetrics::enterNoHeap and leaveNoHeap for a block, a scope created with \var active false does nothing.
+ */
+class RscpNoHeapScope {
+public:
+	explicit RscpNoHeapScope(bool active = true) : active(active) {
+		if(active) {
+			RscpMetrics::enterNoHeap();
+		}
+	}
+	~RscpNoHeapScope() {
+		if(active) {
+			RscpMetrics::leaveNoHeap();
+		}
+	}
+private:
+	bool active;
+	RscpNoHeapScope(const RscpNoHeapScope &);
+	RscpNoHeapScope & operator=(const RscpNoHeapScope &);
+};
+
+#endif /* RSCPMETRICS_H_ */
@@ -0,0 +1,205 @@
+/*
+ * RscpPipeline.cpp
+ *
+ * Three stage processing of received RSCP frames.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "RscpPipeline.h"
+#include "RscpMetrics.h"
+
+static_assert(RSCP_PIPELINE_BUFFERS <= 4 * RSCP_PIPELINE_QUEUE_SIZE, "every pooled buffer must fit into a free queue");
+
+namespace {
+int64_t monotonicNs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// a consumer without work spins shortly and then sleeps in small steps,
+// frames arrive at most a few times per second so the sleep does not cost throughput
+void idle(uint32_t & uiIdleRounds) {
+	if(++uiIdleRounds < 64) {
+		std::this_thread::yield();
+	}
+	else {
+		usleep(200);
+	}
+}
+}
+
+RscpPipeline::RscpPipeline(DecodeHandler decodeHandler, OutputHandler outputHandler) :
+		decodeHandler(decodeHandler), outputHandler(outputHandler), bRunning(false), submitted(0), decoded(0) {
+	resetCounters(decodeCounters);
+	resetCounters(outputCounters);
+	// the pool starts in one of the free queues, no stage is running yet
+	for(size_t i = 0; i < RSCP_PIPELINE_BUFFERS; ++i) {
+		buffers[i].length = 0;
+		buffers[i].target = NULL;
+		buffers[i].requested = 0;
+		buffers[i].received = 0;
+		buffers[i].decoded = 0;
+		outputFreeQueue.push(&buffers[i]);
+	}
+}
+
+RscpPipeline::~RscpPipeline() {
+	stop();
+}
+
+void RscpPipeline::start() {
+	if(bRunning) {
+		return;
+	}
+	bRunning = true;
+	decoder = std::thread(&RscpPipeline::decodeThread, this);
+	writer = std::thread(&RscpPipeline::outputThread, this);
+}
+
+void RscpPipeline::stop() {
+	bRunning = false;
+	if(decoder.joinable()) {
+		decoder.join();
+	}
+	if(writer.joinable()) {
+		writer.join();
+	}
+}
+
+SRscpPipelineBuffer * RscpPipeline::acquire() {
+	SRscpPipelineBuffer *buffer = NULL;
+	if(outputFreeQueue.pop(buffer) || decodeFreeQueue.pop(buffer)) {
+		return buffer;
+	}
+	return NULL;
+}
+
+bool RscpPipeline::submit(const uint8_t *data, uint32_t length, int64_t requested) {
+	SRscpPipelineBuffer *buffer = acquire();
+	if(buffer == NULL) {
+		decodeCounters.dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	if(buffer->data.size() < length) {
+		buffer->data.resize(length);
+	}
+	memcpy(&buffer->data[0], data, length);
+	buffer->length = length;
+	buffer->requested = requested;
+	buffer->received = monotonicNs();
+
+	if(!decodeQueue.push(buffer)) {
+		// the decode thread does not keep up, the buffer stays with the I/O thread for the next frame
+		decodeCounters.dropped.fetch_add(1, std::memory_order_relaxed);
+		decodeFreeQueue.push(buffer);
+		return false;
+	}
+	++submitted;
+	updateQueueDepth(decodeCounters, decodeQueue.size());
+	return true;
+}
+
+void RscpPipeline::reserve(uint32_t dataBytes, uint32_t textBytes) {
+	for(size_t i = 0; i < RSCP_PIPELINE_BUFFERS; ++i) {
+		if(buffers[i].data.size() < dataBytes) {
+			buffers[i].data.resize(dataBytes);
+		}
+		buffers[i].text.reserve(textBytes);
+	}
+}
+
+void RscpPipeline::flush() {
+	while(bRunning && decoded.load(std::memory_order_acquire) != submitted) {
+		usleep(100);
+	}
+}
+
+void RscpPipeline::decodeThread() {
+	RscpMetrics::registerThread("decode");
+	uint32_t uiIdleRounds = 0;
+	while(bRunning) {
+		SRscpPipelineBuffer *buffer;
+		if(!decodeQueue.pop(buffer)) {
+			idle(uiIdleRounds);
+			continue;
+		}
+		uiIdleRounds = 0;
+
+		bool bForward = decodeHandler(buffer);
+		buffer->decoded = monotonicNs();
+		addLatency(decodeCounters, buffer->decoded - buffer->received);
+		decoded.fetch_add(1, std::memory_order_release);
+
+		if(!bForward) {
+			decodeFreeQueue.push(buffer);
+		}
+		else if(!outputQueue.push(buffer)) {
+			// the sink is slow (for example a full disk), drop this output and keep on decoding
+			outputCounters.dropped.fetch_add(1, std::memory_order_relaxed);
+			decodeFreeQueue.push(buffer);
+		}
+		else {
+			updateQueueDepth(outputCounters, outputQueue.size());
+		}
+	}
+}
+
+void RscpPipeline::outputThread() {
+	RscpMetrics::registerThread("output");
+	uint32_t uiIdleRounds = 0;
+	while(bRunning) {
+		SRscpPipelineBuffer *buffer;
+		if(!outputQueue.pop(buffer)) {
+			idle(uiIdleRounds);
+			continue;
+		}
+		uiIdleRounds = 0;
+
+		outputHandler(buffer);
+		addLatency(outputCounters, monotonicNs() - buffer->decoded);
+		outputFreeQueue.push(buffer);
+	}
+}
+
+void RscpPipeline::resetCounters(SStageCounters & counters) {
+	counters.processed = 0;
+	counters.dropped = 0;
+	counters.totalLatencyNs = 0;
+	counters.maxLatencyNs = 0;
+	counters.maxQueueDepth = 0;
+}
+
+void RscpPipeline::addLatency(SStageCounters & counters, int64_t latency) {
+	// the latency counters of a stage are only written by the thread of that stage
+	uint64_t ulLatency = (latency > 0) ? latency : 0;
+	counters.processed.store(counters.processed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	counters.totalLatencyNs.store(counters.totalLatencyNs.load(std::memory_order_relaxed) + ulLatency, std::memory_order_relaxed);
+	if(ulLatency > counters.maxLatencyNs.load(std::memory_order_relaxed)) {
+		counters.maxLatencyNs.store(ulLatency, std::memory_order_relaxed);
+	}
+}
+
+void RscpPipeline::updateQueueDepth(SStageCounters & counters, uint32_t depth) {
+	// only written by the producer of the queue
+	if(depth > counters.maxQueueDepth.load(std::memory_order_relaxed)) {
+		counters.maxQueueDepth.store(depth, std::memory_order_relaxed);
+	}
+}
+
+void RscpPipeline::getCounters(const SStageCounters & counters, uint32_t depth, SRscpPipelineStageStatistics & statistics) {
+	statistics.queueDepth = depth;
+	statistics.maxQueueDepth = counters.maxQueueDepth.load(std::memory_order_relaxed);
+	statistics.processed = counters.processed.load(std::memory_order_relaxed);
+	statistics.dropped = counters.dropped.load(std::memory_order_relaxed);
+	statistics.maxLatencyNs = counters.maxLatencyNs.load(std::memory_order_relaxed);
+	uint64_t ulTotal = counters.totalLatencyNs.load(std::memory_order_relaxed);
+	statistics.averageLatencyNs = (statistics.processed > 0) ? ulTotal / statistics.processed : 0;
+}
+
+void RscpPipeline::getStatistics(SRscpPipelineStageStatistics & decode, SRscpPipelineStageStatistics & output) const {
+	getCounters(decodeCounters, decodeQueue.size(), decode);
+	getCounters(outputCounters, outputQueue.size(), output);
+}
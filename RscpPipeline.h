@@ -0,0 +1,137 @@
+/*
+ * RscpPipeline.h
+ *
+ * Three stage processing of received RSCP frames. The I/O thread receives and decrypts frames and
+ * submits them to the decode thread which parses them and renders the output. The output thread
+ * writes the rendered data to the sinks. The stages are connected by bounded lock-free queues
+ * carrying pooled buffers, a stage which can not keep up drops work instead of delaying the I/O thread.
+ */
+
+#ifndef RSCPPIPELINE_H_
+#define RSCPPIPELINE_H_
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include "SpscQueue.h"
+
+/*
+ * Number of buffers each queue between two stages can hold, must be a power of two.
+ */
+#define RSCP_PIPELINE_QUEUE_SIZE    16
+/*
+ * Number of pooled buffers. Every buffer can be queued, one can be in work in each stage and one is spare.
+ */
+#define RSCP_PIPELINE_BUFFERS       (2 * RSCP_PIPELINE_QUEUE_SIZE + 4)
+
+/*
+ * Pooled buffer which is passed through the stages. The vector and string keep their capacity
+ * when the buffer returns to the pool so the steady state does not allocate.
+ */
+struct SRscpPipelineBuffer {
+	// decrypted RSCP frame
+	std::vector<uint8_t> data;
+	uint32_t length;
+	// rendered output of the decode stage and the file it is written to, NULL for the target of the live data
+	std::string text;
+	const char *target;
+	// monotonic timestamps in ns, requested is the start of the cycle which requested the frame (0 if unknown)
+	int64_t requested;
+	int64_t received;
+	int64_t decoded;
+};
+
+/*
+ * Snapshot of the counters of one stage. The latency of a stage is measured from the end of the
+ * previous stage and includes the time the buffer waited in the queue.
+ */
+struct SRscpPipelineStageStatistics {
+	uint32_t queueDepth;
+	uint32_t maxQueueDepth;
+	uint64_t processed;
+	uint64_t dropped;
+	uint64_t averageLatencyNs;
+	uint64_t maxLatencyNs;
+};
+
+class RscpPipeline {
+public:
+	/*
+	 * \brief Called on the decode thread for every submitted frame.
+	 * @return - true if the buffer contains rendered output which should be passed to the output stage
+	 */
+	typedef bool (*DecodeHandler)(SRscpPipelineBuffer *buffer);
+	/*
+	 * \brief Called on the output thread for every rendered buffer.
+	 */
+	typedef void (*OutputHandler)(SRscpPipelineBuffer *buffer);
+
+	RscpPipeline(DecodeHandler decodeHandler, OutputHandler outputHandler);
+	virtual ~RscpPipeline();
+	/*
+	 * \brief Start the decode and the output thread.
+	 */
+	void start();
+	/*
+	 * \brief Stop and join the decode and the output thread. Queued buffers are not processed anymore.
+	 */
+	void stop();
+	/*
+	 * \brief Copy a decrypted frame into a pooled buffer and queue it for the decode thread.
+	 *        Must only be called by the I/O thread. Never blocks, the frame is dropped if the decode stage is full.
+	 * @param requested - start of the cycle which requested the frame (RscpMetrics::now()), 0 if unknown
+	 * @return - false if the frame was dropped
+	 */
+	bool submit(const uint8_t *data, uint32_t length, int64_t requested);
+	/*
+	 * \brief Allocate \var dataBytes for the frame and \var textBytes for the rendered output of every pooled buffer
+	 *        up front, so frames and outputs up to these sizes never allocate. Must be called before start().
+	 */
+	void reserve(uint32_t dataBytes, uint32_t textBytes);
+	/*
+	 * \brief Wait until the decode thread handled every submitted frame. Must only be called by the I/O thread.
+	 */
+	void flush();
+	/*
+	 * \brief Snapshot of the counters of the decode and the output stage. Can be called from any thread.
+	 */
+	void getStatistics(SRscpPipelineStageStatistics & decode, SRscpPipelineStageStatistics & output) const;
+private:
+	struct SStageCounters {
+		std::atomic<uint64_t> processed;
+		std::atomic<uint64_t> dropped;
+		std::atomic<uint64_t> totalLatencyNs;
+		std::atomic<uint64_t> maxLatencyNs;
+		std::atomic<uint32_t> maxQueueDepth;
+	};
+
+	SRscpPipelineBuffer * acquire();
+	void decodeThread();
+	void outputThread();
+	static void resetCounters(SStageCounters & counters);
+	static void addLatency(SStageCounters & counters, int64_t latency);
+	static void updateQueueDepth(SStageCounters & counters, uint32_t depth);
+	static void getCounters(const SStageCounters & counters, uint32_t depth, SRscpPipelineStageStatistics & statistics);
+
+	DecodeHandler decodeHandler;
+	OutputHandler outputHandler;
+	std::atomic<bool> bRunning;
+	std::thread decoder;
+	std::thread writer;
+	SRscpPipelineBuffer buffers[RSCP_PIPELINE_BUFFERS];
+	// I/O -> decode and decode -> output
+	SpscQueue<SRscpPipelineBuffer *, RSCP_PIPELINE_QUEUE_SIZE> decodeQueue;
+	SpscQueue<SRscpPipelineBuffer *, RSCP_PIPELINE_QUEUE_SIZE> outputQueue;
+	// free buffers returned to the I/O thread, one queue per returning stage to keep every queue single producer
+	SpscQueue<SRscpPipelineBuffer *, 4 * RSCP_PIPELINE_QUEUE_SIZE> decodeFreeQueue;
+	SpscQueue<SRscpPipelineBuffer *, 4 * RSCP_PIPELINE_QUEUE_SIZE> outputFreeQueue;
+	// frames submitted by the I/O thread and frames handled by the decode thread
+	uint64_t submitted;
+	std::atomic<uint64_t> decoded;
+	SStageCounters decodeCounters;
+	SStageCounters outputCounters;
+};
+
+#endif /* RSCPPIPELINE_H_ */
@@ -11,6 +11,38 @@
 #include <windows.h>
 #endif
 #include "RscpProtocol.h"
+#include "RscpCodec.h"
+#include "RscpMetrics.h"
+#include "RscpVisitor.h"
+
+// value and frame data is allocated with malloc, these wrappers count it like the C++ allocations.
+// They are always inlined, so the allocation site resolves to the RscpProtocol method which allocates.
+static inline __attribute__((always_inline)) void * countedMalloc(size_t size) {
+	void *p = malloc(size);
+	if(p != NULL) {
+		RscpMetrics::countAllocation(p, size, __builtin_return_address(0));
+	}
+	return p;
+}
+
+static inline __attribute__((always_inline)) void * countedRealloc(void *data, size_t size) {
+	// the old block is untracked before it is released, afterwards another thread may get the same address
+	RscpMetrics::countFree(data);
+	void *p = realloc(data, size);
+	if(p != NULL) {
+		RscpMetrics::countAllocation(p, size, __builtin_return_address(0));
+	}
+	else if(size > 0) {
+		// the old block is still allocated
+		RscpMetrics::countAllocation(data, size, __builtin_return_address(0));
+	}
+	return p;
+}
+
+static inline __attribute__((always_inline)) void countedFree(void *data) {
+	RscpMetrics::countFree(data);
+	free(data);
+}
 
 
 RscpProtocol::RscpProtocol() {
@@ -19,9 +51,9 @@ RscpProtocol::RscpProtocol() {
 RscpProtocol::~RscpProtocol() {
 }
 
-bool RscpProtocol::setHeaderTimestamp(SRscpFrame *frame) {
+bool RscpProtocol::setHeaderTimestamp(SRscpFrameHeader *header) {
 	// sanity check
-	if(frame == NULL) {
+	if(header == NULL) {
 		return false;
 	}
 
@@ -31,8 +63,8 @@ bool RscpProtocol::setHeaderTimestamp(SRscpFrame *frame) {
 	struct timeval timeVal;
 	gettimeofday(&timeVal, NULL);
 	// set frame timestamp
-	frame->header.timestamp.seconds = timeVal.tv_sec;
-	frame->header.timestamp.nanoseconds = timeVal.tv_usec * 1000;
+	header->timestamp.seconds = timeVal.tv_sec;
+	header->timestamp.nanoseconds = timeVal.tv_usec * 1000;
 #elif defined(WINNT)
 	// calculate timestamp in nano seconds
 	FILETIME ftNow;
@@ -40,29 +72,101 @@ bool RscpProtocol::setHeaderTimestamp(SRscpFrame *frame) {
 	uint64_t u64Now = (uint64_t)ftNow.dwLowDateTime | ((uint64_t)(ftNow.dwHighDateTime) << 32ULL);
 	u64Now = (u64Now - 116444736000000000ULL) * 100;
 	// set frame timestamp
-	frame->header.timestamp.seconds = u64Now / 1000000000;
-	frame->header.timestamp.nanoseconds = u64Now % 1000000000;
+	header->timestamp.seconds = u64Now / 1000000000;
+	header->timestamp.nanoseconds = u64Now % 1000000000;
 #else
 #warning No time source is available.
 	// unknown
-	frame->header.timeSec = 0;
-	frame->header.timeNanosec = 0;
+	header->timestamp.seconds = 0;
+	header->timestamp.nanoseconds = 0;
 #endif
 
 	return bTimeSet;
 }
 
+void RscpProtocol::initFrameHeader(SRscpFrameHeader *header, uint16_t dataLength, bool calcCRC) {
+	memset(header, 0, sizeof(SRscpFrameHeader));
+	header->magic = RSCP::MAGIC;
+	header->ctrl.value = RscpCodec::frameControl(calcCRC);
+	header->dataLength = dataLength;
+	setHeaderTimestamp(header);
+}
+
+void RscpProtocol::writeFrame(uint8_t *buffer, const uint8_t *data, uint16_t dataLength, bool calcCRC) {
+	SRscpFrameHeader header;
+	initFrameHeader(&header, dataLength, calcCRC);
+	RscpCodec::writeFrameHeader(buffer, header);
+	if(dataLength > 0) {
+		memcpy(buffer + RSCP_FRAME_HEADER_SIZE, data, dataLength);
+	}
+	if(calcCRC) {
+		RscpCodec::store32(buffer + RSCP_FRAME_HEADER_SIZE + dataLength, calculateCRC32(buffer, RSCP_FRAME_HEADER_SIZE + dataLength));
+	}
+}
+
+namespace {
+// CRC32 of the RSCP frames, two steps of four bits per byte
+const uint32_t crcNibbleTable[16] = {
+	0x4DBDF21C, 0x500AE278, 0x76D3D2D4, 0x6B64C2B0,
+	0x3B61B38C, 0x26D6A3E8, 0x000F9344, 0x1DB88320,
+	0xA005713C, 0xBDB26158, 0x9B6B51F4, 0x86DC4190,
+	0xD6D930AC, 0xCB6E20C8, 0xEDB71064, 0xF0000000
+};
+
+inline uint32_t crcNibbleSteps(uint32_t crc, uint8_t byte) {
+	crc = (crc >> 4) ^ crcNibbleTable[(crc ^ (byte >> 0)) & 0x0F];  /* lower nibble */
+	crc = (crc >> 4) ^ crcNibbleTable[(crc ^ (byte >> 4)) & 0x0F];  /* upper nibble */
+	return crc;
+}
+
+/*
+ * Slicing-by-4 tables derived from the nibble table. Every step is the linear CRC32 step plus a constant, the
+ * tables hold the linear part, the constants are those of one byte and of four bytes.
+ */
+struct SCrcTables {
+	uint32_t slice[4][256];
+	uint32_t byteConstant;
+	uint32_t sliceConstant;
+
+	SCrcTables() {
+		byteConstant = crcNibbleSteps(0, 0);
+		for(uint32_t i = 0; i < 256; ++i) {
+			slice[0][i] = crcNibbleSteps(i, 0) ^ byteConstant;
+		}
+		for(uint32_t n = 1; n < 4; ++n) {
+			for(uint32_t i = 0; i < 256; ++i) {
+				slice[n][i] = (slice[n - 1][i] >> 8) ^ slice[0][slice[n - 1][i] & 0xFF];
+			}
+		}
+		sliceConstant = 0;
+		for(uint32_t i = 0; i < 4; ++i) {
+			sliceConstant = crcNibbleSteps(sliceConstant, 0);
+		}
+	}
+};
+
+const SCrcTables & crcTables() {
+	static const SCrcTables tables;
+	return tables;
+}
+}
+
 uint32_t RscpProtocol::calculateCRC32(const uint8_t *data, uint16_t length) {
-    static const uint32_t crc_table[] = {
-      0x4DBDF21C, 0x500AE278, 0x76D3D2D4, 0x6B64C2B0,
-      0x3B61B38C, 0x26D6A3E8, 0x000F9344, 0x1DB88320,
-      0xA005713C, 0xBDB26158, 0x9B6B51F4, 0x86DC4190,
-      0xD6D930AC, 0xCB6E20C8, 0xEDB71064, 0xF0000000
-    };
-	uint32_t crc = 0;
-    for(uint32_t n = 0; n < length; n++) {
-        crc = (crc >> 4) ^ crc_table[(crc ^ (data[n] >> 0)) & 0x0F];  /* lower nibble */
-        crc = (crc >> 4) ^ crc_table[(crc ^ (data[n] >> 4)) & 0x0F];  /* upper nibble */
+	return updateCRC32(0, data, length);
+}
+
+uint32_t RscpProtocol::updateCRC32(uint32_t crc, const uint8_t *data, uint32_t length) {
+	const SCrcTables & tables = crcTables();
+	while(length >= 4) {
+		// the bytes are assembled in the order of the CRC, independent of the byte order of the host
+		crc ^= (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+		crc = tables.slice[3][crc & 0xFF] ^ tables.slice[2][(crc >> 8) & 0xFF] ^ tables.slice[1][(crc >> 16) & 0xFF]
+				^ tables.slice[0][crc >> 24] ^ tables.sliceConstant;
+		data += 4;
+		length -= 4;
+	}
+	while(length-- > 0) {
+		crc = (crc >> 8) ^ tables.slice[0][(crc ^ *data++) & 0xFF] ^ tables.byteConstant;
 	}
 	return crc;
 }
@@ -73,21 +177,22 @@ int32_t RscpProtocol::getFrameLength(const uint8_t * data, const uint32_t & leng
 		return RSCP::ERR_INVALID_INPUT;
 	}
 	// first the length must at least be of the header size
-	if(length < sizeof(SRscpFrameHeader)) {
+	if(length < RSCP_FRAME_HEADER_SIZE) {
 		return RSCP::ERR_INVALID_FRAME_LENGTH;
 	}
 	// check the header information for length
-	SRscpFrameHeader *header = reinterpret_cast<SRscpFrameHeader *> ((uint8_t*)data);
+	SRscpFrameHeader header;
+	RscpCodec::readFrameHeader(data, header);
 
-	if(header->magic != RSCP::MAGIC) {
+	if(header.magic != RSCP::MAGIC) {
 		return RSCP::ERR_INVALID_MAGIC;
 	}
 	// check the frame version number
-	if(header->ctrl.bits.version != RSCP::VERSION) {
+	if(RscpCodec::frameVersion(header) != RSCP::VERSION) {
 		return RSCP::ERR_PROT_VERSION_MISMATCH;
 	}
 	// calculate the expected frame length
-	int32_t frameLength = sizeof(SRscpFrameHeader) + header->dataLength + ((header->ctrl.bits.crc != 0) ? sizeof(uint32_t) : 0);
+	int32_t frameLength = RSCP_FRAME_HEADER_SIZE + header.dataLength + (RscpCodec::frameHasCRC(header) ? RSCP_CRC_SIZE : 0);
 	return frameLength;
 }
 
@@ -96,33 +201,29 @@ int32_t RscpProtocol::createFrameAsBuffer(SRscpFrameBuffer* frameBuffer, const u
 		return RSCP::ERR_INVALID_INPUT;
 	}
 	// calculate the required frame size
-	size_t sFrameSize =  sizeof(SRscpFrameHeader);
+	size_t sFrameSize = RSCP_FRAME_HEADER_SIZE + dataLength + (calcCRC ? RSCP_CRC_SIZE : 0);
 	// allocate the required memory
-	frameBuffer->data = (uint8_t *) malloc(sFrameSize + dataLength + (calcCRC ? 4 : 0));
+	frameBuffer->data = (uint8_t *) countedMalloc(sFrameSize);
 	if(frameBuffer->data == NULL) {
 		return RSCP::ERR_NO_MEMORY;
 	}
 	// set the memory size
-	frameBuffer->dataLength = sFrameSize + dataLength + (calcCRC ? 4 : 0);
-	// set initial header values
-	memset(frameBuffer->data, 0, sizeof(SRscpFrameHeader));
-	SRscpFrame* tmpFrame = reinterpret_cast<SRscpFrame*>(frameBuffer->data);
-	tmpFrame->header.magic = RSCP::MAGIC;
-	tmpFrame->header.ctrl.bits.crc = calcCRC;
-	tmpFrame->header.ctrl.bits.version = RSCP::VERSION;
-	tmpFrame->header.dataLength = dataLength;
-	setHeaderTimestamp(tmpFrame);
-
-	// insert data from the SRscpValues
-	memcpy(&tmpFrame->header + 1, data, dataLength);
+	frameBuffer->dataLength = sFrameSize;
+	// header, the serialized values and the CRC if necessary
+	writeFrame(frameBuffer->data, data, dataLength, calcCRC);
+	return RSCP::OK;
+}
 
-	// calculate CRC if necessary and add to the frame
-	if(calcCRC) {
-		uint32_t uCRC32 = calculateCRC32(frameBuffer->data, frameBuffer->dataLength - sizeof(uint32_t));
-		memcpy(&frameBuffer->data[frameBuffer->dataLength - sizeof(uCRC32)], &uCRC32, sizeof(uCRC32));
+int32_t RscpProtocol::createFrameInBuffer(uint8_t * buffer, uint32_t size, const uint8_t * data, uint16_t dataLength, bool calcCRC) {
+	if(buffer == NULL || (data == NULL && dataLength > 0)) {
+		return RSCP::ERR_INVALID_INPUT;
 	}
-
-	return RSCP::OK;
+	uint32_t uiFrameLength = RSCP_FRAME_HEADER_SIZE + dataLength + (calcCRC ? RSCP_CRC_SIZE : 0);
+	if(uiFrameLength > size) {
+		return RSCP::ERR_INVALID_FRAME_LENGTH;
+	}
+	writeFrame(buffer, data, dataLength, calcCRC);
+	return uiFrameLength;
 }
 
 int32_t RscpProtocol::createFrameAsBuffer(SRscpFrameBuffer* frame, const SRscpValue & data, bool calcCRC) {
@@ -135,50 +236,38 @@ int32_t RscpProtocol::createFrameAsBuffer(SRscpFrameBuffer *frameBuffer, const s
 		return RSCP::ERR_INVALID_INPUT;
 	}
 
-	// calculate the required frame size
-	size_t sFrameSize =  sizeof(SRscpFrameHeader);
-
 	// calculate the complete data size
 	size_t sDataSize = 0;
 	for(size_t i = 0; i < data.size(); ++i) {
-		sDataSize += sizeof(SRscpValue) - sizeof(data[i].data) + data[i].length;
+		sDataSize += RSCP_VALUE_HEADER_SIZE + data[i].length;
+	}
+	if(sDataSize > 0xFFFF) {
+		return RSCP::ERR_DATA_LIMIT_EXCEEDED;
 	}
 
 	// allocate the required memory
-	frameBuffer->data = (uint8_t *) malloc(sFrameSize + sDataSize + (calcCRC ? 4 : 0));
+	size_t sFrameSize = RSCP_FRAME_HEADER_SIZE + sDataSize + (calcCRC ? RSCP_CRC_SIZE : 0);
+	frameBuffer->data = (uint8_t *) countedMalloc(sFrameSize);
 	if(frameBuffer->data == NULL) {
 		return RSCP::ERR_NO_MEMORY;
 	}
 	// set the memory size
-	frameBuffer->dataLength = sFrameSize + sDataSize + (calcCRC ? 4 : 0);
+	frameBuffer->dataLength = sFrameSize;
 
 	// set initial header values
-	memset(frameBuffer->data, 0, sizeof(SRscpFrameHeader));
-	SRscpFrame* tmpFrame = reinterpret_cast<SRscpFrame*> (frameBuffer->data);
-	tmpFrame->header.magic = RSCP::MAGIC;
-	tmpFrame->header.ctrl.bits.crc = calcCRC;
-	tmpFrame->header.ctrl.bits.version = RSCP::VERSION;
-	tmpFrame->header.dataLength = sDataSize;
-	setHeaderTimestamp(tmpFrame);
+	SRscpFrameHeader header;
+	initFrameHeader(&header, sDataSize, calcCRC);
+	RscpCodec::writeFrameHeader(frameBuffer->data, header);
 
 	// insert data from the SRscpValues
-	uint8_t *dataPtr = frameBuffer->data + sFrameSize;
+	uint8_t *dataPtr = frameBuffer->data + RSCP_FRAME_HEADER_SIZE;
 	for(size_t i = 0; i < data.size(); ++i) {
-		SRscpValue *value = reinterpret_cast<SRscpValue *>(dataPtr);
-		value->tag = data[i].tag;
-		value->dataType = data[i].dataType;
-		value->length = data[i].length;
-		if(value->length > 0) {
-			// copy into the position of the data pointer and not into the data pointer itself as the data is appended
-			memcpy(&value->data, data[i].data, data[i].length);
-		}
-		dataPtr += sizeof(SRscpValue) - sizeof(data[i].data) + data[i].length;
+		dataPtr += RscpCodec::writeValue(dataPtr, data[i]);
 	}
 
 	// calculate CRC if necessary and add to the frame
 	if(calcCRC) {
-		uint32_t uCRC32 = calculateCRC32(frameBuffer->data, frameBuffer->dataLength - sizeof(uint32_t));
-		memcpy(frameBuffer->data + frameBuffer->dataLength - sizeof(uCRC32), &uCRC32, sizeof(uCRC32));
+		RscpCodec::store32(dataPtr, calculateCRC32(frameBuffer->data, RSCP_FRAME_HEADER_SIZE + sDataSize));
 	}
 
 	return RSCP::OK;
@@ -190,44 +279,36 @@ int32_t RscpProtocol::createFrameAsBuffer(SRscpFrameBuffer *frameBuffer, const S
 		return RSCP::ERR_INVALID_INPUT;
 	}
 
-	// calculate the required frame size
-	size_t sFrameSize =  sizeof(SRscpFrameHeader);
-
 	// calculate the complete data size
 	size_t sDataSize = 0;
 	for(size_t i = 0; i < frame.data.size(); ++i) {
-		sDataSize += sizeof(SRscpValue) - sizeof(frame.data[i].data) + frame.data[i].length;
+		sDataSize += RSCP_VALUE_HEADER_SIZE + frame.data[i].length;
+	}
+	if(sDataSize > 0xFFFF) {
+		return RSCP::ERR_DATA_LIMIT_EXCEEDED;
 	}
 
 	// allocate the required memory
-	frameBuffer->data = (uint8_t *) malloc(sFrameSize + sDataSize + (calcCRC ? 4 : 0));
+	size_t sFrameSize = RSCP_FRAME_HEADER_SIZE + sDataSize + (calcCRC ? RSCP_CRC_SIZE : 0);
+	frameBuffer->data = (uint8_t *) countedMalloc(sFrameSize);
 	if(frameBuffer->data == NULL) {
 		return RSCP::ERR_NO_MEMORY;
 	}
 	// set the memory size
-	frameBuffer->dataLength = sFrameSize + sDataSize + (calcCRC ? 4 : 0);
+	frameBuffer->dataLength = sFrameSize;
 
 	// copy header information
-	memcpy(frameBuffer->data, &frame.header, sFrameSize);
+	RscpCodec::writeFrameHeader(frameBuffer->data, frame.header);
 
 	// insert data from the SRscpValues
-	uint8_t *dataPtr = frameBuffer->data + sFrameSize;
+	uint8_t *dataPtr = frameBuffer->data + RSCP_FRAME_HEADER_SIZE;
 	for(size_t i = 0; i < frame.data.size(); ++i) {
-		SRscpValue *value = reinterpret_cast<SRscpValue *>(dataPtr);
-		value->tag = frame.data[i].tag;
-		value->dataType = frame.data[i].dataType;
-		value->length = frame.data[i].length;
-		if(value->length > 0) {
-			// copy into the position of the data pointer and not into the data pointer itself as the data is appended
-			memcpy(&value->data, frame.data[i].data, frame.data[i].length);
-		}
-		dataPtr += sizeof(SRscpValue) - sizeof(frame.data[i].data) + frame.data[i].length;
+		dataPtr += RscpCodec::writeValue(dataPtr, frame.data[i]);
 	}
 
 	// calculate CRC if necessary and add to the frame
 	if(calcCRC) {
-		uint32_t uCRC32 = calculateCRC32(frameBuffer->data, frameBuffer->dataLength - sizeof(uint32_t));
-		memcpy(frameBuffer->data + frameBuffer->dataLength - sizeof(uCRC32), &uCRC32, sizeof(uCRC32));
+		RscpCodec::store32(dataPtr, calculateCRC32(frameBuffer->data, RSCP_FRAME_HEADER_SIZE + sDataSize));
 	}
 
 	return RSCP::OK;
@@ -243,19 +324,20 @@ int32_t RscpProtocol::createFrame(SRscpFrame* frame, const std::vector<SRscpValu
 		return RSCP::ERR_INVALID_INPUT;
 	}
 
-	// set frame edge values
-	memset(&frame->header, 0, sizeof(frame->header));
-	frame->header.magic = RSCP::MAGIC;
-	frame->header.ctrl.bits.crc = calcCRC;
-	frame->header.ctrl.bits.version = RSCP::VERSION;
-	setHeaderTimestamp(frame);
-	frame->data = data;
-
 	// calculate the data length
+	uint32_t uiDataLength = 0;
 	for(size_t i = 0; i < data.size(); ++i) {
-		frame->header.dataLength += sizeof(SRscpValue) - sizeof(data[i].data) + data[i].length;
+		uiDataLength += RSCP_VALUE_HEADER_SIZE + data[i].length;
+	}
+	if(uiDataLength > 0xFFFF) {
+		return RSCP::ERR_DATA_LIMIT_EXCEEDED;
 	}
 
+	// set frame edge values
+	initFrameHeader(&frame->header, uiDataLength, calcCRC);
+	frame->data = data;
+	frame->CRC = 0;
+
 	// in case the CRC has to be calculated we need to generate a new frame buffer which then calculates the CRC
 	if(calcCRC) {
 		SRscpFrameBuffer frameBuffer;
@@ -264,7 +346,7 @@ int32_t RscpProtocol::createFrame(SRscpFrame* frame, const std::vector<SRscpValu
 			return iResult;
 		}
 		// get the CRC from the frame buffer
-		memcpy(&frame->CRC, &frameBuffer.data + frameBuffer.dataLength - sizeof(frame->CRC), sizeof(frame->CRC));
+		frame->CRC = RscpCodec::load32(frameBuffer.data + frameBuffer.dataLength - RSCP_CRC_SIZE);
 		// free the buffer data again
 		destroyFrameData(frameBuffer);
 	}
@@ -281,12 +363,12 @@ bool RscpProtocol::allocateMemory(SRscpValue* value, size_t size)  {
 		if(size == 0) {
 			return true;
 		}
-		value->data = (uint8_t *) malloc(size);
+		value->data = (uint8_t *) countedMalloc(size);
 		return (value->data != NULL);
 	}
 	else {
 		// if data is already allocated -> reallocate to the correct size
-		uint8_t *ucTmp = (uint8_t *) realloc(value->data, size);
+		uint8_t *ucTmp = (uint8_t *) countedRealloc(value->data, size);
 		if(ucTmp != NULL) {
 			value->data = ucTmp;
 			return true;
@@ -295,37 +377,36 @@ bool RscpProtocol::allocateMemory(SRscpValue* value, size_t size)  {
 	return false;
 }
 
-int32_t RscpProtocol::parseFrame(const uint8_t* data, const uint32_t & length, SRscpFrame* frame) {
+int32_t RscpProtocol::checkFrame(const uint8_t* data, const uint32_t & length, SRscpFrame* frame, bool verifyCRC) {
 	// sanity check
 	if((data == NULL) || (frame == NULL)) {
 		return RSCP::ERR_INVALID_INPUT;
 	}
 	// check first that at least the header size is in the frame
-	if(sizeof(SRscpFrameHeader) > length) {
+	if(RSCP_FRAME_HEADER_SIZE > length) {
 		return RSCP::ERR_INVALID_FRAME_LENGTH;
 	}
-	// assign pointer to the data struct
-	SRscpFrame* inFrame = reinterpret_cast<SRscpFrame*>((uint8_t*)data);
+	// decode the header
+	SRscpFrameHeader header;
+	RscpCodec::readFrameHeader(data, header);
 	// check if the magic matches
-	if(inFrame->header.magic != RSCP::MAGIC) {
+	if(header.magic != RSCP::MAGIC) {
 		return RSCP::ERR_INVALID_MAGIC;
 	}
 	// check the frame version number
-	if(inFrame->header.ctrl.bits.version != RSCP::VERSION) {
+	if(RscpCodec::frameVersion(header) != RSCP::VERSION) {
 		return RSCP::ERR_PROT_VERSION_MISMATCH;
 	}
 	// check the frame length
-	uint32_t frameLength = sizeof(SRscpFrameHeader) + inFrame->header.dataLength + ((inFrame->header.ctrl.bits.crc != 0) ? sizeof(uint32_t) : 0);
+	uint32_t frameLength = RSCP_FRAME_HEADER_SIZE + header.dataLength + (RscpCodec::frameHasCRC(header) ? RSCP_CRC_SIZE : 0);
 	if(frameLength > length) {
 		return RSCP::ERR_INVALID_FRAME_LENGTH;
 	}
 	// check that CRC matches before starting to parse
-	if(inFrame->header.ctrl.bits.crc != 0) {
-		uint32_t calcCRC32 = calculateCRC32(data, frameLength - sizeof(uint32_t));
-		uint32_t frameCRC32;
-		memcpy(&frameCRC32, data + frameLength - sizeof(uint32_t), sizeof(uint32_t));
+	if(RscpCodec::frameHasCRC(header)) {
+		uint32_t frameCRC32 = RscpCodec::load32(data + frameLength - RSCP_CRC_SIZE);
 		// compare CRC
-		if(frameCRC32 != calcCRC32) {
+		if(verifyCRC && frameCRC32 != calculateCRC32(data, frameLength - RSCP_CRC_SIZE)) {
 			return RSCP::ERR_INVALID_CRC;
 		}
 		// CRC matches set the CRC inside the output frame
@@ -336,15 +417,118 @@ int32_t RscpProtocol::parseFrame(const uint8_t* data, const uint32_t & length, S
 		frame->CRC = 0;
 	}
 	// copy header information
-	memcpy(&frame->header, &inFrame->header, sizeof(SRscpFrameHeader));
+	frame->header = header;
+	return frameLength;
+}
+
+int32_t RscpProtocol::parseFrame(const uint8_t* data, const uint32_t & length, SRscpFrame* frame) {
+	int32_t iResult = checkFrame(data, length, frame, true);
+	if(iResult < 0) {
+		return iResult;
+	}
 	// parse the SRscpValues
-	int32_t iResult = parseData((uint8_t*)(&inFrame->header + 1), inFrame->header.dataLength, frame->data);
+	iResult = parseData(data + RSCP_FRAME_HEADER_SIZE, frame->header.dataLength, frame->data);
 	if(iResult < 0) {
 		return iResult;
 	}
 	// parsing done return OK
-	frameLength = (sizeof(SRscpFrameHeader) + iResult + ((inFrame->header.ctrl.bits.crc != 0) ? sizeof(uint32_t) : 0));
-	return frameLength;
+	return (RSCP_FRAME_HEADER_SIZE + iResult + (RscpCodec::frameHasCRC(frame->header) ? RSCP_CRC_SIZE : 0));
+}
+
+int32_t RscpProtocol::parseFrameViews(const uint8_t* data, const uint32_t & length, SRscpFrame* frame, bool verifyCRC) {
+	int32_t iResult = checkFrame(data, length, frame, verifyCRC);
+	if(iResult < 0) {
+		return iResult;
+	}
+	iResult = parseDataViews(data + RSCP_FRAME_HEADER_SIZE, frame->header.dataLength, frame->data);
+	if(iResult < 0) {
+		return iResult;
+	}
+	return (RSCP_FRAME_HEADER_SIZE + iResult + (RscpCodec::frameHasCRC(frame->header) ? RSCP_CRC_SIZE : 0));
+}
+
+int32_t RscpProtocol::parseDataViews(const uint8_t* data, const uint32_t & length, std::vector<SRscpValue> & views) {
+	// sanity check
+	if(data == NULL) {
+		return RSCP::ERR_INVALID_INPUT;
+	}
+	// clear keeps the capacity, a reused vector does not allocate again
+	views.clear();
+	uint32_t uiPos = 0;
+	// the value header and the data have to be inside the buffer
+	while(uiPos + RSCP_VALUE_HEADER_SIZE <= length) {
+		SRscpValue view;
+		RscpCodec::readValueHeader(data + uiPos, view);
+		if(uiPos + RSCP_VALUE_HEADER_SIZE + view.length > length) {
+			break;
+		}
+		views.push_back(view);
+		uiPos += RSCP_VALUE_HEADER_SIZE + view.length;
+	}
+	return uiPos;
+}
+
+int32_t RscpProtocol::visitFrame(const uint8_t* data, const uint32_t & length, RscpVisitor & visitor, bool verifyCRC) {
+	// the header is checked with an empty frame, its value vector does not allocate
+	SRscpFrame frame;
+	int32_t iResult = checkFrame(data, length, &frame, verifyCRC);
+	if(iResult < 0) {
+		return iResult;
+	}
+	int32_t iVisited = visitData(data + RSCP_FRAME_HEADER_SIZE, frame.header.dataLength, visitor);
+	return (iVisited < 0) ? iVisited : iResult;
+}
+
+int32_t RscpProtocol::visitData(const uint8_t* data, const uint32_t & length, RscpVisitor & visitor) {
+	// sanity check
+	if((data == NULL) && (length > 0)) {
+		return RSCP::ERR_INVALID_INPUT;
+	}
+	// the entered containers and the end of their data
+	SRscpValue containers[RSCP_VISIT_MAX_DEPTH];
+	uint32_t uiEnd[RSCP_VISIT_MAX_DEPTH];
+	uint32_t uiDepth = 0;
+	uint32_t uiPos = 0;
+	while(true) {
+		// leave every container whose values are reported
+		while((uiDepth > 0) && (uiPos == uiEnd[uiDepth - 1])) {
+			--uiDepth;
+			visitor.leaveContainer(containers[uiDepth], uiDepth);
+		}
+		uint32_t uiLimit = (uiDepth > 0) ? uiEnd[uiDepth - 1] : length;
+		if(uiPos == uiLimit) {
+			break;
+		}
+		// the value header and the data have to be inside the enclosing container
+		if(uiPos + RSCP_VALUE_HEADER_SIZE > uiLimit) {
+			return RSCP::ERR_INVALID_FRAME_LENGTH;
+		}
+		SRscpValue value;
+		RscpCodec::readValueHeader(data + uiPos, value);
+		uiPos += RSCP_VALUE_HEADER_SIZE;
+		if(uiPos + value.length > uiLimit) {
+			return RSCP::ERR_INVALID_FRAME_LENGTH;
+		}
+
+		if(value.dataType == RSCP::eTypeContainer) {
+			if(uiDepth == RSCP_VISIT_MAX_DEPTH) {
+				return RSCP::ERR_DATA_LIMIT_EXCEEDED;
+			}
+			if(visitor.enterContainer(value, uiDepth)) {
+				// continue with the first value inside the container
+				containers[uiDepth] = value;
+				uiEnd[uiDepth] = uiPos + value.length;
+				++uiDepth;
+				continue;
+			}
+		}
+		else {
+			visitor.value(value, uiDepth);
+		}
+		// skip the data of the value, a skipped container is not read at all
+		uiPos += value.length;
+	}
+	return uiPos;
 }
 
 int32_t RscpProtocol::parseData(const uint8_t* data, const uint32_t & length, std::vector<SRscpValue> & vecValues) {
@@ -354,34 +538,29 @@ int32_t RscpProtocol::parseData(const uint8_t* data, const uint32_t & length, st
 	}
 	// start parsing
 	uint32_t uiPos = 0;
-	SRscpValue * value = reinterpret_cast<SRscpValue *>(((uint8_t*)data) + uiPos);
 
-	// check the boundaries of the buffer
-	while((uiPos < length) && ((uiPos + value->length) <= length)) {
+	// the value header and the data have to be inside the buffer
+	while(uiPos + RSCP_VALUE_HEADER_SIZE <= length) {
 		// parse the data
 		SRscpValue newVal;
-		newVal.tag = value->tag;
-		newVal.dataType = value->dataType;
-		newVal.length = value->length;
-		if(value->length > 0) {
+		RscpCodec::readValueHeader(data + uiPos, newVal);
+		if(uiPos + RSCP_VALUE_HEADER_SIZE + newVal.length > length) {
+			break;
+		}
+		if(newVal.length > 0) {
 			// allocate data memory for each value separately
-			newVal.data = (uint8_t *) malloc(value->length);
+			newVal.data = (uint8_t *) countedMalloc(newVal.length);
 			if(newVal.data == NULL) {
 				// not enough memory, return only what parsed until now
 				destroyValueData(vecValues);
 				return RSCP::ERR_NO_MEMORY;
 			}
-			memcpy(newVal.data, &value->data, value->length);
-		}
-		else {
-			// set NULL pointer as no data is in this tag
-			newVal.data = NULL;
+			memcpy(newVal.data, data + uiPos + RSCP_VALUE_HEADER_SIZE, newVal.length);
 		}
 		//push new value to the return vector
 		vecValues.push_back(newVal);
 		// increment value pointer
-		uiPos += sizeof(SRscpValue) - sizeof(newVal.data) + value->length;
-		value =  reinterpret_cast<SRscpValue *>(((uint8_t*)data) + uiPos);
+		uiPos += RSCP_VALUE_HEADER_SIZE + newVal.length;
 	}
 
 	// return all collected values
@@ -437,7 +616,7 @@ int32_t RscpProtocol::createValue(SRscpValue* response, const SRscpTag & tag, co
 	// calculate the new tag size
 	uint32_t newTagLength = 0;
 	for(size_t i = 0; i < value.size(); ++i) {
-		newTagLength += sizeof(SRscpValue) - sizeof(value[i].data) + value[i].length;
+		newTagLength += RSCP_VALUE_HEADER_SIZE + value[i].length;
 	}
 	// check boundaries
 	if(newTagLength > 0xFFF8) {
@@ -455,15 +634,7 @@ int32_t RscpProtocol::createValue(SRscpValue* response, const SRscpTag & tag, co
 	// copy data
 	size_t sPos = 0;
 	for(size_t i = 0; i < value.size(); ++i) {
-		SRscpValue *newData = reinterpret_cast<SRscpValue *> (((uint8_t*)response->data) + sPos);
-		newData->tag = value[i].tag;
-		newData->dataType = value[i].dataType;
-		newData->length = value[i].length;
-		if(newData->length > 0) {
-			// copy into the position of the data pointer and not into the data pointer itself as the data is appended
-			memcpy(&newData->data, value[i].data, newData->length);
-		}
-		sPos += sizeof(SRscpValue) - sizeof(value[i].data) + value[i].length;
+		sPos += RscpCodec::writeValue(response->data + sPos, value[i]);
 	}
 	// all added successfully
 	return RSCP::OK;
@@ -475,7 +646,7 @@ int32_t RscpProtocol::appendValue(SRscpValue* response, const SRscpTag & tag, co
 		return RSCP::ERR_INVALID_INPUT;
 	}
 	// calculate the new tag size
-	uint16_t newTagLength = sizeof(SRscpValue) - sizeof(response->data) + dataLength;
+	uint32_t newTagLength = RSCP_VALUE_HEADER_SIZE + dataLength;
 	// check boundaries
 	if(response->length + newTagLength > 0xFFF8) {
 		return RSCP::ERR_DATA_LIMIT_EXCEEDED;
@@ -484,14 +655,10 @@ int32_t RscpProtocol::appendValue(SRscpValue* response, const SRscpTag & tag, co
 	if(allocateMemory(response, response->length + newTagLength) == false) {
 		return RSCP::ERR_NO_MEMORY;
 	}
-	// copy data
-	SRscpValue *newData = reinterpret_cast<SRscpValue *>(response->data + response->length);
-	newData->tag = tag;
-	newData->dataType = dataType;
-	newData->length = dataLength;
-	// copy into the position of the data pointer and not into the data pointer itself as the data is appended
-	if(newData->length > 0) {
-		memcpy(&newData->data, data, dataLength);
+	// copy data behind the header
+	RscpCodec::writeValueHeader(response->data + response->length, tag, dataType, dataLength);
+	if(dataLength > 0) {
+		memcpy(response->data + response->length + RSCP_VALUE_HEADER_SIZE, data, dataLength);
 	}
 	// increment the total length by the new tag
 	response->length += newTagLength;
@@ -504,9 +671,9 @@ int32_t RscpProtocol::appendValue(SRscpValue* response, const SRscpTag & tag, co
 		return RSCP::ERR_INVALID_INPUT;
 	}
 	// calculate the new tag size
-	uint32_t newTagLength = sizeof(SRscpValue) - sizeof(response->data);
+	uint32_t newTagLength = RSCP_VALUE_HEADER_SIZE;
 	for(size_t i = 0; i < value.size(); ++i) {
-		newTagLength += sizeof(SRscpValue) - sizeof(value[i].data) + value[i].length;
+		newTagLength += RSCP_VALUE_HEADER_SIZE + value[i].length;
 	}
 	// check boundaries
 	if(response->length + newTagLength > 0xFFF8) {
@@ -517,23 +684,12 @@ int32_t RscpProtocol::appendValue(SRscpValue* response, const SRscpTag & tag, co
 		return RSCP::ERR_NO_MEMORY;
 	}
 	// first add the TAG for a container
-	SRscpValue *mainTag = reinterpret_cast<SRscpValue *> (response->data + response->length);
-	mainTag->tag = tag;
-	mainTag->dataType = RSCP::eTypeContainer;
-	mainTag->length = newTagLength - (sizeof(SRscpValue) - sizeof(mainTag->data));
+	RscpCodec::writeValueHeader(response->data + response->length, tag, RSCP::eTypeContainer, newTagLength - RSCP_VALUE_HEADER_SIZE);
 
 	// copy data
-	size_t sPos = mainTag->length;
+	size_t sPos = RSCP_VALUE_HEADER_SIZE;
 	for(size_t i = 0; i < value.size(); ++i) {
-		SRscpValue *newData = reinterpret_cast<SRscpValue *> (response->data + response->length + sPos);
-		newData->tag = value[i].tag;
-		newData->dataType = value[i].dataType;
-		newData->length = value[i].length;
-		if(newData->length > 0) {
-			// copy into the position of the data pointer and not into the data pointer itself as the data is appended
-			memcpy(&newData->data, value[i].data, newData->length);
-		}
-		sPos += sizeof(SRscpValue) - sizeof(value[i].data) + value[i].length;
+		sPos += RscpCodec::writeValue(response->data + response->length + sPos, value[i]);
 	}
 	// increment the total length by the new tag
 	response->length += newTagLength;
@@ -549,7 +705,7 @@ int32_t RscpProtocol::appendValue(SRscpValue* response, const std::vector<SRscpV
 	// calculate the new tag size
 	uint32_t newTagLength = 0;
 	for(size_t i = 0; i < value.size(); ++i) {
-		newTagLength += sizeof(SRscpValue) - sizeof(value[i].data) + value[i].length;
+		newTagLength += RSCP_VALUE_HEADER_SIZE + value[i].length;
 	}
 	// check boundaries
 	if(response->length + newTagLength > 0xFFF8) {
@@ -562,15 +718,7 @@ int32_t RscpProtocol::appendValue(SRscpValue* response, const std::vector<SRscpV
 	// copy data
 	size_t sPos = 0;
 	for(size_t i = 0; i < value.size(); ++i) {
-		SRscpValue *newData = reinterpret_cast<SRscpValue *> (response->data + response->length + sPos);
-		newData->tag = value[i].tag;
-		newData->dataType = value[i].dataType;
-		newData->length = value[i].length;
-		if(newData->length > 0) {
-			// copy into the position of the data pointer and not into the data pointer itself as the data is appended
-			memcpy(&newData->data, value[i].data, newData->length);
-		}
-		sPos += sizeof(SRscpValue) - sizeof(value[i].data) + value[i].length;
+		sPos += RscpCodec::writeValue(response->data + response->length + sPos, value[i]);
 	}
 	// increment the total length by the new tag
 	response->length += newTagLength;
@@ -583,7 +731,7 @@ int32_t RscpProtocol::destroyValueData(SRscpValue * value) {
 		return RSCP::ERR_INVALID_INPUT;
 	}
 	if(value->data != NULL) {
-		free(value->data);
+		countedFree(value->data);
 		value->data = NULL;
 	}
 	return RSCP::OK;
@@ -609,7 +757,7 @@ int32_t RscpProtocol::destroyFrameData(SRscpFrameBuffer * frameBuffer) {
 		return RSCP::ERR_INVALID_INPUT;
 	}
 	if(frameBuffer->data != NULL) {
-		free(frameBuffer->data);
+		countedFree(frameBuffer->data);
 		frameBuffer->data = NULL;
 	}
 	return RSCP::OK;
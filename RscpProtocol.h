@@ -12,6 +12,9 @@
 #include <string>
 #include <string.h>
 #include "RscpTypes.h"
+#include "RscpCodec.h"
+
+class RscpVisitor;
 
 class RscpProtocol {
 public:
@@ -28,7 +31,7 @@ public:
      *        This function also validates the MAGIC and VERSION of the frame. The frame inside the \var data buffer
      *        does not have to be complete but should at least have the size of an SRscpFrameHeader in bytes.
      * @param data		- Pointer to the raw data frame buffer
-     * @param length	- Length of data buffer in bytes. Must be at least sizeof(SRscpFrameHeader) bytes.
+     * @param length	- Length of data buffer in bytes. Must be at least RSCP_FRAME_HEADER_SIZE bytes.
      * @return			- RSCP error code if the function fails or the amount of bytes the frame should have to be full.
      */
 	int32_t getFrameLength(const uint8_t * data, const uint32_t & length);
@@ -43,6 +46,17 @@ public:
      * @return	          - RSCP error code if the function fails else RSCP::OK
      */
     int32_t createFrameAsBuffer(SRscpFrameBuffer* frameBuffer, const uint8_t * data, uint16_t dataLength, bool calcCRC);
+    /*
+     * \brief Create a RSCP frame from the serialized values \var data inside the caller owned \var buffer.
+     *        Nothing is allocated, used by callers which keep their buffers for the whole run time.
+     * @param buffer      - Buffer which receives the frame
+     * @param size        - Size of \var buffer in bytes
+     * @param data        - Pointer to the first RSCP value struct in line.
+     * @param dataLength  - Data length of the data buffer in bytes.
+     * @param calcCRC     - If set TRUE the CRC for the frame is calculated and appended to the frame.
+     * @return            - RSCP error code if the function fails else the length of the frame in bytes
+     */
+    int32_t createFrameInBuffer(uint8_t * buffer, uint32_t size, const uint8_t * data, uint16_t dataLength, bool calcCRC);
     /*
      * \brief Create a RSCP frame from one single RscpValue struct into the pre-allocated \var frameBuffer.
      *        The data is aligned in line inside the frameBuffer structure to allow direct send of the complete frame.
@@ -111,6 +125,31 @@ public:
      * @return			- RSCP error code if the function fails or processed amount of bytes on success
      */
     int32_t parseData(const uint8_t* data, const uint32_t & length, std::vector<SRscpValue> & frameData);
+    /*
+     * \brief Same as parseFrame but the values are views: their data points into \var data, which has to stay
+     *        valid while the values are used. The values must not be destroyed, \var frame->data is cleared
+     *        first and keeps its capacity, so a reused frame does not allocate.
+     * @param verifyCRC - false if the CRC was verified already while the frame was received (RscpDecryptor)
+     */
+	int32_t parseFrameViews(const uint8_t* data, const uint32_t & length, SRscpFrame* frame, bool verifyCRC = true);
+    /*
+     * \brief Same as parseData but the values are views into \var data, see parseFrameViews.
+     * @param views - Vector which is cleared and receives the values
+     */
+    int32_t parseDataViews(const uint8_t* data, const uint32_t & length, std::vector<SRscpValue> & views);
+    /*
+     * \brief Walk the values of the frame in \var data once and report them to \var visitor (RscpVisitor.h),
+     *        nested containers included. Nothing is allocated, the reported values are views into \var data.
+     * @param verifyCRC - false if the CRC was verified already while the frame was received (RscpDecryptor)
+     * @return          - RSCP error code if the frame or a value exceeds its bounds else the length of the frame in bytes
+     */
+	int32_t visitFrame(const uint8_t* data, const uint32_t & length, RscpVisitor & visitor, bool verifyCRC = true);
+    /*
+     * \brief Same as visitFrame for the serialized values \var data, for example the data of a container value.
+     *        The values in front of a value which exceeds its bounds are reported already when the error is returned.
+     * @return - RSCP error code if a value exceeds the bounds of its container else \var length
+     */
+    int32_t visitData(const uint8_t* data, const uint32_t & length, RscpVisitor & visitor);
 	/*
 	 * \biref This function allocates memory of size \var size. If data is already allocated it will reallocate the requested size.
 	 * @param value  - Pointer to the RSCP value struct.
@@ -141,79 +180,79 @@ public:
      * @return         - RSCP error code if the function fails else RSCP::OK
      */
     int32_t createValue(SRscpValue* response, const SRscpTag & tag, const bool & value) {
-    	return createValue(response, tag, (uint8_t *) &value, sizeof(value), RSCP::eTypeBool);
+    	return createTypedValue(response, tag, value, RSCP::eTypeBool);
     }
     /*
      * @copydoc RscpProtocol::createValue(SRscpValue* response, const SRscpTag & tag, const char & value)
      */
     int32_t createValue(SRscpValue* response, const SRscpTag & tag, const char & value) {
-    	return createValue(response, tag, (uint8_t *) &value, sizeof(value), RSCP::eTypeChar8);
+    	return createTypedValue(response, tag, value, RSCP::eTypeChar8);
     }
     /*
      * @copydoc RscpProtocol::createValue(SRscpValue* response, const SRscpTag & tag, const uint8_t & value)
      */
     int32_t createValue(SRscpValue* response, const SRscpTag & tag, const int8_t & value) {
-    	return createValue(response, tag, (uint8_t *) &value, sizeof(value), RSCP::eTypeChar8);
+    	return createTypedValue(response, tag, value, RSCP::eTypeChar8);
     }
     /*
      * @copydoc RscpProtocol::createValue(SRscpValue* response, const SRscpTag & tag, const uint8_t & value)
      */
     int32_t createValue(SRscpValue* response, const SRscpTag & tag, const uint8_t & value) {
-    	return createValue(response, tag, (uint8_t *) &value, sizeof(value), RSCP::eTypeUChar8);
+    	return createTypedValue(response, tag, value, RSCP::eTypeUChar8);
     }
     /*
      * @copydoc RscpProtocol::createValue(SRscpValue* response, const SRscpTag & tag, const int16_t & value)
      */
     int32_t createValue(SRscpValue* response, const SRscpTag & tag, const int16_t & value) {
-    	return createValue(response, tag, (uint8_t *) &value, sizeof(value), RSCP::eTypeInt16);
+    	return createTypedValue(response, tag, value, RSCP::eTypeInt16);
     }
     /*
      * @copydoc RscpProtocol::createValue(SRscpValue* response, const SRscpTag & tag, const uint16_t & value)
      */
     int32_t createValue(SRscpValue* response, const SRscpTag & tag, const uint16_t & value) {
-    	return createValue(response, tag, (uint8_t *) &value, sizeof(value), RSCP::eTypeUInt16);
+    	return createTypedValue(response, tag, value, RSCP::eTypeUInt16);
     }
     /*
      * @copydoc RscpProtocol::createValue(SRscpValue* response, const SRscpTag & tag, const int32_t & value)
      */
     int32_t createValue(SRscpValue* response, const SRscpTag & tag, const int32_t & value) {
-    	return createValue(response, tag, (uint8_t *) &value, sizeof(value), RSCP::eTypeInt32);
+    	return createTypedValue(response, tag, value, RSCP::eTypeInt32);
     }
     /*
      * @copydoc RscpProtocol::createValue(SRscpValue* response, const SRscpTag & tag, const uint32_t & value)
      */
     int32_t createValue(SRscpValue* response, const SRscpTag & tag, const uint32_t & value) {
-    	return createValue(response, tag, (uint8_t *) &value, sizeof(value), RSCP::eTypeUInt32);
+    	return createTypedValue(response, tag, value, RSCP::eTypeUInt32);
     }
     /*
      * @copydoc RscpProtocol::createValue(SRscpValue* response, const SRscpTag & tag, const int64_t & value)
      */
     int32_t createValue(SRscpValue* response, const SRscpTag & tag, const int64_t & value) {
-    	return createValue(response, tag, (uint8_t *) &value, sizeof(value), RSCP::eTypeInt64);
+    	return createTypedValue(response, tag, value, RSCP::eTypeInt64);
     }
     /*
      * @copydoc RscpProtocol::createValue(SRscpValue* response, const SRscpTag & tag, const uint64_t & value)
      */
     int32_t createValue(SRscpValue* response, const SRscpTag & tag, const uint64_t & value) {
-    	return createValue(response, tag, (uint8_t *) &value, sizeof(value), RSCP::eTypeUInt64);
+    	return createTypedValue(response, tag, value, RSCP::eTypeUInt64);
     }
     /*
      * @copydoc RscpProtocol::createValue(SRscpValue* response, const SRscpTag & tag, const float & value)
      */
     int32_t createValue(SRscpValue* response, const SRscpTag & tag, const float & value) {
-    	return createValue(response, tag, (uint8_t *) &value, sizeof(value), RSCP::eTypeFloat32);
+    	return createTypedValue(response, tag, value, RSCP::eTypeFloat32);
     }
     /*
      * @copydoc RscpProtocol::createValue(SRscpValue* response, const SRscpTag & tag, const double & value)
      */
     int32_t createValue(SRscpValue* response, const SRscpTag & tag, const double & value) {
-    	return createValue(response, tag, (uint8_t *)&value, sizeof(value), RSCP::eTypeDouble64);
+    	return createTypedValue(response, tag, value, RSCP::eTypeDouble64);
     }
     /*
      * @copydoc RscpProtocol::createValue(SRscpValue* response, const SRscpTag & tag, const SRscpTimestamp & timestamp)
      */
     int32_t createValue(SRscpValue* response, const SRscpTag & tag, const SRscpTimestamp & timestamp) {
-    	return createValue(response, tag, (uint8_t *)&timestamp, sizeof(timestamp), RSCP::eTypeTimestamp);
+    	return createTypedValue(response, tag, timestamp, RSCP::eTypeTimestamp);
     }
     /*
      * @copydoc RscpProtocol::createValue(SRscpValue* response, const SRscpTag & tag, const char * value)
@@ -265,7 +304,7 @@ public:
      * @copydoc RscpProtocol::createErrorValue(SRscpValue* response, const SRscpTag & tag, const uint32_t & error)
      */
     int32_t createErrorValue(SRscpValue* response, const SRscpTag & tag, const uint32_t & error) {
-    	return createValue(response, tag, (uint8_t *)&error, sizeof(error), RSCP::eTypeError);
+    	return createTypedValue(response, tag, error, RSCP::eTypeError);
     }
     /*
      * @copydoc RscpProtocol::createValue(SRscpValue* response, const SRscpTag & tag, const bool & value);
@@ -290,40 +329,40 @@ public:
     	return appendValue(response, tag, NULL, 0, RSCP::eTypeNone);
     }
     int32_t appendValue(SRscpValue* response, const SRscpTag & tag, const bool & value) {
-    	return appendValue(response, tag, (uint8_t *) &value, sizeof(value), RSCP::eTypeBool);
+    	return appendTypedValue(response, tag, value, RSCP::eTypeBool);
     }
     int32_t appendValue(SRscpValue* response, const SRscpTag & tag, const char & value) {
-    	return appendValue(response, tag, (uint8_t *) &value, sizeof(value), RSCP::eTypeChar8);
+    	return appendTypedValue(response, tag, value, RSCP::eTypeChar8);
     }
     int32_t appendValue(SRscpValue* response, const SRscpTag & tag, const int8_t & value) {
-    	return appendValue(response, tag, (uint8_t *) &value, sizeof(value), RSCP::eTypeChar8);
+    	return appendTypedValue(response, tag, value, RSCP::eTypeChar8);
     }
     int32_t appendValue(SRscpValue* response, const SRscpTag & tag, const uint8_t & value) {
-    	return appendValue(response, tag, (uint8_t *) &value, sizeof(value), RSCP::eTypeUChar8);
+    	return appendTypedValue(response, tag, value, RSCP::eTypeUChar8);
     }
     int32_t appendValue(SRscpValue* response, const SRscpTag & tag, const int16_t & value) {
-    	return appendValue(response, tag, (uint8_t *) &value, sizeof(value), RSCP::eTypeInt16);
+    	return appendTypedValue(response, tag, value, RSCP::eTypeInt16);
     }
     int32_t appendValue(SRscpValue* response, const SRscpTag & tag, const uint16_t & value) {
-    	return appendValue(response, tag, (uint8_t *) &value, sizeof(value), RSCP::eTypeUInt16);
+    	return appendTypedValue(response, tag, value, RSCP::eTypeUInt16);
     }
     int32_t appendValue(SRscpValue* response, const SRscpTag & tag, const int32_t & value) {
-    	return appendValue(response, tag, (uint8_t *) &value, sizeof(value), RSCP::eTypeInt32);
+    	return appendTypedValue(response, tag, value, RSCP::eTypeInt32);
     }
     int32_t appendValue(SRscpValue* response, const SRscpTag & tag, const uint32_t & value) {
-    	return appendValue(response, tag, (uint8_t *) &value, sizeof(value), RSCP::eTypeUInt32);
+    	return appendTypedValue(response, tag, value, RSCP::eTypeUInt32);
     }
     int32_t appendValue(SRscpValue* response, const SRscpTag & tag, const int64_t & value) {
-    	return appendValue(response, tag, (uint8_t *) &value, sizeof(value), RSCP::eTypeInt64);
+    	return appendTypedValue(response, tag, value, RSCP::eTypeInt64);
     }
     int32_t appendValue(SRscpValue* response, const SRscpTag & tag, const uint64_t & value) {
-    	return appendValue(response, tag, (uint8_t *) &value, sizeof(value), RSCP::eTypeUInt64);
+    	return appendTypedValue(response, tag, value, RSCP::eTypeUInt64);
     }
     int32_t appendValue(SRscpValue* response, const SRscpTag & tag, const float & value) {
-    	return appendValue(response, tag, (uint8_t *) &value, sizeof(value), RSCP::eTypeFloat32);
+    	return appendTypedValue(response, tag, value, RSCP::eTypeFloat32);
     }
     int32_t appendValue(SRscpValue* response, const SRscpTag & tag, const double & value) {
-    	return appendValue(response, tag, (uint8_t *) &value, sizeof(value), RSCP::eTypeDouble64);
+    	return appendTypedValue(response, tag, value, RSCP::eTypeDouble64);
     }
     int32_t appendValue(SRscpValue* response, const SRscpTag & tag, const char * value) {
     	return appendValue(response, tag, (uint8_t*)value, strlen(value), RSCP::eTypeString);
@@ -332,7 +371,7 @@ public:
     	return appendValue(response, tag, (uint8_t *) value.c_str(), value.size(), RSCP::eTypeString);
     }
     int32_t appendValue(SRscpValue* response, const SRscpTag & tag, const SRscpTimestamp & timestamp) {
-    	return appendValue(response, tag, (uint8_t *) &timestamp, sizeof(timestamp), RSCP::eTypeTimestamp);
+    	return appendTypedValue(response, tag, timestamp, RSCP::eTypeTimestamp);
     }
     int32_t appendValue(SRscpValue* response, const SRscpTag & tag, const SRscpValue & value) {
     	return appendValue(response, tag, std::vector<SRscpValue>(1, value));
@@ -378,7 +417,7 @@ public:
      * @copydoc RscpProtocol::appendErrorValue(SRscpValue* response, const SRscpTag & tag, const uint32_t & error)
      */
     int32_t appendErrorValue(SRscpValue* response, const SRscpTag & tag, const uint32_t & error) {
-    	return appendValue(response, tag, (uint8_t *)&error, sizeof(error), RSCP::eTypeError);
+    	return appendTypedValue(response, tag, error, RSCP::eTypeError);
     }
 	/*!
 	 * \brief This templates is called by the get functions to unify the getting process of all datatypes.
@@ -388,18 +427,16 @@ public:
     	if((value == NULL) || (value->data == NULL)) {
     		return cType();
     	}
-    	// if the size is smaller than needed copy only the smaller part
+    	// the data is little endian, RscpCodec loads it in host byte order
     	if(sizeof(cType) <= value->length) {
-    		cType tTmp;
-    		memcpy(&tTmp, value->data, sizeof(cType));
-    		return tTmp;
+    		return RscpCodec::load<cType>(value->data);
     	}
     	// if the size needed is bigger then zero out the rest
     	else {
-    		cType tTmp;
-    		memset(&tTmp, 0, sizeof(cType));
-    		memcpy(&tTmp, value->data, value->length);
-    		return tTmp;
+    		uint8_t ucTmp[sizeof(cType)];
+    		memset(ucTmp, 0, sizeof(ucTmp));
+    		memcpy(ucTmp, value->data, value->length);
+    		return RscpCodec::load<cType>(ucTmp);
     	}
     }
     /*
@@ -491,6 +528,16 @@ public:
     	parseData(value->data, value->length, dataValues);
     	return dataValues;
     }
+    /*
+     * \brief Function get the values of the container \var value as views into its data, see parseDataViews.
+     * @param views - Vector which is cleared and receives the values. Empty on failure and no or invalid data.
+     */
+    void getContainerViews(const SRscpValue* value, std::vector<SRscpValue> & views) {
+    	views.clear();
+    	if(value->data != NULL) {
+    		parseDataViews(value->data, value->length, views);
+    	}
+    }
     /*
      * \brief This function destroys all allocated data inside a RSCP value.
      * @param  - Pointer to the RSCP value.
@@ -536,7 +583,6 @@ public:
     int32_t destroyFrameData(SRscpFrameBuffer & frameBuffer) {
     	return destroyFrameData(&frameBuffer);
     }
-private:
     /*
      * \brief This function calculates the ethernet protocol CRC32 hash from \var data over \var length bytes.
      * @param - Pointer to a data buffer
@@ -544,12 +590,49 @@ private:
      * @return The calculated CRC32 value is returned.
      */
     uint32_t calculateCRC32(const uint8_t *data, uint16_t length);
+    /*
+     * \brief Continue the CRC32 \var crc (0 at the start of a frame) over \var length bytes of \var data,
+     *        so the CRC of a frame can be calculated block by block while it is received.
+     * @return The CRC32 over the data so far.
+     */
+    static uint32_t updateCRC32(uint32_t crc, const uint8_t *data, uint32_t length);
+private:
     /*
      * \brief This function sets the current time in seconds and nanoseconds to the frame.
      * @param - Pointer to an rscp frame object.
      * @return True on success else false.
      */
-    bool setHeaderTimestamp(SRscpFrame *frame);
+    bool setHeaderTimestamp(SRscpFrameHeader *header);
+    /*
+     * \brief Set magic, control word, timestamp and \var dataLength of a new frame in \var header.
+     */
+    void initFrameHeader(SRscpFrameHeader *header, uint16_t dataLength, bool calcCRC);
+    /*
+     * \brief Write the header of a new frame, the \var dataLength bytes of serialized values from \var data and the CRC
+     *        if \var calcCRC is set to \var buffer, which must hold the whole frame.
+     */
+    void writeFrame(uint8_t *buffer, const uint8_t *data, uint16_t dataLength, bool calcCRC);
+    /*
+     * \brief Create or append a value of type \var dataType whose data is \var value in the little endian wire format.
+     */
+    template <class cType>
+    int32_t createTypedValue(SRscpValue* response, const SRscpTag & tag, const cType & value, uint8_t dataType) {
+    	uint8_t ucData[sizeof(cType)];
+    	RscpCodec::store<cType>(ucData, value);
+    	return createValue(response, tag, ucData, sizeof(ucData), dataType);
+    }
+    template <class cType>
+    int32_t appendTypedValue(SRscpValue* response, const SRscpTag & tag, const cType & value, uint8_t dataType) {
+    	uint8_t ucData[sizeof(cType)];
+    	RscpCodec::store<cType>(ucData, value);
+    	return appendValue(response, tag, ucData, sizeof(ucData), dataType);
+    }
+    /*
+     * \brief Validate the header, the length and the CRC of the frame in \var data and copy the header and the CRC
+     *        to \var frame.
+     * @return - RSCP error code if the frame is invalid else the length of the frame in bytes
+     */
+    int32_t checkFrame(const uint8_t* data, const uint32_t & length, SRscpFrame* frame, bool verifyCRC);
 };
 
 #endif /* RSCPPROTOCOL_H_ */
@@ -0,0 +1,756 @@
+/*
+ * RscpProxy.cpp
+ *
+ * Local RSCP proxy which shares one authenticated session to the device between several clients.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "RscpProxy.h"
+#include "RscpCodec.h"
+#include "RscpTags.h"
+#include "SocketConnection.h"
+#include "RscpMetrics.h"
+#include "settings.h"
+
+#define AES_KEY_SIZE        32
+#define AES_BLOCK_SIZE      32
+
+namespace {
+// size of tag, data type and length in front of every value
+const uint32_t uiValueHeaderSize = RSCP_VALUE_HEADER_SIZE;
+// response tags have the response bit of the tag type set
+const SRscpTag responseBit = 0x00800000;
+// a device which does not answer within this time is reconnected
+const int64_t deviceTimeoutMs = 3000;
+const int64_t statisticsIntervalMs = 60000;
+
+struct STagTtl {
+	SRscpTag tag;
+	int32_t ttl;
+};
+
+// read requests which may be combined and cached, with their cache time in ms
+// requests which are not listed (for example setpoints) are passed through to the device one by one
+const STagTtl tagTtls[] = {
+	{ TAG_INFO_REQ_SERIAL_NUMBER,       3600000 },
+	{ TAG_INFO_REQ_PRODUCTION_DATE,     3600000 },
+	{ TAG_INFO_REQ_SW_RELEASE,          3600000 },
+	{ TAG_INFO_REQ_TIME,                PROXY_CACHE_TTL },
+	{ TAG_EMS_REQ_POWER_PV,             PROXY_CACHE_TTL },
+	{ TAG_EMS_REQ_POWER_BAT,            PROXY_CACHE_TTL },
+	{ TAG_EMS_REQ_POWER_HOME,           PROXY_CACHE_TTL },
+	{ TAG_EMS_REQ_POWER_GRID,           PROXY_CACHE_TTL },
+	{ TAG_EMS_REQ_POWER_ADD,            PROXY_CACHE_TTL },
+	{ TAG_EMS_REQ_AUTARKY,              PROXY_CACHE_TTL },
+	{ TAG_EMS_REQ_SELF_CONSUMPTION,     PROXY_CACHE_TTL },
+	{ TAG_EMS_REQ_BAT_SOC,              PROXY_CACHE_TTL },
+	{ TAG_EMS_REQ_COUPLING_MODE,        PROXY_CACHE_TTL },
+	{ TAG_EMS_REQ_MODE,                 PROXY_CACHE_TTL },
+	{ TAG_EMS_REQ_STATUS,               PROXY_CACHE_TTL },
+	{ TAG_EMS_REQ_GET_IDLE_PERIODS,     60000 },
+	{ TAG_EMS_REQ_GET_POWER_SETTINGS,   60000 },
+	{ TAG_EMS_REQ_GET_SYS_SPECS,        3600000 },
+	{ TAG_BAT_REQ_DATA,                 PROXY_CACHE_TTL },
+	{ TAG_PVI_REQ_DATA,                 PROXY_CACHE_TTL },
+	{ TAG_PM_REQ_DATA,                  PROXY_CACHE_TTL },
+	{ TAG_DCDC_REQ_DATA,                PROXY_CACHE_TTL },
+	{ TAG_WB_REQ_DATA,                  PROXY_CACHE_TTL },
+	{ TAG_DB_REQ_HISTORY_DATA_DAY,      60000 },
+	{ TAG_DB_REQ_HISTORY_DATA_WEEK,     60000 },
+	{ TAG_DB_REQ_HISTORY_DATA_MONTH,    60000 },
+	{ TAG_DB_REQ_HISTORY_DATA_YEAR,     60000 },
+};
+
+int32_t tagTtl(const SRscpTag & tag) {
+	for(size_t i = 0; i < sizeof(tagTtls) / sizeof(tagTtls[0]); ++i) {
+		if(tagTtls[i].tag == tag) {
+			return tagTtls[i].ttl;
+		}
+	}
+	return -1;
+}
+
+SRscpTag responseTag(const SRscpTag & requestTag) {
+	// the only response whose tag number differs from the request
+	if(requestTag == TAG_EMS_REQ_GET_SYS_SPECS) {
+		return TAG_EMS_GET_SYS_SPECS;
+	}
+	return requestTag | responseBit;
+}
+
+int64_t monotonicMs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void initConnection(SRscpProxyConnection & connection, int iSocket, bool encrypted) {
+	connection.socket = iSocket;
+	connection.encrypted = encrypted;
+	connection.received.clear();
+	connection.plain.clear();
+	if(!encrypted) {
+		return;
+	}
+	// same key derivation as the device
+	memset(connection.cipher.encryptionIV, 0xff, AES_BLOCK_SIZE);
+	memset(connection.cipher.decryptionIV, 0xff, AES_BLOCK_SIZE);
+	int iPasswordLength = strlen(AES_PASSWORD);
+	if(iPasswordLength > AES_KEY_SIZE)
+		iPasswordLength = AES_KEY_SIZE;
+	uint8_t ucAesKey[AES_KEY_SIZE];
+	memset(ucAesKey, 0xff, AES_KEY_SIZE);
+	memcpy(ucAesKey, AES_PASSWORD, iPasswordLength);
+	connection.cipher.decrypter.SetParameters(AES_KEY_SIZE * 8, AES_BLOCK_SIZE * 8);
+	connection.cipher.encrypter.SetParameters(AES_KEY_SIZE * 8, AES_BLOCK_SIZE * 8);
+	connection.cipher.decrypter.StartDecryption(ucAesKey);
+	connection.cipher.encrypter.StartEncryption(ucAesKey);
+}
+
+/*
+ * Receive the available data of \var connection and decrypt all complete cipher blocks.
+ * Returns false if the connection was closed or failed.
+ */
+bool receiveConnection(SRscpProxyConnection & connection) {
+	uint8_t ucBuffer[4096];
+	while(true) {
+		ssize_t iResult = recv(connection.socket, ucBuffer, sizeof(ucBuffer), MSG_DONTWAIT);
+		RscpMetrics::countSyscalls(1);
+		if(iResult == 0) {
+			return false;
+		}
+		if(iResult < 0) {
+			return (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR);
+		}
+		if(!connection.encrypted) {
+			connection.plain.insert(connection.plain.end(), ucBuffer, ucBuffer + iResult);
+			continue;
+		}
+		connection.received.insert(connection.received.end(), ucBuffer, ucBuffer + iResult);
+		size_t sLength = ROUNDDOWN(connection.received.size(), AES_BLOCK_SIZE);
+		if(sLength == 0) {
+			continue;
+		}
+		// CBC blocks only depend on the previous cipher block, so every complete block is decrypted once
+		size_t sPlain = connection.plain.size();
+		connection.plain.resize(sPlain + sLength);
+		connection.cipher.decrypter.SetIV(connection.cipher.decryptionIV, AES_BLOCK_SIZE);
+		connection.cipher.decrypter.Decrypt(&connection.received[0], &connection.plain[sPlain], sLength / AES_BLOCK_SIZE);
+		memcpy(connection.cipher.decryptionIV, &connection.received[sLength - AES_BLOCK_SIZE], AES_BLOCK_SIZE);
+		connection.received.erase(connection.received.begin(), connection.received.begin() + sLength);
+	}
+}
+
+/*
+ * Returns the length of the complete frame at the start of the decrypted data, 0 if it is incomplete
+ * or a negative RSCP error code.
+ */
+int32_t nextFrame(SRscpProxyConnection & connection) {
+	if(connection.plain.size() < sizeof(SRscpFrameHeader)) {
+		return 0;
+	}
+	RscpProtocol protocol;
+	int32_t iFrameLength = protocol.getFrameLength(&connection.plain[0], connection.plain.size());
+	if(iFrameLength < 0) {
+		return iFrameLength;
+	}
+	return ((uint32_t)iFrameLength <= connection.plain.size()) ? iFrameLength : 0;
+}
+
+void consumeFrame(SRscpProxyConnection & connection, int32_t frameLength) {
+	// encrypted frames are zero padded to the cipher block size
+	size_t sLength = connection.encrypted ? ROUNDUP(frameLength, AES_BLOCK_SIZE) : frameLength;
+	if(sLength > connection.plain.size()) {
+		sLength = connection.plain.size();
+	}
+	connection.plain.erase(connection.plain.begin(), connection.plain.begin() + sLength);
+}
+
+/*
+ * Append the frame with \var values to \var buffer, encrypted for \var connection.
+ * Returns false if the values do not fit into one frame.
+ */
+bool encodeFrame(SRscpProxyConnection & connection, const std::string & values, std::vector<uint8_t> & buffer) {
+	if(values.size() > 0xFFFF) {
+		printf("Proxy frame too large (%u bytes)\n", (unsigned int)values.size());
+		return false;
+	}
+	RscpProtocol protocol;
+	SRscpFrameBuffer frameBuffer;
+	memset(&frameBuffer, 0, sizeof(frameBuffer));
+	protocol.createFrameAsBuffer(&frameBuffer, (const uint8_t *)values.data(), values.size(), true);
+
+	size_t sStart = buffer.size();
+	buffer.resize(sStart + (connection.encrypted ? ROUNDUP(frameBuffer.dataLength, AES_BLOCK_SIZE) : frameBuffer.dataLength), 0);
+	uint8_t *frame = &buffer[sStart];
+	size_t sLength = buffer.size() - sStart;
+	memcpy(frame, frameBuffer.data, frameBuffer.dataLength);
+	protocol.destroyFrameData(&frameBuffer);
+	if(connection.encrypted) {
+		connection.cipher.encrypter.SetIV(connection.cipher.encryptionIV, AES_BLOCK_SIZE);
+		connection.cipher.encrypter.Encrypt(frame, frame, sLength / AES_BLOCK_SIZE);
+		memcpy(connection.cipher.encryptionIV, frame + sLength - AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+	}
+	return true;
+}
+
+// blocking send of a frame to the device, the device session has nothing else to do meanwhile
+bool sendFrame(SRscpProxyConnection & connection, const std::string & values) {
+	std::vector<uint8_t> buffer;
+	if(!encodeFrame(connection, values, buffer)) {
+		return false;
+	}
+	size_t sSent = 0;
+	while(sSent < buffer.size()) {
+		ssize_t iResult = send(connection.socket, &buffer[0] + sSent, buffer.size() - sSent, MSG_NOSIGNAL);
+		RscpMetrics::countSyscalls(1);
+		if(iResult <= 0) {
+			// let poll report the broken connection to the owner
+			shutdown(connection.socket, SHUT_RDWR);
+			return false;
+		}
+		sSent += iResult;
+	}
+	return true;
+}
+
+// raw bytes of the first value inside \var container
+std::string rawValue(RscpProtocol & protocol, SRscpValue & container) {
+	std::string raw((const char *)container.data, container.length);
+	protocol.destroyValueData(container);
+	return raw;
+}
+
+std::string errorValue(const SRscpTag & requestTag, uint32_t error) {
+	RscpProtocol protocol;
+	SRscpValue container;
+	protocol.createContainerValue(&container, 0);
+	protocol.appendErrorValue(&container, responseTag(requestTag), error);
+	return rawValue(protocol, container);
+}
+
+std::string authenticationValue(uint8_t accessLevel) {
+	RscpProtocol protocol;
+	SRscpValue container;
+	protocol.createContainerValue(&container, 0);
+	protocol.appendValue(&container, TAG_RSCP_AUTHENTICATION, accessLevel);
+	return rawValue(protocol, container);
+}
+
+std::string authenticationRequest() {
+	RscpProtocol protocol;
+	SRscpValue container, authenContainer;
+	protocol.createContainerValue(&container, 0);
+	protocol.createContainerValue(&authenContainer, TAG_RSCP_REQ_AUTHENTICATION);
+	protocol.appendValue(&authenContainer, TAG_RSCP_AUTHENTICATION_USER, E3DC_USER);
+	protocol.appendValue(&authenContainer, TAG_RSCP_AUTHENTICATION_PASSWORD, E3DC_PASSWORD);
+	protocol.appendValue(&container, authenContainer);
+	protocol.destroyValueData(authenContainer);
+	return rawValue(protocol, container);
+}
+
+// local clients authenticate with the same user as the proxy uses for the device
+bool checkAuthentication(const uint8_t *raw) {
+	RscpProtocol protocol;
+	SRscpValue request;
+	RscpCodec::readValueHeader(raw, request);
+	std::string user, password;
+	std::vector<SRscpValue> data = protocol.getValueAsContainer(&request);
+	for(size_t i = 0; i < data.size(); ++i) {
+		if(data[i].tag == TAG_RSCP_AUTHENTICATION_USER) {
+			user = protocol.getValueAsString(&data[i]);
+		}
+		else if(data[i].tag == TAG_RSCP_AUTHENTICATION_PASSWORD) {
+			password = protocol.getValueAsString(&data[i]);
+		}
+	}
+	protocol.destroyValueData(data);
+	return (user == E3DC_USER) && (password == E3DC_PASSWORD);
+}
+
+int listenOn(const char *bindIp, int port) {
+	int iSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if(iSocket < 0) {
+		printf("Cannot create socket. errno %i\n", errno);
+		return -1;
+	}
+	int enable = 1;
+	setsockopt(iSocket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	if(inet_pton(AF_INET, bindIp, &addr.sin_addr) <= 0
+			|| bind(iSocket, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(iSocket, RSCP_PROXY_MAX_CLIENTS) < 0) {
+		printf("Cannot listen on %s:%i. errno %i\n", bindIp, port, errno);
+		close(iSocket);
+		return -1;
+	}
+	return iSocket;
+}
+}
+
+RscpProxy::RscpProxy() :
+		listenSocket(-1), plainListenSocket(-1), nextClientId(1), deviceAuthenticated(false), deviceAccessLevel(0),
+		deviceSentAt(0), deviceRetryAt(0),
+		deviceReconnect(RECONNECT_MIN_DELAY, RECONNECT_MAX_DELAY), clientRequests(0), deviceRequests(0), cacheHits(0), coalesced(0), statisticsAt(0) {
+	device.socket = -1;
+	device.encrypted = true;
+}
+
+RscpProxy::~RscpProxy() {
+	while(!clients.empty()) {
+		closeClient(clients.size() - 1);
+	}
+	if(device.socket >= 0) {
+		SocketClose(device.socket);
+	}
+	if(listenSocket >= 0) {
+		close(listenSocket);
+	}
+	if(plainListenSocket >= 0) {
+		close(plainListenSocket);
+	}
+}
+
+bool RscpProxy::open(const char *bindIp, int port, int plainPort) {
+	listenSocket = listenOn(bindIp, port);
+	if(plainPort > 0) {
+		plainListenSocket = listenOn(bindIp, plainPort);
+	}
+	return (listenSocket >= 0) || (plainListenSocket >= 0);
+}
+
+void RscpProxy::run() {
+	statisticsAt = monotonicMs() + statisticsIntervalMs;
+	while(true) {
+		int64_t now = monotonicMs();
+		if((device.socket < 0) && (now >= deviceRetryAt)) {
+			connectDevice();
+		}
+		if((device.socket >= 0) && (!deviceAuthenticated || !inFlight.empty()) && (now - deviceSentAt > deviceTimeoutMs)) {
+			printf("Device response timeout\n");
+			disconnectDevice(RSCP_ERR_AGAIN);
+		}
+		sendDeviceRequests();
+
+		struct pollfd fds[RSCP_PROXY_MAX_CLIENTS + 3];
+		nfds_t nfds = 0;
+		int sockets[3] = { listenSocket, plainListenSocket, device.socket };
+		for(int i = 0; i < 3; ++i) {
+			fds[nfds].fd = sockets[i];
+			fds[nfds].events = POLLIN;
+			fds[nfds].revents = 0;
+			++nfds;
+		}
+		for(size_t i = 0; i < clients.size(); ++i) {
+			fds[nfds].fd = clients[i]->connection.socket;
+			fds[nfds].events = clients[i]->output.empty() ? POLLIN : (POLLIN | POLLOUT);
+			fds[nfds].revents = 0;
+			++nfds;
+		}
+		// negative sockets are ignored by poll
+		int iReady = poll(fds, nfds, 100);
+		RscpMetrics::countSyscalls(1);
+		if(iReady < 0) {
+			continue;
+		}
+
+		if(fds[2].revents != 0) {
+			bool bConnected = receiveConnection(device);
+			int32_t iFrameLength = 0;
+			while(bConnected && (device.socket >= 0) && ((iFrameLength = nextFrame(device)) > 0)) {
+				handleDeviceFrame(&device.plain[0], iFrameLength);
+				consumeFrame(device, iFrameLength);
+			}
+			if((device.socket >= 0) && (!bConnected || (iFrameLength < 0))) {
+				printf("Device connection lost\n");
+				disconnectDevice(RSCP_ERR_NOT_AVAILABLE);
+			}
+		}
+
+		// clients are only closed after all of them were served, so the poll entries stay valid
+		for(size_t i = 0; i < clients.size(); ++i) {
+			SRscpProxyClient & client = *clients[i];
+			if(fds[3 + i].revents & POLLOUT) {
+				writeClient(client);
+			}
+			if((fds[3 + i].revents & ~POLLOUT) == 0 || client.failed) {
+				continue;
+			}
+			bool bConnected = receiveConnection(client.connection);
+			int32_t iFrameLength = 0;
+			while(bConnected && ((iFrameLength = nextFrame(client.connection)) > 0)) {
+				bConnected = handleClientFrame(client, &client.connection.plain[0], iFrameLength);
+				consumeFrame(client.connection, iFrameLength);
+			}
+			client.failed |= !bConnected || (iFrameLength < 0);
+		}
+		// a client can also fail while the device responses are passed on
+		for(size_t i = clients.size(); i > 0; --i) {
+			if(clients[i - 1]->failed) {
+				closeClient(i - 1);
+			}
+		}
+
+		if(fds[0].revents & POLLIN) {
+			acceptClient(listenSocket, true);
+		}
+		if(fds[1].revents & POLLIN) {
+			acceptClient(plainListenSocket, false);
+		}
+		if(monotonicMs() >= statisticsAt) {
+			printStatistics();
+		}
+	}
+}
+
+void RscpProxy::connectDevice() {
+	printf("Connecting to server %s:%i\n", SERVER_IP, SERVER_PORT);
+	int iSocket = SocketConnect(SERVER_IP, SERVER_PORT);
+	if(iSocket < 0) {
+		deviceReconnect.failed();
+		deviceRetryAt = monotonicMs() + deviceReconnect.delayMs();
+		return;
+	}
+	initConnection(device, iSocket, true);
+	deviceAuthenticated = false;
+	deviceSentAt = monotonicMs();
+	if(!sendFrame(device, authenticationRequest())) {
+		disconnectDevice(RSCP_ERR_NOT_AVAILABLE);
+	}
+}
+
+void RscpProxy::disconnectDevice(uint32_t error) {
+	if(device.socket >= 0) {
+		SocketClose(device.socket);
+		device.socket = -1;
+	}
+	deviceAuthenticated = false;
+	// a session which was authenticated is reconnected at once
+	deviceReconnect.lost(RscpMetrics::now());
+	deviceRetryAt = monotonicMs() + deviceReconnect.delayMs();
+
+	// nobody knows when the device is back, the clients retry on their own
+	std::list<SRscpProxyRequest> failed;
+	failed.splice(failed.end(), inFlight);
+	failed.splice(failed.end(), queued);
+	pending.clear();
+	for(std::list<SRscpProxyRequest>::iterator it = failed.begin(); it != failed.end(); ++it) {
+		std::string response = errorValue(it->tag, error);
+		for(size_t w = 0; w < it->waiters.size(); ++w) {
+			resolve(it->waiters[w], response);
+		}
+	}
+}
+
+void RscpProxy::sendDeviceRequests() {
+	if((device.socket < 0) || !deviceAuthenticated || !inFlight.empty() || queued.empty()) {
+		return;
+	}
+	// combine the queued requests of all clients into one frame
+	std::string values;
+	size_t sRequests = 0;
+	while(!queued.empty() && (sRequests < RSCP_PROXY_MAX_FRAME_REQUESTS)
+			&& ((sRequests == 0) || (values.size() + queued.front().raw.size() <= RSCP_PROXY_MAX_FRAME_DATA))) {
+		values += queued.front().raw;
+		inFlight.splice(inFlight.end(), queued, queued.begin());
+		++sRequests;
+	}
+	deviceRequests += sRequests;
+	deviceSentAt = monotonicMs();
+	if(!sendFrame(device, values)) {
+		disconnectDevice(RSCP_ERR_NOT_AVAILABLE);
+	}
+}
+
+void RscpProxy::handleDeviceFrame(const uint8_t *data, uint32_t length) {
+	SRscpFrameHeader header;
+	RscpCodec::readFrameHeader(data, header);
+	uint32_t uiEnd = RSCP_FRAME_HEADER_SIZE + header.dataLength;
+	int64_t now = monotonicMs();
+
+	for(uint32_t uiPos = RSCP_FRAME_HEADER_SIZE; uiPos + uiValueHeaderSize <= uiEnd; ) {
+		SRscpValue value;
+		RscpCodec::readValueHeader(data + uiPos, value);
+		uint32_t uiSize = uiValueHeaderSize + value.length;
+		if(uiPos + uiSize > uiEnd) {
+			break;
+		}
+		std::string response((const char *)data + uiPos, uiSize);
+		uiPos += uiSize;
+
+		if(!deviceAuthenticated) {
+			if(value.tag == TAG_RSCP_AUTHENTICATION) {
+				deviceAccessLevel = (value.dataType == RSCP::eTypeUChar8) ? data[uiPos - 1] : 0;
+				deviceAuthenticated = (deviceAccessLevel > 0);
+				printf("RSCP authentitication level %i\n", deviceAccessLevel);
+				if(!deviceAuthenticated) {
+					disconnectDevice(RSCP_ERR_ACCESS_DENIED);
+					return;
+				}
+				int64_t iGap = deviceReconnect.online(RscpMetrics::now());
+				if(iGap > 0) {
+					printf("Reconnected after %.3f s\n", iGap / 1e9);
+				}
+				// clients which authenticated before the device session get its access level now
+				std::vector<SRscpProxyWaiter> waiting;
+				waiting.swap(authentications);
+				for(size_t w = 0; w < waiting.size(); ++w) {
+					SRscpProxyClient *client = findClient(waiting[w].client);
+					if(client != NULL) {
+						client->accessLevel = deviceAccessLevel;
+						resolve(waiting[w], authenticationValue(deviceAccessLevel));
+					}
+				}
+			}
+			continue;
+		}
+
+		// the device answers every request with the response tag of the request
+		std::list<SRscpProxyRequest>::iterator it = inFlight.begin();
+		while((it != inFlight.end()) && (responseTag(it->tag) != value.tag)) {
+			++it;
+		}
+		if(it == inFlight.end()) {
+			printf("Unexpected response tag %08X\n", value.tag);
+			continue;
+		}
+		if((it->ttl > 0) && (value.dataType != RSCP::eTypeError)) {
+			SRscpProxyCacheEntry & entry = cache[it->raw];
+			entry.response = response;
+			entry.expires = now + it->ttl;
+		}
+		if(it->ttl >= 0) {
+			pending.erase(it->raw);
+		}
+		for(size_t w = 0; w < it->waiters.size(); ++w) {
+			resolve(it->waiters[w], response);
+		}
+		inFlight.erase(it);
+	}
+
+	// requests without response are answered with an error to not block the client frames
+	for(std::list<SRscpProxyRequest>::iterator it = inFlight.begin(); it != inFlight.end(); ++it) {
+		if(it->ttl >= 0) {
+			pending.erase(it->raw);
+		}
+		std::string response = errorValue(it->tag, RSCP_ERR_NOT_HANDLED);
+		for(size_t w = 0; w < it->waiters.size(); ++w) {
+			resolve(it->waiters[w], response);
+		}
+	}
+	inFlight.clear();
+}
+
+void RscpProxy::acceptClient(int iListenSocket, bool encrypted) {
+	// the responses are written when poll reports the socket writable, a client which does not read them
+	// never blocks the device session or the other clients
+	int iSocket = accept4(iListenSocket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	RscpMetrics::countSyscalls(1);
+	if(iSocket < 0) {
+		return;
+	}
+	if(clients.size() >= RSCP_PROXY_MAX_CLIENTS) {
+		printf("Too many proxy clients\n");
+		close(iSocket);
+		return;
+	}
+	int enable = 1;
+	setsockopt(iSocket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+	SRscpProxyClient *client = new SRscpProxyClient();
+	client->id = nextClientId++;
+	client->accessLevel = 0;
+	client->nextSequence = 0;
+	client->failed = false;
+	initConnection(client->connection, iSocket, encrypted);
+	clients.push_back(client);
+	printf("Proxy client %u connected (%s)\n", client->id, encrypted ? "encrypted" : "plain");
+}
+
+void RscpProxy::closeClient(size_t index) {
+	printf("Proxy client %u disconnected\n", clients[index]->id);
+	close(clients[index]->connection.socket);
+	// waiters of this client are ignored when their response arrives
+	delete clients[index];
+	clients.erase(clients.begin() + index);
+}
+
+bool RscpProxy::handleClientFrame(SRscpProxyClient & client, const uint8_t *data, uint32_t length) {
+	SRscpFrameHeader header;
+	RscpCodec::readFrameHeader(data, header);
+	uint32_t uiEnd = RSCP_FRAME_HEADER_SIZE + header.dataLength;
+	int64_t now = monotonicMs();
+
+	SRscpProxyClientFrame newFrame;
+	newFrame.sequence = client.nextSequence++;
+	newFrame.open = 0;
+	client.frames.push_back(newFrame);
+	SRscpProxyClientFrame & frame = client.frames.back();
+
+	for(uint32_t uiPos = RSCP_FRAME_HEADER_SIZE; uiPos + uiValueHeaderSize <= uiEnd; ) {
+		SRscpValue value;
+		RscpCodec::readValueHeader(data + uiPos, value);
+		uint32_t uiSize = uiValueHeaderSize + value.length;
+		if(uiPos + uiSize > uiEnd) {
+			printf("Invalid value length from proxy client %u\n", client.id);
+			return false;
+		}
+		std::string raw((const char *)data + uiPos, uiSize);
+		const uint8_t *valueData = data + uiPos;
+		uiPos += uiSize;
+
+		size_t sSlot = frame.responses.size();
+		frame.responses.push_back(std::string());
+		++clientRequests;
+
+		if(value.tag == TAG_RSCP_REQ_AUTHENTICATION) {
+			// authentication is answered by the proxy with the access level of the device session
+			bool bValid = checkAuthentication(valueData);
+			if(bValid && !deviceAuthenticated) {
+				// the answer waits for the device session, it is not denied for the whole connection
+				SRscpProxyWaiter waiter;
+				waiter.client = client.id;
+				waiter.sequence = frame.sequence;
+				waiter.slot = sSlot;
+				authentications.push_back(waiter);
+				++frame.open;
+				continue;
+			}
+			client.accessLevel = bValid ? deviceAccessLevel : 0;
+			frame.responses[sSlot] = authenticationValue(client.accessLevel);
+			continue;
+		}
+		if(client.accessLevel == 0) {
+			frame.responses[sSlot] = errorValue(value.tag, RSCP_ERR_ACCESS_DENIED);
+			continue;
+		}
+
+		SRscpProxyWaiter waiter;
+		waiter.client = client.id;
+		waiter.sequence = frame.sequence;
+		waiter.slot = sSlot;
+		int32_t iTtl = tagTtl(value.tag);
+		if(iTtl > 0) {
+			std::map<std::string, SRscpProxyCacheEntry>::iterator cached = cache.find(raw);
+			if((cached != cache.end()) && (cached->second.expires > now)) {
+				frame.responses[sSlot] = cached->second.response;
+				++cacheHits;
+				continue;
+			}
+		}
+		++frame.open;
+		if(iTtl >= 0) {
+			std::map<std::string, SRscpProxyRequest *>::iterator same = pending.find(raw);
+			if(same != pending.end()) {
+				same->second->waiters.push_back(waiter);
+				++coalesced;
+				continue;
+			}
+		}
+		SRscpProxyRequest request;
+		request.raw = raw;
+		request.tag = value.tag;
+		request.ttl = iTtl;
+		request.waiters.push_back(waiter);
+		queued.push_back(request);
+		if(iTtl >= 0) {
+			pending[raw] = &queued.back();
+		}
+	}
+	flushClient(client);
+	return true;
+}
+
+void RscpProxy::resolve(const SRscpProxyWaiter & waiter, const std::string & response) {
+	SRscpProxyClient *client = findClient(waiter.client);
+	if((client == NULL) || client->frames.empty() || (waiter.sequence < client->frames.front().sequence)) {
+		return;
+	}
+	size_t sIndex = waiter.sequence - client->frames.front().sequence;
+	if(sIndex >= client->frames.size()) {
+		return;
+	}
+	SRscpProxyClientFrame & frame = client->frames[sIndex];
+	frame.responses[waiter.slot] = response;
+	--frame.open;
+	if(sIndex == 0) {
+		flushClient(*client);
+	}
+}
+
+void RscpProxy::flushClient(SRscpProxyClient & client) {
+	// responses are sent in the order of the client frames
+	while(!client.frames.empty() && (client.frames.front().open == 0)) {
+		std::string values;
+		SRscpProxyClientFrame & frame = client.frames.front();
+		for(size_t i = 0; i < frame.responses.size(); ++i) {
+			values += frame.responses[i];
+		}
+		client.frames.pop_front();
+		if(!encodeFrame(client.connection, values, client.output)) {
+			client.failed = true;
+		}
+	}
+	writeClient(client);
+	if(!client.failed && (client.output.size() > RSCP_PROXY_MAX_CLIENT_OUTPUT)) {
+		printf("Proxy client %u does not read its responses\n", client.id);
+		client.failed = true;
+	}
+}
+
+void RscpProxy::writeClient(SRscpProxyClient & client) {
+	size_t sSent = 0;
+	while(!client.failed && (sSent < client.output.size())) {
+		ssize_t iResult = send(client.connection.socket, &client.output[sSent], client.output.size() - sSent, MSG_NOSIGNAL | MSG_DONTWAIT);
+		RscpMetrics::countSyscalls(1);
+		if(iResult < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			// the rest is sent when poll reports the socket writable again
+			client.failed = (errno != EAGAIN) && (errno != EWOULDBLOCK);
+			break;
+		}
+		sSent += iResult;
+	}
+	client.output.erase(client.output.begin(), client.output.begin() + sSent);
+}
+
+SRscpProxyClient * RscpProxy::findClient(uint32_t id) {
+	for(size_t i = 0; i < clients.size(); ++i) {
+		if(clients[i]->id == id) {
+			return clients[i];
+		}
+	}
+	return NULL;
+}
+
+void RscpProxy::printStatistics() {
+	int64_t now = monotonicMs();
+	statisticsAt = now + statisticsIntervalMs;
+	// expired entries are only removed here, a lookup of an expired entry just misses
+	for(std::map<std::string, SRscpProxyCacheEntry>::iterator it = cache.begin(); it != cache.end(); ) {
+		if(it->second.expires <= now) {
+			cache.erase(it++);
+		}
+		else {
+			++it;
+		}
+	}
+	printf("Proxy: %u clients, %llu client requests, %llu device requests (%.1f%%), %llu cache hits, %llu combined, %llu reconnects\n",
+			(unsigned int)clients.size(), (unsigned long long)clientRequests, (unsigned long long)deviceRequests,
+			clientRequests > 0 ? 100.0 * deviceRequests / clientRequests : 0.0,
+			(unsigned long long)cacheHits, (unsigned long long)coalesced, (unsigned long long)deviceReconnect.reconnects());
+	fflush(stdout);
+}
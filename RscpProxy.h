@@ -0,0 +1,157 @@
+/*
+ * RscpProxy.h
+ *
+ * Local RSCP proxy which shares one authenticated session to the device between several clients.
+ * Clients connect either encrypted (same AES password as the device) or with plain RSCP frames and
+ * authenticate against the proxy. Identical requests of different clients which are in flight at the same
+ * time are sent to the device only once and responses of read requests are cached for a per tag time.
+ */
+
+#ifndef RSCPPROXY_H_
+#define RSCPPROXY_H_
+
+#include <deque>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "RscpProtocol.h"
+#include "RscpReconnect.h"
+#include "AES.h"
+
+/*
+ * Maximum number of local clients.
+ */
+#define RSCP_PROXY_MAX_CLIENTS          16
+/*
+ * Limits of one request frame to the device. Requests of all clients are combined up to these limits.
+ */
+#define RSCP_PROXY_MAX_FRAME_REQUESTS   32
+#define RSCP_PROXY_MAX_FRAME_DATA       4096
+/*
+ * Responses which a client did not read yet. A client whose responses exceed it is disconnected.
+ */
+#define RSCP_PROXY_MAX_CLIENT_OUTPUT    (256 * 1024)
+
+/*
+ * AES CBC state of one connection. Both directions chain their own IV.
+ */
+struct SRscpProxyCipher {
+	AES encrypter;
+	AES decrypter;
+	uint8_t encryptionIV[32];
+	uint8_t decryptionIV[32];
+};
+
+struct SRscpProxyConnection {
+	int socket;
+	bool encrypted;
+	SRscpProxyCipher cipher;
+	// received data which is not decrypted yet and decrypted data which is not parsed yet
+	std::vector<uint8_t> received;
+	std::vector<uint8_t> plain;
+};
+
+/*
+ * Responses of one client frame. The response frame is sent when every slot is filled.
+ */
+struct SRscpProxyClientFrame {
+	uint64_t sequence;
+	std::vector<std::string> responses;
+	size_t open;
+};
+
+struct SRscpProxyClient {
+	uint32_t id;
+	uint8_t accessLevel;
+	SRscpProxyConnection connection;
+	uint64_t nextSequence;
+	std::deque<SRscpProxyClientFrame> frames;
+	// encoded response frames which the socket did not take yet, sent when poll reports POLLOUT
+	std::vector<uint8_t> output;
+	// the output overflowed or the socket failed, the client is closed by the poll loop
+	bool failed;
+};
+
+/*
+ * Slot of a client frame which waits for a device response.
+ */
+struct SRscpProxyWaiter {
+	uint32_t client;
+	uint64_t sequence;
+	size_t slot;
+};
+
+/*
+ * Request which is sent to the device once for all its waiters.
+ */
+struct SRscpProxyRequest {
+	// raw request value including tag, type and length
+	std::string raw;
+	SRscpTag tag;
+	// cache time in ms, requests without cache time are neither cached nor combined
+	int32_t ttl;
+	std::vector<SRscpProxyWaiter> waiters;
+};
+
+struct SRscpProxyCacheEntry {
+	std::string response;
+	int64_t expires;
+};
+
+class RscpProxy {
+public:
+	RscpProxy();
+	virtual ~RscpProxy();
+	/*
+	 * \brief Listen for encrypted clients on \var port and for plain clients on \var plainPort (0 to disable).
+	 * @return - false if no socket could be opened
+	 */
+	bool open(const char *bindIp, int port, int plainPort);
+	/*
+	 * \brief Serve the clients and keep the device session connected. Does not return.
+	 */
+	void run();
+private:
+	void connectDevice();
+	void disconnectDevice(uint32_t error);
+	void sendDeviceRequests();
+	void handleDeviceFrame(const uint8_t *data, uint32_t length);
+	void acceptClient(int listenSocket, bool encrypted);
+	void closeClient(size_t index);
+	bool handleClientFrame(SRscpProxyClient & client, const uint8_t *data, uint32_t length);
+	void resolve(const SRscpProxyWaiter & waiter, const std::string & response);
+	void flushClient(SRscpProxyClient & client);
+	void writeClient(SRscpProxyClient & client);
+	SRscpProxyClient * findClient(uint32_t id);
+	void printStatistics();
+
+	int listenSocket;
+	int plainListenSocket;
+	uint32_t nextClientId;
+	std::vector<SRscpProxyClient *> clients;
+
+	// device session
+	SRscpProxyConnection device;
+	bool deviceAuthenticated;
+	uint8_t deviceAccessLevel;
+	int64_t deviceSentAt;
+	int64_t deviceRetryAt;
+	RscpReconnect deviceReconnect;
+	std::list<SRscpProxyRequest> queued;
+	std::list<SRscpProxyRequest> inFlight;
+	// cached responses and requests which are queued or in flight, both by raw request
+	std::map<std::string, SRscpProxyRequest *> pending;
+	std::map<std::string, SRscpProxyCacheEntry> cache;
+	// authentications of clients with valid credentials which wait for the device session
+	std::vector<SRscpProxyWaiter> authentications;
+
+	uint64_t clientRequests;
+	uint64_t deviceRequests;
+	uint64_t cacheHits;
+	uint64_t coalesced;
+	int64_t statisticsAt;
+};
+
+#endif /* RSCPPROXY_H_ */
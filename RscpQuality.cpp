@@ -0,0 +1,108 @@
+/*
+ * RscpQuality.cpp
+ *
+ * Quality of the received values.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "RscpQuality.h"
+
+static_assert((RSCP_QUALITY_MAX_TAGS & (RSCP_QUALITY_MAX_TAGS - 1)) == 0, "the table size must be a power of two");
+
+RscpQuality::RscpQuality() : used(0), sampleTime(0), errorCount(0), untrackedCount(0) {
+	memset(entries, 0, sizeof(entries));
+}
+
+void RscpQuality::beginSample(int64_t now) {
+	sampleTime = now;
+}
+
+SRscpTagQuality * RscpQuality::find(SRscpTag tag, uint16_t index) {
+	// tag 0 is the root container and never answered, it marks free slots
+	if(tag == 0) {
+		return NULL;
+	}
+	uint32_t uiHash = (tag ^ ((uint32_t)index << 24) ^ (tag >> 15)) * 0x9E3779B1u;
+	for(uint32_t i = 0; i < RSCP_QUALITY_MAX_TAGS; ++i) {
+		SRscpTagQuality & entry = entries[(uiHash + i) & (RSCP_QUALITY_MAX_TAGS - 1)];
+		if(entry.tag == tag && entry.index == index) {
+			return &entry;
+		}
+		if(entry.tag == 0) {
+			// the table is filled up to 3/4 to keep the probe sequences short
+			if(used >= RSCP_QUALITY_MAX_TAGS / 4 * 3) {
+				++untrackedCount;
+				return NULL;
+			}
+			entry.tag = tag;
+			entry.index = index;
+			order[used++] = &entry - entries;
+			return &entry;
+		}
+	}
+	return NULL;
+}
+
+void RscpQuality::good(SRscpTag tag, uint16_t index) {
+	SRscpTagQuality *entry = find(tag, index);
+	if(entry != NULL) {
+		entry->lastGood = sampleTime;
+	}
+}
+
+void RscpQuality::error(SRscpTag tag, uint16_t index, uint32_t errorCode) {
+	++errorCount;
+	SRscpTagQuality *entry = find(tag, index);
+	if(entry != NULL) {
+		entry->errorCode = errorCode;
+		++entry->errors;
+		entry->lastError = sampleTime;
+	}
+}
+
+size_t RscpQuality::size() const {
+	return used;
+}
+
+const SRscpTagQuality & RscpQuality::at(size_t position) const {
+	return entries[order[position]];
+}
+
+ERscpQuality RscpQuality::quality(const SRscpTagQuality & entry, int64_t now, int64_t staleNs) {
+	if(entry.lastError != 0 && entry.lastError >= entry.lastGood) {
+		return eQualityError;
+	}
+	if(entry.lastGood == 0 || now - entry.lastGood > staleNs) {
+		return eQualityStale;
+	}
+	return eQualityGood;
+}
+
+const char * RscpQuality::qualityName(ERscpQuality quality) {
+	switch(quality) {
+	case eQualityGood:
+		return "good";
+	case eQualityStale:
+		return "stale";
+	default:
+		return "error";
+	}
+}
+
+void RscpQuality::name(const SRscpTagQuality & entry, char *buffer, size_t size) {
+	if(entry.index == 0) {
+		snprintf(buffer, size, "0x%08X", entry.tag);
+	}
+	else {
+		snprintf(buffer, size, "0x%08X_%u", entry.tag, entry.index);
+	}
+}
+
+uint64_t RscpQuality::totalErrors() const {
+	return errorCount;
+}
+
+uint64_t RscpQuality::untracked() const {
+	return untrackedCount;
+}
@@ -0,0 +1,75 @@
+/*
+ * RscpQuality.h
+ *
+ * Quality of the received values. A value which is answered with an error keeps its last good value in the
+ * output, its error is counted per tag and device index and the age of the last good value is provided,
+ * so one failing sub tag does not discard the rest of a sample. The table has a fixed size and never allocates.
+ */
+
+#ifndef RSCPQUALITY_H_
+#define RSCPQUALITY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "RscpTypes.h"
+
+/*
+ * Number of tracked tag and index pairs, must be a power of two. Further pairs are counted as untracked.
+ */
+#define RSCP_QUALITY_MAX_TAGS   512
+
+enum ERscpQuality {
+	eQualityGood = 0,   // the last answer was good and is not older than the stale time
+	eQualityStale,      // no answer since the stale time, the value is the last good one
+	eQualityError       // the last answer was an error, the value is the last good one
+};
+
+struct SRscpTagQuality {
+	SRscpTag tag;
+	// device, string or period index of the container which holds the value, 0 for values outside of containers
+	uint16_t index;
+	// error code of the last answer, only valid if lastError >= lastGood
+	uint32_t errorCode;
+	uint64_t errors;
+	// monotonic ns of the last good and the last error answer, 0 if none
+	int64_t lastGood;
+	int64_t lastError;
+};
+
+class RscpQuality {
+public:
+	RscpQuality();
+	/*
+	 * \brief Set the receive time of the following answers.
+	 */
+	void beginSample(int64_t now);
+	void good(SRscpTag tag, uint16_t index);
+	void error(SRscpTag tag, uint16_t index, uint32_t errorCode);
+	/*
+	 * \brief The tracked values in the order of their first answer.
+	 */
+	size_t size() const;
+	const SRscpTagQuality & at(size_t position) const;
+	/*
+	 * \brief Quality of \var entry at \var now, values without a good answer for \var staleNs are stale.
+	 */
+	static ERscpQuality quality(const SRscpTagQuality & entry, int64_t now, int64_t staleNs);
+	static const char * qualityName(ERscpQuality quality);
+	/*
+	 * \brief Name of \var entry for keys and labels: the tag in hex, followed by _<index> if the index is not 0.
+	 */
+	static void name(const SRscpTagQuality & entry, char *buffer, size_t size);
+	uint64_t totalErrors() const;
+	uint64_t untracked() const;
+private:
+	SRscpTagQuality * find(SRscpTag tag, uint16_t index);
+
+	SRscpTagQuality entries[RSCP_QUALITY_MAX_TAGS];
+	uint16_t order[RSCP_QUALITY_MAX_TAGS];
+	size_t used;
+	int64_t sampleTime;
+	uint64_t errorCount;
+	uint64_t untrackedCount;
+};
+
+#endif /* RSCPQUALITY_H_ */
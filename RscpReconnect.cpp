@@ -0,0 +1,52 @@
+/*
+ * RscpReconnect.cpp
+ *
+ * Reconnect state of a device connection.
+ */
+
+#include <unistd.h>
+#include "RscpMetrics.h"
+#include "RscpReconnect.h"
+
+RscpReconnect::RscpReconnect(int64_t minDelayMs, int64_t maxDelayMs) :
+		minDelay(minDelayMs > 0 ? minDelayMs : 1), maxDelay(maxDelayMs), backoff(0), lostAt(0),
+		connectionState(eConnectionNew), reconnectCount(0),
+		random((uint32_t)RscpMetrics::now() ^ ((uint32_t)getpid() << 16)) {
+	if(maxDelay < minDelay) {
+		maxDelay = minDelay;
+	}
+}
+
+int64_t RscpReconnect::delayMs() {
+	if(backoff == 0) {
+		return 0;
+	}
+	// equal jitter: at least half of the backoff, the rest is random
+	int64_t iHalf = backoff / 2;
+	return iHalf + (int64_t)(random() % (uint32_t)(backoff - iHalf + 1));
+}
+
+void RscpReconnect::failed() {
+	backoff = (backoff == 0) ? minDelay : ((backoff * 2 > maxDelay) ? maxDelay : backoff * 2);
+}
+
+void RscpReconnect::lost(int64_t now) {
+	if(connectionState != eConnectionOnline) {
+		failed();
+		return;
+	}
+	connectionState = eConnectionOffline;
+	lostAt = now;
+	backoff = 0;
+}
+
+int64_t RscpReconnect::online(int64_t now) {
+	ERscpConnectionState previous = connectionState;
+	connectionState = eConnectionOnline;
+	backoff = 0;
+	if(previous != eConnectionOffline) {
+		return 0;
+	}
+	++reconnectCount;
+	return now - lostAt;
+}
@@ -0,0 +1,55 @@
+/*
+ * RscpReconnect.h
+ *
+ * Reconnect state of a device connection. A lost session is reconnected at once, every failed attempt doubles
+ * the delay of the next one up to a maximum and the delays are jittered, so a device which reboots is not hammered
+ * and several clients do not retry in lockstep. The gap from the loss of a session until the first sample of the
+ * next one is measured.
+ */
+
+#ifndef RSCPRECONNECT_H_
+#define RSCPRECONNECT_H_
+
+#include <random>
+#include <stdint.h>
+
+enum ERscpConnectionState {
+	eConnectionNew = 0,     // never online
+	eConnectionOnline,      // the session delivered a sample
+	eConnectionOffline      // the last session was lost, reconnecting
+};
+
+class RscpReconnect {
+public:
+	RscpReconnect(int64_t minDelayMs, int64_t maxDelayMs);
+	/*
+	 * \brief Delay before the next connection attempt, 0 for the first attempt after a lost session.
+	 */
+	int64_t delayMs();
+	/*
+	 * \brief A connection attempt or a session which never got online failed, the next delay is doubled.
+	 */
+	void failed();
+	/*
+	 * \brief The session ended at \var now (monotonic ns). An online session is reconnected without delay.
+	 */
+	void lost(int64_t now);
+	/*
+	 * \brief The session delivered its first sample at \var now (monotonic ns).
+	 * @return - gap since the previous session was lost in ns, 0 if it is the first session or it was online already
+	 */
+	int64_t online(int64_t now);
+	ERscpConnectionState state() const { return connectionState; }
+	uint64_t reconnects() const { return reconnectCount; }
+private:
+	int64_t minDelay;
+	int64_t maxDelay;
+	// delay of the next attempt before the jitter, 0 for an immediate attempt
+	int64_t backoff;
+	int64_t lostAt;
+	ERscpConnectionState connectionState;
+	uint64_t reconnectCount;
+	std::minstd_rand random;
+};
+
+#endif /* RSCPRECONNECT_H_ */
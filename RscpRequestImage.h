@@ -0,0 +1,125 @@
+/*
+ * RscpRequestImage.h
+ *
+ * Requests whose values are known when the program is built. A request is described as a type, for example
+ *
+ *   RscpRequestImage<
+ *       RscpReq<TAG_INFO_REQ_TIME>,
+ *       RscpContainer<TAG_BAT_REQ_DATA, RscpUChar8<TAG_BAT_INDEX, 0>, RscpReq<TAG_BAT_REQ_RSOC> > >
+ *
+ * and the compiler computes its serialized values: the length of every container and the byte image in the
+ * wire format (little endian), which is a constant array in the read-only data. Sending it costs a copy of the
+ * array into the frame plus its timestamp and CRC, nothing is created, appended or destroyed at runtime.
+ */
+
+#ifndef RSCPREQUESTIMAGE_H_
+#define RSCPREQUESTIMAGE_H_
+
+#include <stdint.h>
+#include "RscpTypes.h"
+
+/*
+ * \brief Bytes of a serialized value as a template parameter pack.
+ */
+template<uint8_t... B>
+struct RscpBytes {
+};
+
+template<typename... P>
+struct RscpConcatBytes;
+
+template<>
+struct RscpConcatBytes<> {
+	typedef RscpBytes<> type;
+};
+
+template<uint8_t... A>
+struct RscpConcatBytes<RscpBytes<A...> > {
+	typedef RscpBytes<A...> type;
+};
+
+template<uint8_t... A, uint8_t... B, typename... P>
+struct RscpConcatBytes<RscpBytes<A...>, RscpBytes<B...>, P...> {
+	typedef typename RscpConcatBytes<RscpBytes<A..., B...>, P...>::type type;
+};
+
+template<typename B>
+struct RscpByteCount;
+
+template<uint8_t... B>
+struct RscpByteCount<RscpBytes<B...> > {
+	static const uint32_t value = sizeof...(B);
+};
+
+/*
+ * \brief Header of a value: tag, data type and length of the data.
+ */
+template<SRscpTag TAG, uint8_t TYPE, uint32_t LENGTH>
+struct RscpValueHeaderBytes {
+	static_assert(LENGTH <= 0xFFFF, "the data of an RSCP value is limited to 65535 bytes");
+	typedef RscpBytes<uint8_t(TAG), uint8_t(TAG >> 8), uint8_t(TAG >> 16), uint8_t(TAG >> 24),
+			TYPE, uint8_t(LENGTH), uint8_t(LENGTH >> 8)> type;
+};
+
+/*
+ * \brief Request value without data (RSCP::eTypeNone), e.g. TAG_EMS_REQ_POWER_PV.
+ */
+template<SRscpTag TAG>
+struct RscpReq {
+	typedef typename RscpValueHeaderBytes<TAG, RSCP::eTypeNone, 0>::type bytes;
+};
+
+/*
+ * \brief Value of type RSCP::eTypeUChar8, e.g. the index of a device.
+ */
+template<SRscpTag TAG, uint8_t VALUE>
+struct RscpUChar8 {
+	typedef typename RscpConcatBytes<typename RscpValueHeaderBytes<TAG, RSCP::eTypeUChar8, 1>::type,
+			RscpBytes<VALUE> >::type bytes;
+};
+
+/*
+ * \brief Value of type RSCP::eTypeByteArray with the bytes \var B, e.g. the data of TAG_WB_EXTERN_DATA.
+ */
+template<SRscpTag TAG, uint8_t... B>
+struct RscpByteArray {
+	typedef typename RscpConcatBytes<typename RscpValueHeaderBytes<TAG, RSCP::eTypeByteArray, sizeof...(B)>::type,
+			RscpBytes<B...> >::type bytes;
+};
+
+/*
+ * \brief Container of the values \var V, its length is the sum of their serialized lengths.
+ */
+template<SRscpTag TAG, typename... V>
+struct RscpContainer {
+	typedef typename RscpConcatBytes<typename V::bytes...>::type values;
+	typedef typename RscpConcatBytes<typename RscpValueHeaderBytes<TAG, RSCP::eTypeContainer, RscpByteCount<values>::value>::type,
+			values>::type bytes;
+};
+
+template<typename B>
+struct RscpByteImage;
+
+template<uint8_t... B>
+struct RscpByteImage<RscpBytes<B...> > {
+	static constexpr uint16_t size = sizeof...(B);
+	static constexpr uint8_t data[sizeof...(B)] = { B... };
+};
+
+template<uint8_t... B>
+constexpr uint16_t RscpByteImage<RscpBytes<B...> >::size;
+template<uint8_t... B>
+constexpr uint8_t RscpByteImage<RscpBytes<B...> >::data[sizeof...(B)];
+
+/*
+ * \brief Serialized values \var V one after another, as they are passed to RscpProtocol::createFrameInBuffer.
+ *        data and size are compile time constants.
+ */
+template<typename... V>
+struct RscpRequestImage : RscpByteImage<typename RscpConcatBytes<typename V::bytes...>::type> {
+	static_assert(sizeof...(V) > 0, "a request holds at least one value");
+	static_assert(RscpByteCount<typename RscpConcatBytes<typename V::bytes...>::type>::value <= 0xFFFF,
+			"the values of an RSCP frame are limited to 65535 bytes");
+};
+
+#endif /* RSCPREQUESTIMAGE_H_ */
@@ -0,0 +1,35 @@
+/*
+ * RscpSendSlab.cpp
+ *
+ * Transmit buffer of a device connection.
+ */
+
+#include <string.h>
+#include "RscpSendSlab.h"
+#include "RscpProtocol.h"
+
+RscpSendSlab::RscpSendSlab(AES & aes) : aes(aes) {
+	memset(chain, 0xff, sizeof(chain));
+}
+
+void RscpSendSlab::reset(const uint8_t *iv) {
+	memcpy(chain, iv, sizeof(chain));
+}
+
+int32_t RscpSendSlab::createFrame(const uint8_t *values, uint16_t length) {
+	RscpProtocol protocol;
+	return protocol.createFrameInBuffer(slab, capacity(), values, length, true);
+}
+
+uint32_t RscpSendSlab::encrypt(uint32_t length) {
+	uint32_t uiLength = ROUNDUP(length, RSCP_CIPHER_BLOCK_SIZE);
+	if(length == 0 || uiLength > sizeof(slab)) {
+		return 0;
+	}
+	// zero padding behind the frame, the slab is encrypted in place
+	memset(slab + length, 0, uiLength - length);
+	aes.SetIV(chain, RSCP_CIPHER_BLOCK_SIZE);
+	aes.Encrypt(slab, slab, uiLength / RSCP_CIPHER_BLOCK_SIZE);
+	memcpy(chain, slab + uiLength - RSCP_CIPHER_BLOCK_SIZE, RSCP_CIPHER_BLOCK_SIZE);
+	return uiLength;
+}
@@ -0,0 +1,48 @@
+/*
+ * RscpSendSlab.h
+ *
+ * Transmit buffer of a device connection. A frame is created directly inside the slab, zero padded to the cipher
+ * block size, encrypted in place and sent from it with a single call, so sending a frame neither allocates nor
+ * copies it.
+ */
+
+#ifndef RSCPSENDSLAB_H_
+#define RSCPSENDSLAB_H_
+
+#include <stdint.h>
+#include "AES.h"
+#include "RscpTypes.h"
+
+class RscpSendSlab {
+public:
+	/*
+	 * \brief \var aes must be prepared with StartEncryption.
+	 */
+	explicit RscpSendSlab(AES & aes);
+	/*
+	 * \brief Start a new CBC chain with \var iv (RSCP_CIPHER_BLOCK_SIZE bytes).
+	 */
+	void reset(const uint8_t *iv);
+	/*
+	 * \brief The frame is created at data(), it may take up to capacity() bytes.
+	 */
+	uint8_t * data() { return slab; }
+	uint32_t capacity() const { return RSCP_MAX_FRAME_LENGTH; }
+	/*
+	 * \brief Create a frame with CRC of the serialized values \var values inside the slab.
+	 * @return - length of the frame, RSCP::ERR_* if it does not fit
+	 */
+	int32_t createFrame(const uint8_t *values, uint16_t length);
+	/*
+	 * \brief Pad the frame of \var length bytes inside the slab and encrypt it in place, the chain continues.
+	 * @return - length of the encrypted frame, 0 if \var length exceeds the capacity
+	 */
+	uint32_t encrypt(uint32_t length);
+private:
+	AES & aes;
+	// last cipher block, the IV of the next frame
+	uint8_t chain[RSCP_CIPHER_BLOCK_SIZE];
+	uint8_t slab[ROUNDUP(RSCP_MAX_FRAME_LENGTH, RSCP_CIPHER_BLOCK_SIZE)];
+};
+
+#endif /* RSCPSENDSLAB_H_ */
@@ -0,0 +1,832 @@
+/*
+	Stand-in RSCP server for development and measurements.
+
+	This program answers the RSCP requests of RscpExample like an E3DC S10 would do with synthetic values.
+	It uses the same AES password as configured in settings.h and listens on the given port (default 5033).
+	Every client is served by an own process, so several clients can be measured at the same time.
+
+	Usage: RscpSimulator [port] [--delay <ms>] [--segment <bytes>] [--frame <bytes>] [--errors <n>] [--disconnect <n>]
+
+	--delay    device latency, every response is sent after this time
+	--segment  every response is sent in segments of this size with a short pause in between
+	--frame    poll responses are filled up with further idle period lists to about this size
+	--errors   one in n values of the device data and idle period containers is answered with an error
+	--disconnect  one in n poll responses is not sent and the connection is closed instead
+
+	Copyright (c) 2018 Thomas Bella <thomas@bella.network>
+
+	MIT Licence
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <vector>
+#include "RscpProtocol.h"
+#include "RscpTags.h"
+#include "AES.h"
+#include "settings.h"
+
+#define AES_KEY_SIZE        32
+#define AES_BLOCK_SIZE      32
+
+// response tags have the response bit of the tag type set
+#define RESPONSE_TAG(tag)   ((tag) | 0x00800000)
+
+// simulated hardware which is reported to the topology discovery
+#define SIM_BATTERIES       2
+#define SIM_BATTERY_DCBS    3
+#define SIM_DCB_CELLS       16
+#define SIM_DCB_SENSORS     8
+#define SIM_PVI_STRINGS     2
+#define SIM_PVI_PHASES      3
+#define SIM_PVI_SENSORS     2
+#define SIM_DCDCS           1
+#define SIM_POWER_METERS    2
+#define SIM_WALLBOXES       1
+// the simulated wallbox charges on one phase, so the synthetic surplus covers the whole current range
+#define SIM_WALLBOX_PHASES  1
+#define SIM_PHASE_VOLTAGE   230
+
+// pause between the segments of a response, long enough that the client receives them separately
+#define SIM_SEGMENT_PAUSE_US 50
+
+static uint32_t uiCycle = 0;
+static uint32_t uiDelayMs = 0;
+static uint32_t uiSegmentBytes = 0;
+static uint32_t uiFrameBytes = 0;
+static uint32_t uiErrorRate = 0;
+static uint32_t uiDisconnectRate = 0;
+static uint32_t uiRandom = 1;
+// charge current of the wallboxes in A, set by TAG_WB_REQ_SET_EXTERN
+static uint8_t ucWallboxCurrent[SIM_WALLBOXES];
+
+static bool injectFault(uint32_t rate)
+{
+	if(rate == 0) {
+		return false;
+	}
+	// xorshift, every client process has its own sequence
+	uiRandom ^= uiRandom << 13;
+	uiRandom ^= uiRandom >> 17;
+	uiRandom ^= uiRandom << 5;
+	return (uiRandom % rate) == 0;
+}
+
+static float syntheticPower(float peak, float phase)
+{
+	// slowly changing values so consumers see plausible data
+	return peak * (0.5f + 0.5f * sinf(uiCycle / 60.0f + phase));
+}
+
+static void appendError(RscpProtocol & protocol, SRscpValue * container, const SRscpTag & tag, uint32_t error)
+{
+	protocol.appendErrorValue(container, RESPONSE_TAG(tag), error);
+}
+
+static void appendIdlePeriods(RscpProtocol & protocol, SRscpValue * response)
+{
+	SRscpValue idlePeriods;
+	protocol.createContainerValue(&idlePeriods, RESPONSE_TAG(TAG_EMS_REQ_GET_IDLE_PERIODS));
+	for(uint8_t day = 0; day < 7; ++day) {
+		for(uint8_t type = 0; type < 2; ++type) {
+			SRscpValue period, start, end;
+			protocol.createContainerValue(&period, TAG_EMS_IDLE_PERIOD);
+			protocol.appendValue(&period, TAG_EMS_IDLE_PERIOD_TYPE, type);
+			protocol.appendValue(&period, TAG_EMS_IDLE_PERIOD_DAY, day);
+			protocol.appendValue(&period, TAG_EMS_IDLE_PERIOD_ACTIVE, false);
+			protocol.createContainerValue(&start, TAG_EMS_IDLE_PERIOD_START);
+			if(injectFault(uiErrorRate)) {
+				appendError(protocol, &start, TAG_EMS_IDLE_PERIOD_HOUR, RSCP_ERR_NOT_AVAILABLE);
+			}
+			else {
+				protocol.appendValue(&start, TAG_EMS_IDLE_PERIOD_HOUR, (uint8_t)1);
+			}
+			protocol.appendValue(&start, TAG_EMS_IDLE_PERIOD_MINUTE, (uint8_t)0);
+			protocol.createContainerValue(&end, TAG_EMS_IDLE_PERIOD_END);
+			protocol.appendValue(&end, TAG_EMS_IDLE_PERIOD_HOUR, (uint8_t)21);
+			protocol.appendValue(&end, TAG_EMS_IDLE_PERIOD_MINUTE, (uint8_t)0);
+			protocol.appendValue(&period, start);
+			protocol.appendValue(&period, end);
+			protocol.appendValue(&idlePeriods, period);
+			protocol.destroyValueData(start);
+			protocol.destroyValueData(end);
+			protocol.destroyValueData(period);
+		}
+	}
+	protocol.appendValue(response, idlePeriods);
+	protocol.destroyValueData(idlePeriods);
+}
+
+static void appendSetPower(RscpProtocol & protocol, SRscpValue * response, const SRscpValue * request)
+{
+	// the setpoint is accepted and returned as the power which is set now
+	int32_t iValue = 0;
+	std::vector<SRscpValue> setPower = protocol.getValueAsContainer(request);
+	for(size_t i = 0; i < setPower.size(); ++i) {
+		if(setPower[i].tag == TAG_EMS_REQ_SET_POWER_VALUE) {
+			iValue = protocol.getValueAsInt32(&setPower[i]);
+		}
+	}
+	protocol.destroyValueData(setPower);
+	protocol.appendValue(response, TAG_EMS_SET_POWER, iValue);
+}
+
+static int32_t wallboxPower(uint8_t index)
+{
+	return (index < SIM_WALLBOXES) ? ucWallboxCurrent[index] * SIM_PHASE_VOLTAGE * SIM_WALLBOX_PHASES : 0;
+}
+
+static int32_t wallboxPowerAll(void)
+{
+	int32_t iPower = 0;
+	for(uint8_t i = 0; i < SIM_WALLBOXES; ++i) {
+		iPower += wallboxPower(i);
+	}
+	return iPower;
+}
+
+static void appendExternData(RscpProtocol & protocol, SRscpValue * container, const SRscpValue * request, int32_t power)
+{
+	// the first two bytes of the extern data are the power in W
+	uint8_t ucData[8];
+	memset(ucData, 0, sizeof(ucData));
+	ucData[0] = (uint8_t)power;
+	ucData[1] = (uint8_t)(power >> 8);
+	SRscpValue externData;
+	protocol.createContainerValue(&externData, RESPONSE_TAG(request->tag));
+	protocol.appendValue(&externData, TAG_WB_EXTERN_DATA, ucData, sizeof(ucData));
+	protocol.appendValue(&externData, TAG_WB_EXTERN_DATA_LEN, (uint8_t)sizeof(ucData));
+	protocol.appendValue(container, externData);
+	protocol.destroyValueData(externData);
+}
+
+static void appendSetExtern(RscpProtocol & protocol, SRscpValue * container, const SRscpValue * request, uint8_t index)
+{
+	// the second byte of the extern data is the charge current in A
+	bool bAccepted = false;
+	std::vector<SRscpValue> setExtern = protocol.getValueAsContainer(request);
+	for(size_t i = 0; i < setExtern.size(); ++i) {
+		if(setExtern[i].tag == TAG_WB_EXTERN_DATA && setExtern[i].length >= 2 && index < SIM_WALLBOXES) {
+			ucWallboxCurrent[index] = setExtern[i].data[1];
+			bAccepted = true;
+		}
+	}
+	protocol.destroyValueData(setExtern);
+	if(bAccepted) {
+		protocol.appendValue(container, RESPONSE_TAG(request->tag), true);
+	}
+	else {
+		appendError(protocol, container, request->tag, RSCP_ERR_FORMAT);
+	}
+}
+
+static void appendBatteryInfo(RscpProtocol & protocol, SRscpValue * container, const SRscpValue * request)
+{
+	SRscpValue info;
+	protocol.createContainerValue(&info, RESPONSE_TAG(request->tag));
+	protocol.appendValue(&info, TAG_BAT_RSOC, 50.0f + 0.01f * syntheticPower(2000.0f, 1.0f));
+	protocol.appendValue(&info, TAG_BAT_MODULE_VOLTAGE, 48.8f);
+	protocol.appendValue(&info, TAG_BAT_CURRENT, syntheticPower(60.0f, 1.0f) - 30.0f);
+	protocol.appendValue(&info, TAG_BAT_TERMINAL_VOLTAGE, 48.9f);
+	protocol.appendValue(&info, TAG_BAT_MAX_BAT_VOLTAGE, 55.2f);
+	protocol.appendValue(&info, TAG_BAT_EOD_VOLTAGE, 44.8f);
+	protocol.appendValue(&info, TAG_BAT_MAX_CHARGE_CURRENT, 90.0f);
+	protocol.appendValue(&info, TAG_BAT_MAX_DISCHARGE_CURRENT, 90.0f);
+	protocol.appendValue(&info, TAG_BAT_CHARGE_CYCLES, (uint32_t)167);
+	protocol.appendValue(&info, TAG_BAT_STATUS_CODE, (uint32_t)0);
+	protocol.appendValue(&info, TAG_BAT_ERROR_CODE, (uint32_t)0);
+	protocol.appendValue(container, info);
+	protocol.destroyValueData(info);
+}
+
+static float cellValue(uint8_t battery, uint8_t dcb, uint32_t cell, bool voltage)
+{
+	// every cell differs a little, the voltage follows the charge of the battery
+	float fOffset = 0.001f * (battery * 97 + dcb * 31 + cell * 7 % 13);
+	return voltage ? 3.25f + 0.0001f * syntheticPower(2000.0f, 1.0f) + fOffset : 24.0f + 100.0f * fOffset;
+}
+
+static float cellTemperature(uint8_t battery, bool maximum)
+{
+	float fTemperature = cellValue(battery, 0, 0, false);
+	for(uint8_t dcb = 0; dcb < SIM_BATTERY_DCBS; ++dcb) {
+		for(uint32_t sensor = 0; sensor < SIM_DCB_SENSORS; ++sensor) {
+			float fValue = cellValue(battery, dcb, sensor, false);
+			fTemperature = maximum ? std::max(fTemperature, fValue) : std::min(fTemperature, fValue);
+		}
+	}
+	return fTemperature;
+}
+
+static void appendDcbData(RscpProtocol & protocol, SRscpValue * container, const SRscpValue * request, uint8_t battery)
+{
+	uint8_t dcb = protocol.getValueAsUChar8(request);
+	if(battery >= SIM_BATTERIES || dcb >= SIM_BATTERY_DCBS) {
+		appendError(protocol, container, request->tag, RSCP_ERR_OUT_OF_BOUNDS);
+		return;
+	}
+	// the module containers start with the index of the module, the cell values are inside TAG_BAT_DATA
+	SRscpValue data, cells;
+	protocol.createContainerValue(&data, RESPONSE_TAG(request->tag));
+	protocol.appendValue(&data, TAG_BAT_DCB_INDEX, (uint16_t)dcb);
+	if(request->tag == TAG_BAT_REQ_DCB_INFO) {
+		protocol.appendValue(&data, TAG_BAT_DCB_SOC, 50.0f + 0.01f * syntheticPower(2000.0f, 1.0f) + dcb);
+		protocol.appendValue(&data, TAG_BAT_DCB_SOH, 97.5f - dcb);
+		protocol.appendValue(&data, TAG_BAT_DCB_CYCLE_COUNT, (uint32_t)(160 + dcb));
+		protocol.appendValue(&data, TAG_BAT_DCB_VOLTAGE, 52.0f);
+		protocol.appendValue(&data, TAG_BAT_DCB_CURRENT, (syntheticPower(60.0f, 1.0f) - 30.0f) / SIM_BATTERY_DCBS);
+		protocol.appendValue(&data, TAG_BAT_DCB_VOLTAGE_AVG_30S, 52.0f);
+		protocol.appendValue(&data, TAG_BAT_DCB_CURRENT_AVG_30S, (syntheticPower(60.0f, 1.0f) - 30.0f) / SIM_BATTERY_DCBS);
+		protocol.appendValue(&data, TAG_BAT_DCB_FULL_CHARGE_CAPACITY, 56.0f);
+		protocol.appendValue(&data, TAG_BAT_DCB_REMAINING_CAPACITY, 28.0f);
+		protocol.appendValue(&data, TAG_BAT_DCB_DESIGN_CAPACITY, 58.0f);
+		protocol.appendValue(&data, TAG_BAT_DCB_NR_SERIES_CELL, (uint16_t)SIM_DCB_CELLS);
+		protocol.appendValue(&data, TAG_BAT_DCB_NR_PARALLEL_CELL, (uint16_t)1);
+	}
+	else {
+		bool bVoltages = (request->tag == TAG_BAT_REQ_DCB_ALL_CELL_VOLTAGES);
+		uint32_t uiCells = bVoltages ? SIM_DCB_CELLS : SIM_DCB_SENSORS;
+		protocol.createContainerValue(&cells, TAG_BAT_DATA);
+		for(uint32_t cell = 0; cell < uiCells; ++cell) {
+			protocol.appendValue(&cells, bVoltages ? TAG_BAT_DCB_CELL_VOLTAGE : TAG_BAT_DCB_CELL_TEMPERATURE,
+					cellValue(battery, dcb, cell, bVoltages));
+		}
+		protocol.appendValue(&data, cells);
+		protocol.destroyValueData(cells);
+	}
+	protocol.appendValue(container, data);
+	protocol.destroyValueData(data);
+}
+
+static void appendHistory(RscpProtocol & protocol, SRscpValue * response, const SRscpValue * request)
+{
+	// read the requested range
+	SRscpTimestamp start, interval, span;
+	memset(&start, 0, sizeof(start));
+	memset(&interval, 0, sizeof(interval));
+	memset(&span, 0, sizeof(span));
+	std::vector<SRscpValue> requestData = protocol.getValueAsContainer(request);
+	for(size_t i = 0; i < requestData.size(); ++i) {
+		if(requestData[i].tag == TAG_DB_REQ_HISTORY_TIME_START) {
+			start = protocol.getValueAsTimestamp(&requestData[i]);
+		}
+		else if(requestData[i].tag == TAG_DB_REQ_HISTORY_TIME_INTERVAL) {
+			interval = protocol.getValueAsTimestamp(&requestData[i]);
+		}
+		else if(requestData[i].tag == TAG_DB_REQ_HISTORY_TIME_SPAN) {
+			span = protocol.getValueAsTimestamp(&requestData[i]);
+		}
+	}
+	protocol.destroyValueData(requestData);
+	if(interval.seconds == 0) {
+		appendError(protocol, response, request->tag, RSCP_ERR_FORMAT);
+		return;
+	}
+
+	SRscpValue history;
+	protocol.createContainerValue(&history, RESPONSE_TAG(request->tag));
+	uint64_t rows = span.seconds / interval.seconds;
+	bool bExceeded = false;
+	for(uint64_t row = 0; row <= rows && !bExceeded; ++row) {
+		// row 0 is the sum container of the whole span, afterwards one value container per interval
+		float fBase = (float)((start.seconds + row * interval.seconds) % 86400) / 86400.0f;
+		SRscpValue values;
+		protocol.createContainerValue(&values, (row == 0) ? TAG_DB_SUM_CONTAINER : TAG_DB_VALUE_CONTAINER);
+		protocol.appendValue(&values, TAG_DB_GRAPH_INDEX, (float)(row == 0 ? 0 : row - 1));
+		protocol.appendValue(&values, TAG_DB_BAT_POWER_IN, 1200.0f * fBase);
+		protocol.appendValue(&values, TAG_DB_BAT_POWER_OUT, 800.0f * (1.0f - fBase));
+		protocol.appendValue(&values, TAG_DB_DC_POWER, 4500.0f * fBase);
+		protocol.appendValue(&values, TAG_DB_GRID_POWER_IN, 300.0f * fBase);
+		protocol.appendValue(&values, TAG_DB_GRID_POWER_OUT, 150.0f * (1.0f - fBase));
+		protocol.appendValue(&values, TAG_DB_CONSUMPTION, 900.0f + 100.0f * fBase);
+		protocol.appendValue(&values, TAG_DB_PM_0_POWER, 0.0f);
+		protocol.appendValue(&values, TAG_DB_PM_1_POWER, 0.0f);
+		protocol.appendValue(&values, TAG_DB_BAT_CHARGE_LEVEL, 100.0f * fBase);
+		protocol.appendValue(&values, TAG_DB_BAT_CYCLE_COUNT, 167.0f);
+		protocol.appendValue(&values, TAG_DB_CONSUMED_PRODUCTION, 80.0f);
+		protocol.appendValue(&values, TAG_DB_AUTARKY, 95.0f);
+		bExceeded = (protocol.appendValue(&history, values) != RSCP::OK);
+		protocol.destroyValueData(values);
+	}
+	if(bExceeded) {
+		// like the real device the request is rejected if the answer does not fit into a frame
+		appendError(protocol, response, request->tag, RSCP_ERR_OUT_OF_BOUNDS);
+	}
+	else {
+		protocol.appendValue(response, history);
+	}
+	protocol.destroyValueData(history);
+}
+
+static void appendSysSpecs(RscpProtocol & protocol, SRscpValue * response)
+{
+	static const struct {
+		const char * name;
+		int32_t value;
+	} specs[] = {
+		{ "installedBatteryCapacity", 13800 },
+		{ "maxAcPower", 12000 },
+		{ "maxPvPower", 13500 },
+	};
+	SRscpValue sysSpecs;
+	protocol.createContainerValue(&sysSpecs, TAG_EMS_GET_SYS_SPECS);
+	for(size_t i = 0; i < sizeof(specs) / sizeof(specs[0]); ++i) {
+		SRscpValue spec;
+		protocol.createContainerValue(&spec, TAG_EMS_SYS_SPEC);
+		protocol.appendValue(&spec, TAG_EMS_SYS_SPEC_INDEX, (int32_t)i);
+		protocol.appendValue(&spec, TAG_EMS_SYS_SPEC_NAME, specs[i].name);
+		protocol.appendValue(&spec, TAG_EMS_SYS_SPEC_VALUE_INT, specs[i].value);
+		protocol.appendValue(&sysSpecs, spec);
+		protocol.destroyValueData(spec);
+	}
+	protocol.appendValue(response, sysSpecs);
+	protocol.destroyValueData(sysSpecs);
+}
+
+static void appendIndexedValue(RscpProtocol & protocol, SRscpValue * container, const SRscpValue * request, float value)
+{
+	// indexed PVI values are answered as container with the index and the value
+	SRscpValue indexed;
+	protocol.createContainerValue(&indexed, RESPONSE_TAG(request->tag));
+	protocol.appendValue(&indexed, TAG_PVI_INDEX, (uint16_t)protocol.getValueAsUChar8(request));
+	protocol.appendValue(&indexed, TAG_PVI_VALUE, value);
+	protocol.appendValue(container, indexed);
+	protocol.destroyValueData(indexed);
+}
+
+static void appendDeviceData(RscpProtocol & protocol, SRscpValue * response, const SRscpValue * request)
+{
+	SRscpValue data;
+	protocol.createContainerValue(&data, RESPONSE_TAG(request->tag));
+	std::vector<SRscpValue> requestData = protocol.getValueAsContainer(request);
+	uint8_t index = 0;
+	for(size_t i = 0; i < requestData.size(); ++i) {
+		const SRscpValue * sub = &requestData[i];
+		if(sub->tag != TAG_BAT_INDEX && sub->tag != TAG_PVI_INDEX && sub->tag != TAG_DCDC_INDEX && sub->tag != TAG_PM_INDEX
+				&& sub->tag != TAG_WB_INDEX && injectFault(uiErrorRate)) {
+			appendError(protocol, &data, sub->tag, RSCP_ERR_NOT_AVAILABLE);
+			continue;
+		}
+		switch(sub->tag) {
+		case TAG_BAT_INDEX:
+		case TAG_PVI_INDEX:
+		case TAG_DCDC_INDEX:
+		case TAG_PM_INDEX:
+		case TAG_WB_INDEX:
+			index = protocol.getValueAsUChar8(sub);
+			protocol.appendValue(&data, sub->tag, index);
+			break;
+		case TAG_BAT_REQ_DCB_COUNT:
+			if(index < SIM_BATTERIES) {
+				protocol.appendValue(&data, RESPONSE_TAG(sub->tag), (uint8_t)SIM_BATTERY_DCBS);
+			}
+			else {
+				appendError(protocol, &data, sub->tag, RSCP_ERR_NOT_AVAILABLE);
+			}
+			break;
+		case TAG_BAT_REQ_MAX_DCB_CELL_TEMPERATURE:
+		case TAG_BAT_REQ_MIN_DCB_CELL_TEMPERATURE:
+			protocol.appendValue(&data, RESPONSE_TAG(sub->tag), cellTemperature(index, sub->tag == TAG_BAT_REQ_MAX_DCB_CELL_TEMPERATURE));
+			break;
+		case TAG_BAT_REQ_INFO:
+			appendBatteryInfo(protocol, &data, sub);
+			break;
+		case TAG_BAT_REQ_DCB_INFO:
+		case TAG_BAT_REQ_DCB_ALL_CELL_TEMPERATURES:
+		case TAG_BAT_REQ_DCB_ALL_CELL_VOLTAGES:
+			appendDcbData(protocol, &data, sub, index);
+			break;
+		case TAG_PVI_REQ_DC_MAX_STRING_COUNT:
+			protocol.appendValue(&data, RESPONSE_TAG(sub->tag), (uint16_t)SIM_PVI_STRINGS);
+			break;
+		case TAG_PVI_REQ_AC_MAX_PHASE_COUNT:
+			protocol.appendValue(&data, RESPONSE_TAG(sub->tag), (uint16_t)SIM_PVI_PHASES);
+			break;
+		case TAG_PVI_REQ_TEMPERATURE_COUNT:
+			protocol.appendValue(&data, RESPONSE_TAG(sub->tag), (uint16_t)SIM_PVI_SENSORS);
+			break;
+		case TAG_WB_REQ_DEVICE_STATE:
+			protocol.appendValue(&data, RESPONSE_TAG(sub->tag), index < SIM_WALLBOXES);
+			break;
+		case TAG_BAT_REQ_RSOC:
+			protocol.appendValue(&data, RESPONSE_TAG(sub->tag), 50.0f + 0.01f * syntheticPower(2000.0f, 1.0f));
+			break;
+		case TAG_BAT_REQ_MODULE_VOLTAGE:
+			protocol.appendValue(&data, RESPONSE_TAG(sub->tag), 48.8f);
+			break;
+		case TAG_BAT_REQ_CURRENT:
+			protocol.appendValue(&data, RESPONSE_TAG(sub->tag), syntheticPower(60.0f, 1.0f) - 30.0f);
+			break;
+		case TAG_BAT_REQ_CHARGE_CYCLES:
+			protocol.appendValue(&data, RESPONSE_TAG(sub->tag), (uint32_t)167);
+			break;
+		case TAG_BAT_REQ_TRAINING_MODE:
+			protocol.appendValue(&data, RESPONSE_TAG(sub->tag), (uint8_t)0);
+			break;
+		case TAG_PVI_REQ_ON_GRID:
+			protocol.appendValue(&data, RESPONSE_TAG(sub->tag), true);
+			break;
+		case TAG_PVI_REQ_SYSTEM_MODE:
+			protocol.appendValue(&data, RESPONSE_TAG(sub->tag), (uint8_t)2);
+			break;
+		case TAG_PVI_REQ_DC_POWER:
+			appendIndexedValue(protocol, &data, sub, syntheticPower(2500.0f, 0.0f));
+			break;
+		case TAG_PVI_REQ_DC_VOLTAGE:
+			appendIndexedValue(protocol, &data, sub, 380.0f);
+			break;
+		case TAG_PVI_REQ_DC_CURRENT:
+			appendIndexedValue(protocol, &data, sub, syntheticPower(2500.0f, 0.0f) / 380.0f);
+			break;
+		case TAG_PVI_REQ_DC_STRING_ENERGY_ALL:
+			appendIndexedValue(protocol, &data, sub, 8250000.0f + 1000.0f * protocol.getValueAsUChar8(sub));
+			break;
+		case TAG_PVI_REQ_AC_POWER:
+			appendIndexedValue(protocol, &data, sub, syntheticPower(5000.0f, 0.0f) / SIM_PVI_PHASES);
+			break;
+		case TAG_PVI_REQ_AC_VOLTAGE:
+			appendIndexedValue(protocol, &data, sub, 230.0f + protocol.getValueAsUChar8(sub));
+			break;
+		case TAG_PVI_REQ_AC_CURRENT:
+			appendIndexedValue(protocol, &data, sub, syntheticPower(5000.0f, 0.0f) / SIM_PVI_PHASES / 230.0f);
+			break;
+		case TAG_PVI_REQ_AC_APPARENTPOWER:
+			appendIndexedValue(protocol, &data, sub, syntheticPower(5000.0f, 0.0f) / SIM_PVI_PHASES + 20.0f);
+			break;
+		case TAG_PVI_REQ_AC_REACTIVEPOWER:
+			appendIndexedValue(protocol, &data, sub, -15.0f);
+			break;
+		case TAG_PVI_REQ_TEMPERATURE:
+			appendIndexedValue(protocol, &data, sub, 38.5f + 2.0f * protocol.getValueAsUChar8(sub));
+			break;
+		case TAG_PM_REQ_DEVICE_STATE:
+			protocol.appendValue(&data, RESPONSE_TAG(sub->tag), index < SIM_POWER_METERS);
+			break;
+		case TAG_PM_REQ_ACTIVE_PHASES:
+			protocol.appendValue(&data, RESPONSE_TAG(sub->tag), (int32_t)7);
+			break;
+		case TAG_PM_REQ_POWER_L1:
+		case TAG_PM_REQ_POWER_L2:
+		case TAG_PM_REQ_POWER_L3:
+			protocol.appendValue(&data, RESPONSE_TAG(sub->tag), (double)syntheticPower(400.0f, sub->tag & 0x0F) - 200.0);
+			break;
+		case TAG_PM_REQ_VOLTAGE_L1:
+		case TAG_PM_REQ_VOLTAGE_L2:
+		case TAG_PM_REQ_VOLTAGE_L3:
+			protocol.appendValue(&data, RESPONSE_TAG(sub->tag), 230.0f + (sub->tag & 0x0F));
+			break;
+		case TAG_PM_REQ_ENERGY_L1:
+		case TAG_PM_REQ_ENERGY_L2:
+		case TAG_PM_REQ_ENERGY_L3:
+			// counters in Wh which grow by a fraction of a Wh per poll
+			protocol.appendValue(&data, RESPONSE_TAG(sub->tag), 1250000.0 * (index + 1) + 0.125 * (sub->tag & 0x0F) * uiCycle);
+			break;
+		case TAG_DCDC_REQ_DEVICE_STATE:
+			protocol.appendValue(&data, RESPONSE_TAG(sub->tag), index < SIM_DCDCS);
+			break;
+		case TAG_DCDC_REQ_I_BAT:
+			protocol.appendValue(&data, RESPONSE_TAG(sub->tag), (syntheticPower(3000.0f, 1.0f) - 1500.0f) / 48.8f);
+			break;
+		case TAG_DCDC_REQ_U_BAT:
+			protocol.appendValue(&data, RESPONSE_TAG(sub->tag), 48.8f);
+			break;
+		case TAG_DCDC_REQ_P_BAT:
+			protocol.appendValue(&data, RESPONSE_TAG(sub->tag), syntheticPower(3000.0f, 1.0f) - 1500.0f);
+			break;
+		case TAG_DCDC_REQ_I_DCL:
+			protocol.appendValue(&data, RESPONSE_TAG(sub->tag), (syntheticPower(3000.0f, 1.0f) - 1500.0f) / 700.0f);
+			break;
+		case TAG_DCDC_REQ_U_DCL:
+			protocol.appendValue(&data, RESPONSE_TAG(sub->tag), 700.0f);
+			break;
+		case TAG_DCDC_REQ_P_DCL:
+			protocol.appendValue(&data, RESPONSE_TAG(sub->tag), syntheticPower(3000.0f, 1.0f) - 1530.0f);
+			break;
+		case TAG_DCDC_REQ_STATUS:
+		{
+			SRscpValue status;
+			protocol.createContainerValue(&status, RESPONSE_TAG(sub->tag));
+			protocol.appendValue(&status, TAG_DCDC_STATE, (uint32_t)7);
+			protocol.appendValue(&status, TAG_DCDC_SUBSTATE, (uint32_t)0);
+			protocol.appendValue(&data, status);
+			protocol.destroyValueData(status);
+			break;
+		}
+			break;
+		case TAG_WB_REQ_PM_ACTIVE_PHASES:
+			protocol.appendValue(&data, RESPONSE_TAG(sub->tag), (uint8_t)((1 << SIM_WALLBOX_PHASES) - 1));
+			break;
+		case TAG_WB_REQ_PM_POWER_L1:
+			protocol.appendValue(&data, RESPONSE_TAG(sub->tag), (double)wallboxPower(index));
+			break;
+		case TAG_WB_REQ_PM_POWER_L2:
+		case TAG_WB_REQ_PM_POWER_L3:
+			protocol.appendValue(&data, RESPONSE_TAG(sub->tag), 0.0);
+			break;
+		case TAG_WB_REQ_EXTERN_DATA_SUN:
+			appendExternData(protocol, &data, sub, std::min(wallboxPower(index), (int32_t)syntheticPower(5000.0f, 0.0f)));
+			break;
+		case TAG_WB_REQ_EXTERN_DATA_NET:
+			appendExternData(protocol, &data, sub, std::max(wallboxPower(index) - (int32_t)syntheticPower(5000.0f, 0.0f), 0));
+			break;
+		case TAG_WB_REQ_EXTERN_DATA_ALL:
+			appendExternData(protocol, &data, sub, wallboxPower(index));
+			break;
+		case TAG_WB_REQ_SET_EXTERN:
+			appendSetExtern(protocol, &data, sub, index);
+			break;
+		default:
+			appendError(protocol, &data, sub->tag, RSCP_ERR_UNKNOWN_TAG);
+			break;
+		}
+	}
+	protocol.destroyValueData(requestData);
+	protocol.appendValue(response, data);
+	protocol.destroyValueData(data);
+}
+
+static void handleRequest(RscpProtocol & protocol, SRscpValue * response, const SRscpValue * request)
+{
+	switch(request->tag) {
+	case TAG_RSCP_REQ_AUTHENTICATION:
+		// every user is accepted with the access level of an installer
+		protocol.appendValue(response, TAG_RSCP_AUTHENTICATION, (uint8_t)10);
+		break;
+	case TAG_INFO_REQ_TIME:
+		protocol.appendValue(response, TAG_INFO_TIME, (int32_t)time(NULL));
+		break;
+	case TAG_INFO_REQ_SERIAL_NUMBER:
+		protocol.appendValue(response, TAG_INFO_SERIAL_NUMBER, "S10-SIMULATOR000");
+		break;
+	case TAG_EMS_REQ_POWER_PV:
+		protocol.appendValue(response, TAG_EMS_POWER_PV, (int32_t)syntheticPower(5000.0f, 0.0f));
+		break;
+	case TAG_EMS_REQ_POWER_BAT:
+		protocol.appendValue(response, TAG_EMS_POWER_BAT, (int32_t)syntheticPower(3000.0f, 1.0f) - 1500);
+		break;
+	case TAG_EMS_REQ_POWER_HOME:
+		protocol.appendValue(response, TAG_EMS_POWER_HOME, (int32_t)syntheticPower(1000.0f, 2.0f) + 400);
+		break;
+	case TAG_EMS_REQ_POWER_GRID:
+		protocol.appendValue(response, TAG_EMS_POWER_GRID, (int32_t)syntheticPower(600.0f, 3.0f) - 300);
+		break;
+	case TAG_EMS_REQ_POWER_ADD:
+		protocol.appendValue(response, TAG_EMS_POWER_ADD, (int32_t)0);
+		break;
+	case TAG_EMS_REQ_POWER_WB_ALL:
+		protocol.appendValue(response, TAG_EMS_POWER_WB_ALL, wallboxPowerAll());
+		break;
+	case TAG_EMS_REQ_POWER_WB_SOLAR:
+		protocol.appendValue(response, TAG_EMS_POWER_WB_SOLAR, std::min(wallboxPowerAll(), (int32_t)syntheticPower(5000.0f, 0.0f)));
+		break;
+	case TAG_EMS_REQ_AUTARKY:
+		protocol.appendValue(response, TAG_EMS_AUTARKY, 99.1f);
+		break;
+	case TAG_EMS_REQ_SELF_CONSUMPTION:
+		protocol.appendValue(response, TAG_EMS_SELF_CONSUMPTION, 99.4f);
+		break;
+	case TAG_EMS_REQ_COUPLING_MODE:
+		protocol.appendValue(response, TAG_EMS_COUPLING_MODE, (uint8_t)3);
+		break;
+	case TAG_EMS_REQ_GET_IDLE_PERIODS:
+		appendIdlePeriods(protocol, response);
+		break;
+	case TAG_EMS_REQ_SET_POWER:
+		appendSetPower(protocol, response, request);
+		break;
+	case TAG_EMS_REQ_GET_SYS_SPECS:
+		appendSysSpecs(protocol, response);
+		break;
+	case TAG_BAT_REQ_DATA:
+	case TAG_PVI_REQ_DATA:
+	case TAG_DCDC_REQ_DATA:
+	case TAG_PM_REQ_DATA:
+	case TAG_WB_REQ_DATA:
+		appendDeviceData(protocol, response, request);
+		break;
+	case TAG_DB_REQ_HISTORY_DATA_DAY:
+	case TAG_DB_REQ_HISTORY_DATA_WEEK:
+	case TAG_DB_REQ_HISTORY_DATA_MONTH:
+	case TAG_DB_REQ_HISTORY_DATA_YEAR:
+		appendHistory(protocol, response, request);
+		break;
+	default:
+		appendError(protocol, response, request->tag, RSCP_ERR_UNKNOWN_TAG);
+		break;
+	}
+}
+
+static int sendResponse(int iSocket, AES & aesEncrypter, uint8_t * ucEncryptionIV, const SRscpValue & rootValue)
+{
+	RscpProtocol protocol;
+	SRscpFrameBuffer frameBuffer;
+	memset(&frameBuffer, 0, sizeof(frameBuffer));
+	protocol.createFrameAsBuffer(&frameBuffer, rootValue.data, rootValue.length, true);
+
+	// zero padded and encrypted like the client does it
+	std::vector<uint8_t> encryptionBuffer(ROUNDUP(frameBuffer.dataLength, AES_BLOCK_SIZE), 0);
+	memcpy(&encryptionBuffer[0], frameBuffer.data, frameBuffer.dataLength);
+	protocol.destroyFrameData(&frameBuffer);
+	aesEncrypter.SetIV(ucEncryptionIV, AES_BLOCK_SIZE);
+	aesEncrypter.Encrypt(&encryptionBuffer[0], &encryptionBuffer[0], encryptionBuffer.size() / AES_BLOCK_SIZE);
+	memcpy(ucEncryptionIV, &encryptionBuffer[0] + encryptionBuffer.size() - AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+
+	if(uiDelayMs > 0) {
+		usleep(uiDelayMs * 1000);
+	}
+	size_t sSent = 0;
+	while(sSent < encryptionBuffer.size()) {
+		size_t sLength = encryptionBuffer.size() - sSent;
+		if(uiSegmentBytes > 0 && sLength > uiSegmentBytes) {
+			sLength = uiSegmentBytes;
+			if(sSent > 0) {
+				usleep(SIM_SEGMENT_PAUSE_US);
+			}
+		}
+		ssize_t iResult = send(iSocket, &encryptionBuffer[0] + sSent, sLength, MSG_NOSIGNAL);
+		if(iResult <= 0) {
+			return -1;
+		}
+		sSent += iResult;
+	}
+	return sSent;
+}
+
+static uint32_t parseOption(int argc, char *argv[], int & i)
+{
+	if(i + 1 >= argc) {
+		printf("Missing value of %s\n", argv[i]);
+		exit(EXIT_FAILURE);
+	}
+	return strtoul(argv[++i], NULL, 10);
+}
+
+static void serveClient(int iSocket)
+{
+	AES aesEncrypter, aesDecrypter;
+	uint8_t ucEncryptionIV[AES_BLOCK_SIZE];
+	uint8_t ucDecryptionIV[AES_BLOCK_SIZE];
+	memset(ucEncryptionIV, 0xff, AES_BLOCK_SIZE);
+	memset(ucDecryptionIV, 0xff, AES_BLOCK_SIZE);
+
+	// same key derivation as the client
+	int iPasswordLength = strlen(AES_PASSWORD);
+	if(iPasswordLength > AES_KEY_SIZE)
+		iPasswordLength = AES_KEY_SIZE;
+	uint8_t ucAesKey[AES_KEY_SIZE];
+	memset(ucAesKey, 0xff, AES_KEY_SIZE);
+	memcpy(ucAesKey, AES_PASSWORD, iPasswordLength);
+	aesDecrypter.SetParameters(AES_KEY_SIZE * 8, AES_BLOCK_SIZE * 8);
+	aesEncrypter.SetParameters(AES_KEY_SIZE * 8, AES_BLOCK_SIZE * 8);
+	aesDecrypter.StartDecryption(ucAesKey);
+	aesEncrypter.StartEncryption(ucAesKey);
+
+	uiRandom = getpid();
+	RscpProtocol protocol;
+	std::vector<uint8_t> receiveBuffer;
+	std::vector<uint8_t> decryptionBuffer;
+	size_t sReceived = 0;
+	while(true) {
+		if(receiveBuffer.size() - sReceived < 4096) {
+			receiveBuffer.resize(receiveBuffer.size() + 4096);
+		}
+		ssize_t iResult = recv(iSocket, &receiveBuffer[0] + sReceived, receiveBuffer.size() - sReceived, 0);
+		if(iResult <= 0) {
+			return;
+		}
+		sReceived += iResult;
+
+		// process all complete frames
+		while(sReceived >= AES_BLOCK_SIZE) {
+			size_t sLength = ROUNDDOWN(sReceived, AES_BLOCK_SIZE);
+			decryptionBuffer.resize(sLength);
+			aesDecrypter.SetIV(ucDecryptionIV, AES_BLOCK_SIZE);
+			aesDecrypter.Decrypt(&receiveBuffer[0], &decryptionBuffer[0], sLength / AES_BLOCK_SIZE);
+
+			SRscpFrame frame;
+			int32_t iProcessed = protocol.parseFrame(&decryptionBuffer[0], sLength, &frame);
+			if(iProcessed == RSCP::ERR_INVALID_FRAME_LENGTH) {
+				break;
+			}
+			else if(iProcessed < 0) {
+				printf("Invalid frame from client: %i\n", iProcessed);
+				return;
+			}
+
+			SRscpValue rootValue;
+			protocol.createContainerValue(&rootValue, 0);
+			bool bPoll = false;
+			for(size_t i = 0; i < frame.data.size(); ++i) {
+				handleRequest(protocol, &rootValue, &frame.data[i]);
+				bPoll = bPoll || (frame.data[i].tag == TAG_INFO_REQ_TIME);
+			}
+			protocol.destroyFrameData(frame);
+			while(bPoll && rootValue.length < uiFrameBytes) {
+				appendIdlePeriods(protocol, &rootValue);
+			}
+			if(bPoll && injectFault(uiDisconnectRate)) {
+				protocol.destroyValueData(rootValue);
+				printf("Connection dropped\n");
+				return;
+			}
+			++uiCycle;
+
+			int iSent = sendResponse(iSocket, aesEncrypter, ucEncryptionIV, rootValue);
+			protocol.destroyValueData(rootValue);
+			if(iSent < 0) {
+				return;
+			}
+
+			// remove the processed encrypted data and keep the last cipher block as IV
+			iProcessed = ROUNDUP(iProcessed, AES_BLOCK_SIZE);
+			memcpy(ucDecryptionIV, &receiveBuffer[0] + iProcessed - AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+			memmove(&receiveBuffer[0], &receiveBuffer[0] + iProcessed, sReceived - iProcessed);
+			sReceived -= iProcessed;
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int iPort = SERVER_PORT;
+	for(int i = 1; i < argc; ++i) {
+		if(strcmp(argv[i], "--delay") == 0) {
+			uiDelayMs = parseOption(argc, argv, i);
+		}
+		else if(strcmp(argv[i], "--segment") == 0) {
+			uiSegmentBytes = parseOption(argc, argv, i);
+		}
+		else if(strcmp(argv[i], "--frame") == 0) {
+			uiFrameBytes = parseOption(argc, argv, i);
+		}
+		else if(strcmp(argv[i], "--errors") == 0) {
+			uiErrorRate = parseOption(argc, argv, i);
+		}
+		else if(strcmp(argv[i], "--disconnect") == 0) {
+			uiDisconnectRate = parseOption(argc, argv, i);
+		}
+		else {
+			iPort = atoi(argv[i]);
+		}
+	}
+	// one idle period list is about 1 KiB, the filled up response must stay below the maximum frame length
+	if(uiFrameBytes > 0xFFFF - 2048) {
+		uiFrameBytes = 0xFFFF - 2048;
+	}
+
+	int iListen = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if(iListen < 0) {
+		printf("Cannot create socket. errno %i\n", errno);
+		return EXIT_FAILURE;
+	}
+	int enable = 1;
+	setsockopt(iListen, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+	struct sockaddr_in server_addr;
+	memset(&server_addr, 0, sizeof(server_addr));
+	server_addr.sin_family = AF_INET;
+	server_addr.sin_port = htons(iPort);
+	server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if(bind(iListen, (struct sockaddr *) &server_addr, sizeof(server_addr)) < 0 || listen(iListen, 8) < 0) {
+		printf("Cannot listen on port %i. errno %i\n", iPort, errno);
+		close(iListen);
+		return EXIT_FAILURE;
+	}
+	printf("RSCP simulator listening on port %i\n", iPort);
+	fflush(stdout);
+
+	// finished clients are reaped by the kernel
+	signal(SIGCHLD, SIG_IGN);
+	while(true) {
+		int iSocket = accept(iListen, NULL, NULL);
+		if(iSocket < 0) {
+			continue;
+		}
+		setsockopt(iSocket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+		pid_t pid = fork();
+		if(pid < 0) {
+			printf("Cannot serve client. errno %i\n", errno);
+		}
+		else if(pid == 0) {
+			close(iListen);
+			printf("Client connected\n");
+			serveClient(iSocket);
+			close(iSocket);
+			printf("Client disconnected\n");
+			exit(EXIT_SUCCESS);
+		}
+		close(iSocket);
+	}
+	return 0;
+}
@@ -0,0 +1,323 @@
+/*
+	Long running soak test of the live data path.
+
+	The client runs back to back sessions against RscpSimulator which answers some values with errors and
+	drops some connections, so the error and reconnect paths run as often as the regular ones. After a
+	warm up the live heap allocations per call site, the RSS and the heap fragmentation are sampled at every
+	checkpoint. The test fails if the live allocations of a call site or the RSS grow after the warm up.
+	The gap from a dropped connection until the first response of the next session is reported.
+	Built with RSCP_TRACK_ALLOCATIONS, the call sites are resolved with addr2line -f -C -e RscpSoak <offset>.
+
+	Usage: RscpSoak [--cycles <n>] [--checkpoint <n>] [--errors <n>] [--disconnect <n>] [--rss-growth <KiB>]
+	                [--port <port>] [--simulator <path>] [--dir <output directory>] [--verbose]
+
+	Copyright (c) 2018 Thomas Bella <thomas@bella.network>
+
+	MIT Licence
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <malloc.h>
+#include <cxxabi.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include "RscpMetrics.h"
+#include "SocketConnection.h"
+
+#ifndef RSCP_TRACK_ALLOCATIONS
+#error "RscpSoak must be built with -DRSCP_TRACK_ALLOCATIONS"
+#endif
+
+// growth of the live allocations of one call site which is tolerated, for example new keys of the json data
+#define SOAK_SITE_TOLERANCE     64
+// call sites listed in the report
+#define SOAK_REPORT_SITES       10
+
+// live data session of the client (RscpExampleMain.cpp built with RSCP_NO_MAIN)
+int runLiveSession(const char *host, int port, uint32_t cycles, uint32_t intervalMs, const char *targetFile);
+
+struct SCheckpoint {
+	uint64_t cycles;
+	uint64_t sessions;
+	uint64_t liveAllocations;
+	uint64_t liveBytes;
+	uint64_t untracked;
+	uint64_t rssKiB;
+	uint64_t heapUsed;
+	uint64_t heapFree;
+	std::map<const void *, SRscpAllocationSite> sites;
+};
+
+static uint64_t uiCycles = 1000000;
+static uint64_t uiCheckpointCycles = 20000;
+static uint32_t uiErrorRate = 50;
+static uint32_t uiDisconnectRate = 5000;
+static uint64_t uiRssGrowthKiB = 1024;
+static int iPort = 15033;
+static const char *cSimulator = "./RscpSimulator";
+static const char *cDirectory = "/tmp";
+static bool bVerbose = false;
+// the report, stdout is redirected because the client prints every injected error
+static FILE *report = stdout;
+
+static uint64_t residentKiB(void)
+{
+	unsigned long size = 0, resident = 0;
+	FILE *statm = fopen("/proc/self/statm", "r");
+	if(statm != NULL) {
+		if(fscanf(statm, "%lu %lu", &size, &resident) != 2) {
+			resident = 0;
+		}
+		fclose(statm);
+	}
+	return (uint64_t)resident * (sysconf(_SC_PAGE_SIZE) / 1024);
+}
+
+static void takeCheckpoint(SCheckpoint & checkpoint, uint64_t cycles, uint64_t sessions)
+{
+	checkpoint.cycles = cycles;
+	checkpoint.sessions = sessions;
+	checkpoint.liveAllocations = 0;
+	checkpoint.liveBytes = 0;
+	checkpoint.sites.clear();
+	std::vector<SRscpAllocationSite> sites;
+	checkpoint.untracked = RscpMetrics::getAllocationSites(sites);
+	for(size_t i = 0; i < sites.size(); ++i) {
+		checkpoint.liveAllocations += sites[i].liveAllocations;
+		checkpoint.liveBytes += sites[i].liveBytes;
+		checkpoint.sites[sites[i].site] = sites[i];
+	}
+	checkpoint.rssKiB = residentKiB();
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+	struct mallinfo2 info = mallinfo2();
+#else
+	struct mallinfo info = mallinfo();
+#endif
+	checkpoint.heapUsed = info.uordblks;
+	checkpoint.heapFree = info.fordblks;
+}
+
+static void printCheckpoint(const SCheckpoint & checkpoint)
+{
+	uint64_t uiHeap = checkpoint.heapUsed + checkpoint.heapFree;
+	fprintf(report, "%10llu %8llu %10llu %12llu %10llu %12llu %12llu %8.1f%%\n", (unsigned long long)checkpoint.cycles,
+			(unsigned long long)checkpoint.sessions, (unsigned long long)checkpoint.liveAllocations,
+			(unsigned long long)checkpoint.liveBytes, (unsigned long long)checkpoint.rssKiB,
+			(unsigned long long)checkpoint.heapUsed, (unsigned long long)checkpoint.heapFree,
+			uiHeap ? 100.0 * checkpoint.heapFree / uiHeap : 0.0);
+	fflush(report);
+}
+
+static std::string siteName(const void *site)
+{
+	Dl_info info;
+	char cName[512];
+	if(dladdr(site, &info) == 0) {
+		snprintf(cName, sizeof(cName), "%p", site);
+		return cName;
+	}
+	uintptr_t offset = (uintptr_t)site - (uintptr_t)info.dli_fbase;
+	if(info.dli_sname == NULL) {
+		snprintf(cName, sizeof(cName), "%s+0x%lx", info.dli_fname, (unsigned long)offset);
+		return cName;
+	}
+	int iStatus = 0;
+	char *demangled = abi::__cxa_demangle(info.dli_sname, NULL, NULL, &iStatus);
+	snprintf(cName, sizeof(cName), "%.400s (+0x%lx)", iStatus == 0 ? demangled : info.dli_sname, (unsigned long)offset);
+	free(demangled);
+	return cName;
+}
+
+// call sites whose live allocations grew since the baseline, largest growth of live bytes first
+static bool reportGrowth(const SCheckpoint & baseline, const SCheckpoint & last)
+{
+	struct SGrowth {
+		const void *site;
+		int64_t allocations;
+		int64_t bytes;
+	};
+	std::vector<SGrowth> growth;
+	for(std::map<const void *, SRscpAllocationSite>::const_iterator it = last.sites.begin(); it != last.sites.end(); ++it) {
+		std::map<const void *, SRscpAllocationSite>::const_iterator before = baseline.sites.find(it->first);
+		SGrowth site;
+		site.site = it->first;
+		site.allocations = it->second.liveAllocations - (before != baseline.sites.end() ? before->second.liveAllocations : 0);
+		site.bytes = it->second.liveBytes - (before != baseline.sites.end() ? before->second.liveBytes : 0);
+		if(site.allocations > 0) {
+			growth.push_back(site);
+		}
+	}
+	std::sort(growth.begin(), growth.end(), [](const SGrowth & a, const SGrowth & b) { return a.bytes > b.bytes; });
+
+	bool bLeak = false;
+	for(size_t i = 0; i < growth.size() && i < SOAK_REPORT_SITES; ++i) {
+		bool bSiteLeaks = growth[i].allocations > SOAK_SITE_TOLERANCE;
+		bLeak = bLeak || bSiteLeaks;
+		fprintf(report, "%s +%lld allocations +%lld bytes %s\n", bSiteLeaks ? "LEAK" : "    ", (long long)growth[i].allocations,
+				(long long)growth[i].bytes, siteName(growth[i].site).c_str());
+	}
+	for(size_t i = SOAK_REPORT_SITES; i < growth.size(); ++i) {
+		bLeak = bLeak || growth[i].allocations > SOAK_SITE_TOLERANCE;
+	}
+	return bLeak;
+}
+
+static pid_t startSimulator(void)
+{
+	pid_t pid = fork();
+	if(pid != 0) {
+		return pid;
+	}
+	std::string port = std::to_string(iPort);
+	std::string errors = std::to_string(uiErrorRate);
+	std::string disconnect = std::to_string(uiDisconnectRate);
+	execl(cSimulator, cSimulator, port.c_str(), "--errors", errors.c_str(), "--disconnect", disconnect.c_str(), (char *)NULL);
+	fprintf(stderr, "Cannot start %s. errno %i\n", cSimulator, errno);
+	_exit(EXIT_FAILURE);
+}
+
+static bool waitForSimulator(pid_t simulator)
+{
+	// a simulator which is still running from elsewhere would answer instead
+	usleep(10000);
+	if(waitpid(simulator, NULL, WNOHANG) == simulator) {
+		fprintf(report, "Port %i is in use\n", iPort);
+		return false;
+	}
+	for(int i = 0; i < 200; ++i) {
+		int iSocket = SocketConnect("127.0.0.1", iPort);
+		if(iSocket >= 0) {
+			SocketClose(iSocket);
+			return true;
+		}
+		usleep(10000);
+	}
+	return false;
+}
+
+int main(int argc, char *argv[])
+{
+	for(int i = 1; i < argc; ++i) {
+		if(strcmp(argv[i], "--verbose") == 0) {
+			bVerbose = true;
+		}
+		else if(i + 1 >= argc) {
+			printf("Unknown option %s\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+		else if(strcmp(argv[i], "--cycles") == 0) {
+			uiCycles = strtoull(argv[++i], NULL, 10);
+		}
+		else if(strcmp(argv[i], "--checkpoint") == 0) {
+			uiCheckpointCycles = strtoull(argv[++i], NULL, 10);
+		}
+		else if(strcmp(argv[i], "--errors") == 0) {
+			uiErrorRate = strtoul(argv[++i], NULL, 10);
+		}
+		else if(strcmp(argv[i], "--disconnect") == 0) {
+			uiDisconnectRate = strtoul(argv[++i], NULL, 10);
+		}
+		else if(strcmp(argv[i], "--rss-growth") == 0) {
+			uiRssGrowthKiB = strtoull(argv[++i], NULL, 10);
+		}
+		else if(strcmp(argv[i], "--port") == 0) {
+			iPort = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "--simulator") == 0) {
+			cSimulator = argv[++i];
+		}
+		else if(strcmp(argv[i], "--dir") == 0) {
+			cDirectory = argv[++i];
+		}
+		else {
+			printf("Unknown option %s\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+	}
+	if(uiCheckpointCycles == 0 || uiCycles < 2 * uiCheckpointCycles) {
+		printf("At least two checkpoints are required\n");
+		return EXIT_FAILURE;
+	}
+	if(!bVerbose) {
+		report = fdopen(dup(STDOUT_FILENO), "w");
+		int iNull = open("/dev/null", O_WRONLY);
+		if(report == NULL || iNull < 0) {
+			printf("Cannot redirect the output. errno %i\n", errno);
+			return EXIT_FAILURE;
+		}
+		dup2(iNull, STDOUT_FILENO);
+		close(iNull);
+	}
+
+	pid_t simulator = startSimulator();
+	if(simulator < 0 || !waitForSimulator(simulator)) {
+		fprintf(report, "Simulator did not start\n");
+		return EXIT_FAILURE;
+	}
+	fprintf(report, "Soak test: %llu cycles, one in %u values answered with an error, one in %u responses dropped\n",
+			(unsigned long long)uiCycles, uiErrorRate, uiDisconnectRate);
+	fprintf(report, "%10s %8s %10s %12s %10s %12s %12s %9s\n", "cycles", "sessions", "live", "live_bytes", "rss_kib",
+			"heap_used", "heap_free", "fragment");
+
+	// the first checkpoint ends the warm up and is the baseline
+	std::string target = std::string(cDirectory) + "/rscp_soak_" + std::to_string(getpid()) + ".json";
+	SCheckpoint baseline, last;
+	uint64_t uiDone = 0, uiSessions = 0;
+	uint32_t uiFailedConnects = 0;
+	bool bPassed = true;
+	while(uiDone < uiCycles) {
+		uint64_t uiNext = std::min(uiCycles, (uiDone / uiCheckpointCycles + 1) * uiCheckpointCycles);
+		int iSamples = runLiveSession("127.0.0.1", iPort, uiNext - uiDone, 0, target.c_str());
+		if(iSamples < 0) {
+			if(++uiFailedConnects > 10) {
+				fprintf(report, "Simulator not reachable\n");
+				bPassed = false;
+				break;
+			}
+			usleep(100000);
+			continue;
+		}
+		uiFailedConnects = 0;
+		++uiSessions;
+		uiDone += iSamples;
+		if(uiDone % uiCheckpointCycles != 0 && uiDone != uiCycles) {
+			continue;
+		}
+		takeCheckpoint(uiDone == uiCheckpointCycles ? baseline : last, uiDone, uiSessions);
+		printCheckpoint(uiDone == uiCheckpointCycles ? baseline : last);
+	}
+	unlink(target.c_str());
+	kill(simulator, SIGTERM);
+	waitpid(simulator, NULL, 0);
+	if(!bPassed) {
+		return EXIT_FAILURE;
+	}
+
+	const RscpHistogram & reconnect = RscpMetrics::histogram(eStageReconnect);
+	if(reconnect.count() > 0) {
+		fprintf(report, "%llu reconnects, gap p50 %.3f ms, p99 %.3f ms, max %.3f ms\n", (unsigned long long)reconnect.count(),
+				reconnect.percentile(0.5) / 1e6, reconnect.percentile(0.99) / 1e6, reconnect.max() / 1e6);
+	}
+
+	bool bLeak = reportGrowth(baseline, last);
+	bool bRssGrowth = last.rssKiB > baseline.rssKiB + uiRssGrowthKiB;
+	if(bRssGrowth) {
+		fprintf(report, "RSS grew from %llu KiB to %llu KiB\n", (unsigned long long)baseline.rssKiB, (unsigned long long)last.rssKiB);
+	}
+	if(last.untracked > 0) {
+		fprintf(report, "%llu allocations were not tracked\n", (unsigned long long)last.untracked);
+	}
+	fprintf(report, "Soak test %s\n", (bLeak || bRssGrowth) ? "FAILED" : "passed");
+	fflush(report);
+	return (bLeak || bRssGrowth) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
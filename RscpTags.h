@@ -194,11 +194,14 @@
 #define TAG_BAT_DCB_COUNT                                   	0x0380000D
 #define TAG_BAT_MAX_DCB_CELL_TEMPERATURE                    	0x03800016
 #define TAG_BAT_MIN_DCB_CELL_TEMPERATURE                    	0x03800017
+#define TAG_BAT_DCB_ALL_CELL_TEMPERATURES                   	0x03800018
 #define TAG_BAT_DCB_CELL_TEMPERATURE                        	0x03800019
+#define TAG_BAT_DCB_ALL_CELL_VOLTAGES                       	0x0380001A
 #define TAG_BAT_DCB_CELL_VOLTAGE                            	0x0380001B
 #define TAG_BAT_READY_FOR_SHUTDOWN                          	0x0380001E
 #define TAG_BAT_INFO                                        	0x03800020
 #define TAG_BAT_TRAINING_MODE                               	0x03800021
+#define TAG_BAT_DCB_INFO                                    	0x03800042
 #define TAG_BAT_REQ_RSOC                                    	0x03000001
 #define TAG_BAT_REQ_MODULE_VOLTAGE                          	0x03000002
 #define TAG_BAT_REQ_CURRENT                                 	0x03000003
@@ -214,9 +217,12 @@
 #define TAG_BAT_REQ_DCB_COUNT                               	0x0300000D
 #define TAG_BAT_REQ_MAX_DCB_CELL_TEMPERATURE                	0x03000016
 #define TAG_BAT_REQ_MIN_DCB_CELL_TEMPERATURE                	0x03000017
+#define TAG_BAT_REQ_DCB_ALL_CELL_TEMPERATURES               	0x03000018
+#define TAG_BAT_REQ_DCB_ALL_CELL_VOLTAGES                   	0x0300001A
 #define TAG_BAT_REQ_READY_FOR_SHUTDOWN                      	0x0300001E
 #define TAG_BAT_REQ_INFO                                    	0x03000020
 #define TAG_BAT_REQ_TRAINING_MODE                           	0x03000021
+#define TAG_BAT_REQ_DCB_INFO                                	0x03000042
 #define TAG_BAT_DCB_INDEX                                   	0x03800100
 #define TAG_BAT_DCB_LAST_MESSAGE_TIMESTAMP                  	0x03800101
 #define TAG_BAT_DCB_MAX_CHARGE_VOLTAGE                      	0x03800102
@@ -242,6 +248,8 @@
 #define TAG_BAT_DCB_FW_VERSION                              	0x03800122
 #define TAG_BAT_DCB_DATA_TABLE_VERSION                      	0x03800123
 #define TAG_BAT_DCB_PCB_VERSION                             	0x03800124
+#define TAG_BAT_DCB_NR_SERIES_CELL                          	0x03800125
+#define TAG_BAT_DCB_NR_PARALLEL_CELL                        	0x03800126
 #define TAG_BAT_REQ_DEVICE_STATE                            	0x03060000
 #define TAG_BAT_DEVICE_STATE                                	0x03860000
 #define TAG_BAT_DEVICE_CONNECTED                            	0x03860001
@@ -0,0 +1,320 @@
+/*
+ * RscpTopology.cpp
+ *
+ * Discovery of the devices attached to the E3DC system.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "RscpTopology.h"
+#include "RscpTags.h"
+
+namespace {
+int64_t getValueAsInteger(RscpProtocol *protocol, const SRscpValue *value) {
+	switch(value->dataType) {
+	case RSCP::eTypeBool:
+		return protocol->getValueAsBool(value);
+	case RSCP::eTypeChar8:
+		return protocol->getValueAsChar8(value);
+	case RSCP::eTypeUChar8:
+		return protocol->getValueAsUChar8(value);
+	case RSCP::eTypeInt16:
+		return protocol->getValueAsInt16(value);
+	case RSCP::eTypeUInt16:
+		return protocol->getValueAsUInt16(value);
+	case RSCP::eTypeInt32:
+		return protocol->getValueAsInt32(value);
+	case RSCP::eTypeUInt32:
+		return protocol->getValueAsUInt32(value);
+	case RSCP::eTypeInt64:
+		return protocol->getValueAsInt64(value);
+	case RSCP::eTypeUInt64:
+		return protocol->getValueAsUInt64(value);
+	default:
+		return 0;
+	}
+}
+
+// the device state is either a single bool or a container with the connected flag
+bool isConnected(RscpProtocol *protocol, const SRscpValue *state, const SRscpTag & connectedTag) {
+	if(state->dataType == RSCP::eTypeBool) {
+		return protocol->getValueAsBool(state);
+	}
+	if(state->dataType != RSCP::eTypeContainer) {
+		return false;
+	}
+	bool bConnected = false;
+	std::vector<SRscpValue> data = protocol->getValueAsContainer(state);
+	for(size_t i = 0; i < data.size(); ++i) {
+		if((data[i].tag == connectedTag) && (data[i].dataType == RSCP::eTypeBool)) {
+			bConnected = protocol->getValueAsBool(&data[i]);
+		}
+	}
+	protocol->destroyValueData(data);
+	return bConnected;
+}
+
+void appendDeviceRequest(RscpProtocol *protocol, SRscpValue *rootValue, const SRscpTag & containerTag, const SRscpTag & indexTag,
+		uint8_t index, const SRscpTag *requests, size_t count) {
+	SRscpValue container;
+	protocol->createContainerValue(&container, containerTag);
+	protocol->appendValue(&container, indexTag, index);
+	for(size_t i = 0; i < count; ++i) {
+		protocol->appendValue(&container, requests[i]);
+	}
+	protocol->appendValue(rootValue, container);
+	protocol->destroyValueData(container);
+}
+}
+
+SRscpTopology::SRscpTopology() {
+	setDefault();
+}
+
+void SRscpTopology::setDefault() {
+	valid = false;
+	battery = true;
+	dcbCount = 0;
+	batteries.assign(1, std::make_pair((uint8_t)0, (uint8_t)0));
+	pviStrings = 1;
+	pviPhases = 3;
+	pviTemperatures = 0;
+	dcdcs.assign(1, 0);
+	powerMeters.assign(1, 0);
+	wallboxes.clear();
+	sysSpecs.clear();
+}
+
+int32_t SRscpTopology::appendDiscoveryRequest(RscpProtocol *protocol, SRscpValue *rootValue) {
+	// start from an empty topology, everything which is not answered does not exist
+	valid = false;
+	battery = false;
+	dcbCount = 0;
+	batteries.clear();
+	pviStrings = 0;
+	pviPhases = 0;
+	pviTemperatures = 0;
+	dcdcs.clear();
+	powerMeters.clear();
+	wallboxes.clear();
+	sysSpecs.clear();
+
+	const SRscpTag batRequests[] = { TAG_BAT_REQ_DCB_COUNT };
+	for(uint8_t i = 0; i < RSCP_TOPOLOGY_MAX_BAT; ++i) {
+		appendDeviceRequest(protocol, rootValue, TAG_BAT_REQ_DATA, TAG_BAT_INDEX, i, batRequests, 1);
+	}
+	const SRscpTag pviRequests[] = { TAG_PVI_REQ_DC_MAX_STRING_COUNT, TAG_PVI_REQ_AC_MAX_PHASE_COUNT, TAG_PVI_REQ_TEMPERATURE_COUNT };
+	appendDeviceRequest(protocol, rootValue, TAG_PVI_REQ_DATA, TAG_PVI_INDEX, 0, pviRequests, 3);
+	const SRscpTag dcdcRequests[] = { TAG_DCDC_REQ_DEVICE_STATE };
+	for(uint8_t i = 0; i < RSCP_TOPOLOGY_MAX_DCDC; ++i) {
+		appendDeviceRequest(protocol, rootValue, TAG_DCDC_REQ_DATA, TAG_DCDC_INDEX, i, dcdcRequests, 1);
+	}
+	const SRscpTag pmRequests[] = { TAG_PM_REQ_DEVICE_STATE };
+	for(uint8_t i = 0; i < RSCP_TOPOLOGY_MAX_PM; ++i) {
+		appendDeviceRequest(protocol, rootValue, TAG_PM_REQ_DATA, TAG_PM_INDEX, i, pmRequests, 1);
+	}
+	const SRscpTag wbRequests[] = { TAG_WB_REQ_DEVICE_STATE };
+	for(uint8_t i = 0; i < RSCP_TOPOLOGY_MAX_WB; ++i) {
+		appendDeviceRequest(protocol, rootValue, TAG_WB_REQ_DATA, TAG_WB_INDEX, i, wbRequests, 1);
+	}
+	return protocol->appendValue(rootValue, TAG_EMS_REQ_GET_SYS_SPECS);
+}
+
+int32_t SRscpTopology::handleDiscoveryResponse(RscpProtocol *protocol, const SRscpValue *response) {
+	if(response->dataType == RSCP::eTypeError) {
+		// a missing device class is not an error of the discovery
+		return RSCP::OK;
+	}
+	if(response->dataType != RSCP::eTypeContainer) {
+		return RSCP::ERR_INVALID_INPUT;
+	}
+	std::vector<SRscpValue> data = protocol->getValueAsContainer(response);
+	int64_t index = 0;
+	for(size_t i = 0; i < data.size(); ++i) {
+		const SRscpValue *value = &data[i];
+		if(value->dataType == RSCP::eTypeError) {
+			continue;
+		}
+		switch(value->tag) {
+		case TAG_BAT_INDEX:
+		case TAG_DCDC_INDEX:
+		case TAG_PM_INDEX:
+		case TAG_WB_INDEX:
+			index = getValueAsInteger(protocol, value);
+			break;
+		case TAG_BAT_DCB_COUNT:
+			// the live values are polled from battery 0, the modules of every battery are polled by the battery detail
+			batteries.push_back(std::make_pair((uint8_t)index, (uint8_t)getValueAsInteger(protocol, value)));
+			if(index == 0) {
+				battery = true;
+				dcbCount = batteries.back().second;
+			}
+			break;
+		case TAG_PVI_DC_MAX_STRING_COUNT:
+			pviStrings = getValueAsInteger(protocol, value);
+			break;
+		case TAG_PVI_AC_MAX_PHASE_COUNT:
+			pviPhases = getValueAsInteger(protocol, value);
+			break;
+		case TAG_PVI_TEMPERATURE_COUNT:
+			pviTemperatures = getValueAsInteger(protocol, value);
+			break;
+		case TAG_DCDC_DEVICE_STATE:
+			if(isConnected(protocol, value, TAG_DCDC_DEVICE_CONNECTED)) {
+				dcdcs.push_back(index);
+			}
+			break;
+		case TAG_PM_DEVICE_STATE:
+			if(isConnected(protocol, value, TAG_PM_DEVICE_CONNECTED)) {
+				powerMeters.push_back(index);
+			}
+			break;
+		case TAG_WB_DEVICE_STATE:
+			if(isConnected(protocol, value, TAG_WB_DEVICE_CONNECTED)) {
+				wallboxes.push_back(index);
+			}
+			break;
+		case TAG_EMS_SYS_SPEC:
+		{
+			std::string name;
+			bool bHasValue = false;
+			int64_t specValue = 0;
+			std::vector<SRscpValue> spec = protocol->getValueAsContainer(value);
+			for(size_t n = 0; n < spec.size(); ++n) {
+				if(spec[n].tag == TAG_EMS_SYS_SPEC_NAME) {
+					name = protocol->getValueAsString(&spec[n]);
+				}
+				else if(spec[n].tag == TAG_EMS_SYS_SPEC_VALUE_INT) {
+					specValue = getValueAsInteger(protocol, &spec[n]);
+					bHasValue = true;
+				}
+			}
+			protocol->destroyValueData(spec);
+			// names are stored space separated in the cache file
+			if(bHasValue && !name.empty() && (name.find_first_of(" \t\n") == std::string::npos)) {
+				sysSpecs.push_back(std::make_pair(name, specValue));
+			}
+			break;
+		}
+		default:
+			break;
+		}
+	}
+	protocol->destroyValueData(data);
+	valid = true;
+	return RSCP::OK;
+}
+
+bool SRscpTopology::load(const char *file, const std::string & device) {
+	FILE *cache = fopen(file, "r");
+	if(cache == NULL) {
+		return false;
+	}
+	SRscpTopology topology;
+	bool bSameDevice = false;
+	int iVersion = 0;
+	char cLine[256];
+	while(fgets(cLine, sizeof(cLine), cache) != NULL) {
+		char cKey[32];
+		char cText[128];
+		int iValue = 0;
+		int iOffset = 0;
+		if(sscanf(cLine, "%31s%n", cKey, &iOffset) != 1) {
+			continue;
+		}
+		const char *cArguments = cLine + iOffset;
+		if(strcmp(cKey, "version") == 0 && sscanf(cArguments, "%i", &iValue) == 1) {
+			iVersion = iValue;
+		}
+		else if(strcmp(cKey, "device") == 0) {
+			bSameDevice = (sscanf(cArguments, "%127s", cText) == 1) && (device == cText);
+		}
+		else if(strcmp(cKey, "battery") == 0 && sscanf(cArguments, "%i", &iValue) == 1) {
+			topology.battery = (iValue != 0);
+		}
+		else if(strcmp(cKey, "dcb_count") == 0 && sscanf(cArguments, "%i", &iValue) == 1) {
+			topology.dcbCount = iValue;
+		}
+		else if(strcmp(cKey, "batteries") == 0) {
+			topology.batteries.clear();
+			int iCount = 0;
+			int iRead = 0;
+			while(sscanf(cArguments, "%i:%i%n", &iValue, &iCount, &iRead) == 2) {
+				topology.batteries.push_back(std::make_pair((uint8_t)iValue, (uint8_t)iCount));
+				cArguments += iRead;
+			}
+		}
+		else if(strcmp(cKey, "pvi_strings") == 0 && sscanf(cArguments, "%i", &iValue) == 1) {
+			topology.pviStrings = iValue;
+		}
+		else if(strcmp(cKey, "pvi_phases") == 0 && sscanf(cArguments, "%i", &iValue) == 1) {
+			topology.pviPhases = iValue;
+		}
+		else if(strcmp(cKey, "pvi_temperatures") == 0 && sscanf(cArguments, "%i", &iValue) == 1) {
+			topology.pviTemperatures = iValue;
+		}
+		else if(strcmp(cKey, "dcdcs") == 0 || strcmp(cKey, "power_meters") == 0 || strcmp(cKey, "wallboxes") == 0) {
+			std::vector<uint8_t> & indexes = (cKey[0] == 'd') ? topology.dcdcs : (cKey[0] == 'p') ? topology.powerMeters : topology.wallboxes;
+			indexes.clear();
+			int iRead = 0;
+			while(sscanf(cArguments, "%i%n", &iValue, &iRead) == 1) {
+				indexes.push_back(iValue);
+				cArguments += iRead;
+			}
+		}
+		else if(strcmp(cKey, "spec") == 0) {
+			int64_t specValue = 0;
+			if(sscanf(cArguments, "%127s %" SCNd64, cText, &specValue) == 2) {
+				topology.sysSpecs.push_back(std::make_pair(std::string(cText), specValue));
+			}
+		}
+	}
+	fclose(cache);
+	// an older cache lacks values of the current discovery, e.g. the PV temperature sensors
+	if(!bSameDevice || iVersion != RSCP_TOPOLOGY_CACHE_VERSION) {
+		return false;
+	}
+	*this = topology;
+	valid = true;
+	return true;
+}
+
+bool SRscpTopology::save(const char *file, const std::string & device) const {
+	// write to a temporary file first and rename it afterwards so a crash never leaves a broken cache
+	std::string tmpFile = std::string(file) + ".tmp";
+	FILE *cache = fopen(tmpFile.c_str(), "w");
+	if(cache == NULL) {
+		printf("Cannot write topology cache %s\n", tmpFile.c_str());
+		return false;
+	}
+	fprintf(cache, "version %i\n", RSCP_TOPOLOGY_CACHE_VERSION);
+	fprintf(cache, "device %s\n", device.c_str());
+	fprintf(cache, "battery %i\n", battery ? 1 : 0);
+	fprintf(cache, "dcb_count %u\n", dcbCount);
+	fprintf(cache, "batteries");
+	for(size_t i = 0; i < batteries.size(); ++i) {
+		fprintf(cache, " %u:%u", batteries[i].first, batteries[i].second);
+	}
+	fprintf(cache, "\npvi_strings %u\n", pviStrings);
+	fprintf(cache, "pvi_phases %u\n", pviPhases);
+	fprintf(cache, "pvi_temperatures %u\n", pviTemperatures);
+	fprintf(cache, "dcdcs");
+	for(size_t i = 0; i < dcdcs.size(); ++i) {
+		fprintf(cache, " %u", dcdcs[i]);
+	}
+	fprintf(cache, "\npower_meters");
+	for(size_t i = 0; i < powerMeters.size(); ++i) {
+		fprintf(cache, " %u", powerMeters[i]);
+	}
+	fprintf(cache, "\nwallboxes");
+	for(size_t i = 0; i < wallboxes.size(); ++i) {
+		fprintf(cache, " %u", wallboxes[i]);
+	}
+	fprintf(cache, "\n");
+	for(size_t i = 0; i < sysSpecs.size(); ++i) {
+		fprintf(cache, "spec %s %" PRId64 "\n", sysSpecs[i].first.c_str(), sysSpecs[i].second);
+	}
+	fclose(cache);
+	return (rename(tmpFile.c_str(), file) == 0);
+}
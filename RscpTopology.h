@@ -0,0 +1,78 @@
+/*
+ * RscpTopology.h
+ *
+ * Discovery of the devices attached to the E3DC system. All discovery requests are sent in one frame
+ * after the authentication, the result is cached on disk so a restart does not need the round trip again.
+ */
+
+#ifndef RSCPTOPOLOGY_H_
+#define RSCPTOPOLOGY_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+#include "RscpProtocol.h"
+
+/*
+ * Number of battery, DC/DC converter, power meter and wallbox indexes which are probed.
+ */
+#define RSCP_TOPOLOGY_MAX_BAT   4
+#define RSCP_TOPOLOGY_MAX_DCDC  4
+#define RSCP_TOPOLOGY_MAX_PM    4
+#define RSCP_TOPOLOGY_MAX_WB    4
+
+/*
+ * Format of the topology cache, incremented with every new value of the discovery. A cache of another version is
+ * not loaded, so the device is discovered again instead of using the cache without the new value.
+ */
+#define RSCP_TOPOLOGY_CACHE_VERSION 1
+
+struct SRscpTopology {
+	// true if the topology was discovered or loaded from the cache
+	bool valid;
+	// battery index 0 answered and its number of DCB modules
+	bool battery;
+	uint8_t dcbCount;
+	// index and number of DCB modules of every battery which answered
+	std::vector<std::pair<uint8_t, uint8_t> > batteries;
+	// PV inverter index 0: number of DC strings (MPP trackers), AC phases and temperature sensors
+	uint8_t pviStrings;
+	uint8_t pviPhases;
+	uint8_t pviTemperatures;
+	// indexes of connected DC/DC converters, power meters and wallboxes
+	std::vector<uint8_t> dcdcs;
+	std::vector<uint8_t> powerMeters;
+	std::vector<uint8_t> wallboxes;
+	// integer system specifications of TAG_EMS_REQ_GET_SYS_SPECS by name
+	std::vector<std::pair<std::string, int64_t> > sysSpecs;
+
+	SRscpTopology();
+	/*
+	 * \brief Topology which is used if the discovery fails: one battery without known modules and its DC/DC
+	 *        converter, one PV string and power meter 0. It is not valid, so it is neither cached nor kept
+	 *        for the next session.
+	 */
+	void setDefault();
+	/*
+	 * \brief Append the requests of the discovery to \var rootValue.
+	 * @return - RSCP error code if the function fails else RSCP::OK
+	 */
+	int32_t appendDiscoveryRequest(RscpProtocol *protocol, SRscpValue *rootValue);
+	/*
+	 * \brief Handle one value of the response frame of the discovery request.
+	 * @return - RSCP error code if the value could not be decoded else RSCP::OK
+	 */
+	int32_t handleDiscoveryResponse(RscpProtocol *protocol, const SRscpValue *response);
+	/*
+	 * \brief Load the topology of \var device from \var file.
+	 * @return - false if the file does not exist, belongs to another device or has another version
+	 */
+	bool load(const char *file, const std::string & device);
+	/*
+	 * \brief Store the topology of \var device in \var file.
+	 */
+	bool save(const char *file, const std::string & device) const;
+};
+
+#endif /* RSCPTOPOLOGY_H_ */
@@ -5,6 +5,8 @@
 #include <stdint.h>
 
 #define RSCP_MAX_FRAME_LENGTH       (sizeof(SRscpFrameHeader) + 0xFFFF + sizeof(SRscpFrame::CRC))
+// block size of the RSCP encryption (Rijndael with 256 bit blocks), encrypted frames are zero padded to it
+#define RSCP_CIPHER_BLOCK_SIZE      32
 
 namespace RSCP {
 const uint16_t	MAGIC	= 0xDCE3;
@@ -59,12 +61,20 @@ enum eRscpErrorCodes {
 	RSCP_ERR_ALREADY_IN_USE = 0x08
 };
 
+// the structs hold the fields in host byte order, RscpCodec.h converts them from and to the wire format
 union SRscpControl {
 	struct {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		uint8_t reserved_1 : 3;
+		uint8_t crc : 1;
+		uint8_t version : 4;
+		uint8_t reserved_2 : 8;
+#else
 		uint8_t reserved_2 : 8;
 		uint8_t version : 4;
 		uint8_t crc : 1;
 		uint8_t reserved_1 : 3;
+#endif
 	} bits;
 	uint16_t value;
 } __attribute__((packed));
@@ -79,7 +89,7 @@ typedef uint32_t SRscpTag;
 struct SRscpValue {
 	union  {
 		struct {
-#ifdef __BIG_ENDIAN__
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
 			uint8_t nameSpace : 8;
 			uint8_t tagType : 1;
 			uint32_t tagSpace : 23;
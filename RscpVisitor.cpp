@@ -0,0 +1,78 @@
+/*
+ * RscpVisitor.cpp
+ *
+ * Path filter of the walk over serialized RSCP values.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "RscpVisitor.h"
+
+RscpPathFilter::RscpPathFilter(RscpVisitor & target) : target(target), matchedDepth(UINT32_MAX) {
+	memset(alive, 0, sizeof(alive));
+}
+
+bool RscpPathFilter::addPath(std::initializer_list<SRscpTag> path) {
+	return addPath(path.begin(), path.size());
+}
+
+bool RscpPathFilter::addPath(const SRscpTag *path, uint32_t depth) {
+	if(path == NULL || depth == 0 || depth > RSCP_VISIT_MAX_DEPTH || paths.size() == RSCP_PATH_FILTER_MAX) {
+		return false;
+	}
+	// every path starts at the values of the frame
+	alive[0] |= 1U << paths.size();
+	paths.push_back(std::vector<SRscpTag>(path, path + depth));
+	return true;
+}
+
+RscpPathFilter::EMatch RscpPathFilter::match(SRscpTag tag, uint32_t depth) const {
+	// only the paths which match the entered containers are compared
+	EMatch result = eMatchNone;
+	for(uint32_t uiAlive = alive[depth]; uiAlive != 0 && result != eMatchFull; uiAlive &= uiAlive - 1) {
+		const std::vector<SRscpTag> & path = paths[__builtin_ctz(uiAlive)];
+		if(path[depth] == tag || path[depth] == RSCP_PATH_ANY) {
+			result = (path.size() == depth + 1) ? eMatchFull : eMatchPrefix;
+		}
+	}
+	return result;
+}
+
+bool RscpPathFilter::enterContainer(const SRscpValue & container, uint32_t depth) {
+	if(matchedDepth < depth) {
+		return target.enterContainer(container, depth);
+	}
+	if(depth >= RSCP_VISIT_MAX_DEPTH) {
+		return false;
+	}
+	EMatch eMatch = match(container.tag, depth);
+	if(eMatch == eMatchNone || !target.enterContainer(container, depth)) {
+		return false;
+	}
+	if(eMatch == eMatchFull) {
+		matchedDepth = depth;
+		return true;
+	}
+	// the paths which continue inside the container
+	alive[depth + 1] = 0;
+	for(uint32_t uiAlive = alive[depth]; uiAlive != 0; uiAlive &= uiAlive - 1) {
+		uint32_t p = __builtin_ctz(uiAlive);
+		if(paths[p].size() > depth + 1 && (paths[p][depth] == container.tag || paths[p][depth] == RSCP_PATH_ANY)) {
+			alive[depth + 1] |= 1U << p;
+		}
+	}
+	return true;
+}
+
+void RscpPathFilter::value(const SRscpValue & value, uint32_t depth) {
+	if(matchedDepth < depth || match(value.tag, depth) == eMatchFull) {
+		target.value(value, depth);
+	}
+}
+
+void RscpPathFilter::leaveContainer(const SRscpValue & container, uint32_t depth) {
+	if(matchedDepth == depth) {
+		matchedDepth = UINT32_MAX;
+	}
+	target.leaveContainer(container, depth);
+}
@@ -0,0 +1,85 @@
+/*
+ * RscpVisitor.h
+ *
+ * Events of a single walk over serialized RSCP values (RscpProtocol::visitData and visitFrame). The walk reports
+ * every container when it is entered and left and every other value in between, in the order of the buffer. The
+ * values are views: their data points into the walked buffer, nothing is allocated, copied or has to be destroyed.
+ * A container whose values are not of interest is skipped as a whole by its length.
+ */
+
+#ifndef RSCPVISITOR_H_
+#define RSCPVISITOR_H_
+
+#include <initializer_list>
+#include <stdint.h>
+#include <vector>
+#include "RscpTypes.h"
+
+/*
+ * Deepest nesting of containers a walk follows, deeper data is rejected with RSCP::ERR_DATA_LIMIT_EXCEEDED.
+ */
+#define RSCP_VISIT_MAX_DEPTH    16
+/*
+ * Path element of RscpPathFilter which matches every tag at its level.
+ */
+#define RSCP_PATH_ANY           0xFFFFFFFF
+/*
+ * Paths of one RscpPathFilter at most.
+ */
+#define RSCP_PATH_FILTER_MAX    32
+
+class RscpVisitor {
+public:
+	virtual ~RscpVisitor() {}
+	/*
+	 * \brief The container \var container at \var depth starts, the values of the frame have depth 0.
+	 * @return - false to skip the values inside the container, it is not left then
+	 */
+	virtual bool enterContainer(const SRscpValue & container, uint32_t depth) { return true; }
+	/*
+	 * \brief A value which is no container, its data is valid as long as the walked buffer.
+	 */
+	virtual void value(const SRscpValue & value, uint32_t depth) = 0;
+	/*
+	 * \brief All values of the container which was entered at \var depth are reported.
+	 */
+	virtual void leaveContainer(const SRscpValue & container, uint32_t depth) {}
+};
+
+/*
+ * Visitor which passes only the values at the added tag paths to \var target, for example
+ * { TAG_BAT_DATA, TAG_BAT_RSOC }. A path which ends at a container passes the container with all its values.
+ * The containers on the way to a path are entered and left at \var target as well, every other container is
+ * skipped by its length without reading its values.
+ */
+class RscpPathFilter : public RscpVisitor {
+public:
+	explicit RscpPathFilter(RscpVisitor & target);
+	/*
+	 * \brief Add a path of tags from the values of the frame downwards, RSCP_PATH_ANY matches every tag.
+	 *        The paths are added before a walk, the walk itself does not allocate.
+	 * @return - false if the path is empty, deeper than RSCP_VISIT_MAX_DEPTH or RSCP_PATH_FILTER_MAX paths are added
+	 */
+	bool addPath(std::initializer_list<SRscpTag> path);
+	bool addPath(const SRscpTag *path, uint32_t depth);
+
+	bool enterContainer(const SRscpValue & container, uint32_t depth);
+	void value(const SRscpValue & value, uint32_t depth);
+	void leaveContainer(const SRscpValue & container, uint32_t depth);
+private:
+	enum EMatch {
+		eMatchNone = 0,     // on no path, skipped
+		eMatchPrefix,       // a container on the way to a path
+		eMatchFull          // the end of a path, passed with everything inside
+	};
+	EMatch match(SRscpTag tag, uint32_t depth) const;
+
+	RscpVisitor & target;
+	std::vector<std::vector<SRscpTag> > paths;
+	// one bit per path which matches all entered containers up to the depth
+	uint32_t alive[RSCP_VISIT_MAX_DEPTH + 1];
+	// depth of the entered container at the end of a path, everything below it passes, UINT32_MAX if none
+	uint32_t matchedDepth;
+};
+
+#endif /* RSCPVISITOR_H_ */
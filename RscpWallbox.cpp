@@ -0,0 +1,159 @@
+/*
+ * RscpWallbox.cpp
+ *
+ * Solar surplus charging of a wallbox.
+ */
+
+#include <string.h>
+#include "RscpWallbox.h"
+#include "RscpProtocol.h"
+#include "RscpRequestImage.h"
+#include "RscpVisitor.h"
+#include "RscpMetrics.h"
+#include "RscpTags.h"
+
+namespace {
+// wallbox index 0, sun mode and current 0, both are patched for every setpoint
+typedef RscpRequestImage<
+	RscpContainer<TAG_WB_REQ_DATA,
+		RscpUChar8<TAG_WB_INDEX, 0>,
+		RscpContainer<TAG_WB_REQ_SET_EXTERN,
+			RscpByteArray<TAG_WB_EXTERN_DATA, RSCP_WALLBOX_MODE_SUN, 0, 0, 0, 0, 0>,
+			RscpUChar8<TAG_WB_EXTERN_DATA_LEN, RSCP_WALLBOX_EXTERN_DATA_SIZE> > > > SetExternRequest;
+// the index is the data of the first value inside TAG_WB_REQ_DATA, behind two value headers
+#define SET_EXTERN_INDEX_OFFSET     (2 * RSCP_VALUE_HEADER_SIZE)
+// the extern data follows the index and the header of TAG_WB_REQ_SET_EXTERN, its second byte is the current
+#define SET_EXTERN_CURRENT_OFFSET   (4 * RSCP_VALUE_HEADER_SIZE + 1 + 1)
+
+// the response is TAG_WB_DATA with the index and TAG_WB_SET_EXTERN, an error answers either of them
+class SetExternResponse : public RscpVisitor {
+public:
+	SetExternResponse() : answered(false), accepted(false) {}
+	void value(const SRscpValue & value, uint32_t depth) {
+		if(value.tag == TAG_WB_SET_EXTERN || value.tag == TAG_WB_DATA || value.tag == TAG_WB_REQ_SET_EXTERN) {
+			answered = true;
+			accepted = (value.dataType != RSCP::eTypeError);
+		}
+	}
+	bool answered;
+	bool accepted;
+};
+}
+
+RscpWallboxControl::RscpWallboxControl(uint8_t index, int32_t batteryReserve, uint8_t minCurrent, uint8_t maxCurrent) :
+		index(index), batteryReserve(batteryReserve), minCurrent(minCurrent), maxCurrent(maxCurrent),
+		sampleTime(0), sampleValues(0), pvPower(0), addPower(0), homePower(0), activePhases(0), lastSurplus(0),
+		lastCurrent(-1), posted(0), rejectedSeen(0), acceptedCount(0), rejectedCount(0) {
+	static_assert(sizeof(request) >= SetExternRequest::size, "the request buffer is too small for TAG_WB_REQ_SET_EXTERN");
+	memcpy(request, SetExternRequest::data, SetExternRequest::size);
+}
+
+void RscpWallboxControl::beginSample(int64_t received) {
+	sampleTime = received;
+	sampleValues = 0;
+}
+
+void RscpWallboxControl::setPower(SRscpTag tag, int32_t power) {
+	switch(tag) {
+	case TAG_EMS_POWER_PV:
+		pvPower = power;
+		sampleValues |= eHasPV;
+		break;
+	case TAG_EMS_POWER_ADD:
+		addPower = power;
+		sampleValues |= eHasAdd;
+		break;
+	case TAG_EMS_POWER_HOME:
+		homePower = power;
+		sampleValues |= eHasHome;
+		break;
+	default:
+		break;
+	}
+}
+
+void RscpWallboxControl::setActivePhases(uint8_t wallbox, uint8_t phases) {
+	if(wallbox == index) {
+		activePhases = phases;
+	}
+}
+
+bool RscpWallboxControl::endSample() {
+	// a rejected setpoint is not the current of the wallbox, the next sample sends it again
+	uint64_t uiRejected = rejectedCount.load(std::memory_order_relaxed);
+	if(uiRejected != rejectedSeen) {
+		rejectedSeen = uiRejected;
+		lastCurrent = -1;
+	}
+	if(sampleValues != eHasAll) {
+		return false;
+	}
+	// the home consumption does not contain the wallbox, so its own charge power does not feed back
+	lastSurplus = pvPower + addPower - homePower - batteryReserve;
+	// the phases are counted from the bits, a wallbox which did not answer yet is assumed to charge on three
+	uint8_t ucPhases = (activePhases & 1) + ((activePhases >> 1) & 1) + ((activePhases >> 2) & 1);
+	uint8_t ucCurrent = chargeCurrent(lastSurplus, (ucPhases > 0) ? ucPhases : 3, minCurrent, maxCurrent);
+	if(ucCurrent == lastCurrent) {
+		return false;
+	}
+	SRscpWallboxSetpoint setpoint;
+	setpoint.index = index;
+	setpoint.current = ucCurrent;
+	setpoint.surplus = lastSurplus;
+	setpoint.sampled = sampleTime;
+	if(!pending.push(setpoint)) {
+		// the I/O thread did not take the previous setpoints, the next sample tries again
+		return false;
+	}
+	lastCurrent = ucCurrent;
+	++posted;
+	return true;
+}
+
+bool RscpWallboxControl::takeSetpoint(SRscpWallboxSetpoint & setpoint) {
+	bool bPending = false;
+	while(pending.pop(setpoint)) {
+		bPending = true;
+	}
+	return bPending;
+}
+
+const uint8_t * RscpWallboxControl::createRequest(const SRscpWallboxSetpoint & setpoint, uint16_t & length) {
+	request[SET_EXTERN_INDEX_OFFSET] = setpoint.index;
+	request[SET_EXTERN_CURRENT_OFFSET] = setpoint.current;
+	length = SetExternRequest::size;
+	return request;
+}
+
+int32_t RscpWallboxControl::handleResponse(const uint8_t *data, uint32_t length, const SRscpWallboxSetpoint & setpoint) {
+	RscpProtocol protocol;
+	SetExternResponse response;
+	// the CRC was checked already while the frame was decrypted (RscpDecryptor)
+	int32_t iResult = protocol.visitFrame(data, length, response, false);
+	if(iResult < 0) {
+		return iResult;
+	}
+	if(response.answered && response.accepted) {
+		RscpMetrics::record(eStageWallbox, setpoint.sampled);
+		acceptedCount.fetch_add(1, std::memory_order_relaxed);
+	}
+	else {
+		failed();
+	}
+	return iResult;
+}
+
+void RscpWallboxControl::failed() {
+	rejectedCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint8_t RscpWallboxControl::chargeCurrent(int32_t surplus, uint8_t phases, uint8_t minCurrent, uint8_t maxCurrent) {
+	if(phases == 0 || surplus <= 0) {
+		return 0;
+	}
+	int32_t iCurrent = surplus / (phases * RSCP_WALLBOX_PHASE_VOLTAGE);
+	if(iCurrent < minCurrent) {
+		return 0;
+	}
+	return (iCurrent > maxCurrent) ? maxCurrent : (uint8_t)iCurrent;
+}
@@ -0,0 +1,129 @@
+/*
+ * RscpWallbox.h
+ *
+ * Solar surplus charging of a wallbox. The decode thread passes the EMS power values of every poll response to
+ * the controller, which derives the charge current covered by the surplus of that sample. A changed current is
+ * handed to the I/O thread, which sends it as TAG_WB_REQ_SET_EXTERN right behind the poll response it was computed
+ * from, so the wallbox follows the surplus within the same fetch cycle. The request is a byte image
+ * (RscpRequestImage.h) whose index and current are patched, and the acknowledgement is checked with a walk over
+ * the response frame (RscpVisitor.h), so a setpoint does not use the heap.
+ */
+
+#ifndef RSCPWALLBOX_H_
+#define RSCPWALLBOX_H_
+
+#include <atomic>
+#include <stdint.h>
+#include "RscpTypes.h"
+#include "SpscQueue.h"
+
+/*
+ * Voltage of one phase which converts the surplus power into a charge current.
+ */
+#define RSCP_WALLBOX_PHASE_VOLTAGE      230
+/*
+ * Bytes of TAG_WB_EXTERN_DATA: mode, charge current in A and four bytes which are left 0.
+ */
+#define RSCP_WALLBOX_EXTERN_DATA_SIZE   6
+#define RSCP_WALLBOX_MODE_SUN           1
+
+struct SRscpWallboxSetpoint {
+	uint8_t index;
+	// charge current in A, 0 if the surplus does not cover the minimum current
+	uint8_t current;
+	// surplus of the sample in W
+	int32_t surplus;
+	// monotonic ns when the poll response of the sample was received
+	int64_t sampled;
+};
+
+class RscpWallboxControl {
+public:
+	/*
+	 * \brief Control wallbox \var index with the surplus of PV and additional power above the home consumption
+	 *        and \var batteryReserve W, as current between \var minCurrent and \var maxCurrent A.
+	 */
+	RscpWallboxControl(uint8_t index, int32_t batteryReserve, uint8_t minCurrent, uint8_t maxCurrent);
+	uint8_t wallbox() const { return index; }
+	/*
+	 * \brief Start the sample of the poll response which was received at \var received. Decode thread only.
+	 */
+	void beginSample(int64_t received);
+	/*
+	 * \brief TAG_EMS_POWER_PV, TAG_EMS_POWER_ADD or TAG_EMS_POWER_HOME of the sample, other tags are ignored.
+	 */
+	void setPower(SRscpTag tag, int32_t power);
+	/*
+	 * \brief TAG_WB_PM_ACTIVE_PHASES (one bit per phase) of wallbox \var wallbox, only the controlled one is used.
+	 */
+	void setActivePhases(uint8_t wallbox, uint8_t phases);
+	/*
+	 * \brief Compute the current of the sample, a changed current is handed to the I/O thread. A sample without
+	 *        all three power values keeps the current.
+	 * @return - true if a new setpoint is pending
+	 */
+	bool endSample();
+	/*
+	 * \brief Take the latest pending setpoint, older ones are superseded. I/O thread only.
+	 * @return - false if no setpoint is pending
+	 */
+	bool takeSetpoint(SRscpWallboxSetpoint & setpoint);
+	/*
+	 * \brief Serialized values of the TAG_WB_REQ_SET_EXTERN request of \var setpoint, valid until the next call.
+	 */
+	const uint8_t * createRequest(const SRscpWallboxSetpoint & setpoint, uint16_t & length);
+	/*
+	 * \brief Check the response frame \var data of the request of \var setpoint, an accepted setpoint records
+	 *        its reaction time (eStageWallbox), a rejected one is sent again with the next sample.
+	 * @return - RSCP error code if the frame is invalid or incomplete else its length in bytes
+	 */
+	int32_t handleResponse(const uint8_t *data, uint32_t length, const SRscpWallboxSetpoint & setpoint);
+	/*
+	 * \brief The request of the taken setpoint was not answered, it is sent again with the next sample.
+	 */
+	void failed();
+	/*
+	 * \brief Charge current in A which \var surplus W cover on \var phases phases, 0 below \var minCurrent.
+	 */
+	static uint8_t chargeCurrent(int32_t surplus, uint8_t phases, uint8_t minCurrent, uint8_t maxCurrent);
+
+	// state for the output, read by the decode thread
+	int32_t surplus() const { return lastSurplus; }
+	// -1 before the first setpoint
+	int16_t current() const { return lastCurrent; }
+	uint64_t setpoints() const { return posted; }
+	uint64_t accepted() const { return acceptedCount.load(std::memory_order_relaxed); }
+	uint64_t rejected() const { return rejectedCount.load(std::memory_order_relaxed); }
+private:
+	enum {
+		eHasPV = 1,
+		eHasAdd = 2,
+		eHasHome = 4,
+		eHasAll = 7
+	};
+
+	uint8_t index;
+	int32_t batteryReserve;
+	uint8_t minCurrent;
+	uint8_t maxCurrent;
+	// sample of the decode thread
+	int64_t sampleTime;
+	uint32_t sampleValues;
+	int32_t pvPower;
+	int32_t addPower;
+	int32_t homePower;
+	uint8_t activePhases;
+	int32_t lastSurplus;
+	// current of the last setpoint, -1 until the first one and after a rejection
+	int16_t lastCurrent;
+	uint64_t posted;
+	uint64_t rejectedSeen;
+	// decode -> I/O thread
+	SpscQueue<SRscpWallboxSetpoint, 4> pending;
+	// I/O thread
+	uint8_t request[64];
+	std::atomic<uint64_t> acceptedCount;
+	std::atomic<uint64_t> rejectedCount;
+};
+
+#endif /* RSCPWALLBOX_H_ */
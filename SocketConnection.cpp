@@ -4,11 +4,13 @@
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <poll.h>
 #include <sys/select.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/tcp.h>
 #include <resolv.h>
+#include "RscpMetrics.h"
 
 /*
  * This is a very simple example client socket connection.
@@ -51,13 +53,35 @@ int SocketConnect(const char *cpIpAddress, int iPort) {
     setsockopt(iSocket, IPPROTO_TCP, TCP_NODELAY, (char *) &enable, sizeof(enable));
 
 
-    // wait 3 seconds for connection to get ready
-    int iRetries = 3;
-    if(connect(iSocket, (struct sockaddr *) &server_addr, sizeof(struct sockaddr)) < 0) {
+    // wait 3 seconds for connection to get ready, a device which is down does not block the reconnect for minutes
+    int iFlags = fcntl(iSocket, F_GETFL, 0);
+    fcntl(iSocket, F_SETFL, iFlags | O_NONBLOCK);
+    int iResult = connect(iSocket, (struct sockaddr *) &server_addr, sizeof(struct sockaddr));
+    if(iResult < 0 && errno == EINPROGRESS) {
+        fd_set fdWrite;
+        FD_ZERO(&fdWrite);
+        FD_SET(iSocket, &fdWrite);
+        tv.tv_sec = 3;
+        tv.tv_usec = 0;
+        iResult = select(iSocket + 1, NULL, &fdWrite, NULL, &tv);
+        if(iResult == 0) {
+            errno = ETIMEDOUT;
+            iResult = -1;
+        }
+        else if(iResult > 0) {
+            int iError = 0;
+            socklen_t len = sizeof(iError);
+            getsockopt(iSocket, SOL_SOCKET, SO_ERROR, &iError, &len);
+            errno = iError;
+            iResult = (iError == 0) ? 0 : -1;
+        }
+    }
+    if(iResult < 0) {
         printf("Cannot connect to server. errno %i.\n", errno);
         close(iSocket);
         return -1;
     }
+    fcntl(iSocket, F_SETFL, iFlags);
 
     return iSocket;
 }
@@ -81,7 +105,9 @@ int SocketSendData(int iSocket, const unsigned char * ucBuffer, int iLength)
     int iSentBytes = 0;
     while(iLength)
     {
-        int result = send(iSocket, ucBuffer, iLength, 0);
+        // a connection closed by the device fails the send instead of terminating the process with SIGPIPE
+        int result = send(iSocket, ucBuffer, iLength, MSG_NOSIGNAL);
+        RscpMetrics::countSyscalls(1);
         if(result <= 0) {
             return -1;
         }
@@ -99,5 +125,33 @@ int SocketRecvData(int iSocket, unsigned char * ucBuffer, int iLength)
         return iSocket;
     }
 
+    RscpMetrics::countSyscalls(1);
     return recv(iSocket, ucBuffer, iLength, 0);
 }
+
+int SocketRecvAll(int iSocket, unsigned char * ucBuffer, int iLength)
+{
+    // sanity check
+    if(iSocket < 0) {
+        return iSocket;
+    }
+
+    // one system call for the rest of a frame, the kernel collects the segments without waking the caller
+    RscpMetrics::countSyscalls(1);
+    return recv(iSocket, ucBuffer, iLength, MSG_WAITALL);
+}
+
+int SocketWaitData(int iSocket, int iTimeoutMs)
+{
+    // sanity check
+    if(iSocket < 0) {
+        return iSocket;
+    }
+
+    struct pollfd pfd;
+    pfd.fd = iSocket;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    RscpMetrics::countSyscalls(1);
+    return poll(&pfd, 1, iTimeoutMs);
+}
@@ -12,6 +12,10 @@ int SocketConnect(const char *cpIpAddress, int iPort);
 void SocketClose(int iSocket);
 int SocketSendData(int iSocket, const unsigned char * ucBuffer, int iLength);
 int SocketRecvData(int iSocket, unsigned char * ucBuffer, int iLength);
+// blocks until iLength bytes are received, the receive timeout or an error returns less
+int SocketRecvAll(int iSocket, unsigned char * ucBuffer, int iLength);
+// waits at most iTimeoutMs for data to receive: > 0 if data is available, 0 on timeout and < 0 on error
+int SocketWaitData(int iSocket, int iTimeoutMs);
 
 
  #endif // __SOCKET_CONNECTION_H_
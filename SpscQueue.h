@@ -0,0 +1,62 @@
+/*
+ * SpscQueue.h
+ *
+ * Bounded lock-free ring buffer for exactly one producer thread and one consumer thread.
+ * Neither side ever blocks, a full queue is reported to the producer which decides whether to drop.
+ */
+
+#ifndef SPSCQUEUE_H_
+#define SPSCQUEUE_H_
+
+#include <atomic>
+#include <stdint.h>
+
+template<typename T, uint32_t N>
+class SpscQueue {
+	static_assert((N > 0) && ((N & (N - 1)) == 0), "SpscQueue size must be a power of two");
+public:
+	SpscQueue() : head(0), tail(0) {
+	}
+	/*
+	 * \brief Append \var value to the queue. Must only be called by the producer thread.
+	 * @return - false if the queue is full
+	 */
+	bool push(const T & value) {
+		uint32_t uiTail = tail.load(std::memory_order_relaxed);
+		if(uiTail - head.load(std::memory_order_acquire) == N) {
+			return false;
+		}
+		items[uiTail & (N - 1)] = value;
+		tail.store(uiTail + 1, std::memory_order_release);
+		return true;
+	}
+	/*
+	 * \brief Remove the oldest entry of the queue into \var value. Must only be called by the consumer thread.
+	 * @return - false if the queue is empty
+	 */
+	bool pop(T & value) {
+		uint32_t uiHead = head.load(std::memory_order_relaxed);
+		if(uiHead == tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+		value = items[uiHead & (N - 1)];
+		head.store(uiHead + 1, std::memory_order_release);
+		return true;
+	}
+	/*
+	 * \brief Number of entries in the queue. Only a snapshot if called while the other side is active.
+	 */
+	uint32_t size() const {
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+	static uint32_t capacity() {
+		return N;
+	}
+private:
+	// head and tail are written by different threads and are kept on separate cache lines
+	alignas(64) std::atomic<uint32_t> head;
+	alignas(64) std::atomic<uint32_t> tail;
+	alignas(64) T items[N];
+};
+
+#endif /* SPSCQUEUE_H_ */
@@ -3,5 +3,5 @@ chmod +x /root/ownRSCP/RscpExample
 
 while true; do
 	/root/ownRSCP/RscpExample
-	sleep 10
+	sleep 1
 done
@@ -12,8 +12,68 @@
 // Location where the json data should be stored
 #define TARGET_FILE     "/mnt/RAMDisk/e3dc.json"
 
-// Number of used trackers - 1 default | 2 with max. 2 strings
-#define PVI_TRACKER     1
+// Cache of the discovered devices (PV strings, power meters, wallboxes, ...), removed to discover again
+#define TOPOLOGY_CACHE_FILE "/mnt/RAMDisk/e3dc_topology.cache"
 
 // Seconds to wait until every fetch of data. Minimum is 1 (second)
 #define FETCH_INTERVAL  1
+
+// History backfill (RscpExample --backfill <start> <end>): sample interval in seconds,
+// number of chunk requests kept in flight, checkpoint file to resume and the CSV target file
+#define HISTORY_INTERVAL        900
+#define HISTORY_INFLIGHT        4
+#define HISTORY_CHECKPOINT_FILE "/mnt/RAMDisk/e3dc_history.checkpoint"
+#define HISTORY_TARGET_FILE     "/mnt/RAMDisk/e3dc_history.csv"
+
+// Unix domain socket for setpoints (SET_POWER <mode> <value>), sent to the device without waiting for the next fetch
+#define COMMAND_SOCKET          "/mnt/RAMDisk/e3dc_command.sock"
+
+// OpenMetrics / Prometheus endpoint http://METRICS_BIND_IP:METRICS_PORT/metrics (0 to disable)
+#define METRICS_BIND_IP         "127.0.0.1"
+#define METRICS_PORT            9533
+
+// Proxy mode (RscpExample --proxy): local clients connect encrypted with AES_PASSWORD on PROXY_PORT or with plain
+// RSCP frames on PROXY_PLAIN_PORT (0 to disable) and share one session to the device. Live values are cached PROXY_CACHE_TTL ms
+#define PROXY_BIND_IP           "127.0.0.1"
+#define PROXY_PORT              5034
+#define PROXY_PLAIN_PORT        5035
+#define PROXY_CACHE_TTL         1000
+
+// Static memory mode for gateways with little RAM (0 to disable): 1 allocates every buffer of the fetch cycle at startup and counts
+// heap use inside a cycle after the first STATIC_MEMORY_WARMUP cycles of a session (prog.metrics.heap), 2 aborts on the first
+// one (test builds). STATIC_OUTPUT_BYTES are reserved for every rendered output
+#define STATIC_MEMORY           0
+#define STATIC_MEMORY_WARMUP    3
+#define STATIC_OUTPUT_BYTES     32768
+
+// Values without a good answer for QUALITY_STALE_SECONDS are marked stale in "quality", the output keeps their last good value
+#define QUALITY_STALE_SECONDS   10
+
+// A lost session is reconnected at once, further attempts wait RECONNECT_MIN_DELAY ms doubled per failure up to RECONNECT_MAX_DELAY ms
+// (jittered). A device which does not answer RECONNECT_TIMEOUTS requests in a row is reconnected
+#define RECONNECT_MIN_DELAY     100
+#define RECONNECT_MAX_DELAY     2000
+#define RECONNECT_TIMEOUTS      2
+
+// Solar surplus charging (0 to disable): after every poll the charge current of wallbox WALLBOX_CONTROL_INDEX is set to the
+// PV and additional power above the home consumption and WALLBOX_BATTERY_RESERVE W, between WALLBOX_MIN_CURRENT and
+// WALLBOX_MAX_CURRENT A per phase (0 A below the minimum)
+#define WALLBOX_SURPLUS_CONTROL 0
+#define WALLBOX_CONTROL_INDEX   0
+#define WALLBOX_BATTERY_RESERVE 0
+#define WALLBOX_MIN_CURRENT     6
+#define WALLBOX_MAX_CURRENT     16
+
+// Battery detail (0 to disable): every BATTERY_DETAIL_INTERVAL seconds the DCB modules of every battery are polled with their cell
+// voltages and temperatures and written to BATTERY_DETAIL_FILE. The requests are sent in the wait of the fetch cycle,
+// BATTERY_DETAIL_BATCH modules per frame and one frame per cycle. A frame is only sent if more than BATTERY_DETAIL_BUDGET ms
+// of the wait remain, its response is awaited until the end of the wait (at most BATTERY_DETAIL_BUDGET ms without a cycle time)
+#define BATTERY_DETAIL_INTERVAL 0
+#define BATTERY_DETAIL_BATCH    8
+#define BATTERY_DETAIL_BUDGET   200
+#define BATTERY_DETAIL_FILE     "/mnt/RAMDisk/e3dc_battery.json"
+
+// Energy of the power meters per ENERGY_INTERVAL seconds (aligned to the device time) from their energy counters, which
+// roll over after PM_ENERGY_ROLLOVER Wh (0 if they do not roll over)
+#define ENERGY_INTERVAL         300
+#define PM_ENERGY_ROLLOVER      0